@@ -0,0 +1,311 @@
+#include <Rose/Core/HeadlessApp.hpp>
+#include <Rose/Render/ViewportCamera.hpp>
+#include <Rose/Render/SceneRenderer/SceneRenderer.hpp>
+
+#include <json.hpp>
+
+using namespace RoseEngine;
+
+// Renders a scene offscreen along a camera path and writes per-frame timings (and optionally images).
+// Usage: HeadlessSceneApp scene.gltf [--frames N] [--size WxH] [--camera path.json] [--output dir] [--no-images] [--no-shader-objects] [--compress-textures]
+//                         [--stream-textures] [--texture-budget MiB] [--instances N] [--drag] [--full-rebuild]
+//                         [--no-frustum-culling] [--no-occlusion-culling] [--no-cone-culling] [--meshlets off|auto|mesh|emulated]
+//
+// --instances places N copies of the scene in a grid, with their own nodes. --drag moves the first copy every frame, to measure
+// incremental scene updates, or full rebuilds with --full-rebuild. --meshlets emulated draws meshlets without mesh shaders (e.g. on lavapipe).
+//
+// The camera path is a json array of keyframes, spread evenly over the frames:
+// [ { "position": [x,y,z], "angles": [pitch,yaw], "fovY": 50 }, ... ]
+// Without a path, the camera orbits the origin.
+
+struct CameraKeyframe {
+	float3 position;
+	float2 angles;
+	float  fovY;
+};
+
+std::vector<CameraKeyframe> LoadCameraPath(const std::filesystem::path& path) {
+	std::vector<CameraKeyframe> keyframes;
+	std::ifstream file(path);
+	if (!file) {
+		std::cerr << "Could not open " << path << std::endl;
+		return keyframes;
+	}
+	const nlohmann::json data = nlohmann::json::parse(file);
+	for (const auto& k : data) {
+		CameraKeyframe keyframe {
+			.position = float3(0, 2, 2),
+			.angles = float2(-float(M_PI) / 4, 0),
+			.fovY = 50.f };
+		if (k.contains("position")) keyframe.position = float3(k["position"][0], k["position"][1], k["position"][2]);
+		if (k.contains("angles"))   keyframe.angles   = float2(k["angles"][0], k["angles"][1]);
+		if (k.contains("fovY"))     keyframe.fovY     = k["fovY"];
+		keyframes.emplace_back(keyframe);
+	}
+	return keyframes;
+}
+
+// Copies n and its subtree. Meshes and materials are shared.
+ref<SceneNode> CloneNode(const SceneNode& n) {
+	const ref<SceneNode> clone = SceneNode::Create(n.Name());
+	clone->transform = n.transform;
+	clone->mesh      = n.mesh;
+	clone->material  = n.material;
+	for (const ref<SceneNode>& c : n)
+		CloneNode(*c)->SetParent(clone);
+	return clone;
+}
+
+ViewportCamera GetCamera(const std::vector<CameraKeyframe>& keyframes, const float t) {
+	ViewportCamera camera = {};
+	if (keyframes.empty()) {
+		const float theta = t * 2 * float(M_PI);
+		camera.position = float3(std::sin(theta), 0.5f, std::cos(theta)) * 3.f;
+		camera.eulerAngles = float2(-std::atan2(0.5f, 1.f), theta);
+		return camera;
+	}
+
+	const float f = t * (keyframes.size() - 1);
+	const size_t i = std::min((size_t)f, keyframes.size() - 1);
+	const CameraKeyframe& a = keyframes[i];
+	const CameraKeyframe& b = keyframes[std::min(i + 1, keyframes.size() - 1)];
+	const float u = f - i;
+	camera.position    = glm::mix(a.position, b.position, u);
+	camera.eulerAngles = glm::mix(a.angles, b.angles, u);
+	camera.fovY        = glm::mix(a.fovY, b.fovY, u);
+	return camera;
+}
+
+int main(int argc, const char** argv) {
+	std::span args = { argv, (size_t)argc };
+
+	std::filesystem::path scenePath;
+	std::filesystem::path cameraPath;
+	std::filesystem::path outputPath = ".";
+	uint32_t frameCount = 100;
+	uint2    extent = uint2(1920, 1080);
+	bool     writeImages = true;
+	bool     shaderObjects = true;
+	bool     compressTextures = false;
+	bool     streamTextures = false;
+	uint64_t textureBudget = 0; // MiB, 0 for the streamer's default
+	uint32_t instanceCount = 1;
+	bool     drag = false;
+	bool     fullRebuild = false;
+	bool     frustumCulling = true;
+	bool     occlusionCulling = true;
+	bool     coneCulling = true;
+	SceneRenderer::MeshletMode meshletMode = SceneRenderer::MeshletMode::eAuto;
+
+	for (size_t i = 1; i < args.size(); i++) {
+		const std::string arg = args[i];
+		if      (arg == "--frames" && i + 1 < args.size()) frameCount = std::stoul(args[++i]);
+		else if (arg == "--camera" && i + 1 < args.size()) cameraPath = args[++i];
+		else if (arg == "--output" && i + 1 < args.size()) outputPath = args[++i];
+		else if (arg == "--no-images") writeImages = false;
+		else if (arg == "--no-shader-objects") shaderObjects = false;
+		else if (arg == "--compress-textures") compressTextures = true;
+		else if (arg == "--stream-textures") streamTextures = true;
+		else if (arg == "--texture-budget" && i + 1 < args.size()) textureBudget = std::stoull(args[++i]);
+		else if (arg == "--instances" && i + 1 < args.size()) instanceCount = std::max(1ul, std::stoul(args[++i]));
+		else if (arg == "--drag") drag = true;
+		else if (arg == "--full-rebuild") fullRebuild = true;
+		else if (arg == "--no-frustum-culling") frustumCulling = false;
+		else if (arg == "--no-occlusion-culling") occlusionCulling = false;
+		else if (arg == "--no-cone-culling") coneCulling = false;
+		else if (arg == "--meshlets" && i + 1 < args.size()) {
+			const std::string mode = args[++i];
+			if      (mode == "off")      meshletMode = SceneRenderer::MeshletMode::eOff;
+			else if (mode == "auto")     meshletMode = SceneRenderer::MeshletMode::eAuto;
+			else if (mode == "mesh")     meshletMode = SceneRenderer::MeshletMode::eMeshShaders;
+			else if (mode == "emulated") meshletMode = SceneRenderer::MeshletMode::eEmulated;
+		}
+		else if (arg == "--size" && i + 1 < args.size()) {
+			const std::string s = args[++i];
+			const size_t x = s.find('x');
+			if (x != std::string::npos)
+				extent = uint2(std::stoul(s.substr(0, x)), std::stoul(s.substr(x + 1)));
+		}
+		else scenePath = arg;
+	}
+
+	if (scenePath.empty()) {
+		std::cerr << "Usage: " << args[0] << " scene.gltf [--frames N] [--size WxH] [--camera path.json] [--output dir] [--no-images] [--no-shader-objects] [--compress-textures] [--stream-textures] [--texture-budget MiB] [--instances N] [--drag] [--full-rebuild] [--no-frustum-culling] [--no-occlusion-culling] [--no-cone-culling] [--meshlets off|auto|mesh|emulated]" << std::endl;
+		return EXIT_FAILURE;
+	}
+
+	// the path tracer is skipped on devices without ray queries (e.g. lavapipe)
+	HeadlessApp app({}, {
+		VK_KHR_DEFERRED_HOST_OPERATIONS_EXTENSION_NAME,
+		VK_KHR_ACCELERATION_STRUCTURE_EXTENSION_NAME,
+		VK_KHR_RAY_QUERY_EXTENSION_NAME,
+		VK_KHR_FRAGMENT_SHADER_BARYCENTRIC_EXTENSION_NAME,
+		VK_KHR_PIPELINE_LIBRARY_EXTENSION_NAME,
+		VK_EXT_GRAPHICS_PIPELINE_LIBRARY_EXTENSION_NAME,
+		VK_EXT_SHADER_OBJECT_EXTENSION_NAME,
+		VK_EXT_MESH_SHADER_EXTENSION_NAME,
+	});
+	const bool pathTrace =
+		app.device->EnabledExtensions().contains(VK_KHR_ACCELERATION_STRUCTURE_EXTENSION_NAME) &&
+		app.device->EnabledExtensions().contains(VK_KHR_RAY_QUERY_EXTENSION_NAME);
+
+	std::filesystem::create_directories(outputPath);
+
+	const std::vector<CameraKeyframe> keyframes = cameraPath.empty() ? std::vector<CameraKeyframe>{} : LoadCameraPath(cameraPath);
+
+	ref<Scene> scene = make_ref<Scene>();
+	if (streamTextures) {
+		scene->textureStreamer = make_ref<TextureStreamer>();
+		if (textureBudget > 0) scene->textureStreamer->budget = textureBudget * 1024*1024;
+	}
+	const auto loadStart = std::chrono::steady_clock::now();
+	{
+		ref<CommandContext> context = CommandContext::Create(app.device, app.queueFamily);
+		context->Begin();
+		const ref<SceneNode> loaded = LoadGLTF(*context, scenePath, compressTextures, scene->textureStreamer.get());
+		context->Submit();
+		app.device->Wait();
+		std::cout << "Loaded scene in " << std::chrono::duration<float>(std::chrono::steady_clock::now() - loadStart).count() << "s" << std::endl;
+		if (!loaded) {
+			std::cerr << "Failed to load " << scenePath << std::endl;
+			return EXIT_FAILURE;
+		}
+
+		// each copy gets a parent node to place (and drag) it. the root's own transform would be ignored
+		scene->sceneRoot = SceneNode::Create("Root");
+		const uint32_t gridSize = (uint32_t)std::ceil(std::sqrt((float)instanceCount));
+		for (uint32_t i = 0; i < instanceCount; i++) {
+			const ref<SceneNode> copy = SceneNode::Create("Instance " + std::to_string(i));
+			copy->transform = Transform::Translate(2.f * float3(i % gridSize, 0, i / gridSize));
+			copy->SetParent(scene->sceneRoot);
+			(i == 0 ? loaded : CloneNode(*loaded))->SetParent(copy);
+		}
+		scene->SetDirty();
+	}
+	const ref<SceneNode> dragged = *scene->sceneRoot->begin();
+
+	auto sceneRenderer = make_ref<SceneRenderer>();
+	sceneRenderer->SetScene(scene);
+	sceneRenderer->useShaderObjects = shaderObjects;
+	sceneRenderer->culler.frustumCulling = frustumCulling;
+	sceneRenderer->culler.occlusionCulling = occlusionCulling;
+	sceneRenderer->culler.coneCulling = coneCulling;
+	sceneRenderer->meshletMode = meshletMode;
+	sceneRenderer->overwriteRenderTarget = pathTrace;
+
+	// one readback buffer per frame in flight. a frame's pixels are written once its slot is reused
+	std::vector<BufferRange<uint8_t>> readback(app.frames->FramesInFlight());
+	std::vector<int64_t> readbackFrame(app.frames->FramesInFlight(), -1);
+	if (writeImages) {
+		for (auto& b : readback)
+			b = Buffer::Create(*app.device, size_t(extent.x) * extent.y * 4, vk::BufferUsageFlagBits::eTransferDst,
+				vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent,
+				VMA_ALLOCATION_CREATE_MAPPED_BIT | VMA_ALLOCATION_CREATE_HOST_ACCESS_RANDOM_BIT,
+				MemoryCategory::eStaging);
+	}
+
+	auto writeImage = [&](const uint32_t index) {
+		if (readbackFrame[index] < 0) return;
+		char name[32];
+		std::snprintf(name, sizeof(name), "frame_%05ld.png", readbackFrame[index]);
+		SavePngFile(outputPath / name, extent, 4, readback[index].data());
+		readbackFrame[index] = -1;
+	};
+
+	std::vector<double> recordTimes;
+	std::vector<double> updateTimes;
+	for (uint32_t frame = 0; frame < frameCount; frame++) {
+		CommandContext& context = app.BeginFrame();
+		const uint32_t index = app.frames->FrameIndex();
+
+		// BeginFrame waited for this slot's previous frame
+		if (writeImages)
+			writeImage(index);
+
+		const ViewportCamera camera = GetCamera(keyframes, frameCount > 1 ? frame / float(frameCount - 1) : 0.f);
+
+		if (drag && frame > 0) {
+			dragged->transform = Transform::Translate(float3(0, 0.25f * std::sin(frame * 0.1f), 0));
+			if (fullRebuild)
+				scene->SetDirty();
+			else
+				scene->SetTransformDirty(dragged);
+		}
+
+		sceneRenderer->PreRender(context, extent, camera.GetCameraToWorld(), camera.GetProjection(extent.x / (float)extent.y));
+		if (drag && frame > 0)
+			updateTimes.emplace_back(scene->stats.updateTime);
+		sceneRenderer->Render(context);
+		recordTimes.emplace_back(sceneRenderer->stats.recordTime);
+		if (pathTrace)
+			sceneRenderer->PostRender(context);
+
+		if (writeImages) {
+			context.Copy(sceneRenderer->GetAttachment(0), readback[index]);
+			readbackFrame[index] = frame;
+		}
+
+		app.EndFrame();
+
+		if (frame == 0) {
+			app.device->Wait();
+			std::cout << "Time to first frame: " << std::chrono::duration<float>(std::chrono::steady_clock::now() - loadStart).count() << "s" << std::endl;
+		}
+	}
+
+	app.Flush();
+
+	if (writeImages) {
+		for (uint32_t i = 0; i < readback.size(); i++)
+			writeImage(i);
+	}
+
+	app.WriteTimings(outputPath / "timings.csv");
+
+	double cpuTime = 0, gpuTime = 0, recordTime = 0;
+	for (const auto& t : app.timings) {
+		cpuTime += t.cpuTime;
+		gpuTime += t.gpuTime;
+	}
+	for (const double t : recordTimes)
+		recordTime += t / frameCount;
+	std::cout << "Rendered " << frameCount << " frames: " <<
+		cpuTime / frameCount << " ms cpu, " <<
+		gpuTime / frameCount << " ms gpu per frame" << std::endl;
+	std::cout << sceneRenderer->stats.pipelineCount << (app.device->EnabledExtensions().contains(VK_EXT_SHADER_OBJECT_EXTENSION_NAME) && shaderObjects ? " shader objects" : " pipelines") <<
+		" created in " << sceneRenderer->stats.pipelineTime << " ms, " << recordTime << " ms average draw recording, " <<
+		sceneRenderer->stats.drawCount << " indirect draws per frame" << std::endl;
+	std::cout << "Pipeline cache: " << app.device->PipelineCacheHits() << " hits, " << app.device->PipelineCacheMisses() << " misses" << std::endl;
+	{
+		// the last frame whose counters were read back
+		const InstanceCuller::Stats& c = sceneRenderer->culler.GetStats();
+		std::cout << "Culling: " << c.instanceCount << " instances, " <<
+			c.frustumCulled << " outside the frustum, " << c.occlusionCulled << " occluded, " <<
+			c.firstPhaseDrawn << " + " << c.secondPhaseDrawn << " drawn" << std::endl;
+		std::cout << "Culling passes: " <<
+			c.firstCullTime << " ms cull, " << c.firstDrawTime << " ms draw, " <<
+			c.depthPyramidTime << " ms depth pyramid, " <<
+			c.secondCullTime << " ms cull, " << c.secondDrawTime << " ms draw" << std::endl;
+		if (c.meshletsDrawn + c.meshletFrustumCulled + c.meshletConeCulled + c.meshletOcclusionCulled > 0)
+			std::cout << "Meshlets: " << c.meshletsDrawn << " drawn, " <<
+				c.meshletFrustumCulled << " outside the frustum, " << c.meshletConeCulled << " backfacing, " <<
+				c.meshletOcclusionCulled << " occluded" << std::endl;
+	}
+	if (!updateTimes.empty()) {
+		double updateTime = 0;
+		for (const double t : updateTimes)
+			updateTime += t / updateTimes.size();
+		std::cout << "Scene updates (" << (scene->stats.rebuilt ? "full rebuild" : "incremental") << ", " << instanceCount << " copies): " <<
+			updateTime << " ms average" << std::endl;
+	}
+	if (scene->textureStreamer) {
+		const TextureStreamer::Stats& s = scene->textureStreamer->GetStats();
+		std::cout << "Streamed textures: " << s.textureCount << " textures, " <<
+			s.residentBytes / double(1024*1024) << " MiB resident of " <<
+			s.fullBytes / double(1024*1024) << " MiB (" <<
+			(s.fullBytes - std::min(s.fullBytes, s.residentBytes)) / double(1024*1024) << " MiB saved), " <<
+			s.streamingCount << " still streaming" << std::endl;
+	}
+
+	return EXIT_SUCCESS;
+}
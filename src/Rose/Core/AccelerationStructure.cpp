@@ -6,10 +6,10 @@
 namespace RoseEngine {
 
 
-ref<AccelerationStructure> AccelerationStructure::Create(CommandContext& context, const vk::AccelerationStructureTypeKHR type, const vk::ArrayProxy<const vk::AccelerationStructureGeometryKHR>& geometries, const vk::ArrayProxy<const vk::AccelerationStructureBuildRangeInfoKHR>& buildRanges) {
+ref<AccelerationStructure> AccelerationStructure::Create(CommandContext& context, const vk::AccelerationStructureTypeKHR type, const vk::ArrayProxy<const vk::AccelerationStructureGeometryKHR>& geometries, const vk::ArrayProxy<const vk::AccelerationStructureBuildRangeInfoKHR>& buildRanges, const vk::BuildAccelerationStructureFlagsKHR flags) {
 	vk::AccelerationStructureBuildGeometryInfoKHR buildGeometry {
 		.type  = type,
-		.flags = vk::BuildAccelerationStructureFlagBitsKHR::ePreferFastTrace,
+		.flags = flags,
 		.mode  = vk::BuildAccelerationStructureModeKHR::eBuild };
 	buildGeometry.setGeometries(geometries);
 
@@ -27,10 +27,16 @@ ref<AccelerationStructure> AccelerationStructure::Create(CommandContext& context
 		vk::BufferUsageFlagBits::eAccelerationStructureStorageKHR | vk::BufferUsageFlagBits::eShaderDeviceAddress | vk::BufferUsageFlagBits::eStorageBuffer);
 
 	AccelerationStructure* as = new AccelerationStructure();
+	as->type  = type;
+	as->flags = flags;
+	as->updateScratchSize = buildSizes.updateScratchSize;
 	as->buffer = Buffer::Create(
 		context.GetDevice(),
 		buildSizes.accelerationStructureSize,
-		vk::BufferUsageFlagBits::eAccelerationStructureStorageKHR | vk::BufferUsageFlagBits::eShaderDeviceAddress);
+		vk::BufferUsageFlagBits::eAccelerationStructureStorageKHR | vk::BufferUsageFlagBits::eShaderDeviceAddress,
+		vk::MemoryPropertyFlagBits::eDeviceLocal,
+		VMA_ALLOCATION_CREATE_STRATEGY_MIN_MEMORY_BIT,
+		MemoryCategory::eAccelerationStructure);
 
 	as->accelerationStructure = context.GetDevice()->createAccelerationStructureKHR(vk::AccelerationStructureCreateInfoKHR{
 		.buffer = **as->buffer.mBuffer,
@@ -65,6 +71,72 @@ ref<AccelerationStructure> AccelerationStructure::Create(CommandContext& context
 	return Create(context, vk::AccelerationStructureTypeKHR::eTopLevel, geometry, range);
 }
 
+static vk::AccelerationStructureGeometryKHR InstanceGeometry(const Device& device, const BufferRange<vk::AccelerationStructureInstanceKHR>& instances) {
+	vk::AccelerationStructureGeometryInstancesDataKHR instanceGeometries{
+		.data = device->getBufferAddress(vk::BufferDeviceAddressInfo{ .buffer = **instances.mBuffer }) + instances.mOffset };
+	return vk::AccelerationStructureGeometryKHR{
+		.geometryType = vk::GeometryTypeKHR::eInstances,
+		.geometry = instanceGeometries };
+}
+
+ref<AccelerationStructure> AccelerationStructure::Create(CommandContext& context, const BufferRange<vk::AccelerationStructureInstanceKHR>& instances, const bool allowUpdate) {
+	if (!instances.empty()) {
+		context.AddBarrier(instances, Buffer::ResourceState{
+			.stage  = vk::PipelineStageFlagBits2::eAccelerationStructureBuildKHR,
+			.access = vk::AccessFlagBits2::eShaderRead,
+			.queueFamily = context.QueueFamily() });
+		context.ExecuteBarriers();
+	}
+
+	vk::BuildAccelerationStructureFlagsKHR flags = vk::BuildAccelerationStructureFlagBitsKHR::ePreferFastTrace;
+	if (allowUpdate) flags |= vk::BuildAccelerationStructureFlagBitsKHR::eAllowUpdate;
+	vk::AccelerationStructureBuildRangeInfoKHR range{ .primitiveCount = (uint32_t)instances.size() };
+	return Create(context, vk::AccelerationStructureTypeKHR::eTopLevel, InstanceGeometry(context.GetDevice(), instances), range, flags);
+}
+
+void AccelerationStructure::Update(CommandContext& context, const BufferRange<vk::AccelerationStructureInstanceKHR>& instances) {
+	if (!(flags & vk::BuildAccelerationStructureFlagBitsKHR::eAllowUpdate))
+		throw std::logic_error("Acceleration structure was not created with allowUpdate");
+
+	const vk::AccelerationStructureGeometryKHR geometry = InstanceGeometry(context.GetDevice(), instances);
+	vk::AccelerationStructureBuildGeometryInfoKHR buildGeometry {
+		.type  = type,
+		.flags = flags,
+		.mode  = vk::BuildAccelerationStructureModeKHR::eUpdate,
+		.srcAccelerationStructure = *accelerationStructure,
+		.dstAccelerationStructure = *accelerationStructure };
+	buildGeometry.setGeometries(geometry);
+
+	auto scratchData = context.GetTransientBuffer(
+		std::max<vk::DeviceSize>(updateScratchSize, 4),
+		vk::BufferUsageFlagBits::eAccelerationStructureStorageKHR | vk::BufferUsageFlagBits::eShaderDeviceAddress | vk::BufferUsageFlagBits::eStorageBuffer);
+	buildGeometry.scratchData = context.GetDevice()->getBufferAddress(vk::BufferDeviceAddressInfo{ .buffer = **scratchData.mBuffer }) + scratchData.mOffset;
+
+	context.AddBarrier(instances, Buffer::ResourceState{
+		.stage  = vk::PipelineStageFlagBits2::eAccelerationStructureBuildKHR,
+		.access = vk::AccessFlagBits2::eShaderRead,
+		.queueFamily = context.QueueFamily() });
+	context.ExecuteBarriers();
+
+	// reads of the structure by earlier commands (e.g. the previous frame's ray queries) aren't tracked, so they are waited on here
+	const vk::MemoryBarrier2 before {
+		.srcStageMask  = vk::PipelineStageFlagBits2::eAllCommands,
+		.srcAccessMask = vk::AccessFlagBits2::eAccelerationStructureReadKHR,
+		.dstStageMask  = vk::PipelineStageFlagBits2::eAccelerationStructureBuildKHR,
+		.dstAccessMask = vk::AccessFlagBits2::eAccelerationStructureReadKHR | vk::AccessFlagBits2::eAccelerationStructureWriteKHR };
+	context->pipelineBarrier2(vk::DependencyInfo{}.setMemoryBarriers(before));
+
+	const vk::AccelerationStructureBuildRangeInfoKHR range{ .primitiveCount = (uint32_t)instances.size() };
+	context->buildAccelerationStructuresKHR(buildGeometry, &range);
+
+	const vk::MemoryBarrier2 after {
+		.srcStageMask  = vk::PipelineStageFlagBits2::eAccelerationStructureBuildKHR,
+		.srcAccessMask = vk::AccessFlagBits2::eAccelerationStructureWriteKHR,
+		.dstStageMask  = vk::PipelineStageFlagBits2::eAllCommands,
+		.dstAccessMask = vk::AccessFlagBits2::eAccelerationStructureReadKHR };
+	context->pipelineBarrier2(vk::DependencyInfo{}.setMemoryBarriers(after));
+}
+
 ref<AccelerationStructure> AccelerationStructure::Create(CommandContext& context, const float3 aabbMin, const float3 aabbMax, const bool opaque) {
 	vk::AabbPositionsKHR aabb{
 		.minX = aabbMin.x, .minY = aabbMin.y, .minZ = aabbMin.z,
@@ -13,14 +13,24 @@ class AccelerationStructure {
 private:
 	vk::raii::AccelerationStructureKHR accelerationStructure = nullptr;
 	BufferView buffer = {};
+	vk::AccelerationStructureTypeKHR      type = {};
+	vk::BuildAccelerationStructureFlagsKHR flags = {};
+	vk::DeviceSize                        updateScratchSize = 0;
 
 	inline AccelerationStructure() {}
 
 public:
-	static ref<AccelerationStructure> Create(CommandContext& context, const vk::AccelerationStructureTypeKHR type, const vk::ArrayProxy<const vk::AccelerationStructureGeometryKHR>& geometries, const vk::ArrayProxy<const vk::AccelerationStructureBuildRangeInfoKHR>& buildRanges);
+	static ref<AccelerationStructure> Create(CommandContext& context, const vk::AccelerationStructureTypeKHR type, const vk::ArrayProxy<const vk::AccelerationStructureGeometryKHR>& geometries, const vk::ArrayProxy<const vk::AccelerationStructureBuildRangeInfoKHR>& buildRanges, const vk::BuildAccelerationStructureFlagsKHR flags = vk::BuildAccelerationStructureFlagBitsKHR::ePreferFastTrace);
 	static ref<AccelerationStructure> Create(CommandContext& context, vk::ArrayProxy<vk::AccelerationStructureInstanceKHR>&& instances);
+	// Builds a top level structure from instances in a device buffer. With allowUpdate, Update can refit it after instances move.
+	static ref<AccelerationStructure> Create(CommandContext& context, const BufferRange<vk::AccelerationStructureInstanceKHR>& instances, const bool allowUpdate);
 	static ref<AccelerationStructure> Create(CommandContext& context, const float3 aabbMin, const float3 aabbMax, const bool opaque = true);
 
+	// Refits a structure created with allowUpdate in place, after the transforms in instances changed.
+	// The instance count must not change. Refitting is much cheaper than a rebuild, but the structure's
+	// quality degrades as instances move away from where they were when it was built.
+	void Update(CommandContext& context, const BufferRange<vk::AccelerationStructureInstanceKHR>& instances);
+
 	inline       vk::raii::AccelerationStructureKHR& operator*()        { return accelerationStructure; }
 	inline const vk::raii::AccelerationStructureKHR& operator*() const  { return accelerationStructure; }
 	inline       vk::raii::AccelerationStructureKHR* operator->()       { return &accelerationStructure; }
@@ -3,11 +3,25 @@
 
 namespace RoseEngine {
 
-ref<Buffer> Buffer::Create(const Device& device, const vk::BufferCreateInfo& createInfo, const VmaAllocationCreateInfo& allocationInfo) {
+ref<Buffer> Buffer::Create(const Device& device, const vk::BufferCreateInfo& createInfo, const VmaAllocationCreateInfo& allocationInfo, const MemoryCategory category) {
+	VmaAllocationCreateInfo allocationCreateInfo = allocationInfo;
+	if (category != MemoryCategory::eUncategorized && allocationCreateInfo.pool == VK_NULL_HANDLE) {
+		allocationCreateInfo.flags = Device::GetAllocationFlags(category, allocationCreateInfo.flags);
+		uint32_t memoryTypeIndex;
+		if (vmaFindMemoryTypeIndexForBufferInfo(device.MemoryAllocator(), &(const VkBufferCreateInfo&)createInfo, &allocationCreateInfo, &memoryTypeIndex) == VK_SUCCESS)
+			allocationCreateInfo.pool = device.GetMemoryPool(category, memoryTypeIndex);
+	}
+
 	VmaAllocation alloc;
 	VmaAllocationInfo allocInfo;
 	VkBuffer vkbuffer;
-	vk::Result result = (vk::Result)vmaCreateBuffer(device.MemoryAllocator(), &(const VkBufferCreateInfo&)createInfo, &allocationInfo, &vkbuffer, &alloc, &allocInfo);
+	vk::Result result = (vk::Result)vmaCreateBuffer(device.MemoryAllocator(), &(const VkBufferCreateInfo&)createInfo, &allocationCreateInfo, &vkbuffer, &alloc, &allocInfo);
+	if (result != vk::Result::eSuccess && allocationCreateInfo.pool != allocationInfo.pool) {
+		// category pools can't hold allocations larger than their block size, or ones which need dedicated memory
+		allocationCreateInfo.pool = VK_NULL_HANDLE;
+		allocationCreateInfo.flags |= VMA_ALLOCATION_CREATE_DEDICATED_MEMORY_BIT;
+		result = (vk::Result)vmaCreateBuffer(device.MemoryAllocator(), &(const VkBufferCreateInfo&)createInfo, &allocationCreateInfo, &vkbuffer, &alloc, &allocInfo);
+	}
 	if (result != vk::Result::eSuccess) {
 		std::cerr << "Failed to create buffer: " << vk::to_string(result) << std::endl;
 		return nullptr;
@@ -22,10 +36,16 @@ ref<Buffer> Buffer::Create(const Device& device, const vk::BufferCreateInfo& cre
 	buffer->mUsage = createInfo.usage;
 	buffer->mMemoryFlags = (vk::MemoryPropertyFlags)allocInfo.memoryType;
 	buffer->mSharingMode = createInfo.sharingMode;
+	buffer->mParent = &device;
+	buffer->mCategory = category;
+	device.MemoryCounters(category).Add(allocInfo.size);
+	vmaSetAllocationUserData(device.MemoryAllocator(), alloc, buffer.get());
 	return buffer;
 }
 
 Buffer::~Buffer() {
+	if (mParent && mAllocation)
+		mParent->MemoryCounters(mCategory).Remove(mAllocationInfo.size);
 	if (mMemoryAllocator && mBuffer && mAllocation) {
 		vmaDestroyBuffer(mMemoryAllocator, mBuffer, mAllocation);
 		mMemoryAllocator = nullptr;
@@ -34,11 +54,42 @@ Buffer::~Buffer() {
 	}
 }
 
+bool Buffer::IsMovable() const {
+	const vk::BufferUsageFlags pinnedUsage =
+		vk::BufferUsageFlagBits::eShaderDeviceAddress |
+		vk::BufferUsageFlagBits::eAccelerationStructureStorageKHR |
+		vk::BufferUsageFlagBits::eAccelerationStructureBuildInputReadOnlyKHR |
+		vk::BufferUsageFlagBits::eShaderBindingTableKHR |
+		vk::BufferUsageFlagBits::eUniformTexelBuffer |
+		vk::BufferUsageFlagBits::eStorageTexelBuffer;
+	const vk::BufferUsageFlags copyUsage = vk::BufferUsageFlagBits::eTransferSrc | vk::BufferUsageFlagBits::eTransferDst;
+	return
+		mAllocation &&
+		mAllocationInfo.pMappedData == nullptr &&
+		mSharingMode == vk::SharingMode::eExclusive &&
+		(mUsage & pinnedUsage) == vk::BufferUsageFlags{} &&
+		(mUsage & copyUsage) == copyUsage;
+}
+
+void Buffer::SetMemoryCategory(const MemoryCategory category) {
+	if (!mParent || !mAllocation || category == mCategory) return;
+	mParent->MemoryCounters(mCategory).Remove(mAllocationInfo.size);
+	mParent->MemoryCounters(category).Add(mAllocationInfo.size);
+	mCategory = category;
+}
+
+vk::Buffer Buffer::SwapHandle(const vk::Buffer buffer) {
+	vk::Buffer old = mBuffer;
+	mBuffer = buffer;
+	return old;
+}
+
 BufferView Buffer::Create(
 	const Device& device,
 	const vk::BufferCreateInfo&    createInfo,
 	const vk::MemoryPropertyFlags  memoryFlags,
-	const VmaAllocationCreateFlags allocationFlags) {
+	const VmaAllocationCreateFlags allocationFlags,
+	const MemoryCategory           category) {
 	auto buf = Create(
 		device,
 		createInfo,
@@ -49,7 +100,8 @@ BufferView Buffer::Create(
 			.memoryTypeBits = 0,
 			.pool = VK_NULL_HANDLE,
 			.pUserData = VK_NULL_HANDLE,
-			.priority = 0 });
+			.priority = 0 },
+		category);
 	return { buf, 0, createInfo.size };
 }
 
@@ -58,7 +110,8 @@ BufferView Buffer::Create(
 	const vk::DeviceSize size,
 	const vk::BufferUsageFlags     usage,
 	const vk::MemoryPropertyFlags  memoryFlags,
-	const VmaAllocationCreateFlags allocationFlags) {
+	const VmaAllocationCreateFlags allocationFlags,
+	const MemoryCategory           category) {
 	auto buf = Create(
 		device,
 		vk::BufferCreateInfo{
@@ -71,7 +124,8 @@ BufferView Buffer::Create(
 			.memoryTypeBits = 0,
 			.pool = VK_NULL_HANDLE,
 			.pUserData = VK_NULL_HANDLE,
-			.priority = 0 });
+			.priority = 0 },
+		category);
 	return { buf, 0, size };
 }
 
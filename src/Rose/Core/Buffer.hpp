@@ -10,7 +10,7 @@ struct BufferRange;
 
 using BufferView = BufferRange<std::byte>;
 
-class Buffer {
+class Buffer : public std::enable_shared_from_this<Buffer> {
 public:
 	struct ResourceState {
 		vk::PipelineStageFlags2 stage       = {};
@@ -27,6 +27,8 @@ private:
 	vk::BufferUsageFlags    mUsage = {};
 	vk::MemoryPropertyFlags mMemoryFlags = {};
 	vk::SharingMode         mSharingMode = {};
+	const Device*           mParent = nullptr; // for memory accounting
+	MemoryCategory          mCategory = MemoryCategory::eUncategorized;
 
 	PairMap<ResourceState, vk::DeviceSize, vk::DeviceSize> mState;
 
@@ -34,25 +36,29 @@ public:
 	static ref<Buffer> Create(
 		const Device&                  device,
 		const vk::BufferCreateInfo&    createInfo,
-		const VmaAllocationCreateInfo& allocationInfo);
+		const VmaAllocationCreateInfo& allocationInfo,
+		const MemoryCategory           category = MemoryCategory::eUncategorized);
 	static BufferView Create(
 		const Device&                  device,
 		const vk::BufferCreateInfo&    createInfo,
 		const vk::MemoryPropertyFlags  memoryFlags     = vk::MemoryPropertyFlagBits::eDeviceLocal,
-		const VmaAllocationCreateFlags allocationFlags = VMA_ALLOCATION_CREATE_STRATEGY_MIN_MEMORY_BIT);
+		const VmaAllocationCreateFlags allocationFlags = VMA_ALLOCATION_CREATE_STRATEGY_MIN_MEMORY_BIT,
+		const MemoryCategory           category        = MemoryCategory::eUncategorized);
 	static BufferView Create(
 		const Device&                  device,
 		const vk::DeviceSize           size,
 		const vk::BufferUsageFlags     usage           = vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eTransferSrc | vk::BufferUsageFlagBits::eTransferDst,
 		const vk::MemoryPropertyFlags  memoryFlags     = vk::MemoryPropertyFlagBits::eDeviceLocal,
-		const VmaAllocationCreateFlags allocationFlags = VMA_ALLOCATION_CREATE_STRATEGY_MIN_MEMORY_BIT);
+		const VmaAllocationCreateFlags allocationFlags = VMA_ALLOCATION_CREATE_STRATEGY_MIN_MEMORY_BIT,
+		const MemoryCategory           category        = MemoryCategory::eUncategorized);
 	template<std::ranges::contiguous_range R>
 	static BufferRange<std::ranges::range_value_t<R>> Create(
 		const Device& device,
 		R&&           data,
 		const vk::BufferUsageFlags     usage           = vk::BufferUsageFlagBits::eTransferSrc,
 		const vk::MemoryPropertyFlags  memoryFlags     = vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent,
-		const VmaAllocationCreateFlags allocationFlags = VMA_ALLOCATION_CREATE_STRATEGY_MIN_MEMORY_BIT | VMA_ALLOCATION_CREATE_MAPPED_BIT | VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT);
+		const VmaAllocationCreateFlags allocationFlags = VMA_ALLOCATION_CREATE_STRATEGY_MIN_MEMORY_BIT | VMA_ALLOCATION_CREATE_MAPPED_BIT | VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT,
+		const MemoryCategory           category        = MemoryCategory::eUncategorized);
 	~Buffer();
 
 	inline       vk::Buffer& operator*()        { return mBuffer; }
@@ -65,9 +71,21 @@ public:
 	inline vk::BufferUsageFlags    Usage() const { return mUsage; }
 	inline vk::MemoryPropertyFlags MemoryFlags() const  { return mMemoryFlags; }
 	inline vk::SharingMode         SharingMode() const  { return mSharingMode; }
+	inline MemoryCategory          Category() const  { return mCategory; }
+
+	// Moves this buffer's bytes to category's counters. The buffer stays in the pool it was allocated from.
+	void SetMemoryCategory(const MemoryCategory category);
 
 	inline void* data() const { return mAllocationInfo.pMappedData; }
 
+	// Whether defragmentation may move this buffer's memory. Buffers which are mapped, referenced by device
+	// address, or viewed through texel buffer views cannot be moved.
+	bool IsMovable() const;
+	// Replaces the buffer handle after defragmentation moved its allocation. Returns the old handle, which must
+	// be destroyed by the caller once the GPU is done with it.
+	vk::Buffer SwapHandle(const vk::Buffer buffer);
+	inline void UpdateAllocationInfo() { vmaGetAllocationInfo(mMemoryAllocator, mAllocation, &mAllocationInfo); }
+
 	inline const ResourceState& GetState(vk::DeviceSize offset, vk::DeviceSize size) {
 		auto it = mState.find(std::make_pair(offset, size));
 		if (it == mState.end())
@@ -148,7 +166,8 @@ inline BufferRange<std::ranges::range_value_t<R>> Buffer::Create(
 	R&&                            data,
 	const vk::BufferUsageFlags     usage,
 	const vk::MemoryPropertyFlags  memoryFlags,
-	const VmaAllocationCreateFlags allocationFlags ) {
+	const VmaAllocationCreateFlags allocationFlags,
+	const MemoryCategory           category ) {
 
 	const size_t size = std::ranges::size(data) * sizeof(std::ranges::range_value_t<R>);
 
@@ -157,7 +176,8 @@ inline BufferRange<std::ranges::range_value_t<R>> Buffer::Create(
 		size,
 		usage,
 		memoryFlags,
-		allocationFlags);
+		allocationFlags,
+		category);
 
 	std::memcpy(buf.data(), std::ranges::data(data), size);
 
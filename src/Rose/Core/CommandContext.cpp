@@ -1,8 +1,19 @@
 #include <iostream>
 #include "CommandContext.hpp"
+#include <Rose/Downsample/Downsample.hpp>
 
 namespace RoseEngine {
 
+CommandContext::~CommandContext() {
+	mAliasedImages.clear();
+	for (auto& block : mAliasedImageBlocks) {
+		block.mPlacements.clear();
+		mDevice->MemoryCounters(MemoryCategory::eTransient).Remove(block.mAllocationInfo.size);
+		vmaFreeMemory(mDevice->MemoryAllocator(), block.mAllocation);
+	}
+	mAliasedImageBlocks.clear();
+}
+
 void CommandContext::Begin() {
 	if (!*mCommandPool) {
 		mCommandPool = (*mDevice)->createCommandPool(vk::CommandPoolCreateInfo{
@@ -18,8 +29,12 @@ void CommandContext::Begin() {
 		mCommandBuffer = std::move(commandBuffers[0]);
 	}
 
-	if (mLastSubmit > 0)
+	mLastWaitTime = 0;
+	if (!IsReady()) {
+		const auto start = std::chrono::high_resolution_clock::now();
 		mDevice->Wait(mLastSubmit);
+		mLastWaitTime = std::chrono::duration_cast<std::chrono::duration<double, std::milli>>(std::chrono::high_resolution_clock::now() - start).count();
+	}
 
 	mCommandBuffer.reset();
 	mCommandBuffer.begin(vk::CommandBufferBeginInfo{});
@@ -46,6 +61,12 @@ void CommandContext::Begin() {
 		}
 	}
 
+	for (auto& block : mAliasedImageBlocks)
+		block.mPlacements.clear();
+	mAliasedImageBytes = 0;
+
+	mDescriptorBuffers.clear();
+
 	if (!mCache.mNewDescriptorSets.empty()) {
 		for (auto&[layout, sets] : mCache.mNewDescriptorSets)
 			for (auto& s : sets)
@@ -101,6 +122,9 @@ uint64_t CommandContext::Submit(
 
 	mLastSubmit = signalValue;
 
+	mDevice->CollectGarbage();
+	mDevice->UpdatePipelineCache();
+
 	return signalValue;
 }
 
@@ -177,11 +201,188 @@ ref<Image> CommandContext::GetTransientImage(const ImageInfo& info) {
 		}
 	}
 
-	if (!image) image = Image::Create(GetDevice(), info);
+	if (!image) image = Image::Create(GetDevice(), info, vk::MemoryPropertyFlagBits::eDeviceLocal, VMA_ALLOCATION_CREATE_STRATEGY_MIN_TIME_BIT, MemoryCategory::eTransient);
 
 	return mCache.mNewImages[info].emplace_back(image);
 }
 
+vk::DeviceSize CommandContext::ReleaseCachedResources(const vk::DeviceSize bytes) {
+	vk::DeviceSize released = 0;
+
+	// cached buffers are sorted by size
+	for (auto&[usage, bufs] : mCache.mBuffers) {
+		while (!bufs.empty() && released < bytes) {
+			const auto& b = bufs.back();
+			if (b.buffer)     released += b.buffer.size_bytes();
+			if (b.hostBuffer) released += b.hostBuffer.size_bytes();
+			bufs.pop_back();
+		}
+	}
+
+	for (auto&[info, images] : mCache.mImages) {
+		while (!images.empty() && released < bytes) {
+			released += images.back()->MemorySize();
+			images.pop_back();
+		}
+	}
+
+	// aliased blocks without placements in the current recording. previous recordings may still be using them,
+	// so the memory and the images bound to it are released once the next submit finishes
+	std::vector<uint32_t> blockIndices(mAliasedImageBlocks.size(), 0); // old index -> new index, or ~0u if released
+	bool releasedBlocks = false;
+	for (uint32_t i = 0, kept = 0; i < mAliasedImageBlocks.size(); i++) {
+		AliasedImageBlock& block = mAliasedImageBlocks[i];
+		if (released < bytes && block.mPlacements.empty()) {
+			mDevice->MemoryCounters(MemoryCategory::eTransient).Remove(block.mAllocationInfo.size);
+			mDevice->DeferFree(block.mAllocation);
+			released += block.mAllocationInfo.size;
+			block.mAllocation = nullptr;
+			blockIndices[i] = ~0u;
+			releasedBlocks = true;
+		} else
+			blockIndices[i] = kept++;
+	}
+	if (releasedBlocks) {
+		TupleMap<ref<Image>, ImageInfo, uint32_t, vk::DeviceSize> images;
+		for (auto&[key, image] : mAliasedImages) {
+			const auto&[info, blockIndex, offset] = key;
+			if (blockIndices[blockIndex] == ~0u)
+				mDevice->DeferDestroy(std::move(image));
+			else
+				images.emplace(std::tuple{ info, blockIndices[blockIndex], offset }, std::move(image));
+		}
+		mAliasedImages = std::move(images);
+		std::erase_if(mAliasedImageBlocks, [](const AliasedImageBlock& block) { return block.mAllocation == nullptr; });
+	}
+
+	return released;
+}
+
+// blocks grow to fit larger images, so this only needs to cover the common small transients
+static const vk::DeviceSize kAliasedImageBlockSize = 16*1024*1024;
+
+ref<Image> CommandContext::GetTransientImage(const ImageInfo& info, const uint32_t firstUse, const uint32_t lastUse) {
+	// linear images would need bufferImageGranularity padding between placements
+	if (info.tiling != vk::ImageTiling::eOptimal)
+		return GetTransientImage(info);
+
+	ref<Image> newImage = {};
+	vk::MemoryRequirements requirements;
+	if (auto it = mAliasedImageRequirements.find(info); it != mAliasedImageRequirements.end())
+		requirements = it->second;
+	else {
+		newImage = Image::CreateAliased(*mDevice, info);
+		if (!newImage) return nullptr;
+		requirements = newImage->GetMemoryRequirements();
+		mAliasedImageRequirements.emplace(info, requirements);
+	}
+
+	auto alignUp = [&](const vk::DeviceSize offset) {
+		return (offset + requirements.alignment - 1) / requirements.alignment * requirements.alignment;
+	};
+
+	// find the lowest offset in a block which doesn't overlap any placement with an overlapping lifetime
+
+	uint32_t blockIndex = -1;
+	vk::DeviceSize offset = 0;
+	std::vector<std::pair<vk::DeviceSize, vk::DeviceSize>> occupied;
+	for (uint32_t i = 0; i < mAliasedImageBlocks.size(); i++) {
+		const AliasedImageBlock& block = mAliasedImageBlocks[i];
+		if ((requirements.memoryTypeBits & (1u << block.mAllocationInfo.memoryType)) == 0)
+			continue;
+
+		occupied.clear();
+		for (const auto& p : block.mPlacements)
+			if (p.mFirstUse <= lastUse && firstUse <= p.mLastUse)
+				occupied.emplace_back(p.mOffset, p.mOffset + p.mSize);
+		std::ranges::sort(occupied);
+
+		vk::DeviceSize o = 0;
+		for (const auto&[begin, end] : occupied) {
+			if (alignUp(o) + requirements.size <= begin)
+				break;
+			o = std::max(o, end);
+		}
+		o = alignUp(o);
+
+		if (o + requirements.size <= block.mAllocationInfo.size) {
+			blockIndex = i;
+			offset = o;
+			break;
+		}
+	}
+
+	if (blockIndex == -1) {
+		vk::MemoryRequirements blockRequirements = requirements;
+		blockRequirements.size = std::max(requirements.size, kAliasedImageBlockSize);
+
+		VmaAllocationCreateInfo allocationCreateInfo {
+			.flags = VMA_ALLOCATION_CREATE_DEDICATED_MEMORY_BIT,
+			.usage = VMA_MEMORY_USAGE_UNKNOWN,
+			.requiredFlags = (VkMemoryPropertyFlags)vk::MemoryPropertyFlagBits::eDeviceLocal,
+			.memoryTypeBits = requirements.memoryTypeBits,
+			.pool = VK_NULL_HANDLE,
+			.pUserData = VK_NULL_HANDLE,
+			.priority = 0 };
+
+		AliasedImageBlock block = {};
+		vk::Result result = (vk::Result)vmaAllocateMemory(mDevice->MemoryAllocator(), &(const VkMemoryRequirements&)blockRequirements, &allocationCreateInfo, &block.mAllocation, &block.mAllocationInfo);
+		if (result != vk::Result::eSuccess) {
+			std::cerr << "Failed to allocate transient image memory: " << vk::to_string(result) << std::endl;
+			return nullptr;
+		}
+		vmaSetAllocationName(mDevice->MemoryAllocator(), block.mAllocation, "Transient image block");
+		mDevice->MemoryCounters(MemoryCategory::eTransient).Add(block.mAllocationInfo.size);
+
+		blockIndex = (uint32_t)mAliasedImageBlocks.size();
+		offset = 0;
+		mAliasedImageBlocks.emplace_back(std::move(block));
+	}
+
+	AliasedImageBlock& block = mAliasedImageBlocks[blockIndex];
+
+	// images are created once per placement and reused whenever the same placement comes up again
+
+	ref<Image> image = {};
+	auto key = std::tuple{ info, blockIndex, offset };
+	if (auto it = mAliasedImages.find(key); it != mAliasedImages.end())
+		image = it->second;
+	else {
+		image = newImage ? newImage : Image::CreateAliased(*mDevice, info);
+		if (!image || !image->BindMemory(block.mAllocation, offset))
+			return nullptr;
+		mDevice->SetDebugName(**image, "Transient aliased image");
+		mAliasedImages.emplace(key, image);
+	}
+
+	// aliasing barrier: discard the contents and wait for any writes to the memory by previous placements
+
+	Image::ResourceState state {
+		.layout = vk::ImageLayout::eUndefined,
+		.stage  = vk::PipelineStageFlagBits2::eTopOfPipe,
+		.access = vk::AccessFlagBits2::eNone,
+		.queueFamily = mQueueFamily };
+	for (const auto& p : block.mPlacements) {
+		if (p.mOffset >= offset + requirements.size || offset >= p.mOffset + p.mSize)
+			continue;
+		for (uint32_t layer = 0; layer < p.mImage->Info().arrayLayers; layer++) {
+			for (uint32_t level = 0; level < p.mImage->Info().mipLevels; level++) {
+				const auto& s = p.mImage->GetSubresourceState(layer, level);
+				state.stage  |= s.stage;
+				state.access |= s.access & gWriteAccesses;
+			}
+		}
+	}
+	image->ResetSubresourceStates(state);
+
+	block.mPlacements.emplace_back(image, offset, requirements.size, firstUse, lastUse);
+
+	mAliasedImageBytes += requirements.size;
+	mPeakAliasedImageBytes = std::max(mPeakAliasedImageBytes, mAliasedImageBytes);
+
+	return image;
+}
+
 
 uint32_t align16(uint32_t s) {
 	s = (s + 3)&(~3);
@@ -415,6 +616,10 @@ void CommandContext::UpdateDescriptorSets(const DescriptorSets& descriptorSets,
 				.range  = buffer.size() });
 	}
 
+	for (const vk::WriteDescriptorSet& write : w.writes)
+		if (write.pBufferInfo)
+			mDescriptorBuffers.emplace(write.pBufferInfo->buffer);
+
 	if (!w.writes.empty())
 		(*mDevice)->updateDescriptorSets(w.writes, {});
 }
@@ -465,6 +670,190 @@ void PushConstants(const CommandContext& context, const PipelineLayout& pipeline
 	}
 }
 
+void CommandContext::GenerateMipMaps(const ref<Image>& img, const vk::Filter filter, const vk::ImageAspectFlags aspect) {
+	if (filter == vk::Filter::eLinear && aspect == vk::ImageAspectFlagBits::eColor && Downsampler::IsSupported(*mDevice, img->Info())) {
+		if (!mDownsampler) mDownsampler = make_ref<Downsampler>();
+		(*mDownsampler)(*this, img);
+	} else
+		BlitMipMaps(img, filter, aspect);
+}
+
+void CommandContext::BeginRendering(const vk::ArrayProxy<const RenderAttachment>& attachments, const uint32_t viewMask) {
+	uint2 imageExtent = uint2(0);
+
+	std::vector<vk::RenderingAttachmentInfo> colorAttachments;
+	vk::RenderingAttachmentInfo depthAttachment;
+	bool hasDepthAttachment = false;
+
+	colorAttachments.reserve(attachments.size());
+	for (const RenderAttachment& a : attachments) {
+		imageExtent = a.image.Extent();
+
+		const bool depth = IsDepthStencil(a.image.GetImage()->Info().format);
+		const Image::ResourceState state = depth ?
+			Image::ResourceState{
+				.layout = vk::ImageLayout::eDepthAttachmentOptimal,
+				.stage  = vk::PipelineStageFlagBits2::eEarlyFragmentTests|vk::PipelineStageFlagBits2::eLateFragmentTests,
+				.access = vk::AccessFlagBits2::eDepthStencilAttachmentRead|vk::AccessFlagBits2::eDepthStencilAttachmentWrite,
+				.queueFamily = QueueFamily() } :
+			Image::ResourceState{
+				.layout = vk::ImageLayout::eColorAttachmentOptimal,
+				.stage  = vk::PipelineStageFlagBits2::eColorAttachmentOutput,
+				.access = vk::AccessFlagBits2::eColorAttachmentRead|vk::AccessFlagBits2::eColorAttachmentWrite,
+				.queueFamily = QueueFamily() };
+
+		// the previous contents aren't loaded, so transition from an undefined layout. the returned barriers
+		// are dropped since they only change the tracked layout; the previous access is still synchronized below.
+		if (a.loadOp != vk::AttachmentLoadOp::eLoad) {
+			const Image::ResourceState& prev = a.image.GetImage()->GetSubresourceState(a.image.mSubresource.baseArrayLayer, a.image.mSubresource.baseMipLevel);
+			a.image.SetState(Image::ResourceState{ vk::ImageLayout::eUndefined, prev.stage, prev.access, prev.queueFamily });
+		}
+		AddBarrier(a.image, state);
+
+		vk::RenderingAttachmentInfo info {
+			.imageView = *a.image,
+			.imageLayout = state.layout,
+			.resolveMode = vk::ResolveModeFlagBits::eNone,
+			.resolveImageView = {},
+			.resolveImageLayout = vk::ImageLayout::eUndefined,
+			.loadOp  = a.loadOp,
+			.storeOp = a.storeOp,
+			.clearValue = a.clearValue };
+
+		if (a.resolveImage) {
+			// resolves happen in the color attachment output stage, for depth attachments too
+			const Image::ResourceState& prev = a.resolveImage.GetImage()->GetSubresourceState(a.resolveImage.mSubresource.baseArrayLayer, a.resolveImage.mSubresource.baseMipLevel);
+			a.resolveImage.SetState(Image::ResourceState{ vk::ImageLayout::eUndefined, prev.stage, prev.access, prev.queueFamily });
+			AddBarrier(a.resolveImage, Image::ResourceState{
+				.layout = state.layout,
+				.stage  = vk::PipelineStageFlagBits2::eColorAttachmentOutput,
+				.access = vk::AccessFlagBits2::eColorAttachmentWrite,
+				.queueFamily = QueueFamily() });
+			info.resolveMode = a.resolveMode != vk::ResolveModeFlagBits::eNone ? a.resolveMode : depth ? vk::ResolveModeFlagBits::eSampleZero : vk::ResolveModeFlagBits::eAverage;
+			info.resolveImageView   = *a.resolveImage;
+			info.resolveImageLayout = state.layout;
+		}
+
+		if (depth) {
+			depthAttachment = info;
+			hasDepthAttachment = true;
+		} else
+			colorAttachments.emplace_back(info);
+	}
+
+	ExecuteBarriers();
+
+	mRendering = true;
+	mRenderArea = vk::Rect2D{ vk::Offset2D{0, 0}, vk::Extent2D{ imageExtent.x, imageExtent.y } };
+	mCommandBuffer.beginRendering(vk::RenderingInfo {
+		.renderArea = mRenderArea,
+		.layerCount = 1,
+		.viewMask = viewMask,
+		.colorAttachmentCount = (uint32_t)colorAttachments.size(),
+		.pColorAttachments = colorAttachments.data(),
+		.pDepthAttachment = hasDepthAttachment ? &depthAttachment : nullptr,
+		.pStencilAttachment = nullptr
+	});
+
+	mCommandBuffer.setViewport(0, vk::Viewport{ 0, 0, (float)imageExtent.x, (float)imageExtent.y, 0, 1 });
+	mCommandBuffer.setScissor(0, mRenderArea);
+}
+
+void CommandContext::BindGraphicsPipeline(const Pipeline& pipeline) {
+	if (!pipeline.IsShaderObject()) {
+		mCommandBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics, **pipeline);
+		return;
+	}
+	mCommandBuffer.bindShadersEXT(pipeline.ShaderObjectStages(), pipeline.ShaderObjectHandles());
+	SetGraphicsState(pipeline.GraphicsState().value_or(GraphicsPipelineInfo{}));
+}
+
+void CommandContext::SetGraphicsState(const GraphicsPipelineInfo& info) {
+	const vk::PipelineInputAssemblyStateCreateInfo inputAssembly = info.inputAssemblyState.value_or(vk::PipelineInputAssemblyStateCreateInfo{});
+	mCommandBuffer.setPrimitiveTopology(inputAssembly.topology);
+	mCommandBuffer.setPrimitiveRestartEnable(inputAssembly.primitiveRestartEnable);
+
+	if (info.vertexInputState)
+		SetVertexInput(info.vertexInputState->bindings, info.vertexInputState->attributes);
+
+	mCommandBuffer.setViewportWithCount(vk::Viewport{ (float)mRenderArea.offset.x, (float)mRenderArea.offset.y, (float)mRenderArea.extent.width, (float)mRenderArea.extent.height, 0, 1 });
+	mCommandBuffer.setScissorWithCount(mRenderArea);
+
+	const vk::PipelineRasterizationStateCreateInfo rasterization = info.rasterizationState.value_or(vk::PipelineRasterizationStateCreateInfo{ .lineWidth = 1.f });
+	mCommandBuffer.setRasterizerDiscardEnable(rasterization.rasterizerDiscardEnable);
+	mCommandBuffer.setPolygonModeEXT(rasterization.polygonMode);
+	mCommandBuffer.setCullMode(rasterization.cullMode);
+	mCommandBuffer.setFrontFace(rasterization.frontFace);
+	mCommandBuffer.setLineWidth(rasterization.lineWidth > 0 ? rasterization.lineWidth : 1.f);
+	mCommandBuffer.setDepthBiasEnable(rasterization.depthBiasEnable);
+	if (rasterization.depthBiasEnable)
+		mCommandBuffer.setDepthBias(rasterization.depthBiasConstantFactor, rasterization.depthBiasClamp, rasterization.depthBiasSlopeFactor);
+	// must be set when the feature is enabled, and can't be without it
+	if (mDevice->Features().depthClamp)
+		mCommandBuffer.setDepthClampEnableEXT(rasterization.depthClampEnable);
+
+	const vk::PipelineMultisampleStateCreateInfo multisample = info.multisampleState.value_or(vk::PipelineMultisampleStateCreateInfo{});
+	mCommandBuffer.setRasterizationSamplesEXT(multisample.rasterizationSamples);
+	mCommandBuffer.setSampleMaskEXT(multisample.rasterizationSamples, vk::SampleMask(~0u));
+	mCommandBuffer.setAlphaToCoverageEnableEXT(multisample.alphaToCoverageEnable);
+
+	const vk::PipelineDepthStencilStateCreateInfo depthStencil = info.depthStencilState.value_or(vk::PipelineDepthStencilStateCreateInfo{});
+	mCommandBuffer.setDepthTestEnable(depthStencil.depthTestEnable);
+	mCommandBuffer.setDepthWriteEnable(depthStencil.depthWriteEnable);
+	mCommandBuffer.setDepthCompareOp(depthStencil.depthCompareOp);
+	mCommandBuffer.setDepthBoundsTestEnable(depthStencil.depthBoundsTestEnable);
+	mCommandBuffer.setStencilTestEnable(depthStencil.stencilTestEnable);
+	if (depthStencil.stencilTestEnable) {
+		for (const auto&[face, state] : { std::pair{ vk::StencilFaceFlagBits::eFront, depthStencil.front }, std::pair{ vk::StencilFaceFlagBits::eBack, depthStencil.back } }) {
+			mCommandBuffer.setStencilOp(face, state.failOp, state.passOp, state.depthFailOp, state.compareOp);
+			mCommandBuffer.setStencilCompareMask(face, state.compareMask);
+			mCommandBuffer.setStencilWriteMask(face, state.writeMask);
+			mCommandBuffer.setStencilReference(face, state.reference);
+		}
+	}
+
+	if (info.colorBlendState && !info.colorBlendState->attachments.empty()) {
+		std::vector<vk::Bool32>                 enables;
+		std::vector<vk::ColorBlendEquationEXT>  equations;
+		std::vector<vk::ColorComponentFlags>    writeMasks;
+		for (const vk::PipelineColorBlendAttachmentState& a : info.colorBlendState->attachments) {
+			enables.emplace_back(a.blendEnable);
+			equations.emplace_back(vk::ColorBlendEquationEXT{
+				.srcColorBlendFactor = a.srcColorBlendFactor,
+				.dstColorBlendFactor = a.dstColorBlendFactor,
+				.colorBlendOp        = a.colorBlendOp,
+				.srcAlphaBlendFactor = a.srcAlphaBlendFactor,
+				.dstAlphaBlendFactor = a.dstAlphaBlendFactor,
+				.alphaBlendOp        = a.alphaBlendOp });
+			writeMasks.emplace_back(a.colorWriteMask);
+		}
+		mCommandBuffer.setColorBlendEnableEXT(0, enables);
+		mCommandBuffer.setColorBlendEquationEXT(0, equations);
+		mCommandBuffer.setColorWriteMaskEXT(0, writeMasks);
+		mCommandBuffer.setBlendConstants(info.colorBlendState->blendConstants.data());
+	}
+}
+
+void CommandContext::SetVertexInput(const vk::ArrayProxy<const vk::VertexInputBindingDescription>& bindings, const vk::ArrayProxy<const vk::VertexInputAttributeDescription>& attributes) {
+	std::vector<vk::VertexInputBindingDescription2EXT>   bindings2;
+	std::vector<vk::VertexInputAttributeDescription2EXT> attributes2;
+	bindings2.reserve(bindings.size());
+	attributes2.reserve(attributes.size());
+	for (const vk::VertexInputBindingDescription& b : bindings)
+		bindings2.emplace_back(vk::VertexInputBindingDescription2EXT{
+			.binding   = b.binding,
+			.stride    = b.stride,
+			.inputRate = b.inputRate,
+			.divisor   = 1 });
+	for (const vk::VertexInputAttributeDescription& a : attributes)
+		attributes2.emplace_back(vk::VertexInputAttributeDescription2EXT{
+			.location = a.location,
+			.binding  = a.binding,
+			.format   = a.format,
+			.offset   = a.offset });
+	mCommandBuffer.setVertexInputEXT(bindings2, attributes2);
+}
+
 void CommandContext::PushConstants(const PipelineLayout& pipelineLayout, const ShaderParameter& rootParameter) const {
 	RoseEngine::PushConstants(*this, pipelineLayout, rootParameter, pipelineLayout.RootBinding());
 }
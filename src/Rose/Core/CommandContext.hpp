@@ -1,5 +1,7 @@
 #pragma once
 
+#include <iostream>
+
 #include "Buffer.hpp"
 #include "Image.hpp"
 #include "AccelerationStructure.hpp"
@@ -67,6 +69,17 @@ struct ImageParameter {
 
 using AccelerationStructureParameter = ref<AccelerationStructure>;
 
+// An attachment for CommandContext::BeginRendering
+struct RenderAttachment {
+	ImageView             image = {};
+	vk::AttachmentLoadOp  loadOp  = vk::AttachmentLoadOp::eClear;
+	vk::AttachmentStoreOp storeOp = vk::AttachmentStoreOp::eStore;
+	vk::ClearValue        clearValue = {};
+	// multisampled attachments are resolved into resolveImage. eNone picks average for color and sample zero for depth.
+	ImageView               resolveImage = {};
+	vk::ResolveModeFlagBits resolveMode = vk::ResolveModeFlagBits::eNone;
+};
+
 using ShaderParameter = ParameterMap<
 	std::monostate,
 	ConstantParameter,
@@ -80,6 +93,8 @@ concept shader_parameter = one_of<T, ShaderParameter, ConstantParameter, BufferP
 
 using DescriptorSets = std::vector<vk::raii::DescriptorSet>;
 
+class Downsampler;
+
 class CommandContext {
 private:
 	vk::raii::CommandPool mCommandPool = nullptr;
@@ -93,6 +108,11 @@ private:
 	std::vector<vk::ImageMemoryBarrier2>  mImageBarrierQueue = {};
 
 	uint64_t mLastSubmit = 0;
+	bool     mRendering = false; // between BeginRendering and EndRendering, where barriers can't be recorded
+	vk::Rect2D mRenderArea = {};
+	double   mLastWaitTime = 0; // milliseconds Begin() spent waiting for mLastSubmit
+
+	ref<Downsampler> mDownsampler = {}; // created by the first GenerateMipMaps that uses it
 
 	struct CachedData {
 		std::unordered_map<vk::PipelineLayout, std::vector<ref<DescriptorSets>>> mDescriptorSets = {};
@@ -113,10 +133,34 @@ private:
 	};
 	CachedData mCache = {};
 
+	// Memory blocks shared by transient images with disjoint lifetimes
+	struct AliasedImageBlock {
+		VmaAllocation     mAllocation = nullptr;
+		VmaAllocationInfo mAllocationInfo = {};
+
+		struct Placement {
+			ref<Image>     mImage = {};
+			vk::DeviceSize mOffset = 0;
+			vk::DeviceSize mSize = 0;
+			uint32_t       mFirstUse = 0;
+			uint32_t       mLastUse = 0;
+		};
+		std::vector<Placement> mPlacements = {}; // cleared by Begin()
+	};
+	std::vector<AliasedImageBlock> mAliasedImageBlocks = {};
+	TupleMap<ref<Image>, ImageInfo, uint32_t, vk::DeviceSize> mAliasedImages = {}; // (info, block, offset) -> image bound at that placement
+	std::unordered_map<ImageInfo, vk::MemoryRequirements> mAliasedImageRequirements = {};
+	vk::DeviceSize mAliasedImageBytes = 0;     // sum of aliased image sizes requested since Begin()
+	vk::DeviceSize mPeakAliasedImageBytes = 0; // largest mAliasedImageBytes seen so far
+
+	std::unordered_set<vk::Buffer> mDescriptorBuffers = {}; // buffers written to descriptor sets since Begin()
+
 	void AllocateDescriptorPool();
 	DescriptorSets AllocateDescriptorSets(const vk::ArrayProxy<const vk::DescriptorSetLayout>& layouts, const vk::ArrayProxy<const uint32_t>& variableSetCounts = {});
 
 public:
+	~CommandContext();
+
 	inline       vk::raii::CommandBuffer& operator*()        { return mCommandBuffer; }
 	inline const vk::raii::CommandBuffer& operator*() const  { return mCommandBuffer; }
 	inline       vk::raii::CommandBuffer* operator->()       { return &mCommandBuffer; }
@@ -136,8 +180,14 @@ public:
 	inline const ref<Device>& GetDeviceRef() const { return mDevice; }
 	inline uint32_t QueueFamily() const { return mQueueFamily; }
 
+	// Waits for this context's previous submit to finish, if it hasn't already, then begins recording
 	void Begin();
 
+	inline uint64_t LastSubmit() const { return mLastSubmit; }
+	// True if the GPU has finished this context's previous submit, so Begin() won't block
+	inline bool IsReady() const { return mLastSubmit == 0 || mDevice->CurrentTimelineValue() >= mLastSubmit; }
+	inline double LastWaitTime() const { return mLastWaitTime; }
+
 	// Signals the device's timeline semaphore upon completion. Returns the signal value.
 	uint64_t Submit(
 		const uint32_t queueIndex = 0,
@@ -148,6 +198,9 @@ public:
 		const vk::ArrayProxy<const uint64_t>&               waitValues = {});
 
 	void UpdateDescriptorSets(const DescriptorSets& descriptorSets, const ShaderParameter& rootParameter, const PipelineLayout& pipelineLayout);
+	// Whether a descriptor set written since Begin() references buffer. Such buffers can't get a new handle
+	// (e.g. by defragmentation) until the next recording, since the descriptors would still use the old one.
+	inline bool HasDescriptorReference(const vk::Buffer buffer) const { return mDescriptorBuffers.contains(buffer); }
 	ref<DescriptorSets> GetDescriptorSets(const PipelineLayout& pipelineLayout);
 	void BindDescriptors(const PipelineLayout& pipelineLayout, const DescriptorSets& descriptorSets) const;
 	void PushConstants  (const PipelineLayout& pipelineLayout, const ShaderParameter& rootParameter) const;
@@ -274,6 +327,60 @@ public:
 				.imageOffset = { 0, 0, 0 },
 				.imageExtent = vk::Extent3D{dst.Extent().x, dst.Extent().y, dst.Extent().z} });
 	}
+	// Copies regions of src into dst. Each region's bufferOffset is relative to src.
+	template<typename T>
+	inline void Copy(const BufferRange<T>& src, const ref<Image>& dst, const vk::ArrayProxy<const vk::BufferImageCopy>& regions) {
+		AddBarrier(src, Buffer::ResourceState{
+			.stage  = vk::PipelineStageFlagBits2::eTransfer,
+			.access = vk::AccessFlagBits2::eTransferRead,
+			.queueFamily = mQueueFamily });
+		std::vector<vk::BufferImageCopy> copies(regions.begin(), regions.end());
+		for (vk::BufferImageCopy& c : copies) {
+			c.bufferOffset += src.mOffset;
+			AddBarrier(dst, vk::ImageSubresourceRange{
+					.aspectMask     = c.imageSubresource.aspectMask,
+					.baseMipLevel   = c.imageSubresource.mipLevel,
+					.levelCount     = 1,
+					.baseArrayLayer = c.imageSubresource.baseArrayLayer,
+					.layerCount     = c.imageSubresource.layerCount },
+				Image::ResourceState{
+					.layout = vk::ImageLayout::eTransferDstOptimal,
+					.stage = vk::PipelineStageFlagBits2::eTransfer,
+					.access = vk::AccessFlagBits2::eTransferWrite,
+					.queueFamily = mQueueFamily });
+		}
+
+		ExecuteBarriers();
+
+		mCommandBuffer.copyBufferToImage(**src.mBuffer, **dst, vk::ImageLayout::eTransferDstOptimal, copies);
+	}
+	template<typename T>
+	inline void Copy(const ImageView& src, const BufferRange<T>& dst, const uint32_t srcLevel = 0) {
+		AddBarrier(src,
+			Image::ResourceState{
+				.layout = vk::ImageLayout::eTransferSrcOptimal,
+				.stage = vk::PipelineStageFlagBits2::eTransfer,
+				.access = vk::AccessFlagBits2::eTransferRead,
+				.queueFamily = mQueueFamily });
+		AddBarrier(dst, Buffer::ResourceState{
+			.stage  = vk::PipelineStageFlagBits2::eTransfer,
+			.access = vk::AccessFlagBits2::eTransferWrite,
+			.queueFamily = mQueueFamily });
+
+		ExecuteBarriers();
+
+		mCommandBuffer.copyImageToBuffer(
+			**src.mImage,
+			vk::ImageLayout::eTransferSrcOptimal,
+			**dst.mBuffer,
+			vk::BufferImageCopy{
+				.bufferOffset = dst.mOffset,
+				.bufferRowLength = 0,
+				.bufferImageHeight = 0,
+				.imageSubresource = src.GetSubresourceLayer(srcLevel),
+				.imageOffset = { 0, 0, 0 },
+				.imageExtent = vk::Extent3D{src.Extent().x, src.Extent().y, src.Extent().z} });
+	}
 
 	inline void Copy(const ref<Image>& src, const ref<Image>& dst, const vk::ArrayProxy<const vk::ImageCopy>& regions) {
 		for (const vk::ImageCopy& region : regions) {
@@ -347,7 +454,8 @@ public:
 				size,
 				usage,
 				vk::MemoryPropertyFlagBits::eDeviceLocal,
-				VMA_ALLOCATION_CREATE_STRATEGY_MIN_TIME_BIT);
+				VMA_ALLOCATION_CREATE_STRATEGY_MIN_TIME_BIT,
+				MemoryCategory::eTransient);
 			mDevice->SetDebugName(**buffer.mBuffer, "Transient buffer");
 			hostBuffer = {};
 		}
@@ -367,6 +475,27 @@ public:
 		});
 	}
 
+	// Returns a transient image that may share memory with other aliased transient images.
+	// firstUse and lastUse are caller-defined points (e.g. pass indices) within the current recording. Images
+	// whose [firstUse, lastUse] ranges do not overlap may be placed at the same memory. The image should be requested
+	// at its first use, and is only valid until the next Begin(). Its contents are undefined, and the first barrier
+	// on it waits for previous writes to the aliased memory.
+	ref<Image> GetTransientImage(const ImageInfo& info, const uint32_t firstUse, const uint32_t lastUse);
+
+	// Releases cached transient buffers and images, then aliased image blocks, which are not used by the current recording.
+	// Returns the number of bytes released.
+	vk::DeviceSize ReleaseCachedResources(const vk::DeviceSize bytes = VK_WHOLE_SIZE);
+
+	// Bytes of device memory backing aliased transient images
+	inline vk::DeviceSize AliasedImageMemory() const {
+		vk::DeviceSize size = 0;
+		for (const auto& block : mAliasedImageBlocks)
+			size += block.mAllocationInfo.size;
+		return size;
+	}
+	// Peak bytes that aliased transient images used within one recording, if each had its own allocation
+	inline vk::DeviceSize PeakAliasedImageRequestedMemory() const { return mPeakAliasedImageBytes; }
+
 	// Copies data to a host-visible buffer
 	template<std::ranges::contiguous_range R>
 	inline BufferView UploadData(R&& data) {
@@ -388,7 +517,13 @@ public:
 		}
 
 		if (!hostBuffer || hostBuffer.size() < size) {
-			hostBuffer = Buffer::Create(*mDevice, data);
+			hostBuffer = Buffer::Create(
+				*mDevice,
+				data,
+				vk::BufferUsageFlagBits::eTransferSrc,
+				vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent,
+				VMA_ALLOCATION_CREATE_MAPPED_BIT | VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT,
+				MemoryCategory::eStaging);
 			mDevice->SetDebugName(**hostBuffer.mBuffer, "Transient host buffer");
 		} else
 			std::memcpy(hostBuffer.data(), data.data(), size);
@@ -421,7 +556,13 @@ public:
 		if (hostBuffer && hostBuffer.size() >= size) {
 			std::memcpy(hostBuffer.data(), std::ranges::data(data), size);
 		} else {
-			hostBuffer = Buffer::Create(*mDevice, data);
+			hostBuffer = Buffer::Create(
+				*mDevice,
+				data,
+				vk::BufferUsageFlagBits::eTransferSrc,
+				vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent,
+				VMA_ALLOCATION_CREATE_MAPPED_BIT | VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT,
+				MemoryCategory::eStaging);
 			mDevice->SetDebugName(**hostBuffer.mBuffer, "Transient host buffer");
 		}
 
@@ -431,7 +572,8 @@ public:
 				size,
 				usage,
 				vk::MemoryPropertyFlagBits::eDeviceLocal,
-				VMA_ALLOCATION_CREATE_STRATEGY_MIN_TIME_BIT);
+				VMA_ALLOCATION_CREATE_STRATEGY_MIN_TIME_BIT,
+				MemoryCategory::eTransient);
 			mDevice->SetDebugName(**buffer.mBuffer, "Transient buffer");
 		}
 
@@ -524,7 +666,10 @@ public:
 		ClearDepth(img.mImage, clearValue, img.mSubresource);
 	}
 
-	inline void GenerateMipMaps(const ref<Image>& img, const vk::Filter filter = vk::Filter::eLinear, const vk::ImageAspectFlags aspect = vk::ImageAspectFlagBits::eColor) {
+	// Generates every level of img from the first level. Uses a single compute pass (see Downsampler) when img supports it,
+	// otherwise one blit per level, which requires a format with linear filtering unless filter is eNearest.
+	void GenerateMipMaps(const ref<Image>& img, const vk::Filter filter = vk::Filter::eLinear, const vk::ImageAspectFlags aspect = vk::ImageAspectFlagBits::eColor);
+	inline void BlitMipMaps(const ref<Image>& img, const vk::Filter filter = vk::Filter::eLinear, const vk::ImageAspectFlags aspect = vk::ImageAspectFlagBits::eColor) {
 		vk::ImageBlit blit {
 			.srcSubresource = vk::ImageSubresourceLayers{
 				.aspectMask = aspect,
@@ -544,7 +689,7 @@ public:
 			blit.dstOffsets[1].y = std::max(1, blit.srcOffsets[1].y / 2);
 			blit.dstOffsets[1].z = std::max(1, blit.srcOffsets[1].z / 2);
 
-			Blit(img, img, blit, vk::Filter::eLinear);
+			Blit(img, img, blit, filter);
 
 			blit.srcOffsets[1] = blit.dstOffsets[1];
 		}
@@ -553,76 +698,30 @@ public:
 	#pragma endregion
 
 	#pragma region Rasterization
+	// Begins dynamic rendering. Attachments which are cleared or don't care on load are transitioned from an undefined layout, so
+	// their previous contents are never preserved. With a nonzero viewMask, each attachment's array layers are rendered with multiview.
+	void BeginRendering(const vk::ArrayProxy<const RenderAttachment>& attachments, const uint32_t viewMask = 0);
+	// Clears and stores every attachment
 	inline void BeginRendering(const vk::ArrayProxy<std::pair<ImageView, vk::ClearValue>>& attachments) {
-		uint2 imageExtent;
-
-		std::vector<vk::RenderingAttachmentInfo> attachmentInfos;
-		vk::RenderingAttachmentInfo depthAttachmentInfo;
-		bool hasDepthAttachment = false;
-
-		attachmentInfos.reserve(attachments.size());
-		for (const auto& [attachment, clearValue] : attachments) {
-			imageExtent = attachment.Extent();
-			if (IsDepthStencil(attachment.GetImage()->Info().format)) {
-				AddBarrier(attachment, Image::ResourceState{
-					.layout = vk::ImageLayout::eDepthAttachmentOptimal,
-					.stage  = vk::PipelineStageFlagBits2::eLateFragmentTests,
-					.access =  vk::AccessFlagBits2::eDepthStencilAttachmentRead|vk::AccessFlagBits2::eDepthStencilAttachmentWrite,
-					.queueFamily = QueueFamily()
-				});
-
-				depthAttachmentInfo = vk::RenderingAttachmentInfo {
-					.imageView = *attachment,
-					.imageLayout = vk::ImageLayout::eDepthAttachmentOptimal,
-					.resolveMode = vk::ResolveModeFlagBits::eNone,
-					.resolveImageView = {},
-					.resolveImageLayout = vk::ImageLayout::eUndefined,
-					.loadOp  = vk::AttachmentLoadOp::eClear,
-					.storeOp = vk::AttachmentStoreOp::eStore,
-					.clearValue = clearValue
-				};
-
-				hasDepthAttachment = true;
-			} else {
-				AddBarrier(attachment, Image::ResourceState{
-					.layout = vk::ImageLayout::eColorAttachmentOptimal,
-					.stage  = vk::PipelineStageFlagBits2::eColorAttachmentOutput,
-					.access =  vk::AccessFlagBits2::eColorAttachmentRead|vk::AccessFlagBits2::eColorAttachmentWrite,
-					.queueFamily = QueueFamily()
-				});
-
-				attachmentInfos.emplace_back(vk::RenderingAttachmentInfo {
-					.imageView = *attachment,
-					.imageLayout = vk::ImageLayout::eColorAttachmentOptimal,
-					.resolveMode = vk::ResolveModeFlagBits::eNone,
-					.resolveImageView = {},
-					.resolveImageLayout = vk::ImageLayout::eUndefined,
-					.loadOp  = vk::AttachmentLoadOp::eClear,
-					.storeOp = vk::AttachmentStoreOp::eStore,
-					.clearValue = clearValue
-				});
-			}
-		}
-
-		ExecuteBarriers();
-
-		mCommandBuffer.beginRendering(vk::RenderingInfo {
-			.renderArea = vk::Rect2D{ vk::Offset2D{0, 0}, vk::Extent2D{ imageExtent.x, imageExtent.y } },
-			.layerCount = 1,
-			.viewMask = 0,
-			.colorAttachmentCount = (uint32_t)attachmentInfos.size(),
-			.pColorAttachments = attachmentInfos.data(),
-			.pDepthAttachment = hasDepthAttachment ? &depthAttachmentInfo : nullptr,
-			.pStencilAttachment = nullptr
-		});
-
-		mCommandBuffer.setViewport(0, vk::Viewport{ 0, 0, (float)imageExtent.x, (float)imageExtent.y, 0, 1 });
-		mCommandBuffer.setScissor(0, vk::Rect2D{ vk::Offset2D{0, 0}, vk::Extent2D{ imageExtent.x, imageExtent.y } } );
+		std::vector<RenderAttachment> renderAttachments;
+		renderAttachments.reserve(attachments.size());
+		for (const auto& [attachment, clearValue] : attachments)
+			renderAttachments.emplace_back(RenderAttachment{ .image = attachment, .clearValue = clearValue });
+		BeginRendering(renderAttachments);
 	}
-	inline void EndRendering() const {
+	inline void EndRendering() {
 		mCommandBuffer.endRendering();
+		mRendering = false;
 	}
 
+	// Binds a graphics pipeline. Shader object pipelines bind their shaders and set their graphics state dynamically,
+	// with the viewport and scissor covering the render area.
+	void BindGraphicsPipeline(const Pipeline& pipeline);
+	// Sets all state in info which is dynamic when drawing with shader objects
+	void SetGraphicsState(const GraphicsPipelineInfo& info);
+	// Sets the vertex input state for shader object draws
+	void SetVertexInput(const vk::ArrayProxy<const vk::VertexInputBindingDescription>& bindings, const vk::ArrayProxy<const vk::VertexInputAttributeDescription>& attributes);
+
 	#pragma endregion
 
 	#pragma region Dispatch
@@ -651,6 +750,71 @@ public:
 	void Dispatch(const Pipeline& pipeline, const uint32_t threadCount, const DescriptorSets& descriptorSets) { Dispatch(pipeline, uint3(threadCount, 1, 1), descriptorSets); }
 
 	#pragma endregion
+
+	#pragma region Indirect
+
+	// Transitions a buffer written on the GPU for reading by indirect commands.
+	// Barriers can't be recorded inside BeginRendering/EndRendering, so argument buffers for indirect draws should be transitioned before BeginRendering.
+	template<typename T>
+	inline void AddIndirectArgsBarrier(const BufferRange<T>& args) {
+		AddBarrier(args, Buffer::ResourceState{
+			.stage  = vk::PipelineStageFlagBits2::eDrawIndirect,
+			.access = vk::AccessFlagBits2::eIndirectCommandRead,
+			.queueFamily = mQueueFamily });
+	}
+
+	// args contains a VkDispatchIndirectCommand (workgroup counts, not thread counts)
+	void DispatchIndirect(const Pipeline& pipeline, const BufferView& args, const ShaderParameter& rootParameter) {
+		mCommandBuffer.bindPipeline(vk::PipelineBindPoint::eCompute, **pipeline);
+		BindParameters(*pipeline.Layout(), rootParameter);
+		AddIndirectArgsBarrier(args);
+		ExecuteBarriers();
+
+		mCommandBuffer.dispatchIndirect(**args.mBuffer, args.mOffset);
+	}
+	void DispatchIndirect(const Pipeline& pipeline, const BufferView& args, const DescriptorSets& descriptorSets) {
+		mCommandBuffer.bindPipeline(vk::PipelineBindPoint::eCompute, **pipeline);
+		BindDescriptors(*pipeline.Layout(), descriptorSets);
+		AddIndirectArgsBarrier(args);
+		ExecuteBarriers();
+
+		mCommandBuffer.dispatchIndirect(**args.mBuffer, args.mOffset);
+	}
+
+private:
+	inline void PrepareIndirectDraw(const Pipeline& pipeline, const ShaderParameter& rootParameter, const BufferView& args, const BufferView& countBuffer = {}) {
+		mCommandBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics, **pipeline);
+		BindParameters(*pipeline.Layout(), rootParameter);
+		if (!mRendering) {
+			AddIndirectArgsBarrier(args);
+			if (countBuffer) AddIndirectArgsBarrier(countBuffer);
+			ExecuteBarriers();
+		} else if (args.GetState().access != vk::AccessFlagBits2::eIndirectCommandRead || (countBuffer && countBuffer.GetState().access != vk::AccessFlagBits2::eIndirectCommandRead))
+			std::cout << "Warning: Indirect draw argument buffer was not transitioned before BeginRendering" << std::endl;
+	}
+
+public:
+	// args contains drawCount VkDrawIndirectCommands
+	void DrawIndirect(const Pipeline& pipeline, const BufferView& args, const uint32_t drawCount, const ShaderParameter& rootParameter, const uint32_t stride = sizeof(vk::DrawIndirectCommand)) {
+		PrepareIndirectDraw(pipeline, rootParameter, args);
+		mCommandBuffer.drawIndirect(**args.mBuffer, args.mOffset, drawCount, stride);
+	}
+	// args contains drawCount VkDrawIndexedIndirectCommands. The index buffer must already be bound.
+	void DrawIndexedIndirect(const Pipeline& pipeline, const BufferView& args, const uint32_t drawCount, const ShaderParameter& rootParameter, const uint32_t stride = sizeof(vk::DrawIndexedIndirectCommand)) {
+		PrepareIndirectDraw(pipeline, rootParameter, args);
+		mCommandBuffer.drawIndexedIndirect(**args.mBuffer, args.mOffset, drawCount, stride);
+	}
+	// The number of draws is read from the first uint in countBuffer, clamped to maxDrawCount
+	void DrawIndirectCount(const Pipeline& pipeline, const BufferView& args, const BufferView& countBuffer, const uint32_t maxDrawCount, const ShaderParameter& rootParameter, const uint32_t stride = sizeof(vk::DrawIndirectCommand)) {
+		PrepareIndirectDraw(pipeline, rootParameter, args, countBuffer);
+		mCommandBuffer.drawIndirectCount(**args.mBuffer, args.mOffset, **countBuffer.mBuffer, countBuffer.mOffset, maxDrawCount, stride);
+	}
+	void DrawIndexedIndirectCount(const Pipeline& pipeline, const BufferView& args, const BufferView& countBuffer, const uint32_t maxDrawCount, const ShaderParameter& rootParameter, const uint32_t stride = sizeof(vk::DrawIndexedIndirectCommand)) {
+		PrepareIndirectDraw(pipeline, rootParameter, args, countBuffer);
+		mCommandBuffer.drawIndexedIndirectCount(**args.mBuffer, args.mOffset, **countBuffer.mBuffer, countBuffer.mOffset, maxDrawCount, stride);
+	}
+
+	#pragma endregion
 };
 
 }
\ No newline at end of file
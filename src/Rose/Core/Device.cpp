@@ -7,21 +7,27 @@
 #include "Instance.hpp"
 
 #include <functional>
+#include <cstdlib>
+#include <cstring>
+#include <sstream>
+#include <json.hpp>
 
 namespace RoseEngine {
 
 auto ConfigureFeatures(Device& device, vk::PhysicalDeviceFeatures& features) {
 	vk::StructureChain<
 		vk::DeviceCreateInfo,
+		vk::PhysicalDeviceVulkan11Features,
 		vk::PhysicalDeviceVulkan12Features,
 		vk::PhysicalDeviceVulkan13Features,
-		vk::PhysicalDevice16BitStorageFeatures,
 		vk::PhysicalDeviceShaderAtomicFloatFeaturesEXT,
 		vk::PhysicalDeviceAccelerationStructureFeaturesKHR,
 		vk::PhysicalDeviceRayTracingPipelineFeaturesKHR,
 		vk::PhysicalDeviceRayQueryFeaturesKHR,
 		vk::PhysicalDeviceFragmentShaderBarycentricFeaturesKHR,
-		vk::PhysicalDeviceMeshShaderFeaturesEXT
+		vk::PhysicalDeviceMeshShaderFeaturesEXT,
+		vk::PhysicalDeviceGraphicsPipelineLibraryFeaturesEXT,
+		vk::PhysicalDeviceShaderObjectFeaturesEXT
 		> createInfo = {};
 
 	features.fillModeNonSolid = true;
@@ -34,11 +40,20 @@ auto ConfigureFeatures(Device& device, vk::PhysicalDeviceFeatures& features) {
 	features.shaderInt16 = true;
 	features.shaderFloat64 = true;
 	features.geometryShader = true;
+	features.multiDrawIndirect = true;
+	features.textureCompressionBC = device.PhysicalDevice().getFeatures().textureCompressionBC; // KTX2 textures are transcoded to BCn when supported
+	features.shaderStorageImageWriteWithoutFormat = device.PhysicalDevice().getFeatures().shaderStorageImageWriteWithoutFormat; // used by Downsampler
+	features.depthClamp = device.PhysicalDevice().getFeatures().depthClamp; // rasterizationState.depthClampEnable is ignored without it
 	//features.shaderStorageBufferArrayDynamicIndexing = true;
 	//features.shaderSampledImageArrayDynamicIndexing = true;
 	//features.shaderStorageImageArrayDynamicIndexing = true;
 	//features.fragmentStoresAndAtomics = true;
 
+	// 16 bit storage features are part of Vulkan11Features, which can't be chained with PhysicalDevice16BitStorageFeatures
+	vk::PhysicalDeviceVulkan11Features& vk11features = std::get<vk::PhysicalDeviceVulkan11Features>(createInfo);
+	vk11features.storageBuffer16BitAccess = true;
+	vk11features.multiview = true; // required by Vulkan 1.1. used by CommandContext::BeginRendering's viewMask
+
 	vk::PhysicalDeviceVulkan12Features& vk12features = std::get<vk::PhysicalDeviceVulkan12Features>(createInfo);
 	vk12features.shaderStorageBufferArrayNonUniformIndexing = true;
 	vk12features.shaderSampledImageArrayNonUniformIndexing = true;
@@ -47,14 +62,12 @@ auto ConfigureFeatures(Device& device, vk::PhysicalDeviceFeatures& features) {
 	vk12features.shaderFloat16 = true;
 	vk12features.bufferDeviceAddress = device.EnabledExtensions().contains(VK_KHR_ACCELERATION_STRUCTURE_EXTENSION_NAME) || device.EnabledExtensions().contains(VK_KHR_BUFFER_DEVICE_ADDRESS_EXTENSION_NAME);
 	vk12features.timelineSemaphore = true;
+	vk12features.drawIndirectCount = true;
 
 	vk::PhysicalDeviceVulkan13Features& vk13features = std::get<vk::PhysicalDeviceVulkan13Features>(createInfo);
 	vk13features.dynamicRendering = true;
 	vk13features.synchronization2 = true;
 
-	vk::PhysicalDevice16BitStorageFeatures& storageFeatures = std::get<vk::PhysicalDevice16BitStorageFeatures>(createInfo);
-	storageFeatures.storageBuffer16BitAccess = true;
-
 	// optional extensions
 
 	auto configureExtension = [&]<typename FeatureStruct>(const char* extensionName, auto&& fn) {
@@ -91,10 +104,18 @@ auto ConfigureFeatures(Device& device, vk::PhysicalDeviceFeatures& features) {
 		v.taskShader = true;
 	});
 
+	configureExtension.template operator()<vk::PhysicalDeviceGraphicsPipelineLibraryFeaturesEXT>(VK_EXT_GRAPHICS_PIPELINE_LIBRARY_EXTENSION_NAME, [](vk::PhysicalDeviceGraphicsPipelineLibraryFeaturesEXT& v){
+		v.graphicsPipelineLibrary = true;
+	});
+
+	configureExtension.template operator()<vk::PhysicalDeviceShaderObjectFeaturesEXT>(VK_EXT_SHADER_OBJECT_EXTENSION_NAME, [](vk::PhysicalDeviceShaderObjectFeaturesEXT& v){
+		v.shaderObject = true;
+	});
+
 	return createInfo;
 }
 
-ref<Device> Device::Create(const Instance& instance, const vk::raii::PhysicalDevice& physicalDevice, const vk::ArrayProxy<const std::string>& deviceExtensions) {
+ref<Device> Device::Create(const Instance& instance, const vk::raii::PhysicalDevice& physicalDevice, const vk::ArrayProxy<const std::string>& deviceExtensions, const vk::ArrayProxy<const std::string>& optionalExtensions) {
 	ref<Device> device = make_ref<Device>();
 
 	device->mPhysicalDevice = physicalDevice;
@@ -103,6 +124,18 @@ ref<Device> Device::Create(const Instance& instance, const vk::raii::PhysicalDev
 	for (const auto& e : deviceExtensions)
 		device->mExtensions.emplace(e);
 
+	if (!optionalExtensions.empty()) {
+		std::unordered_set<std::string> supported;
+		for (const auto& e : physicalDevice.enumerateDeviceExtensionProperties())
+			supported.emplace(e.extensionName.data());
+		for (const auto& e : optionalExtensions) {
+			if (supported.contains(e))
+				device->mExtensions.emplace(e);
+			else
+				std::cout << "Warning: Optional extension " << e << " is not supported" << std::endl;
+		}
+	}
+
 	auto createStructureChain = ConfigureFeatures(*device, device->mFeatures);
 
 	// Configure queues
@@ -134,7 +167,10 @@ ref<Device> Device::Create(const Instance& instance, const vk::raii::PhysicalDev
 		.setPEnabledFeatures(&device->mFeatures);
 	device->mDevice = device->mPhysicalDevice.createDevice(createInfo);
 
-	device->mPipelineCache = device->mDevice.createPipelineCache({});
+	if (const std::filesystem::path cacheDir = DefaultCacheDirectory(); !cacheDir.empty())
+		device->EnablePersistentPipelineCache(cacheDir);
+	else
+		device->mPipelineCache = device->mDevice.createPipelineCache({});
 
 	// Create allocator
 
@@ -172,35 +208,306 @@ ref<Device> Device::Create(const Instance& instance, const vk::raii::PhysicalDev
 	return device;
 }
 Device::~Device() {
+	if (*mDevice) {
+		mDevice.waitIdle();
+		// the allocator and pools are destroyed below, so everything has to go, not just what the timeline has passed
+		CollectGarbage(true);
+		UpdatePipelineCache(true);
+	}
+	for (auto&[key, pool] : mMemoryPools)
+		vmaDestroyPool(mMemoryAllocator, pool);
+	mMemoryPools.clear();
+	mLinearMemoryPools.clear();
 	if (mMemoryAllocator != nullptr) {
 		vmaDestroyAllocator(mMemoryAllocator);
 		mMemoryAllocator = nullptr;
 	}
 }
 
-void Device::LoadPipelineCache(const std::filesystem::path& path) {
+void Device::DeferFree(const VmaAllocation allocation, const uint64_t lastUse) {
+	if (!allocation) return;
+	std::lock_guard lock(mDeferredDestructionMutex);
+	mDeferredDestructions.emplace_back(DeferredDestruction{ .lastUse = lastUse, .allocation = allocation });
+}
+
+void Device::CollectGarbage(const bool all) {
+	const uint64_t value = all || !*mTimelineSemaphore ? UINT64_MAX : CurrentTimelineValue();
+
+	// objects are released outside the lock, since their destructors may defer more objects.
+	// when releasing everything, repeat until those are gone too
+	do {
+		std::vector<DeferredDestruction> expired;
+		{
+			std::lock_guard lock(mDeferredDestructionMutex);
+			auto it = std::ranges::partition(mDeferredDestructions, [=](const DeferredDestruction& d) { return d.lastUse > value; }).begin();
+			expired.assign(std::make_move_iterator(it), std::make_move_iterator(mDeferredDestructions.end()));
+			mDeferredDestructions.erase(it, mDeferredDestructions.end());
+		}
+		if (expired.empty()) break;
+
+		for (const DeferredDestruction& d : expired)
+			if (d.allocation)
+				vmaFreeMemory(mMemoryAllocator, d.allocation);
+	} while (all);
+}
+
+VmaPool Device::GetMemoryPool(const MemoryCategory category, const uint32_t memoryTypeIndex) const {
+	if (category == MemoryCategory::eUncategorized || category >= MemoryCategory::eCount)
+		return VK_NULL_HANDLE;
+
+	std::lock_guard lock(mMemoryPoolMutex);
+
+	const uint64_t key = (uint64_t(category) << 32) | memoryTypeIndex;
+	if (auto it = mMemoryPools.find(key); it != mMemoryPools.end())
+		return it->second;
+
+	VmaPoolCreateInfo createInfo {
+		.memoryTypeIndex = memoryTypeIndex,
+		.flags = 0,
+		.blockSize = 0,
+		.minBlockCount = 0,
+		.maxBlockCount = 0,
+		.priority = 0,
+		.minAllocationAlignment = 0,
+		.pMemoryAllocateNext = nullptr };
+	switch (category) {
+	case MemoryCategory::eMesh:
+		createInfo.blockSize = 64*1024*1024;
+		break;
+	case MemoryCategory::eTexture:
+		createInfo.blockSize = 256*1024*1024;
+		break;
+	case MemoryCategory::eAccelerationStructure:
+		createInfo.blockSize = 32*1024*1024;
+		break;
+	case MemoryCategory::eTransient:
+		createInfo.blockSize = 64*1024*1024;
+		break;
+	case MemoryCategory::eStaging:
+		// staging memory is allocated and released in roughly FIFO order
+		createInfo.flags = VMA_POOL_CREATE_LINEAR_ALGORITHM_BIT;
+		createInfo.blockSize = 32*1024*1024;
+		break;
+	default:
+		break;
+	}
+
+	VmaPool pool = VK_NULL_HANDLE;
+	vk::Result result = (vk::Result)vmaCreatePool(mMemoryAllocator, &createInfo, &pool);
+	if (result != vk::Result::eSuccess) {
+		std::cerr << "Warning: Failed to create " << to_string(category) << " memory pool: " << vk::to_string(result) << std::endl;
+		return VK_NULL_HANDLE;
+	}
+	vmaSetPoolName(mMemoryAllocator, pool, to_string(category));
+	mMemoryPools.emplace(key, pool);
+	if (createInfo.flags & VMA_POOL_CREATE_LINEAR_ALGORITHM_BIT)
+		mLinearMemoryPools.emplace(pool);
+	return pool;
+}
+
+VmaAllocationCreateFlags Device::GetAllocationFlags(const MemoryCategory category, const VmaAllocationCreateFlags flags) {
+	switch (category) {
+	default:
+		return flags;
+	case MemoryCategory::eTransient:
+	case MemoryCategory::eStaging:
+		return (flags & ~VMA_ALLOCATION_CREATE_STRATEGY_MASK) | VMA_ALLOCATION_CREATE_STRATEGY_MIN_TIME_BIT;
+	}
+}
+
+std::string Device::MemoryStatisticsJson() const {
+	nlohmann::json data;
+	for (uint32_t i = 0; i < (uint32_t)MemoryCategory::eCount; i++) {
+		const MemoryCategoryCounters& c = mMemoryCounters[i];
+		nlohmann::json& category = data[to_string((MemoryCategory)i)];
+		category["liveBytes"]       = c.liveBytes.load();
+		category["peakBytes"]       = c.peakBytes.load();
+		category["allocationCount"] = c.allocationCount.load();
+	}
+	return data.dump(1, '\t');
+}
+
+std::filesystem::path Device::DefaultCacheDirectory() {
+	if (const char* dir = std::getenv("ROSE_CACHE_DIR"))
+		return dir;
+#ifdef _WIN32
+	if (const char* dir = std::getenv("LOCALAPPDATA"))
+		return std::filesystem::path(dir) / "Rose";
+#else
+	if (const char* dir = std::getenv("XDG_CACHE_HOME"))
+		return std::filesystem::path(dir) / "rose";
+	if (const char* dir = std::getenv("HOME"))
+		return std::filesystem::path(dir) / ".cache" / "rose";
+#endif
+	return {};
+}
+
+bool Device::LoadPipelineCache(const std::filesystem::path& path) {
 	std::vector<uint8_t> cacheData;
 	vk::PipelineCacheCreateInfo cacheInfo = {};
-	try {
-		cacheData = ReadFile<std::vector<uint8_t>>(path);
-		if (!cacheData.empty()) {
+	// a missing file is a cold start, only unreadable ones are worth a warning
+	std::error_code ec;
+	if (std::filesystem::exists(path, ec)) {
+		try {
+			cacheData = ReadFile<std::vector<uint8_t>>(path);
+		} catch (std::exception& e) {
+			std::cerr << "Warning: Failed to read pipeline cache: " << e.what() << std::endl;
+			cacheData.clear();
+		}
+	}
+
+	// some drivers don't validate the data themselves, so check the header against this device
+	if (!cacheData.empty()) {
+		vk::PipelineCacheHeaderVersionOne header = {};
+		const vk::PhysicalDeviceProperties properties = mPhysicalDevice.getProperties();
+		bool valid = cacheData.size() >= sizeof(header);
+		if (valid) {
+			std::memcpy(&header, cacheData.data(), sizeof(header));
+			valid =
+				header.headerSize >= sizeof(header) &&
+				header.headerVersion == vk::PipelineCacheHeaderVersion::eOne &&
+				header.vendorID == properties.vendorID &&
+				header.deviceID == properties.deviceID &&
+				header.pipelineCacheUUID == properties.pipelineCacheUUID;
+		}
+		if (valid) {
 			cacheInfo.pInitialData = cacheData.data();
 			cacheInfo.initialDataSize = cacheData.size();
 			std::cout << "Read pipeline cache (" << std::fixed << std::showpoint << std::setprecision(2) << cacheData.size()/1024.f << "KiB)" << std::endl;
+		} else {
+			std::cout << "Warning: Ignoring pipeline cache " << path << " created by a different device or driver" << std::endl;
+			cacheData.clear();
 		}
-	} catch (std::exception& e) {
-		std::cerr << "Warning: Failed to read pipeline cache: " << e.what() << std::endl;
 	}
+
 	mPipelineCache = mDevice.createPipelineCache(cacheInfo);
+	return !cacheData.empty();
 }
 void Device::StorePipelineCache(const std::filesystem::path& path) {
 	try {
 		const std::vector<uint8_t> cacheData = mPipelineCache.getData();
-		if (!cacheData.empty())
-			WriteFile(path, cacheData);
+		if (cacheData.empty()) return;
+		std::filesystem::path tmp = path;
+		tmp += ".tmp";
+		{
+			std::ofstream file(tmp, std::ios::binary | std::ios::trunc);
+			file.write(reinterpret_cast<const char*>(cacheData.data()), cacheData.size());
+			if (!file) throw std::runtime_error("Failed to write " + tmp.string());
+		}
+		std::filesystem::rename(tmp, path);
 	} catch (std::exception& e) {
 		std::cerr << "Warning: Failed to write pipeline cache: " << e.what() << std::endl;
 	}
 }
 
+void Device::EnablePersistentPipelineCache(const std::filesystem::path& directory, const vk::DeviceSize maxSize) {
+	const vk::PhysicalDeviceProperties properties = mPhysicalDevice.getProperties();
+	std::stringstream name;
+	name << "pipelines_" << std::hex << std::setfill('0') << std::setw(4) << properties.vendorID << "_" << std::setw(4) << properties.deviceID << "_";
+	for (const uint8_t b : properties.pipelineCacheUUID)
+		name << std::setw(2) << (uint32_t)b;
+	name << ".bin";
+
+	try {
+		std::filesystem::create_directories(directory);
+	} catch (std::exception& e) {
+		std::cerr << "Warning: Failed to create pipeline cache directory " << directory << ": " << e.what() << std::endl;
+		if (!*mPipelineCache) mPipelineCache = mDevice.createPipelineCache({});
+		return;
+	}
+
+	mPipelineCachePath = directory / name.str();
+	mPipelineCacheMaxSize = maxSize;
+	mLastPipelineCacheStore = std::chrono::steady_clock::now();
+
+	if (LoadPipelineCache(mPipelineCachePath)) {
+		// mark the cache as recently used for eviction
+		std::error_code ec;
+		std::filesystem::last_write_time(mPipelineCachePath, std::filesystem::file_time_type::clock::now(), ec);
+	}
+}
+
+void Device::PipelineCreated(const vk::PipelineCreationFeedback& feedback) const {
+	if (!(feedback.flags & vk::PipelineCreationFeedbackFlagBits::eValid))
+		return;
+	if (feedback.flags & vk::PipelineCreationFeedbackFlagBits::eApplicationPipelineCacheHit)
+		mPipelineCacheHits++;
+	else {
+		mPipelineCacheMisses++;
+		mPipelinesSinceStore++;
+	}
+}
+
+ref<vk::raii::Pipeline> Device::GetPipelineLibrary(const size_t key, const std::function<vk::raii::Pipeline()>& create) const {
+	{
+		std::lock_guard lock(mPipelineLibraryMutex);
+		if (auto it = mPipelineLibraries.find(key); it != mPipelineLibraries.end())
+			return it->second;
+	}
+
+	// created outside the lock so other threads can link while this part compiles
+	ref<vk::raii::Pipeline> library = make_ref<vk::raii::Pipeline>(create());
+
+	std::lock_guard lock(mPipelineLibraryMutex);
+	return mPipelineLibraries.emplace(key, library).first->second;
+}
+
+void Device::UpdatePipelineCache(const bool force) {
+	if (mPipelinesSinceStore == 0 || !*mPipelineCache) return;
+
+	// pipelines are often created in bursts, so wait until a few seconds have passed since the last store
+	const auto now = std::chrono::steady_clock::now();
+	if (!force && now - mLastPipelineCacheStore < std::chrono::seconds(5)) return;
+	mLastPipelineCacheStore = now;
+	mPipelinesSinceStore = 0;
+
+	if (!mPipelineCachePath.empty()) {
+		StorePipelineCache(mPipelineCachePath);
+		EvictPipelineCaches();
+	}
+
+	{
+		std::lock_guard lock(mPipelineLibraryMutex);
+		std::erase_if(mPipelineLibraries, [](const auto& p) { return p.second.use_count() == 1; });
+	}
+}
+
+void Device::EvictPipelineCaches() {
+	struct CacheFile {
+		std::filesystem::path path;
+		std::filesystem::file_time_type time;
+		uintmax_t size;
+	};
+	std::vector<CacheFile> files;
+	uintmax_t totalSize = 0;
+	std::error_code ec;
+	for (const auto& entry : std::filesystem::directory_iterator(mPipelineCachePath.parent_path(), ec)) {
+		const std::string filename = entry.path().filename().string();
+		if (!entry.is_regular_file() || !filename.starts_with("pipelines_") || entry.path().extension() != ".bin")
+			continue;
+		files.emplace_back(CacheFile{ entry.path(), entry.last_write_time(ec), entry.file_size(ec) });
+		totalSize += files.back().size;
+	}
+
+	// least recently used first
+	std::ranges::sort(files, {}, &CacheFile::time);
+	for (const CacheFile& f : files) {
+		if (totalSize <= mPipelineCacheMaxSize) break;
+		if (f.path == mPipelineCachePath) continue;
+		if (std::filesystem::remove(f.path, ec)) {
+			std::cout << "Evicted pipeline cache " << f.path.filename() << std::endl;
+			totalSize -= f.size;
+		}
+	}
+
+	// this device's cache alone is too large. start over with an empty one, so it only holds pipelines created from now on.
+	// background links still use the current cache, so this waits for a store after they finish
+	if (totalSize > mPipelineCacheMaxSize && mPendingPipelineLinks == 0) {
+		std::cout << "Warning: Pipeline cache exceeds " << mPipelineCacheMaxSize / (1024*1024) << " MiB, clearing it" << std::endl;
+		std::filesystem::remove(mPipelineCachePath, ec);
+		DeferDestroy(std::move(mPipelineCache));
+		mPipelineCache = mDevice.createPipelineCache({});
+	}
+}
+
 }
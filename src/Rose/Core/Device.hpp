@@ -1,6 +1,9 @@
 #pragma once
 
 #include <bitset>
+#include <atomic>
+#include <mutex>
+#include <functional>
 #include <vk_mem_alloc.h>
 
 #include "RoseEngine.hpp"
@@ -11,6 +14,45 @@ class Instance;
 
 class CommandContext;
 
+// Allocations are placed into a separate set of VmaPools for each category
+enum class MemoryCategory : uint32_t {
+	eUncategorized, // default VMA pools
+	eMesh,
+	eTexture,
+	eAccelerationStructure,
+	eTransient,
+	eStaging,
+	eCount
+};
+inline const char* to_string(const MemoryCategory category) {
+	switch (category) {
+	default:
+	case MemoryCategory::eUncategorized:         return "Uncategorized";
+	case MemoryCategory::eMesh:                  return "Mesh";
+	case MemoryCategory::eTexture:               return "Texture";
+	case MemoryCategory::eAccelerationStructure: return "Acceleration structure";
+	case MemoryCategory::eTransient:             return "Transient";
+	case MemoryCategory::eStaging:               return "Staging";
+	}
+}
+
+struct MemoryCategoryCounters {
+	std::atomic<vk::DeviceSize> liveBytes = 0;
+	std::atomic<vk::DeviceSize> peakBytes = 0;
+	std::atomic<uint32_t>       allocationCount = 0;
+
+	inline void Add(const vk::DeviceSize size) {
+		const vk::DeviceSize live = liveBytes += size;
+		vk::DeviceSize peak = peakBytes;
+		while (live > peak && !peakBytes.compare_exchange_weak(peak, live)) {}
+		allocationCount++;
+	}
+	inline void Remove(const vk::DeviceSize size) {
+		liveBytes -= size;
+		allocationCount--;
+	}
+};
+
 class Device {
 private:
 	vk::raii::Device         mDevice = nullptr;
@@ -30,27 +72,106 @@ private:
 
 	bool mUseDebugUtils = false;
 
+	mutable std::mutex mMemoryPoolMutex = {};
+	mutable std::unordered_map<uint64_t, VmaPool> mMemoryPools = {}; // (category, memory type) -> pool
+	mutable std::unordered_set<VmaPool> mLinearMemoryPools = {};       // pools using the linear algorithm, which VMA can't defragment
+	mutable std::array<MemoryCategoryCounters, (size_t)MemoryCategory::eCount> mMemoryCounters = {};
+
+	struct DeferredDestruction {
+		uint64_t              lastUse = 0;
+		std::shared_ptr<void> object = {};
+		VmaAllocation         allocation = nullptr;
+	};
+	std::mutex                       mDeferredDestructionMutex = {};
+	std::vector<DeferredDestruction> mDeferredDestructions = {};
+
+	std::filesystem::path mPipelineCachePath = {}; // empty if the pipeline cache isn't persistent
+	vk::DeviceSize        mPipelineCacheMaxSize = 0;
+	mutable std::atomic<uint32_t> mPipelineCacheHits = 0;
+	mutable std::atomic<uint32_t> mPipelineCacheMisses = 0;
+	mutable std::atomic<uint32_t> mPipelinesSinceStore = 0;
+	mutable std::atomic<uint32_t> mPendingPipelineLinks = 0; // background links using mPipelineCache
+	std::chrono::steady_clock::time_point mLastPipelineCacheStore = {};
+
+	mutable std::mutex mPipelineLibraryMutex = {};
+	mutable std::unordered_map<size_t, ref<vk::raii::Pipeline>> mPipelineLibraries = {};
+
+	void EvictPipelineCaches();
+
 public:
 	~Device();
 
-	static ref<Device> Create(const Instance& instance, const vk::raii::PhysicalDevice& physicalDevice, const vk::ArrayProxy<const std::string>& deviceExtensions = {});
+	// optionalExtensions are only enabled if the physical device supports them
+	static ref<Device> Create(const Instance& instance, const vk::raii::PhysicalDevice& physicalDevice, const vk::ArrayProxy<const std::string>& deviceExtensions = {}, const vk::ArrayProxy<const std::string>& optionalExtensions = {});
 
 	inline       vk::raii::Device& operator*()        { return mDevice; }
 	inline const vk::raii::Device& operator*() const  { return mDevice; }
 	inline       vk::raii::Device* operator->()       { return &mDevice; }
 	inline const vk::raii::Device* operator->() const { return &mDevice; }
 
-	void  LoadPipelineCache(const std::filesystem::path& path);
+	// Returns false if the file doesn't exist or its header doesn't match this device, in which case an empty cache is created.
+	bool  LoadPipelineCache(const std::filesystem::path& path);
+	// Writes to a temporary file first, so an interrupted write never leaves a corrupt cache behind.
 	void StorePipelineCache(const std::filesystem::path& path);
 
+	// Loads this device's pipeline cache from directory, and stores it again periodically while new pipelines are
+	// being created and on destruction. The file name contains the vendor, device and driver cache UUID.
+	// Least recently used caches in directory (e.g. from old drivers) are deleted once the directory exceeds maxSize.
+	void EnablePersistentPipelineCache(const std::filesystem::path& directory, const vk::DeviceSize maxSize = 256*1024*1024);
+	// Stores the persistent pipeline cache and releases unused pipeline library parts if pipelines were created since
+	// the last store, at most every few seconds unless force is set. Called after every submit.
+	void UpdatePipelineCache(const bool force = false);
+	// Counts hits and misses using the feedback returned by pipeline creation
+	void PipelineCreated(const vk::PipelineCreationFeedback& feedback) const;
+	inline uint32_t PipelineCacheHits() const { return mPipelineCacheHits; }
+	inline uint32_t PipelineCacheMisses() const { return mPipelineCacheMisses; }
+	inline const std::filesystem::path& PipelineCachePath() const { return mPipelineCachePath; }
+	// Background threads which create pipelines with PipelineCache() must be enclosed by these,
+	// so that the cache isn't replaced while they use it
+	inline void BeginPipelineLink() const { mPendingPipelineLinks++; }
+	inline void EndPipelineLink() const   { mPendingPipelineLinks--; }
+
+	// Returns the graphics pipeline library part for key, calling create if it doesn't exist yet.
+	// Parts are shared by all pipelines with the same state for that part, and each linked Pipeline holds its parts.
+	// Parts which no Pipeline holds anymore are released by UpdatePipelineCache.
+	ref<vk::raii::Pipeline> GetPipelineLibrary(const size_t key, const std::function<vk::raii::Pipeline()>& create) const;
+	inline size_t PipelineLibraryCount() const {
+		std::lock_guard lock(mPipelineLibraryMutex);
+		return mPipelineLibraries.size();
+	}
+
+	// $ROSE_CACHE_DIR if set, otherwise the platform's user cache directory
+	static std::filesystem::path DefaultCacheDirectory();
+
 	inline VmaAllocator                           MemoryAllocator() const { return mMemoryAllocator; }
 	inline vk::Instance                           GetInstance() const { return mInstance; }
 	inline const vk::raii::PhysicalDevice&        PhysicalDevice() const { return mPhysicalDevice; }
 	inline const vk::raii::PipelineCache&         PipelineCache() const { return mPipelineCache; }
 	inline const vk::PhysicalDeviceLimits&        Limits() const { return mLimits; }
+	inline const vk::PhysicalDeviceFeatures&      Features() const { return mFeatures; }
 	inline const std::unordered_set<std::string>& EnabledExtensions() const { return mExtensions; }
 	inline bool                                   DebugUtilsEnabled() const { return mUseDebugUtils; }
 
+	// Returns the pool for allocations of category in memory type memoryTypeIndex, creating it if needed.
+	// eUncategorized allocations use the default pools, so VK_NULL_HANDLE is returned for them. Buffer::Create and Image::Create
+	// fall back to dedicated memory for allocations the pool can't hold, e.g. ones larger than its block size.
+	VmaPool GetMemoryPool(const MemoryCategory category, const uint32_t memoryTypeIndex) const;
+	// Every category pool created so far which VMA can defragment. Pools live until the device is destroyed.
+	inline std::vector<VmaPool> DefragmentableMemoryPools() const {
+		std::lock_guard lock(mMemoryPoolMutex);
+		std::vector<VmaPool> pools;
+		for (const auto&[key, pool] : mMemoryPools)
+			if (!mLinearMemoryPools.contains(pool))
+				pools.emplace_back(pool);
+		return pools;
+	}
+	// Allocation flags used for allocations of category, in addition to the caller's flags
+	static VmaAllocationCreateFlags GetAllocationFlags(const MemoryCategory category, const VmaAllocationCreateFlags flags);
+
+	inline MemoryCategoryCounters& MemoryCounters(const MemoryCategory category) const { return mMemoryCounters[(size_t)category]; }
+	// Live/peak bytes per category as JSON
+	std::string MemoryStatisticsJson() const;
+
 	inline uint32_t FindQueueFamily(const vk::QueueFlags flags = vk::QueueFlagBits::eGraphics | vk::QueueFlagBits::eCompute | vk::QueueFlagBits::eTransfer) {
 		uint32_t min_i = -1;
 		uint32_t min_bits = UINT32_MAX;
@@ -83,6 +204,38 @@ public:
 	inline void Wait() {
 		Wait(mCurrentTimelineValue - 1);
 		mDevice.waitIdle();
+		CollectGarbage();
+	}
+
+	// Takes ownership of object and releases it once the GPU passes timeline value lastUse.
+	// Works with ref<T>s, Vulkan RAII objects and containers of either.
+	template<typename T>
+	inline void DeferDestroy(T&& object, const uint64_t lastUse) {
+		using Type = std::remove_cvref_t<T>;
+		std::shared_ptr<void> ptr;
+		if constexpr (std::is_convertible_v<Type, std::shared_ptr<void>>)
+			ptr = std::forward<T>(object);
+		else
+			ptr = std::make_shared<Type>(std::forward<T>(object));
+		if (!ptr) return;
+
+		std::lock_guard lock(mDeferredDestructionMutex);
+		mDeferredDestructions.emplace_back(DeferredDestruction{ .lastUse = lastUse, .object = std::move(ptr) });
+	}
+	// Releases object once all work submitted so far, plus the next submit, has finished
+	template<typename T>
+	inline void DeferDestroy(T&& object) { DeferDestroy(std::forward<T>(object), mCurrentTimelineValue); }
+
+	// Frees allocation once the GPU passes timeline value lastUse
+	void DeferFree(const VmaAllocation allocation, const uint64_t lastUse);
+	inline void DeferFree(const VmaAllocation allocation) { DeferFree(allocation, mCurrentTimelineValue); }
+
+	// Releases deferred objects the GPU is done with. Called after every submit.
+	// all releases every deferred object regardless of its last use, for when the device is idle.
+	void CollectGarbage(const bool all = false);
+	inline size_t DeferredDestructionCount() {
+		std::lock_guard lock(mDeferredDestructionMutex);
+		return mDeferredDestructions.size();
 	}
 
 	template<typename T> requires(std::convertible_to<decltype(T::objectType), vk::ObjectType>)
@@ -0,0 +1,60 @@
+#include <imgui/imgui.h>
+
+#include "FrameScheduler.hpp"
+
+namespace RoseEngine {
+
+ref<FrameScheduler> FrameScheduler::Create(const ref<Device>& device, const uint32_t queueFamily, const uint32_t framesInFlight) {
+	ref<FrameScheduler> scheduler = make_ref<FrameScheduler>();
+	scheduler->mDevice = device;
+	scheduler->mQueueFamily = queueFamily;
+	scheduler->Resize(std::max(framesInFlight, 1u));
+	return scheduler;
+}
+
+void FrameScheduler::Resize(const uint32_t n) {
+	while (mFrames.size() > n) {
+		const uint64_t lastSubmit = mFrames.back()->LastSubmit();
+		mDevice->DeferDestroy(std::move(mFrames.back()), lastSubmit);
+		mFrames.pop_back();
+	}
+	while (mFrames.size() < n)
+		mFrames.emplace_back(CommandContext::Create(mDevice, mQueueFamily));
+
+	if (mFrameIndex >= n)
+		mFrameIndex = 0;
+}
+
+CommandContext& FrameScheduler::BeginFrame() {
+	if (mPendingFramesInFlight > 0) {
+		Resize(mPendingFramesInFlight);
+		mPendingFramesInFlight = 0;
+	}
+
+	if (mFrameCount > 0)
+		mFrameIndex = (mFrameIndex + 1) % mFrames.size();
+	mFrameCount++;
+
+	CommandContext& context = *mFrames[mFrameIndex];
+	context.Begin();
+
+	mCpuWaitTime = context.LastWaitTime();
+	mAverageCpuWaitTime += (mCpuWaitTime - mAverageCpuWaitTime) * 0.05;
+	if (mCpuWaitTime > 0)
+		mBlockedFrames++;
+
+	return context;
+}
+
+void FrameScheduler::InspectorGui() {
+	uint32_t framesInFlight = mPendingFramesInFlight > 0 ? mPendingFramesInFlight : FramesInFlight();
+	const uint32_t minFrames = 1;
+	const uint32_t maxFrames = 8;
+	if (ImGui::SliderScalar("Frames in flight", ImGuiDataType_U32, &framesInFlight, &minFrames, &maxFrames))
+		SetFramesInFlight(framesInFlight);
+
+	ImGui::Text("CPU wait: %.2f ms (average %.2f ms)", mCpuWaitTime, mAverageCpuWaitTime);
+	ImGui::Text("%lu / %lu frames blocked", mBlockedFrames, mFrameCount);
+}
+
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+#include "CommandContext.hpp"
+
+namespace RoseEngine {
+
+// Round-robins over N CommandContexts, each with its own command pool and resource caches.
+// The CPU only blocks in BeginFrame when it is more than N frames ahead of the GPU.
+class FrameScheduler {
+private:
+	ref<Device> mDevice = {};
+	uint32_t    mQueueFamily = 0;
+
+	std::vector<ref<CommandContext>> mFrames = {};
+	uint32_t mFrameIndex = 0;
+	uint64_t mFrameCount = 0;
+
+	double mCpuWaitTime = 0;        // milliseconds spent waiting in the last BeginFrame
+	double mAverageCpuWaitTime = 0; // moving average of mCpuWaitTime
+	uint64_t mBlockedFrames = 0;    // number of frames which had to wait
+
+	uint32_t mPendingFramesInFlight = 0; // applied by the next BeginFrame, since the current context may be recording
+
+	void Resize(const uint32_t count);
+
+public:
+	static ref<FrameScheduler> Create(const ref<Device>& device, const uint32_t queueFamily, const uint32_t framesInFlight = 2);
+
+	inline uint32_t FramesInFlight() const { return (uint32_t)mFrames.size(); }
+	// Takes effect on the next BeginFrame. Contexts removed by lowering the frame count are released once their last submit finishes.
+	inline void SetFramesInFlight(const uint32_t count) { mPendingFramesInFlight = std::max(count, 1u); }
+
+	inline uint32_t FrameIndex() const { return mFrameIndex; }
+	inline uint64_t FrameCount() const { return mFrameCount; }
+	inline CommandContext& CurrentContext() const { return *mFrames[mFrameIndex]; }
+	inline const std::vector<ref<CommandContext>>& Contexts() const { return mFrames; }
+
+	inline double   CpuWaitTime() const { return mCpuWaitTime; }
+	inline double   AverageCpuWaitTime() const { return mAverageCpuWaitTime; }
+	inline uint64_t BlockedFrames() const { return mBlockedFrames; }
+
+	// Advances to the next frame's context and begins it. Waits only if the GPU hasn't finished
+	// the frame that was submitted N frames ago.
+	CommandContext& BeginFrame();
+
+	void InspectorGui();
+};
+
+}
@@ -39,6 +39,7 @@ std::string getExecutableDir() {
 
 weak_ref<Device> Gui::mDevice = {};
 vk::raii::RenderPass Gui::mRenderPass = nullptr;
+vk::raii::RenderPass Gui::mClearRenderPass = nullptr;
 uint32_t Gui::mQueueFamily = 0;
 std::unordered_map<vk::Image, vk::raii::Framebuffer> Gui::mFramebuffers = {};
 std::shared_ptr<vk::raii::DescriptorPool> Gui::mImGuiDescriptorPool = {};
@@ -240,6 +241,12 @@ void Gui::Initialize(CommandContext& context, const Window& window, const Swapch
 		.pAttachments = &attachment,
 		.subpassCount = 1,
 		.pSubpasses = &subpass });
+	attachment.loadOp = vk::AttachmentLoadOp::eClear;
+	mClearRenderPass = vk::raii::RenderPass(**device, vk::RenderPassCreateInfo{
+		.attachmentCount = 1,
+		.pAttachments = &attachment,
+		.subpassCount = 1,
+		.pSubpasses = &subpass });
 
 	std::vector<vk::DescriptorPoolSize> poolSizes {
 		vk::DescriptorPoolSize{ vk::DescriptorType::eSampler,              std::min(1024u, device->Limits().maxDescriptorSetSamplers) },
@@ -299,6 +306,7 @@ void Gui::Destroy() {
 		ImPlot::DestroyContext();
 		ImGui::DestroyContext();
 		mRenderPass.clear();
+		mClearRenderPass.clear();
 		mFramebuffers.clear();
 		mFrameTextures.clear();
 		mTextureIDs.clear();
@@ -306,6 +314,13 @@ void Gui::Destroy() {
 	}
 }
 
+void Gui::ReleaseFramebuffers() {
+	if (mFramebuffers.empty()) return;
+	if (auto device = mDevice.lock())
+		device->DeferDestroy(std::move(mFramebuffers));
+	mFramebuffers.clear();
+}
+
 void Gui::NewFrame() {
 	ImGui_ImplGlfw_NewFrame();
 	ImGui_ImplVulkan_NewFrame();
@@ -313,10 +328,13 @@ void Gui::NewFrame() {
 	ImGuizmo::BeginFrame();
 }
 
-void Gui::Render(CommandContext& context, const ImageView& renderTarget) {
+void Gui::Render(CommandContext& context, const ImageView& renderTarget, const std::optional<vk::ClearColorValue>& clearColor) {
 	ImGui::Render();
 	ImDrawData* drawData = ImGui::GetDrawData();
-	if (drawData->DisplaySize.x <= 0.0f || drawData->DisplaySize.y <= 0.0f) return;
+	if (drawData->DisplaySize.x <= 0.0f || drawData->DisplaySize.y <= 0.0f) {
+		if (clearColor) context.ClearColor(renderTarget, *clearColor);
+		return;
+	}
 
 	const vk::Extent2D extent {
 		.width  = (uint32_t)drawData->DisplaySize.x,
@@ -347,17 +365,25 @@ void Gui::Render(CommandContext& context, const ImageView& renderTarget) {
 
 	// render gui
 
+	if (clearColor) {
+		// the previous contents are cleared, so transition from an undefined layout
+		const Image::ResourceState& prev = renderTarget.GetImage()->GetSubresourceState(0, 0);
+		renderTarget.SetState(Image::ResourceState{ vk::ImageLayout::eUndefined, prev.stage, prev.access, prev.queueFamily });
+	}
 	context.AddBarrier(renderTarget, Image::ResourceState{
 		.layout = vk::ImageLayout::eColorAttachmentOptimal,
 		.stage  = vk::PipelineStageFlagBits2::eColorAttachmentOutput,
 		.access = vk::AccessFlagBits2::eColorAttachmentRead|vk::AccessFlagBits2::eColorAttachmentWrite,
 		.queueFamily = context.QueueFamily() });
 	context.ExecuteBarriers();
+	const vk::ClearValue clearValue = clearColor.value_or(vk::ClearColorValue{});
 	context->beginRenderPass(
 		vk::RenderPassBeginInfo{
-			.renderPass = *mRenderPass,
+			.renderPass = clearColor ? *mClearRenderPass : *mRenderPass,
 			.framebuffer = framebuffer,
-			.renderArea = vk::Rect2D{ {0,0}, extent } },
+			.renderArea = vk::Rect2D{ {0,0}, extent },
+			.clearValueCount = clearColor ? 1u : 0u,
+			.pClearValues = &clearValue },
 		vk::SubpassContents::eInline);
 
 	// Record dear imgui primitives into command buffer
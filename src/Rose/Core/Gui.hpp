@@ -130,16 +130,20 @@ public:
 
 	static void Initialize(CommandContext& context, const Window& window, const Swapchain& swapchain, const uint32_t queueFamily);
 	static void Destroy();
+	// Releases framebuffers of old swapchain images, once the GPU is done with them
+	static void ReleaseFramebuffers();
 
 	static void NewFrame();
 
-	// converts renderTarget to ColorAttachmentOptimal before rendering
-	static void Render(CommandContext& context, const ImageView& renderTarget);
+	// converts renderTarget to ColorAttachmentOptimal before rendering. If clearColor is set, renderTarget
+	// is cleared by the render pass instead of being loaded.
+	static void Render(CommandContext& context, const ImageView& renderTarget, const std::optional<vk::ClearColorValue>& clearColor = std::nullopt);
 
 private:
 	static weak_ref<Device> mDevice;
 
 	static vk::raii::RenderPass mRenderPass;
+	static vk::raii::RenderPass mClearRenderPass; // compatible with mRenderPass, but clears instead of loading
 	static uint32_t mQueueFamily;
 	static std::unordered_map<vk::Image, vk::raii::Framebuffer> mFramebuffers;
 	static std::shared_ptr<vk::raii::DescriptorPool> mImGuiDescriptorPool;
@@ -1,27 +1,187 @@
 #pragma once
 
+#include <array>
+#include <bit>
+#include <cstring>
 #include <variant>
 #include <ranges>
 #include <vulkan/vulkan_hash.hpp>
 
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
 namespace RoseEngine {
 
 template<typename T> concept hashable = requires(T v) { { std::hash<T>()(v) } -> std::convertible_to<size_t>; };
 
+// 64-bit hash of a byte range, in the style of XXH3: inputs up to 128 bytes are mixed with a few 128-bit multiplies,
+// longer inputs are accumulated over 64 byte stripes in 8 independent lanes, which compilers vectorize (SSE2/AVX2/NEON).
+// Values are not compatible with the reference xxh3. They only depend on the bytes and the seed (no per-process state or
+// std::hash), so they may be persisted, e.g. in cache file names, as long as kHashBytesVersion is part of what is persisted.
+// Assumes a little-endian host.
+namespace hash_detail {
+
+inline constexpr uint64_t kPrime32_1 = 0x9E3779B1u;
+inline constexpr uint64_t kPrime64_1 = 0x9E3779B185EBCA87ull;
+inline constexpr uint64_t kPrime64_2 = 0xC2B2AE3D27D4EB4Full;
+inline constexpr uint64_t kPrime64_3 = 0x165667B19E3779F9ull;
+
+// splitmix64 sequence, used as the secret key material
+inline constexpr std::array<uint64_t, 16> kSecret = []() {
+	std::array<uint64_t, 16> secret = {};
+	uint64_t x = 0x9E3779B97F4A7C15ull;
+	for (uint64_t& s : secret) {
+		x += 0x9E3779B97F4A7C15ull;
+		uint64_t z = x;
+		z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+		z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+		s = z ^ (z >> 31);
+	}
+	return secret;
+}();
+
+inline uint64_t Read64(const uint8_t* p) { uint64_t v; std::memcpy(&v, p, sizeof(v)); return v; }
+inline uint64_t Read32(const uint8_t* p) { uint32_t v; std::memcpy(&v, p, sizeof(v)); return v; }
+
+inline uint64_t Mul128Fold64(const uint64_t a, const uint64_t b) {
+#if defined(__SIZEOF_INT128__)
+	const __uint128_t r = (__uint128_t)a * b;
+	return uint64_t(r) ^ uint64_t(r >> 64);
+#elif defined(_MSC_VER) && defined(_M_X64)
+	uint64_t hi;
+	const uint64_t lo = _umul128(a, b, &hi);
+	return lo ^ hi;
+#else
+	const uint64_t lolo = (a & 0xFFFFFFFF) * (b & 0xFFFFFFFF);
+	const uint64_t hilo = (a >> 32)        * (b & 0xFFFFFFFF);
+	const uint64_t lohi = (a & 0xFFFFFFFF) * (b >> 32);
+	const uint64_t hihi = (a >> 32)        * (b >> 32);
+	const uint64_t cross = (lolo >> 32) + (hilo & 0xFFFFFFFF) + lohi;
+	const uint64_t upper = (hilo >> 32) + (cross >> 32) + hihi;
+	const uint64_t lower = (cross << 32) | (lolo & 0xFFFFFFFF);
+	return lower ^ upper;
+#endif
+}
+
+constexpr uint64_t Avalanche(uint64_t h) {
+	h ^= h >> 37;
+	h *= kPrime64_3;
+	h ^= h >> 32;
+	return h;
+}
+
+inline uint64_t Mix16(const uint8_t* p, const size_t secretIndex, const uint64_t seed) {
+	return Mul128Fold64(
+		Read64(p)     ^ (kSecret[secretIndex]     + seed),
+		Read64(p + 8) ^ (kSecret[secretIndex + 1] - seed));
+}
+
+inline uint64_t HashShort(const uint8_t* p, const size_t len, const uint64_t seed) {
+	if (len > 8) {
+		const uint64_t lo = Read64(p)           ^ (kSecret[0] + seed);
+		const uint64_t hi = Read64(p + len - 8) ^ (kSecret[1] - seed);
+		return Avalanche(len + std::byteswap(lo) + hi + Mul128Fold64(lo, hi));
+	}
+	if (len >= 4) {
+		const uint64_t v = (Read32(p) << 32) | Read32(p + len - 4);
+		return Avalanche(Mul128Fold64(v ^ (kSecret[2] + seed), kPrime64_1 + (len << 2)));
+	}
+	if (len > 0) {
+		const uint64_t v = (uint64_t(p[0]) << 16) | (uint64_t(p[len >> 1]) << 24) | uint64_t(p[len - 1]) | (uint64_t(len) << 8);
+		return Avalanche((v ^ (kSecret[3] + seed)) * kPrime64_1);
+	}
+	return Avalanche(seed ^ kSecret[4]);
+}
+
+inline uint64_t HashMedium(const uint8_t* p, const size_t len, const uint64_t seed) {
+	// mix 16 byte blocks from both ends towards the middle
+	uint64_t acc = len * kPrime64_1;
+	const size_t pairs = (len + 31) / 32;
+	for (size_t i = 0; i < pairs; i++) {
+		acc += Mix16(p + 16 * i,            (2 * i) % 14,     seed);
+		acc += Mix16(p + len - 16 * (i + 1), (2 * i + 1) % 14, seed);
+	}
+	return Avalanche(acc);
+}
+
+inline uint64_t HashLong(const uint8_t* p, const size_t len, const uint64_t seed) {
+	constexpr size_t kStripe = 64;
+	constexpr size_t kStripesPerBlock = 16;
+
+	std::array<uint64_t, 8> keys;
+	for (size_t i = 0; i < 8; i++)
+		keys[i] = kSecret[i] + ((i & 1) ? -seed : seed);
+
+	std::array<uint64_t, 8> acc = { kPrime32_1, kPrime64_1, kPrime64_2, kPrime64_3, kSecret[8], kSecret[9], kSecret[10], kSecret[11] };
+
+	// 32x32->64 multiplies in independent lanes, the same shape as XXH3's accumulate_512
+	auto accumulate = [&](const uint8_t* stripe) {
+		for (size_t i = 0; i < 8; i++) {
+			const uint64_t data = Read64(stripe + 8 * i);
+			const uint64_t key  = data ^ keys[i];
+			acc[i ^ 1] += data;
+			acc[i]     += (key & 0xFFFFFFFF) * (key >> 32);
+		}
+	};
+	auto scramble = [&]() {
+		for (size_t i = 0; i < 8; i++) {
+			acc[i] ^= acc[i] >> 47;
+			acc[i] ^= kSecret[8 + i];
+			acc[i] *= kPrime32_1;
+		}
+	};
+
+	const size_t stripes = (len - 1) / kStripe;
+	for (size_t s = 0; s < stripes; s++) {
+		accumulate(p + s * kStripe);
+		if ((s + 1) % kStripesPerBlock == 0)
+			scramble();
+	}
+	// the last stripe overlaps the previous one, so every byte is read
+	accumulate(p + len - kStripe);
+
+	uint64_t h = len * kPrime64_1;
+	for (size_t i = 0; i < 8; i += 2)
+		h += Mul128Fold64(acc[i] ^ kSecret[12 + i / 2], acc[i + 1] ^ kSecret[(12 + i / 2 + 1) % 16]);
+	return Avalanche(h);
+}
+
+}
+
+// bump whenever HashBytes' values change, which invalidates everything persisted with them. tests/Hash pins the current values.
+inline constexpr uint32_t kHashBytesVersion = 1;
+
+inline uint64_t HashBytes(const void* data, const size_t size, const uint64_t seed = 0) {
+	const uint8_t* p = reinterpret_cast<const uint8_t*>(data);
+	if (size <= 16)  return hash_detail::HashShort(p, size, seed);
+	if (size <= 128) return hash_detail::HashMedium(p, size, seed);
+	return hash_detail::HashLong(p, size, seed);
+}
+
+// Strong 64-bit mixer (rrmxmx). Used for combining hashes, since std::hash is the identity for integers in most standard libraries.
+// HashCombine and HashArgs go through std::hash, whose values differ between standard libraries, so they must not be persisted.
+constexpr uint64_t HashMix(uint64_t h) {
+	h ^= std::rotr(h, 49) ^ std::rotr(h, 24);
+	h *= 0x9FB21C651E98DF25ull;
+	h ^= h >> 28;
+	h *= 0x9FB21C651E98DF25ull;
+	return h ^ (h >> 28);
+}
+
 template<hashable T>
 constexpr void HashCombine(size_t& seed, T value) {
-	seed ^= (std::hash<T>{}( value ) + 0x9e3779b9 + ( seed << 6 ) + ( seed >> 2 ));
+	seed = (size_t)HashMix(seed + 0x9E3779B97F4A7C15ull + (uint64_t)std::hash<T>{}( value ));
 }
 
 template<hashable Tx, hashable... Ty>
 constexpr size_t HashArgs(const Tx& x, const Ty&... y) {
-	std::hash<Tx> hasher;
 	if constexpr (sizeof...(Ty) == 0)
-		return hasher(x);
+		return std::hash<Tx>{}(x);
 	else {
 		size_t seed = 0;
-		HashCombine(seed, hasher(x));
-		HashCombine(seed, HashArgs<Ty...>(y...));
+		HashCombine(seed, x);
+		(HashCombine(seed, y), ...);
 		return seed;
 	}
 }
@@ -38,14 +198,19 @@ constexpr size_t HashArray(const T(& arr)[N]) {
 		return HashArgs(HashArray<T,N-1>(arr), hasher(arr[N-1]));
 }
 
+// Contiguous ranges of types without padding or multiple representations (integers, enums, flags) are hashed as bytes
 template<std::ranges::range R> requires(hashable<std::ranges::range_value_t<R>>)
 inline size_t HashRange(const R& r) {
-	std::hash<std::ranges::range_value_t<R>> hasher;
-	size_t seed = 0;
-	for (const auto& elem : r) {
-		HashCombine(seed, elem);
+	using T = std::ranges::range_value_t<R>;
+	if constexpr (std::ranges::contiguous_range<R> && std::ranges::sized_range<R> && std::has_unique_object_representations_v<T>) {
+		return (size_t)HashBytes(std::ranges::data(r), std::ranges::size(r) * sizeof(T));
+	} else {
+		size_t seed = 0;
+		for (const auto& elem : r) {
+			HashCombine(seed, elem);
+		}
+		return seed;
 	}
-	return seed;
 }
 
 template<hashable... Ts>
@@ -64,7 +229,7 @@ struct PairHash {
 template<hashable... Types>
 struct TupleHash {
 	inline size_t operator()(const std::tuple<Types...>& v) const {
-		return HashArgs<Types...>(std::get<Types>(v)...);
+		return std::apply([](const Types&... x) { return HashArgs<Types...>(x...); }, v);
 	}
 };
 
@@ -88,4 +253,4 @@ using PairMap = std::unordered_map<std::pair<T0, T1>, Ty, PairHash<T0, T1>>;
 template<typename Ty, hashable... Types>
 using TupleMap = std::unordered_map<std::tuple<Types...>, Ty, TupleHash<Types...>>;
 
-}
\ No newline at end of file
+}
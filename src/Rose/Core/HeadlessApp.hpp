@@ -0,0 +1,136 @@
+#pragma once
+
+#include "Instance.hpp"
+#include "FrameScheduler.hpp"
+
+#include <iostream>
+#include <fstream>
+
+namespace RoseEngine {
+
+// Application host without a window, swapchain or gui. Used for offscreen rendering and benchmarking,
+// e.g. on render farm nodes or under lavapipe in CI.
+struct HeadlessApp {
+	ref<Instance>       instance = nullptr;
+	ref<Device>         device   = nullptr;
+	ref<FrameScheduler> frames   = nullptr;
+
+	uint32_t queueFamily = 0;
+
+	// timestamps at the start and end of each frame in flight
+	vk::raii::QueryPool timestampQueries = nullptr;
+	std::vector<bool>   timestampsWritten = {};
+
+	struct FrameTiming {
+		uint64_t frame = 0;
+		double   cpuTime = 0; // milliseconds between BeginFrame and EndFrame
+		double   cpuWaitTime = 0;
+		double   gpuTime = 0;
+	};
+	std::vector<FrameTiming> timings = {};
+	std::chrono::high_resolution_clock::time_point frameStart = {};
+
+	inline CommandContext& CurrentContext() { return frames->CurrentContext(); }
+
+	// Reads the gpu time of the frame which last used frame index, in milliseconds
+	inline double ReadGpuTime(const uint32_t index) {
+		if (!timestampsWritten[index]) return 0;
+		timestampsWritten[index] = false;
+		const auto[result, t] = timestampQueries.getResults<uint64_t>(2 * index, 2, 2 * sizeof(uint64_t), sizeof(uint64_t), vk::QueryResultFlagBits::e64);
+		if (result != vk::Result::eSuccess) return 0;
+		return double(t[1] - t[0]) * device->Limits().timestampPeriod * 1e-6;
+	}
+
+	// optionalExtensions are enabled if the device supports them
+	inline HeadlessApp(
+		const vk::ArrayProxy<const std::string>& deviceExtensions = {},
+		const vk::ArrayProxy<const std::string>& optionalExtensions = {},
+		const uint32_t framesInFlight = 2) {
+
+		instance = Instance::Create({}, { "VK_LAYER_KHRONOS_validation" });
+
+		// pick the first device with a graphics and compute queue, preferring discrete gpus.
+		// a compute-only family can't record the draws that headless renderers submit
+		vk::raii::PhysicalDevice physicalDevice = nullptr;
+		for (const auto& p : (*instance)->enumeratePhysicalDevices()) {
+			const auto families = p.getQueueFamilyProperties();
+			const vk::QueueFlags required = vk::QueueFlagBits::eGraphics | vk::QueueFlagBits::eCompute;
+			const auto it = std::ranges::find_if(families, [&](const vk::QueueFamilyProperties& f) { return (f.queueFlags & required) == required; });
+			if (it == families.end())
+				continue;
+			if (!*physicalDevice || p.getProperties().deviceType == vk::PhysicalDeviceType::eDiscreteGpu) {
+				physicalDevice = p;
+				queueFamily = (uint32_t)std::distance(families.begin(), it);
+			}
+		}
+		if (!*physicalDevice)
+			throw std::runtime_error("No device with a graphics queue");
+
+		std::cout << "Using " << physicalDevice.getProperties().deviceName.data() << std::endl;
+
+		device = Device::Create(*instance, physicalDevice, deviceExtensions, optionalExtensions);
+		frames = FrameScheduler::Create(device, queueFamily, framesInFlight);
+
+		timestampQueries = (*device)->createQueryPool(vk::QueryPoolCreateInfo{
+			.queryType  = vk::QueryType::eTimestamp,
+			.queryCount = 2 * framesInFlight });
+		timestampsWritten.resize(framesInFlight, false);
+	}
+	inline ~HeadlessApp() {
+		device->Wait();
+	}
+
+	// Begins the next frame's context. Only blocks if the cpu is more than frames->FramesInFlight() frames ahead.
+	inline CommandContext& BeginFrame() {
+		frameStart = std::chrono::high_resolution_clock::now();
+
+		CommandContext& context = frames->BeginFrame();
+		const uint32_t index = frames->FrameIndex();
+
+		// the frame which last used this index has finished, so its timestamps are available
+		if (timestampsWritten[index])
+			timings[frames->FrameCount() - 1 - frames->FramesInFlight()].gpuTime = ReadGpuTime(index);
+
+		context->resetQueryPool(*timestampQueries, 2 * index, 2);
+		context->writeTimestamp2(vk::PipelineStageFlagBits2::eTopOfPipe, *timestampQueries, 2 * index);
+		return context;
+	}
+
+	// Submits the current frame. Returns the timeline value signalled once it finishes.
+	inline uint64_t EndFrame() {
+		CommandContext& context = frames->CurrentContext();
+		const uint32_t index = frames->FrameIndex();
+
+		context->writeTimestamp2(vk::PipelineStageFlagBits2::eBottomOfPipe, *timestampQueries, 2 * index + 1);
+		timestampsWritten[index] = true;
+
+		const uint64_t value = context.Submit();
+
+		timings.emplace_back(FrameTiming{
+			.frame = frames->FrameCount() - 1,
+			.cpuTime = std::chrono::duration_cast<std::chrono::duration<double, std::milli>>(std::chrono::high_resolution_clock::now() - frameStart).count(),
+			.cpuWaitTime = frames->CpuWaitTime() });
+
+		return value;
+	}
+
+	// Waits for all frames, so every timing has its gpu time
+	inline void Flush() {
+		device->Wait();
+		for (uint32_t i = 0; i < frames->FramesInFlight() && i < timings.size(); i++) {
+			const uint64_t frame = timings.size() - 1 - i;
+			const uint32_t index = (frames->FrameIndex() + frames->FramesInFlight() - i) % frames->FramesInFlight();
+			if (timestampsWritten[index])
+				timings[frame].gpuTime = ReadGpuTime(index);
+		}
+	}
+
+	inline void WriteTimings(const std::filesystem::path& path) const {
+		std::ofstream file(path);
+		file << "frame,cpu_ms,cpu_wait_ms,gpu_ms" << std::endl;
+		for (const FrameTiming& t : timings)
+			file << t.frame << "," << t.cpuTime << "," << t.cpuWaitTime << "," << t.gpuTime << std::endl;
+	}
+};
+
+}
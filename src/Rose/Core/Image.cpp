@@ -16,7 +16,7 @@ std::vector<std::vector<Image::ResourceState>> CreateSubresourceStates(const Ima
 				.queueFamily = info.queueFamilies.empty() ? VK_QUEUE_FAMILY_IGNORED : info.queueFamilies.front() }));
 }
 
-ref<Image> Image::Create(Device& device, const ImageInfo& info, const vk::MemoryPropertyFlags memoryFlags, const VmaAllocationCreateFlags allocationFlags) {
+ref<Image> Image::Create(Device& device, const ImageInfo& info, const vk::MemoryPropertyFlags memoryFlags, const VmaAllocationCreateFlags allocationFlags, const MemoryCategory category) {
 	VmaAllocationCreateInfo allocationCreateInfo {
 		.flags = allocationFlags,
 		.usage = VMA_MEMORY_USAGE_AUTO,
@@ -40,9 +40,23 @@ ref<Image> Image::Create(Device& device, const ImageInfo& info, const vk::Memory
 		.initialLayout = vk::ImageLayout::eUndefined };
 	createInfo.setQueueFamilyIndices(info.queueFamilies);
 
+	if (category != MemoryCategory::eUncategorized) {
+		allocationCreateInfo.flags = Device::GetAllocationFlags(category, allocationCreateInfo.flags);
+		uint32_t memoryTypeIndex;
+		if (vmaFindMemoryTypeIndexForImageInfo(device.MemoryAllocator(), &(const VkImageCreateInfo&)createInfo, &allocationCreateInfo, &memoryTypeIndex) == VK_SUCCESS)
+			allocationCreateInfo.pool = device.GetMemoryPool(category, memoryTypeIndex);
+	}
+
 	VkImage vkimg;
 	VmaAllocation alloc;
-	vk::Result result = (vk::Result)vmaCreateImage(device.MemoryAllocator(), &(const VkImageCreateInfo&)createInfo, &allocationCreateInfo, &vkimg, &alloc, nullptr);
+	VmaAllocationInfo allocInfo;
+	vk::Result result = (vk::Result)vmaCreateImage(device.MemoryAllocator(), &(const VkImageCreateInfo&)createInfo, &allocationCreateInfo, &vkimg, &alloc, &allocInfo);
+	if (result != vk::Result::eSuccess && allocationCreateInfo.pool != VK_NULL_HANDLE) {
+		// category pools can't hold allocations larger than their block size, or ones which need dedicated memory
+		allocationCreateInfo.pool = VK_NULL_HANDLE;
+		allocationCreateInfo.flags |= VMA_ALLOCATION_CREATE_DEDICATED_MEMORY_BIT;
+		result = (vk::Result)vmaCreateImage(device.MemoryAllocator(), &(const VkImageCreateInfo&)createInfo, &allocationCreateInfo, &vkimg, &alloc, &allocInfo);
+	}
 	if (result != vk::Result::eSuccess) {
 		std::cerr << "Failed to create image: " << vk::to_string(result) << std::endl;
 		return nullptr;
@@ -55,6 +69,10 @@ ref<Image> Image::Create(Device& device, const ImageInfo& info, const vk::Memory
 	image->mAllocation = alloc;
 	image->mInfo = info;
 	image->mSubresourceStates = CreateSubresourceStates(info);
+	image->mParent = &device;
+	image->mCategory = category;
+	image->mAllocationSize = allocInfo.size;
+	device.MemoryCounters(category).Add(allocInfo.size);
 	return image;
 }
 ref<Image> Image::Create(const vk::Device device, const vk::Image vkimage, const ImageInfo& info) {
@@ -67,29 +85,89 @@ ref<Image> Image::Create(const vk::Device device, const vk::Image vkimage, const
 	image->mSubresourceStates = CreateSubresourceStates(info);
 	return image;
 }
+ref<Image> Image::CreateAliased(Device& device, const ImageInfo& info) {
+	vk::ImageCreateInfo createInfo{
+		.flags       = info.createFlags | vk::ImageCreateFlagBits::eAlias,
+		.imageType   = info.type,
+		.format      = info.format,
+		.extent      = vk::Extent3D{info.extent.x, info.extent.y, info.extent.z},
+		.mipLevels   = info.mipLevels,
+		.arrayLayers = info.arrayLayers,
+		.samples     = info.samples,
+		.tiling      = info.tiling,
+		.usage       = info.usage,
+		.sharingMode = info.sharingMode,
+		.initialLayout = vk::ImageLayout::eUndefined };
+	createInfo.setQueueFamilyIndices(info.queueFamilies);
+
+	vk::Image vkimg;
+	vk::Result result = vk::Device(**device).createImage(&createInfo, nullptr, &vkimg);
+	if (result != vk::Result::eSuccess) {
+		std::cerr << "Failed to create image: " << vk::to_string(result) << std::endl;
+		return nullptr;
+	}
+
+	auto image = make_ref<Image>();
+	image->mImage = vkimg;
+	image->mDevice = **device;
+	image->mMemoryAllocator = device.MemoryAllocator();
+	image->mAllocation = nullptr;
+	image->mInfo = info;
+	image->mAliased = true;
+	image->mSubresourceStates = CreateSubresourceStates(info);
+	return image;
+}
 Image::~Image() {
 	for (auto[key, v] : mCachedViews)
 		mDevice.destroyImageView(v);
+	if (mParent && mAllocation)
+		mParent->MemoryCounters(mCategory).Remove(mAllocationSize);
 	if (mMemoryAllocator && mImage && mAllocation) {
 		vmaDestroyImage(mMemoryAllocator, mImage, mAllocation);
 		mMemoryAllocator = nullptr;
 		mImage = nullptr;
 		mAllocation = nullptr;
+	} else if (mAliased && mImage) {
+		mDevice.destroyImage(mImage);
+		mImage = nullptr;
+	}
+}
+
+vk::MemoryRequirements Image::GetMemoryRequirements() const {
+	return mDevice.getImageMemoryRequirements(mImage);
+}
+void Image::SetMemoryCategory(const MemoryCategory category) {
+	if (!mParent || !mAllocation || category == mCategory) return;
+	mParent->MemoryCounters(mCategory).Remove(mAllocationSize);
+	mParent->MemoryCounters(category).Add(mAllocationSize);
+	mCategory = category;
+}
+bool Image::BindMemory(const VmaAllocation allocation, const vk::DeviceSize offset) {
+	if (!mAliased) {
+		std::cerr << "Failed to bind image memory: image is not aliased" << std::endl;
+		return false;
+	}
+	vk::Result result = (vk::Result)vmaBindImageMemory2(mMemoryAllocator, allocation, offset, mImage, nullptr);
+	if (result != vk::Result::eSuccess) {
+		std::cerr << "Failed to bind image memory: " << vk::to_string(result) << std::endl;
+		return false;
 	}
+	return true;
 }
 
-ImageView ImageView::Create(const ref<Image>& image, const vk::ImageSubresourceRange& subresource, const vk::ImageViewType type, const vk::ComponentMapping& componentMapping) {
+ImageView ImageView::Create(const ref<Image>& image, const vk::ImageSubresourceRange& subresource, const vk::ImageViewType type, const vk::ComponentMapping& componentMapping, const vk::Format format) {
 	if (!image) return {};
 	vk::ImageSubresourceRange s = subresource;
 	if (s.layerCount == VK_REMAINING_ARRAY_LAYERS) s.layerCount = image->Info().arrayLayers;
 	if (s.levelCount == VK_REMAINING_MIP_LEVELS)   s.levelCount = image->Info().mipLevels;
-	auto key = std::tie(s, type, componentMapping);
+	const vk::Format f = format == vk::Format::eUndefined ? image->Info().format : format;
+	auto key = std::tie(s, type, componentMapping, f);
 	auto it = image->mCachedViews.find(key);
 	if (it == image->mCachedViews.end()) {
 		vk::ImageView v = image->mDevice.createImageView(vk::ImageViewCreateInfo{
 			.image = **image,
 			.viewType = type,
-			.format = image->Info().format,
+			.format = f,
 			.components = componentMapping,
 			.subresourceRange = s });
 		it = image->mCachedViews.emplace(key, v).first;
@@ -99,7 +177,8 @@ ImageView ImageView::Create(const ref<Image>& image, const vk::ImageSubresourceR
 		.mImage = image,
 		.mSubresource = s,
 		.mType = type,
-		.mComponentMapping = componentMapping
+		.mComponentMapping = componentMapping,
+		.mFormat = f
 	};
 }
 
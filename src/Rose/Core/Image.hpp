@@ -25,6 +25,10 @@ inline constexpr bool IsDepthStencil(vk::Format format) {
 		format == vk::Format::eD32SfloatS8Uint;
 }
 
+inline constexpr bool IsBlockCompressed(vk::Format format) {
+	return format >= vk::Format::eBc1RgbUnormBlock && format <= vk::Format::eBc7SrgbBlock;
+}
+
 // Size of an element of format, in bytes
 template<typename T = uint32_t> requires(std::is_arithmetic_v<T>)
 inline constexpr T GetTexelSize(vk::Format format) {
@@ -343,9 +347,40 @@ struct PixelData {
 	BufferView data     = {};
 	vk::Format format   = {};
 	uint3 extent = {};
+	uint32_t mipLevels   = 1; // stored mip levels
+	uint32_t arrayLayers = 1; // 6 per cube for cubemaps
+	bool     cubemap = false;
+	bool     flipY   = false; // rows are stored bottom to top, so v must be flipped when sampling
+	vk::ComponentMapping components = {}; // view swizzle, for channels that are stored in a different place than they are sampled from
+	std::vector<vk::BufferImageCopy> regions = {}; // one per stored level and layer, with offsets relative to data. empty if data is only the first level.
+};
+// Image decoded to host memory. Decoding records no commands, so it can run on worker threads.
+struct HostPixelData {
+	std::vector<std::byte> bytes  = {};
+	PixelData              pixels = {}; // pixels.data is unset until bytes are uploaded
 };
 class CommandContext;
-PixelData LoadImageFile(CommandContext& context, const std::filesystem::path& filename, const bool srgb = true, int desiredChannels = 0);
+class Device;
+// compress block compresses 8 bit images on the CPU (see CompressImageFile), and .exr/.hdr files to BC6H (see CompressHdrImage).
+// .exr and .hdr files are memory mapped and loaded as half floats (see DecodeExr).
+PixelData LoadImageFile(CommandContext& context, const std::filesystem::path& filename, const bool srgb = true, int desiredChannels = 0, const bool compress = false);
+// Decodes an image file in memory with stb (png, jpg, hdr, ...). Returns empty data if the file can't be decoded.
+// Grey (and grey+alpha) images are stored in r (and g), with components set so they sample as grey.
+HostPixelData DecodeImage(const std::span<const std::byte> file, const bool srgb = true, int desiredChannels = 0);
+// Decodes an OpenEXR file in memory to half floats: R16G16B16A16_SFLOAT if the file has alpha or rgba is set, otherwise
+// R16G16B16_SFLOAT. Half channels are copied, float channels are converted (clamped to the half range, NaNs become 0).
+// A single unnamed channel (e.g. Y) is replicated to RGB. Throws on invalid or multipart files.
+HostPixelData DecodeExr(const std::span<const std::byte> file, const bool rgba = false);
+// Decodes a Radiance .hdr file in memory to R16G16B16_SFLOAT, or R16G16B16A16_SFLOAT with opaque alpha if rgba is set
+HostPixelData DecodeHdr(const std::span<const std::byte> file, const bool rgba = false);
+// Decodes a KTX2 container with every stored level. Basis Universal (ETC1S/UASTC) payloads are transcoded to BC4/BC5/BC7
+// if the device supports BC textures, otherwise to RGBA8. Requires libktx (ENABLE_KTX).
+HostPixelData DecodeKtx2(const Device& device, const std::span<const std::byte> file);
+// Creates an image for d and copies every stored level and layer into it. If only the first level is stored,
+// the rest are generated with blits, unless the format is block compressed.
+ImageView UploadImage(CommandContext& context, const PixelData& d, const bool generateMips = true);
+// Writes 8 bit pixels to a png file
+void SavePngFile(const std::filesystem::path& filename, const uint2 extent, const uint32_t channels, const void* pixels);
 
 struct ImageInfo {
 	vk::ImageCreateFlags    createFlags   = {};
@@ -378,17 +413,29 @@ private:
 	VmaAllocator  mMemoryAllocator = nullptr;
 	VmaAllocation mAllocation = nullptr;
 	ImageInfo     mInfo = {};
+	bool          mAliased = false; // image is bound to memory owned by someone else
+	const Device* mParent = nullptr; // for memory accounting
+	MemoryCategory mCategory = MemoryCategory::eUncategorized;
+	vk::DeviceSize mAllocationSize = 0;
 
 	friend struct ImageView;
-	TupleMap<vk::ImageView, vk::ImageSubresourceRange, vk::ImageViewType, vk::ComponentMapping> mCachedViews = {};
+	TupleMap<vk::ImageView, vk::ImageSubresourceRange, vk::ImageViewType, vk::ComponentMapping, vk::Format> mCachedViews = {};
 
 	std::vector<std::vector<ResourceState>> mSubresourceStates = {}; // mSubresourceStates[arrayLayer][mipLevel]
 
 public:
-	static ref<Image> Create(Device& device, const ImageInfo& info, const vk::MemoryPropertyFlags memoryFlags = vk::MemoryPropertyFlagBits::eDeviceLocal, const VmaAllocationCreateFlags allocationFlags = VMA_ALLOCATION_CREATE_STRATEGY_MIN_MEMORY_BIT);
+	static ref<Image> Create(Device& device, const ImageInfo& info, const vk::MemoryPropertyFlags memoryFlags = vk::MemoryPropertyFlagBits::eDeviceLocal, const VmaAllocationCreateFlags allocationFlags = VMA_ALLOCATION_CREATE_STRATEGY_MIN_MEMORY_BIT, const MemoryCategory category = MemoryCategory::eUncategorized);
 	static ref<Image> Create(const vk::Device device, const vk::Image image, const ImageInfo& info);
+	// Creates an image without any memory bound to it. Memory must be bound with BindMemory before the image is used.
+	static ref<Image> CreateAliased(Device& device, const ImageInfo& info);
 	~Image();
 
+	vk::MemoryRequirements GetMemoryRequirements() const;
+	// Size of the memory owned by this image. Zero for aliased and swapchain images.
+	inline vk::DeviceSize MemorySize() const { return mAllocationSize; }
+	// Binds an aliased image to allocation at offset. The allocation is not owned by the image.
+	bool BindMemory(const VmaAllocation allocation, const vk::DeviceSize offset);
+
 	inline       vk::Image& operator*()        { return mImage; }
 	inline const vk::Image& operator*() const  { return mImage; }
 	inline       vk::Image* operator->()       { return &mImage; }
@@ -399,10 +446,19 @@ public:
 	inline operator bool() const { return mImage; }
 
 	inline const ImageInfo& Info() const { return mInfo; }
+	inline MemoryCategory Category() const { return mCategory; }
+
+	// Moves this image's bytes to category's counters. The image stays in the pool it was allocated from.
+	void SetMemoryCategory(const MemoryCategory category);
 
 	inline const ResourceState& GetSubresourceState(const uint32_t arrayLayer, const uint32_t level) const {
 		return mSubresourceStates[arrayLayer][level];
 	}
+	// Overwrites the state of every subresource without emitting barriers. Used to discard contents, e.g. when memory is aliased.
+	inline void ResetSubresourceStates(const ResourceState& state) {
+		for (auto& layer : mSubresourceStates)
+			std::ranges::fill(layer, state);
+	}
 	inline std::vector<vk::ImageMemoryBarrier2> SetSubresourceState(const vk::ImageSubresourceRange& subresource, const ResourceState& newState) {
 		std::vector<vk::ImageMemoryBarrier2> barriers;
 
@@ -472,8 +528,10 @@ struct ImageView {
 	vk::ImageSubresourceRange mSubresource = { vk::ImageAspectFlagBits::eColor, 0, VK_REMAINING_MIP_LEVELS, 0, VK_REMAINING_ARRAY_LAYERS };
 	vk::ImageViewType         mType = vk::ImageViewType::e2D;
 	vk::ComponentMapping      mComponentMapping = {};
+	vk::Format                mFormat = {};
 
-	static ImageView Create(const ref<Image>& image, const vk::ImageSubresourceRange& subresource = { vk::ImageAspectFlagBits::eColor, 0, VK_REMAINING_MIP_LEVELS, 0, VK_REMAINING_ARRAY_LAYERS }, const vk::ImageViewType type = vk::ImageViewType::e2D, const vk::ComponentMapping& componentMapping = {});
+	// format defaults to the image's format. Other formats require an image created with eMutableFormat.
+	static ImageView Create(const ref<Image>& image, const vk::ImageSubresourceRange& subresource = { vk::ImageAspectFlagBits::eColor, 0, VK_REMAINING_MIP_LEVELS, 0, VK_REMAINING_ARRAY_LAYERS }, const vk::ImageViewType type = vk::ImageViewType::e2D, const vk::ComponentMapping& componentMapping = {}, const vk::Format format = vk::Format::eUndefined);
 
 	inline       vk::ImageView& operator*()        { return mView; }
 	inline const vk::ImageView& operator*() const  { return mView; }
@@ -1,5 +1,8 @@
 #include "Image.hpp"
 #include "CommandContext.hpp"
+#include "TextureCompression.hpp"
+#include "MappedFile.hpp"
+#include <Rose/Downsample/Downsample.hpp>
 
 #define STB_IMAGE_IMPLEMENTATION
 #define STB_IMAGE_WRITE_IMPLEMENTATION
@@ -14,6 +17,14 @@
 #define TINYDDSLOADER_IMPLEMENTATION
 #include <tinyddsloader.h>
 
+#ifdef ENABLE_KTX
+#include <ktx.h>
+#endif
+
+#include <glm/gtc/packing.hpp>
+
+#include <fstream>
+
 namespace RoseEngine {
 
 inline vk::Format dxgiToVulkan(tinyddsloader::DDSFile::DXGIFormat format, const bool alphaFlag) {
@@ -35,6 +46,15 @@ inline vk::Format dxgiToVulkan(tinyddsloader::DDSFile::DXGIFormat format, const
 		case tinyddsloader::DDSFile::DXGIFormat::BC4_SNorm:       return vk::Format::eBc4SnormBlock;
 		case tinyddsloader::DDSFile::DXGIFormat::BC5_UNorm:       return vk::Format::eBc5UnormBlock;
 		case tinyddsloader::DDSFile::DXGIFormat::BC5_SNorm:       return vk::Format::eBc5SnormBlock;
+		case tinyddsloader::DDSFile::DXGIFormat::BC6H_UF16:       return vk::Format::eBc6HUfloatBlock;
+		case tinyddsloader::DDSFile::DXGIFormat::BC6H_SF16:       return vk::Format::eBc6HSfloatBlock;
+		case tinyddsloader::DDSFile::DXGIFormat::BC7_UNorm:       return vk::Format::eBc7UnormBlock;
+		case tinyddsloader::DDSFile::DXGIFormat::BC7_UNorm_SRGB:  return vk::Format::eBc7SrgbBlock;
+
+		case tinyddsloader::DDSFile::DXGIFormat::R8_UNorm:            return vk::Format::eR8Unorm;
+		case tinyddsloader::DDSFile::DXGIFormat::R8G8_UNorm:          return vk::Format::eR8G8Unorm;
+		case tinyddsloader::DDSFile::DXGIFormat::R10G10B10A2_UNorm:   return vk::Format::eA2B10G10R10UnormPack32;
+		case tinyddsloader::DDSFile::DXGIFormat::R11G11B10_Float:     return vk::Format::eB10G11R11UfloatPack32;
 
 		case tinyddsloader::DDSFile::DXGIFormat::R8G8B8A8_UNorm:      return vk::Format::eR8G8B8A8Unorm;
 		case tinyddsloader::DDSFile::DXGIFormat::R8G8B8A8_UNorm_SRGB: return vk::Format::eR8G8B8A8Srgb;
@@ -49,82 +69,434 @@ inline vk::Format dxgiToVulkan(tinyddsloader::DDSFile::DXGIFormat format, const
 		case tinyddsloader::DDSFile::DXGIFormat::R16G16B16A16_UInt:   return vk::Format::eR16G16B16A16Uint;
 		case tinyddsloader::DDSFile::DXGIFormat::R16G16B16A16_UNorm:  return vk::Format::eR16G16B16A16Unorm;
 		case tinyddsloader::DDSFile::DXGIFormat::R16G16B16A16_SNorm:  return vk::Format::eR16G16B16A16Snorm;
+		case tinyddsloader::DDSFile::DXGIFormat::R16_Float:           return vk::Format::eR16Sfloat;
+		case tinyddsloader::DDSFile::DXGIFormat::R16G16_Float:        return vk::Format::eR16G16Sfloat;
+
+		case tinyddsloader::DDSFile::DXGIFormat::R32_Float:           return vk::Format::eR32Sfloat;
+		case tinyddsloader::DDSFile::DXGIFormat::R32G32_Float:        return vk::Format::eR32G32Sfloat;
+		case tinyddsloader::DDSFile::DXGIFormat::R32G32B32A32_Float:  return vk::Format::eR32G32B32A32Sfloat;
 
 		default: return vk::Format::eUndefined;
 	}
 }
 
-PixelData LoadImageFile(CommandContext& context, const std::filesystem::path& filename, const bool srgb, int desiredChannels) {
+HostPixelData DecodeKtx2(const Device& device, const std::span<const std::byte> file) {
+#ifdef ENABLE_KTX
+	ktxTexture2* texture = nullptr;
+	KTX_error_code result = ktxTexture2_CreateFromMemory((const ktx_uint8_t*)file.data(), file.size(), KTX_TEXTURE_CREATE_LOAD_IMAGE_DATA_BIT, &texture);
+	if (result != KTX_SUCCESS)
+		throw std::runtime_error(std::string("Failed to load KTX2 data: ") + ktxErrorString(result));
+
+	if (ktxTexture2_NeedsTranscoding(texture)) {
+		// BC4/BC5 keep single and two channel data (masks, normal maps) at full precision, BC7 for everything else
+		ktx_transcode_fmt_e target = KTX_TTF_RGBA32;
+		if (device.Features().textureCompressionBC) {
+			switch (ktxTexture2_GetNumComponents(texture)) {
+				case 1:  target = KTX_TTF_BC4_R;    break;
+				case 2:  target = KTX_TTF_BC5_RG;   break;
+				default: target = KTX_TTF_BC7_RGBA; break;
+			}
+		}
+		result = ktxTexture2_TranscodeBasis(texture, target, 0);
+		if (result != KTX_SUCCESS) {
+			ktxTexture_Destroy(ktxTexture(texture));
+			throw std::runtime_error(std::string("Failed to transcode KTX2 data: ") + ktxErrorString(result));
+		}
+	}
+
+	HostPixelData d;
+	d.pixels = PixelData{
+		.format = (vk::Format)texture->vkFormat,
+		.extent = uint3(texture->baseWidth, texture->baseHeight, texture->baseDepth),
+		.mipLevels = texture->numLevels,
+		.arrayLayers = texture->numLayers * texture->numFaces,
+		.cubemap = texture->isCubemap };
+
+	const std::byte* data = (const std::byte*)ktxTexture_GetData(ktxTexture(texture));
+	d.bytes.assign(data, data + ktxTexture_GetDataSize(ktxTexture(texture)));
+
+	for (uint32_t layer = 0; layer < texture->numLayers; layer++) {
+		for (uint32_t face = 0; face < texture->numFaces; face++) {
+			for (uint32_t level = 0; level < texture->numLevels; level++) {
+				ktx_size_t offset = 0;
+				ktxTexture_GetImageOffset(ktxTexture(texture), level, layer, face, &offset);
+				d.pixels.regions.emplace_back(vk::BufferImageCopy{
+					.bufferOffset = offset,
+					.bufferRowLength = 0,
+					.bufferImageHeight = 0,
+					.imageSubresource = vk::ImageSubresourceLayers{
+						.aspectMask = vk::ImageAspectFlagBits::eColor,
+						.mipLevel = level,
+						.baseArrayLayer = layer * texture->numFaces + face,
+						.layerCount = 1 },
+					.imageOffset = { 0, 0, 0 },
+					.imageExtent = vk::Extent3D{
+						std::max(texture->baseWidth  >> level, 1u),
+						std::max(texture->baseHeight >> level, 1u),
+						std::max(texture->baseDepth  >> level, 1u) } });
+			}
+		}
+	}
+
+	ktxTexture_Destroy(ktxTexture(texture));
+
+	if (d.pixels.format == vk::Format::eUndefined)
+		throw std::runtime_error("Unsupported KTX2 format");
+	return d;
+#else
+	throw std::runtime_error("KTX2 support requires libktx");
+#endif
+}
+
+static std::vector<std::byte> ReadFile(const std::filesystem::path& filename) {
+	std::vector<std::byte> file(std::filesystem::file_size(filename));
+	std::ifstream(filename, std::ios::binary).read(reinterpret_cast<char*>(file.data()), file.size());
+	return file;
+}
+
+// Grey images (with alpha if channels is 2) are stored in r (and g), and sampled as grey
+static vk::ComponentMapping GreyComponents(const int channels) {
+	return vk::ComponentMapping{ vk::ComponentSwizzle::eR, vk::ComponentSwizzle::eR, vk::ComponentSwizzle::eR, channels == 2 ? vk::ComponentSwizzle::eG : vk::ComponentSwizzle::eOne };
+}
+
+HostPixelData DecodeImage(const std::span<const std::byte> file, const bool srgb, int desiredChannels) {
+	const stbi_uc* bytes = reinterpret_cast<const stbi_uc*>(file.data());
+	const int size = (int)file.size();
+
+	int x, y, channels;
+	if (!stbi_info_from_memory(bytes, size, &x, &y, &channels))
+		return {};
+
+	// 3 channel formats are rarely supported for sampling
+	if (channels == 3 && !desiredChannels) desiredChannels = 4;
+	const uint32_t outChannels = desiredChannels ? desiredChannels : channels;
+
+	void* pixels = nullptr;
+	vk::Format format = vk::Format::eUndefined;
+	if (stbi_is_hdr_from_memory(bytes, size)) {
+		pixels = stbi_loadf_from_memory(bytes, size, &x, &y, &channels, desiredChannels);
+		static const std::array<vk::Format, 4> formats = { vk::Format::eR32Sfloat, vk::Format::eR32G32Sfloat, vk::Format::eR32G32B32Sfloat, vk::Format::eR32G32B32A32Sfloat };
+		format = formats[outChannels - 1];
+	} else if (stbi_is_16_bit_from_memory(bytes, size)) {
+		pixels = stbi_load_16_from_memory(bytes, size, &x, &y, &channels, desiredChannels);
+		static const std::array<vk::Format, 4> formats = { vk::Format::eR16Unorm, vk::Format::eR16G16Unorm, vk::Format::eR16G16B16Unorm, vk::Format::eR16G16B16A16Unorm };
+		format = formats[outChannels - 1];
+	} else {
+		pixels = stbi_load_from_memory(bytes, size, &x, &y, &channels, desiredChannels);
+		static const std::array<vk::Format, 4> unormFormats = { vk::Format::eR8Unorm, vk::Format::eR8G8Unorm, vk::Format::eR8G8B8Unorm, vk::Format::eR8G8B8A8Unorm };
+		static const std::array<vk::Format, 4> srgbFormats  = { vk::Format::eR8Srgb,  vk::Format::eR8G8Srgb,  vk::Format::eR8G8B8Srgb,  vk::Format::eR8G8B8A8Srgb };
+		format = (srgb ? srgbFormats : unormFormats)[outChannels - 1];
+	}
+	if (!pixels) return {};
+
+	HostPixelData d;
+	d.pixels = PixelData{ .format = format, .extent = uint3(x, y, 1) };
+	if (!desiredChannels && channels <= 2)
+		d.pixels.components = GreyComponents(channels);
+	const std::byte* data = reinterpret_cast<const std::byte*>(pixels);
+	d.bytes.assign(data, data + size_t(x)*size_t(y)*GetTexelSize(format));
+	stbi_image_free(pixels);
+	return d;
+}
+
+static uint16_t FloatToHalf(const float f) {
+	// values beyond the half range would become infinity, and NaNs would spread through filtering
+	if (std::isnan(f)) return 0;
+	return (uint16_t)glm::packHalf1x16(std::clamp(f, -65504.f, 65504.f));
+}
+
+HostPixelData DecodeExr(const std::span<const std::byte> file, const bool rgba) {
+	const unsigned char* bytes = reinterpret_cast<const unsigned char*>(file.data());
+	const char* err = nullptr;
+	auto fail = [&](const char* what) {
+		std::string msg = std::string(what) + (err ? std::string(": ") + err : std::string());
+		if (err) FreeEXRErrorMessage(err);
+		throw std::runtime_error(msg);
+	};
+
+	EXRVersion version;
+	if (ParseEXRVersionFromMemory(&version, bytes, file.size()) != TINYEXR_SUCCESS)
+		fail("Invalid EXR file");
+	if (version.multipart || version.non_image)
+		fail("Multipart and deep EXR files are not supported");
+
+	EXRHeader header;
+	InitEXRHeader(&header);
+	if (ParseEXRHeaderFromMemory(&header, &version, bytes, file.size(), &err) != TINYEXR_SUCCESS)
+		fail("Failed to parse EXR header");
+
+	// every channel is decoded in its stored type, so half channels aren't expanded to float (tinyexr only converts half to float)
+	for (int c = 0; c < header.num_channels; c++)
+		header.requested_pixel_types[c] = header.pixel_types[c];
+
+	EXRImage image;
+	InitEXRImage(&image);
+	if (LoadEXRImageFromMemory(&image, &header, bytes, file.size(), &err) != TINYEXR_SUCCESS) {
+		FreeEXRHeader(&header);
+		fail("Failed to load EXR image");
+	}
+
+	// R, G, B and A channels, or a single luminance channel which is replicated
+	std::array<int, 4> channelIndex = { -1, -1, -1, -1 };
+	for (int c = 0; c < header.num_channels; c++) {
+		const std::string_view name = header.channels[c].name;
+		if      (name == "R") channelIndex[0] = c;
+		else if (name == "G") channelIndex[1] = c;
+		else if (name == "B") channelIndex[2] = c;
+		else if (name == "A") channelIndex[3] = c;
+	}
+	if (channelIndex[0] < 0 && channelIndex[1] < 0 && channelIndex[2] < 0) {
+		if (header.num_channels != 1) {
+			FreeEXRImage(&image);
+			FreeEXRHeader(&header);
+			fail("EXR file has no R, G or B channels");
+		}
+		channelIndex[0] = channelIndex[1] = channelIndex[2] = 0;
+	}
+
+	const bool hasAlpha = channelIndex[3] >= 0;
+	const uint32_t outChannels = rgba || hasAlpha ? 4 : 3;
+	const uint2 extent = uint2(image.width, image.height);
+
+	HostPixelData d;
+	d.pixels = PixelData{
+		.format = outChannels == 4 ? vk::Format::eR16G16B16A16Sfloat : vk::Format::eR16G16B16Sfloat,
+		.extent = uint3(extent, 1) };
+	d.bytes.resize(size_t(extent.x) * extent.y * outChannels * sizeof(uint16_t));
+	uint16_t* dst = reinterpret_cast<uint16_t*>(d.bytes.data());
+
+	static const uint16_t kHalfOne = 0x3C00;
+	auto convertBlock = [&](unsigned char** images, const uint2 offset, const uint2 size, const uint32_t srcStride) {
+		for (uint32_t c = 0; c < outChannels; c++) {
+			const int ci = channelIndex[c];
+			for (uint32_t y = 0; y < size.y; y++) {
+				uint16_t* row = dst + (size_t(offset.y + y) * extent.x + offset.x) * outChannels + c;
+				if (ci < 0) {
+					for (uint32_t x = 0; x < size.x; x++) row[x * outChannels] = c == 3 ? kHalfOne : 0;
+				} else if (header.requested_pixel_types[ci] == TINYEXR_PIXELTYPE_HALF) {
+					const uint16_t* src = reinterpret_cast<const uint16_t*>(images[ci]) + size_t(y) * srcStride;
+					for (uint32_t x = 0; x < size.x; x++) row[x * outChannels] = src[x];
+				} else if (header.requested_pixel_types[ci] == TINYEXR_PIXELTYPE_FLOAT) {
+					const float* src = reinterpret_cast<const float*>(images[ci]) + size_t(y) * srcStride;
+					for (uint32_t x = 0; x < size.x; x++) row[x * outChannels] = FloatToHalf(src[x]);
+				} else {
+					const uint32_t* src = reinterpret_cast<const uint32_t*>(images[ci]) + size_t(y) * srcStride;
+					for (uint32_t x = 0; x < size.x; x++) row[x * outChannels] = FloatToHalf(float(src[x]));
+				}
+			}
+		}
+	};
+
+	if (header.tiled) {
+		for (int t = 0; t < image.num_tiles; t++) {
+			const EXRTile& tile = image.tiles[t];
+			convertBlock(tile.images,
+				uint2(tile.offset_x * header.tile_size_x, tile.offset_y * header.tile_size_y),
+				uint2(tile.width, tile.height),
+				header.tile_size_x);
+		}
+	} else
+		convertBlock(image.images, uint2(0), extent, extent.x);
+
+	FreeEXRImage(&image);
+	FreeEXRHeader(&header);
+	return d;
+}
+
+HostPixelData DecodeHdr(const std::span<const std::byte> file, const bool rgba) {
+	int x, y, channels;
+	float* pixels = stbi_loadf_from_memory(reinterpret_cast<const stbi_uc*>(file.data()), (int)file.size(), &x, &y, &channels, rgba ? 4 : 3);
+	if (!pixels) return {};
+
+	const uint32_t outChannels = rgba ? 4 : 3;
+	HostPixelData d;
+	d.pixels = PixelData{
+		.format = rgba ? vk::Format::eR16G16B16A16Sfloat : vk::Format::eR16G16B16Sfloat,
+		.extent = uint3(x, y, 1) };
+	d.bytes.resize(size_t(x) * y * outChannels * sizeof(uint16_t));
+	uint16_t* dst = reinterpret_cast<uint16_t*>(d.bytes.data());
+	for (size_t i = 0; i < size_t(x) * y * outChannels; i++)
+		dst[i] = FloatToHalf(pixels[i]);
+	stbi_image_free(pixels);
+	return d;
+}
+
+// Whether images of format can be sampled and have mips generated with blits
+static bool SupportsSampledMips(const Device& device, const vk::Format format) {
+	const vk::FormatFeatureFlags required =
+		vk::FormatFeatureFlagBits::eSampledImage |
+		vk::FormatFeatureFlagBits::eSampledImageFilterLinear |
+		vk::FormatFeatureFlagBits::eBlitSrc |
+		vk::FormatFeatureFlagBits::eBlitDst |
+		vk::FormatFeatureFlagBits::eTransferDst;
+	return (device.PhysicalDevice().getFormatProperties(format).optimalTilingFeatures & required) == required;
+}
+
+// Loads an .exr or .hdr file as half floats, mapped instead of read into memory.
+// The alpha channel is dropped if the file has none and RGB16F is supported by the device.
+static PixelData LoadHdrImageFile(CommandContext& context, const std::filesystem::path& filename, const bool compress) {
+	const MappedFile file(filename);
+	if (!file.IsOpen())
+		throw std::runtime_error("Failed to open " + filename.string());
+
+	const bool rgba = !SupportsSampledMips(context.GetDevice(), vk::Format::eR16G16B16Sfloat);
+	HostPixelData d = filename.extension() == ".exr" ? DecodeExr(file.Bytes(), rgba) : DecodeHdr(file.Bytes(), rgba);
+	if (d.bytes.empty())
+		throw std::runtime_error("Failure when loading image: " + filename.string());
+
+	const uint2 extent = uint2(d.pixels.extent);
+	if (compress && context.GetDevice().Features().textureCompressionBC) {
+		const uint32_t channels = d.pixels.format == vk::Format::eR16G16B16A16Sfloat ? 4 : 3;
+		float psnr = 0;
+		d = CompressHdrImage(std::span{ reinterpret_cast<const uint16_t*>(d.bytes.data()), d.bytes.size() / sizeof(uint16_t) }, extent, channels, &psnr);
+		std::cout << "Compressed " << filename << " to BC6H (" << extent.x << "x" << extent.y << ", " << d.pixels.mipLevels << " levels, PSNR " << psnr << " dB)" << std::endl;
+	} else
+		std::cout << "Loaded " << filename << " (" << extent.x << "x" << extent.y << ", " << vk::to_string(d.pixels.format) << ")" << std::endl;
+
+	d.pixels.data = context.UploadData(d.bytes);
+	return d.pixels;
+}
+
+PixelData LoadImageFile(CommandContext& context, const std::filesystem::path& filename, const bool srgb, int desiredChannels, const bool compress) {
 	if (!std::filesystem::exists(filename))
 		throw std::invalid_argument("File does not exist: " + filename.string());
-	if (filename.extension() == ".exr") {
-		float* pixels = nullptr;
-		int width;
-		int height;
-		const char* err = nullptr;
-		int ret = LoadEXR(&pixels, &width, &height, filename.string().c_str(), &err);
-		if (ret != TINYEXR_SUCCESS) {
-			std::cerr << "OpenEXR error: " << err << std::endl;
-			FreeEXRErrorMessage(err);
-			throw std::runtime_error(std::string("Failure when loading image: ") + filename.string());
-		}
-		auto buf = context.UploadData(std::span{ pixels, size_t(width)*size_t(height)*4 });
-		std::free(pixels);
-		return PixelData{buf, vk::Format::eR32G32B32A32Sfloat, uint3(width, height, 1)};
+	if (filename.extension() == ".ktx2") {
+		HostPixelData d = DecodeKtx2(context.GetDevice(), ReadFile(filename));
+		d.pixels.data = context.UploadData(d.bytes);
+		std::cout << "Loaded " << filename << " (" << d.pixels.extent.x << "x" << d.pixels.extent.y << ", " << d.pixels.mipLevels << " levels, " << d.pixels.arrayLayers << " layers)" << std::endl;
+		return d.pixels;
+	} else if (filename.extension() == ".exr" || filename.extension() == ".hdr") {
+		return LoadHdrImageFile(context, filename, compress);
 	} else if (filename.extension() == ".dds") {
 		using namespace tinyddsloader;
 		DDSFile dds;
     	auto ret = dds.Load(filename.string().c_str());
 		if (tinyddsloader::Result::tinydds_Success != ret) throw std::runtime_error("Failed to load " + filename.string());
-		dds.GetBitsPerPixel(dds.GetFormat());
 
-		dds.Flip();
+		const vk::Format format = dxgiToVulkan(dds.GetFormat(), desiredChannels == 4);
+		if (format == vk::Format::eUndefined)
+			throw std::runtime_error("Unsupported DDS format in " + filename.string());
 
-		const DDSFile::ImageData* img = dds.GetImageData(0, 0);
+		// levels and layers are stored contiguously after the header, so they are uploaded with one copy.
+		// rows are not flipped here (which would corrupt block compressed data); PixelData::flipY is set instead.
+		const DDSFile::ImageData* first = dds.GetImageData(0, 0);
+		const DDSFile::ImageData* last  = dds.GetImageData(dds.GetMipCount() - 1, dds.GetArraySize() - 1);
+		std::byte* begin = (std::byte*)first->m_mem;
+		std::byte* end   = (std::byte*)last->m_mem + size_t(last->m_memSlicePitch) * last->m_depth;
 
-		auto buf = context.UploadData(std::span{ (std::byte*)img->m_mem, img->m_memSlicePitch });
-		return PixelData{buf, dxgiToVulkan(dds.GetFormat(), desiredChannels == 4), uint3(dds.GetWidth(), dds.GetHeight(), dds.GetDepth())};
-	} else {
-		int x,y,channels;
-		stbi_info(filename.string().c_str(), &x, &y, &channels);
-
-		if (channels == 3) desiredChannels = 4;
-
-		std::byte* pixels = nullptr;
-		vk::Format format = vk::Format::eUndefined;
-		if (stbi_is_hdr(filename.string().c_str())) {
-			pixels = (std::byte*)stbi_loadf(filename.string().c_str(), &x, &y, &channels, desiredChannels);
-			switch(desiredChannels ? desiredChannels : channels) {
-				case 1: format = vk::Format::eR32Sfloat; break;
-				case 2: format = vk::Format::eR32G32Sfloat; break;
-				case 3: format = vk::Format::eR32G32B32Sfloat; break;
-				case 4: format = vk::Format::eR32G32B32A32Sfloat; break;
-			}
-		} else if (stbi_is_16_bit(filename.string().c_str())) {
-			pixels = (std::byte*)stbi_load_16(filename.string().c_str(), &x, &y, &channels, desiredChannels);
-			switch(desiredChannels ? desiredChannels : channels) {
-				case 1: format = vk::Format::eR16Unorm; break;
-				case 2: format = vk::Format::eR16G16Unorm; break;
-				case 3: format = vk::Format::eR16G16B16Unorm; break;
-				case 4: format = vk::Format::eR16G16B16A16Unorm; break;
+		PixelData d {
+			.data = context.UploadData(std::span{ begin, end }),
+			.format = format,
+			.extent = uint3(dds.GetWidth(), dds.GetHeight(), dds.GetDepth()),
+			.mipLevels = dds.GetMipCount(),
+			.arrayLayers = dds.GetArraySize(),
+			.cubemap = dds.IsCubemap(),
+			.flipY = true };
+
+		for (uint32_t layer = 0; layer < dds.GetArraySize(); layer++) {
+			for (uint32_t level = 0; level < dds.GetMipCount(); level++) {
+				const DDSFile::ImageData* img = dds.GetImageData(level, layer);
+				d.regions.emplace_back(vk::BufferImageCopy{
+					.bufferOffset = vk::DeviceSize((std::byte*)img->m_mem - begin),
+					.bufferRowLength = 0,
+					.bufferImageHeight = 0,
+					.imageSubresource = vk::ImageSubresourceLayers{
+						.aspectMask = vk::ImageAspectFlagBits::eColor,
+						.mipLevel = level,
+						.baseArrayLayer = layer,
+						.layerCount = 1 },
+					.imageOffset = { 0, 0, 0 },
+					.imageExtent = vk::Extent3D{ img->m_width, img->m_height, img->m_depth } });
 			}
-		} else {
-			pixels = (std::byte*)stbi_load(filename.string().c_str(), &x, &y, &channels, desiredChannels);
-			switch (desiredChannels ? desiredChannels : channels) {
-				case 1: format = srgb ? vk::Format::eR8Srgb : vk::Format::eR8Unorm; break;
-				case 2: format = srgb ? vk::Format::eR8G8Srgb : vk::Format::eR8G8Unorm; break;
-				case 3: format = srgb ? vk::Format::eR8G8B8Srgb : vk::Format::eR8G8B8Unorm; break;
-				case 4: format = srgb ? vk::Format::eR8G8B8A8Srgb : vk::Format::eR8G8B8A8Unorm; break;
+		}
+
+		std::cout << "Loaded " << filename << " (" << d.extent.x << "x" << d.extent.y << ", " << d.mipLevels << " levels, " << d.arrayLayers << " layers)" << std::endl;
+		return d;
+	} else {
+		// read once, since stb would otherwise reopen the file for every query
+		const std::vector<std::byte> file = ReadFile(filename);
+		const stbi_uc* bytes = reinterpret_cast<const stbi_uc*>(file.data());
+
+		int x, y, channels;
+		if (compress &&
+			stbi_info_from_memory(bytes, (int)file.size(), &x, &y, &channels) &&
+			!stbi_is_hdr_from_memory(bytes, (int)file.size()) &&
+			!stbi_is_16_bit_from_memory(bytes, (int)file.size())) {
+			// grey and grey+alpha files are decoded as LLLA, so BC5 stores L and A. color images stay BC7, since BC4 and BC5
+			// have no sRGB formats
+			const int storedChannels = desiredChannels ? desiredChannels : srgb ? 4 : channels;
+			vk::Format format = srgb ? vk::Format::eBc7SrgbBlock : vk::Format::eBc7UnormBlock;
+			switch (storedChannels) {
+				case 1: format = vk::Format::eBc4UnormBlock; break;
+				case 2: format = vk::Format::eBc5UnormBlock; break;
 			}
+			HostPixelData d = CompressImageFile(file, format, uint2(0, channels == 2 ? 3 : 1), filename.filename().string());
+			d.pixels.components = !desiredChannels && storedChannels <= 2 ? GreyComponents(channels) : vk::ComponentMapping{};
+			d.pixels.data = context.UploadData(d.bytes);
+			return d.pixels;
 		}
-		if (!pixels) throw std::invalid_argument("Could not load " + filename.string());
-		std::cout << "Loaded " << filename << " (" << x << "x" << y << ")" << std::endl;
-		if (desiredChannels) channels = desiredChannels;
 
-		auto buf = context.UploadData(std::span{ pixels, size_t(x)*size_t(y)*GetTexelSize(format) });
-		stbi_image_free(pixels);
-		return PixelData{buf, format, uint3(x,y,1)};
+		HostPixelData d = DecodeImage(file, srgb, desiredChannels);
+		if (d.bytes.empty()) throw std::invalid_argument("Could not load " + filename.string());
+		std::cout << "Loaded " << filename << " (" << d.pixels.extent.x << "x" << d.pixels.extent.y << ")" << std::endl;
+		d.pixels.data = context.UploadData(d.bytes);
+		return d.pixels;
+	}
+}
+
+ImageView UploadImage(CommandContext& context, const PixelData& d, const bool generateMips) {
+	const bool generateLevels = generateMips && d.mipLevels == 1 && !IsBlockCompressed(d.format);
+
+	ImageInfo info {
+		.createFlags = d.cubemap ? vk::ImageCreateFlagBits::eCubeCompatible : vk::ImageCreateFlags{},
+		.type = d.extent.z > 1 ? vk::ImageType::e3D : vk::ImageType::e2D,
+		.format = d.format,
+		.extent = d.extent,
+		.mipLevels = generateLevels ? GetMaxMipLevels(d.extent) : d.mipLevels,
+		.arrayLayers = d.arrayLayers,
+		.queueFamilies = { context.QueueFamily() } };
+	if (IsBlockCompressed(d.format))
+		info.usage = vk::ImageUsageFlagBits::eTransferDst | vk::ImageUsageFlagBits::eSampled;
+	else if (generateLevels) {
+		// storage usage lets GenerateMipMaps use a single compute pass instead of a blit per level
+		ImageInfo downsampleInfo = info;
+		Downsampler::AddRequiredUsage(downsampleInfo);
+		if (Downsampler::IsSupported(context.GetDevice(), downsampleInfo))
+			info = downsampleInfo;
 	}
+
+	const ref<Image> image = Image::Create(context.GetDevice(), info, vk::MemoryPropertyFlagBits::eDeviceLocal, VMA_ALLOCATION_CREATE_STRATEGY_MIN_MEMORY_BIT, MemoryCategory::eTexture);
+	if (!image) return {};
+
+	if (d.regions.empty())
+		context.Copy(d.data, ImageView::Create(image, vk::ImageSubresourceRange{ vk::ImageAspectFlagBits::eColor, 0, 1, 0, 1 }));
+	else
+		context.Copy(d.data, image, d.regions);
+
+	if (generateLevels)
+		context.GenerateMipMaps(image);
+
+	vk::ImageViewType viewType = vk::ImageViewType::e2D;
+	if (d.cubemap)
+		viewType = d.arrayLayers > 6 ? vk::ImageViewType::eCubeArray : vk::ImageViewType::eCube;
+	else if (info.type == vk::ImageType::e3D)
+		viewType = vk::ImageViewType::e3D;
+	else if (d.arrayLayers > 1)
+		viewType = vk::ImageViewType::e2DArray;
+
+	return ImageView::Create(image, vk::ImageSubresourceRange{
+			.aspectMask = vk::ImageAspectFlagBits::eColor,
+			.baseMipLevel = 0,
+			.levelCount = info.mipLevels,
+			.baseArrayLayer = 0,
+			.layerCount = info.arrayLayers },
+		viewType,
+		d.components);
+}
+
+void SavePngFile(const std::filesystem::path& filename, const uint2 extent, const uint32_t channels, const void* pixels) {
+	if (!stbi_write_png(filename.string().c_str(), extent.x, extent.y, channels, pixels, extent.x * channels))
+		std::cerr << "Failed to write " << filename << std::endl;
 }
 
 }
\ No newline at end of file
@@ -0,0 +1,80 @@
+#include "MappedFile.hpp"
+
+#include <utility>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace RoseEngine {
+
+MappedFile::MappedFile(const std::filesystem::path& filename) {
+#ifdef _WIN32
+	HANDLE f = CreateFileW(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+	if (f == INVALID_HANDLE_VALUE) return;
+	file = f;
+
+	LARGE_INTEGER fileSize;
+	if (!GetFileSizeEx(f, &fileSize) || fileSize.QuadPart == 0) { Close(); return; }
+
+	mapping = CreateFileMappingW(f, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (!mapping) { Close(); return; }
+
+	data = (const std::byte*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+	if (!data) { Close(); return; }
+	size = (size_t)fileSize.QuadPart;
+#else
+	const int fd = open(filename.c_str(), O_RDONLY);
+	if (fd < 0) return;
+
+	struct stat st;
+	if (fstat(fd, &st) == 0 && st.st_size > 0) {
+		void* p = mmap(nullptr, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (p != MAP_FAILED) {
+			// decoders read the file front to back
+			madvise(p, (size_t)st.st_size, MADV_SEQUENTIAL);
+			data = (const std::byte*)p;
+			size = (size_t)st.st_size;
+		}
+	}
+	// the mapping stays valid after the descriptor is closed
+	close(fd);
+#endif
+}
+
+MappedFile::MappedFile(MappedFile&& other) noexcept {
+	*this = std::move(other);
+}
+MappedFile& MappedFile::operator=(MappedFile&& other) noexcept {
+	if (this != &other) {
+		Close();
+		data = std::exchange(other.data, nullptr);
+		size = std::exchange(other.size, 0);
+#ifdef _WIN32
+		file    = std::exchange(other.file, nullptr);
+		mapping = std::exchange(other.mapping, nullptr);
+#endif
+	}
+	return *this;
+}
+
+void MappedFile::Close() {
+#ifdef _WIN32
+	if (data)    UnmapViewOfFile(data);
+	if (mapping) CloseHandle(mapping);
+	if (file)    CloseHandle(file);
+	file = nullptr;
+	mapping = nullptr;
+#else
+	if (data) munmap((void*)data, size);
+#endif
+	data = nullptr;
+	size = 0;
+}
+
+}
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <cstddef>
+#include <filesystem>
+#include <span>
+
+namespace RoseEngine {
+
+// Read-only memory mapping of a whole file. Large files (e.g. environment maps) are decoded straight from the page cache
+// instead of being copied into a buffer first. Bytes() is empty if the file couldn't be opened or is empty.
+class MappedFile {
+private:
+	const std::byte* data = nullptr;
+	size_t size = 0;
+#ifdef _WIN32
+	void* file = nullptr;
+	void* mapping = nullptr;
+#endif
+
+	void Close();
+
+public:
+	MappedFile() = default;
+	MappedFile(const std::filesystem::path& filename);
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+	MappedFile(MappedFile&& other) noexcept;
+	MappedFile& operator=(MappedFile&& other) noexcept;
+	inline ~MappedFile() { Close(); }
+
+	inline std::span<const std::byte> Bytes() const { return { data, size }; }
+	inline bool IsOpen() const { return data != nullptr; }
+};
+
+}
@@ -0,0 +1,259 @@
+#include <iostream>
+#include <imgui/imgui.h>
+
+#include "MemoryBudget.hpp"
+
+namespace RoseEngine {
+
+ref<MemoryBudget> MemoryBudget::Create(const ref<Device>& device) {
+	ref<MemoryBudget> budget = make_ref<MemoryBudget>();
+	budget->mDevice = device;
+	return budget;
+}
+MemoryBudget::~MemoryBudget() {
+	if (!mDefragmentation) return;
+	if (mDefragmentationPassActive) {
+		mDevice->Wait(mDefragmentationPassValue);
+		EndDefragmentationPass();
+	}
+	mDefragmentationPools.clear();
+	EndDefragmentation();
+}
+
+void MemoryBudget::AddEvictionCallback(const std::string& name, const float threshold, EvictionCallback fn) {
+	RemoveEvictionCallback(name);
+	auto it = std::ranges::upper_bound(mCallbacks, threshold, {}, &Callback::threshold);
+	mCallbacks.insert(it, Callback{ name, threshold, fn });
+}
+void MemoryBudget::RemoveEvictionCallback(const std::string& name) {
+	std::erase_if(mCallbacks, [&](const Callback& c) { return c.name == name; });
+}
+
+void MemoryBudget::Defragment() {
+	if (mDefragmentation) return;
+	mDefragmentationPools = mDevice->DefragmentableMemoryPools();
+	mDefragmentationPools.emplace_back(VK_NULL_HANDLE); // default pools first
+	BeginNextDefragmentation();
+}
+
+void MemoryBudget::BeginNextDefragmentation() {
+	while (!mDefragmentation && !mDefragmentationPools.empty()) {
+		const VmaPool pool = mDefragmentationPools.back();
+		mDefragmentationPools.pop_back();
+		BeginDefragmentation(pool);
+	}
+}
+
+void MemoryBudget::BeginDefragmentation(const VmaPool pool) {
+	VmaDefragmentationInfo info {
+		.flags = VMA_DEFRAGMENTATION_FLAG_ALGORITHM_FAST_BIT,
+		.pool = pool,
+		.maxBytesPerPass = maxBytesPerPass,
+		.maxAllocationsPerPass = 0,
+		.pfnBreakCallback = nullptr,
+		.pBreakCallbackUserData = nullptr };
+	vk::Result result = (vk::Result)vmaBeginDefragmentation(mDevice->MemoryAllocator(), &info, &mDefragmentation);
+	if (result != vk::Result::eSuccess) {
+		std::cerr << "Failed to begin defragmentation: " << vk::to_string(result) << std::endl;
+		mDefragmentation = nullptr;
+	}
+}
+
+void MemoryBudget::EndDefragmentation() {
+	VmaDefragmentationStats stats = {};
+	vmaEndDefragmentation(mDevice->MemoryAllocator(), mDefragmentation, &stats);
+	mDefragmentation = nullptr;
+	mDefragmentationStats.bytesFreed += stats.bytesFreed;
+
+	BeginNextDefragmentation();
+}
+
+void MemoryBudget::BeginDefragmentationPass(CommandContext& context) {
+	const VmaAllocator allocator = mDevice->MemoryAllocator();
+
+	vk::Result result = (vk::Result)vmaBeginDefragmentationPass(allocator, mDefragmentation, &mDefragmentationPass);
+	if (result != vk::Result::eIncomplete) {
+		// eSuccess means there is nothing left to move
+		if (result != vk::Result::eSuccess)
+			std::cerr << "Failed to begin defragmentation pass: " << vk::to_string(result) << std::endl;
+		EndDefragmentation();
+		return;
+	}
+
+	const auto start = std::chrono::high_resolution_clock::now();
+
+	bool recorded = false;
+	for (uint32_t i = 0; i < mDefragmentationPass.moveCount; i++) {
+		VmaDefragmentationMove& move = mDefragmentationPass.pMoves[i];
+
+		// only Buffers store themselves in the allocation's user data
+		VmaAllocationInfo srcInfo;
+		vmaGetAllocationInfo(allocator, move.srcAllocation, &srcInfo);
+		Buffer* buffer = reinterpret_cast<Buffer*>(srcInfo.pUserData);
+
+		const double elapsed = std::chrono::duration_cast<std::chrono::duration<double, std::milli>>(std::chrono::high_resolution_clock::now() - start).count();
+		// descriptor sets already written by this recording would keep using the old handle after the copy
+		if (!buffer || !buffer->IsMovable() || context.HasDescriptorReference(**buffer) || elapsed > defragmentTimeBudget) {
+			move.operation = VMA_DEFRAGMENTATION_MOVE_OPERATION_IGNORE;
+			continue;
+		}
+
+		vk::BufferCreateInfo createInfo {
+			.size = buffer->Size(),
+			.usage = buffer->Usage(),
+			.sharingMode = buffer->SharingMode() };
+		vk::Buffer newBuffer;
+		if (vk::Device(**mDevice).createBuffer(&createInfo, nullptr, &newBuffer) != vk::Result::eSuccess) {
+			move.operation = VMA_DEFRAGMENTATION_MOVE_OPERATION_IGNORE;
+			continue;
+		}
+		if (vmaBindBufferMemory(allocator, move.dstTmpAllocation, newBuffer) != VK_SUCCESS) {
+			vk::Device(**mDevice).destroyBuffer(newBuffer);
+			move.operation = VMA_DEFRAGMENTATION_MOVE_OPERATION_IGNORE;
+			continue;
+		}
+
+		if (!recorded) {
+			// buffer states are tracked per range, so synchronize the copies with everything
+			context.ExecuteBarriers();
+			context->pipelineBarrier2(vk::DependencyInfo{}.setMemoryBarriers(vk::MemoryBarrier2{
+				.srcStageMask  = vk::PipelineStageFlagBits2::eAllCommands,
+				.srcAccessMask = vk::AccessFlagBits2::eMemoryWrite,
+				.dstStageMask  = vk::PipelineStageFlagBits2::eTransfer,
+				.dstAccessMask = vk::AccessFlagBits2::eTransferRead }));
+			recorded = true;
+		}
+
+		context->copyBuffer(**buffer, newBuffer, vk::BufferCopy{ .srcOffset = 0, .dstOffset = 0, .size = buffer->Size() });
+
+		mMovedBuffers.emplace_back(buffer->SwapHandle(newBuffer));
+		mMovingBuffers.emplace_back(buffer->shared_from_this());
+		mDefragmentationStats.bytesMoved += buffer->Size();
+		mDefragmentationStats.allocationsMoved++;
+	}
+
+	if (recorded) {
+		context->pipelineBarrier2(vk::DependencyInfo{}.setMemoryBarriers(vk::MemoryBarrier2{
+			.srcStageMask  = vk::PipelineStageFlagBits2::eTransfer,
+			.srcAccessMask = vk::AccessFlagBits2::eTransferWrite,
+			.dstStageMask  = vk::PipelineStageFlagBits2::eAllCommands,
+			.dstAccessMask = vk::AccessFlagBits2::eMemoryRead | vk::AccessFlagBits2::eMemoryWrite }));
+	}
+
+	mDefragmentationPassValue = mDevice->NextTimelineSignal();
+	mDefragmentationPassActive = true;
+}
+
+bool MemoryBudget::EndDefragmentationPass() {
+	for (const vk::Buffer b : mMovedBuffers)
+		vk::Device(**mDevice).destroyBuffer(b);
+	mMovedBuffers.clear();
+
+	vk::Result result = (vk::Result)vmaEndDefragmentationPass(mDevice->MemoryAllocator(), mDefragmentation, &mDefragmentationPass);
+
+	for (const auto& b : mMovingBuffers)
+		b->UpdateAllocationInfo();
+	mMovingBuffers.clear();
+
+	mDefragmentationPassActive = false;
+	mDefragmentationStats.passes++;
+
+	return result == vk::Result::eSuccess;
+}
+
+void MemoryBudget::Update(CommandContext& context) {
+	const VmaAllocator allocator = mDevice->MemoryAllocator();
+
+	vmaSetCurrentFrameIndex(allocator, mFrameIndex++);
+
+	// finish the previous defragmentation pass once its copies are done
+	if (mDefragmentationPassActive && mDevice->CurrentTimelineValue() >= mDefragmentationPassValue) {
+		if (EndDefragmentationPass())
+			EndDefragmentation();
+	}
+
+	// refresh budgets
+
+	const VkPhysicalDeviceMemoryProperties* memoryProperties = nullptr;
+	vmaGetMemoryProperties(allocator, &memoryProperties);
+
+	VmaBudget budgets[VK_MAX_MEMORY_HEAPS];
+	vmaGetHeapBudgets(allocator, budgets);
+
+	mHeaps.resize(memoryProperties->memoryHeapCount);
+	for (uint32_t heapIndex = 0; heapIndex < mHeaps.size(); heapIndex++) {
+		HeapInfo& heap = mHeaps[heapIndex];
+		heap.usage  = budgets[heapIndex].usage;
+		heap.budget = budgets[heapIndex].budget;
+		heap.allocationBytes = budgets[heapIndex].statistics.allocationBytes;
+		heap.blockBytes      = budgets[heapIndex].statistics.blockBytes;
+		heap.deviceLocal = (memoryProperties->memoryHeaps[heapIndex].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT) != 0;
+		if (heapIndex < mBudgetLimits.size() && mBudgetLimits[heapIndex] > 0)
+			heap.budget = std::min(heap.budget, mBudgetLimits[heapIndex]);
+	}
+
+	// evict, least important memory first
+
+	for (uint32_t heapIndex = 0; heapIndex < mHeaps.size(); heapIndex++) {
+		HeapInfo& heap = mHeaps[heapIndex];
+		for (const Callback& c : mCallbacks) {
+			const vk::DeviceSize target = (vk::DeviceSize)(c.threshold * heap.budget);
+			if (heap.usage <= target)
+				break; // callbacks are sorted by threshold
+			const vk::DeviceSize released = c.fn(heapIndex, heap.usage - target);
+			heap.usage -= std::min(released, heap.usage);
+		}
+	}
+
+	// defragment
+
+	if (autoDefragment && !mDefragmentation) {
+		for (const HeapInfo& heap : mHeaps) {
+			if (heap.blockBytes > 0 && heap.blockBytes - heap.allocationBytes > defragmentThreshold * heap.blockBytes) {
+				Defragment();
+				break;
+			}
+		}
+	}
+
+	if (mDefragmentation && !mDefragmentationPassActive)
+		BeginDefragmentationPass(context);
+}
+
+void MemoryBudget::InspectorGui() {
+	for (uint32_t heapIndex = 0; heapIndex < mHeaps.size(); heapIndex++) {
+		const HeapInfo& heap = mHeaps[heapIndex];
+		const auto[usage, usageUnit]   = FormatBytes(heap.usage);
+		const auto[budget, budgetUnit] = FormatBytes(heap.budget);
+		ImGui::Text("Heap %u%s: %lu %s / %lu %s", heapIndex, heap.deviceLocal ? " (device local)" : "", usage, usageUnit, budget, budgetUnit);
+		ImGui::ProgressBar(heap.budget > 0 ? float(double(heap.usage) / double(heap.budget)) : 0.f);
+
+		uint64_t limitMiB = heapIndex < mBudgetLimits.size() ? mBudgetLimits[heapIndex] / (1024*1024) : 0;
+		ImGui::PushID(heapIndex);
+		if (ImGui::InputScalar("Budget limit (MiB)", ImGuiDataType_U64, &limitMiB))
+			SetBudgetLimit(heapIndex, limitMiB * 1024*1024);
+		ImGui::PopID();
+	}
+
+	if (!mCallbacks.empty() && ImGui::CollapsingHeader("Eviction callbacks")) {
+		for (const Callback& c : mCallbacks)
+			ImGui::Text("%s (%.0f%%)", c.name.c_str(), c.threshold * 100);
+	}
+
+	ImGui::Checkbox("Auto defragment", &autoDefragment);
+	ImGui::SameLine();
+	if (ImGui::Button("Defragment"))
+		Defragment();
+	ImGui::InputDouble("Time budget (ms)", &defragmentTimeBudget);
+
+	const auto[moved, movedUnit] = FormatBytes(mDefragmentationStats.bytesMoved);
+	const auto[freed, freedUnit] = FormatBytes(mDefragmentationStats.bytesFreed);
+	ImGui::Text("%u passes, %u allocations moved (%lu %s), %lu %s freed%s",
+		mDefragmentationStats.passes,
+		mDefragmentationStats.allocationsMoved,
+		moved, movedUnit,
+		freed, freedUnit,
+		IsDefragmenting() ? " (running)" : "");
+}
+
+}
@@ -0,0 +1,96 @@
+#pragma once
+
+#include <functional>
+#include <optional>
+
+#include "CommandContext.hpp"
+
+namespace RoseEngine {
+
+// Polls VMA heap budgets each frame. Registered eviction callbacks are called when a heap's usage
+// crosses their threshold, and movable buffers are defragmented incrementally across frames.
+class MemoryBudget {
+public:
+	// Called with a heap index and the number of bytes to free from it. Returns the number of bytes released.
+	using EvictionCallback = std::function<vk::DeviceSize(uint32_t heapIndex, vk::DeviceSize bytes)>;
+
+	struct HeapInfo {
+		vk::DeviceSize usage  = 0;
+		vk::DeviceSize budget = 0;
+		vk::DeviceSize allocationBytes = 0;
+		vk::DeviceSize blockBytes = 0;
+		bool           deviceLocal = false;
+	};
+
+	struct DefragmentationStats {
+		uint32_t       passes = 0;
+		uint32_t       allocationsMoved = 0;
+		vk::DeviceSize bytesMoved = 0;
+		vk::DeviceSize bytesFreed = 0;
+	};
+
+private:
+	struct Callback {
+		std::string      name;
+		float            threshold; // fraction of the budget
+		EvictionCallback fn;
+	};
+
+	ref<Device>           mDevice = {};
+	std::vector<Callback> mCallbacks = {}; // sorted by threshold
+	std::vector<HeapInfo> mHeaps = {};
+	std::vector<vk::DeviceSize> mBudgetLimits = {}; // per-heap, 0 means no limit
+	uint32_t              mFrameIndex = 0;
+
+	VmaDefragmentationContext     mDefragmentation = nullptr;
+	std::vector<VmaPool>          mDefragmentationPools = {}; // pools left to defragment after the current one, last first
+	VmaDefragmentationPassMoveInfo mDefragmentationPass = {};
+	std::vector<vk::Buffer>       mMovedBuffers = {}; // old handles, destroyed once mDefragmentationPassValue is reached
+	std::vector<ref<Buffer>>      mMovingBuffers = {};
+	uint64_t                      mDefragmentationPassValue = 0;
+	bool                          mDefragmentationPassActive = false;
+	DefragmentationStats          mDefragmentationStats = {};
+
+	void BeginDefragmentation(const VmaPool pool);
+	void BeginNextDefragmentation();
+	void EndDefragmentation(); // and begins the next pool's
+	void BeginDefragmentationPass(CommandContext& context);
+	bool EndDefragmentationPass();
+
+public:
+	bool   autoDefragment = true;
+	float  defragmentThreshold = 0.25f;          // start when unused block bytes exceed this fraction of a heap's block bytes
+	double defragmentTimeBudget = 1.0;           // milliseconds per frame
+	vk::DeviceSize maxBytesPerPass = 64*1024*1024;
+
+	static ref<MemoryBudget> Create(const ref<Device>& device);
+	~MemoryBudget();
+
+	inline const std::vector<HeapInfo>& Heaps() const { return mHeaps; }
+	inline const DefragmentationStats& GetDefragmentationStats() const { return mDefragmentationStats; }
+	inline bool IsDefragmenting() const { return mDefragmentation != nullptr; }
+
+	// Lowers the budget reported for a heap. Useful for testing eviction on devices with plenty of memory. 0 removes the limit.
+	inline void SetBudgetLimit(const uint32_t heapIndex, const vk::DeviceSize limit) {
+		if (heapIndex >= mBudgetLimits.size())
+			mBudgetLimits.resize(heapIndex + 1, 0);
+		mBudgetLimits[heapIndex] = limit;
+	}
+
+	// Registers a callback which is called when a heap's usage exceeds threshold * budget.
+	// Callbacks with lower thresholds are called first, so they should free the least important memory.
+	void AddEvictionCallback(const std::string& name, const float threshold, EvictionCallback fn);
+	void RemoveEvictionCallback(const std::string& name);
+
+	// Starts a new defragmentation of the default pools followed by each category pool that VMA can defragment (not the
+	// linear staging pools), if one isn't already running.
+	void Defragment();
+
+	// Refreshes budgets, calls eviction callbacks and runs a defragmentation pass. Records copies into context,
+	// which must be submitted before the next Update.
+	void Update(CommandContext& context);
+
+	void InspectorGui();
+};
+
+}
@@ -182,6 +182,8 @@ ref<PipelineLayout> PipelineLayout::Create(const Device& device, const vk::Array
 			case vk::ShaderStageFlagBits::eTessellationEvaluation: return vk::PipelineStageFlagBits2::eTessellationEvaluationShader;
 			case vk::ShaderStageFlagBits::eGeometry:               return vk::PipelineStageFlagBits2::eGeometryShader;
 			case vk::ShaderStageFlagBits::eFragment:               return vk::PipelineStageFlagBits2::eFragmentShader;
+			case vk::ShaderStageFlagBits::eTaskEXT:                return vk::PipelineStageFlagBits2::eTaskShaderEXT;
+			case vk::ShaderStageFlagBits::eMeshEXT:                return vk::PipelineStageFlagBits2::eMeshShaderEXT;
 			case vk::ShaderStageFlagBits::eCompute:                return vk::PipelineStageFlagBits2::eComputeShader;
 			case vk::ShaderStageFlagBits::eRaygenKHR:              return vk::PipelineStageFlagBits2::eRayTracingShaderKHR;
 			case vk::ShaderStageFlagBits::eAnyHitKHR:              return vk::PipelineStageFlagBits2::eRayTracingShaderKHR;
@@ -207,8 +209,12 @@ ref<PipelineLayout> PipelineLayout::Create(const Device& device, const vk::Array
 
 	layout->mDescriptorSetLayouts = descriptorSetLayouts;
 	layout->mDescriptorSetLayouts.resize(bindings.bindingData.size());
+	layout->mHash = HashArgs(layout->mInfo.flags, layout->mInfo.descriptorSetLayoutFlags);
 	for (uint32_t i = 0; i < bindings.bindingData.size(); i++) {
-		if (layout->mDescriptorSetLayouts[i]) continue;
+		if (layout->mDescriptorSetLayouts[i]) {
+			HashCombine(layout->mHash, (VkDescriptorSetLayout)**layout->mDescriptorSetLayouts[i]);
+			continue;
+		}
 		std::vector<vk::DescriptorSetLayoutBinding> layoutBindings;
 		std::vector<vk::DescriptorBindingFlags>     bindingFlags;
 		bool hasFlags = false;
@@ -220,6 +226,10 @@ ref<PipelineLayout> PipelineLayout::Create(const Device& device, const vk::Array
 			auto& b = layoutBindings.emplace_back(binding);
 			if (!samplers.empty())
 				b.setImmutableSamplers(samplers);
+
+			HashCombine(layout->mHash, HashArgs(i, b.binding, b.descriptorType, b.descriptorCount, b.stageFlags, bindingFlags.back()));
+			for (const vk::Sampler s : samplers)
+				HashCombine(layout->mHash, (VkSampler)s);
 		}
 
 		vk::DescriptorSetLayoutBindingFlagsCreateInfo bindingFlagsInfo = {};
@@ -238,6 +248,10 @@ ref<PipelineLayout> PipelineLayout::Create(const Device& device, const vk::Array
 	if (bindings.pushConstantStages != vk::ShaderStageFlags{0})
 		pushConstantRanges.emplace_back(bindings.pushConstantStages, bindings.pushConstantRangeBegin, bindings.pushConstantRangeEnd - bindings.pushConstantRangeBegin);
 
+	for (const vk::PushConstantRange& r : pushConstantRanges)
+		HashCombine(layout->mHash, HashArgs(r.stageFlags, r.offset, r.size));
+	layout->mPushConstantRanges = pushConstantRanges;
+
 	std::vector<vk::DescriptorSetLayout> vklayouts;
 	for (const auto& ds : layout->mDescriptorSetLayouts)
 		vklayouts.emplace_back(**ds);
@@ -255,7 +269,10 @@ ref<Pipeline> Pipeline::CreateCompute(const Device& device, const ref<const Shad
 	ref<Pipeline> pipeline = make_ref<Pipeline>();
 	pipeline->mLayout = layout;
 	pipeline->mShaders = { shader };
+	vk::PipelineCreationFeedbackCreateInfo feedbackInfo = {};
+	feedbackInfo.setPPipelineCreationFeedback(&pipeline->mCreationFeedback);
 	pipeline->mPipeline = device->createComputePipeline(device.PipelineCache(), vk::ComputePipelineCreateInfo{
+		.pNext = &feedbackInfo,
 		.flags = info.flags,
 		.stage = vk::PipelineShaderStageCreateInfo{
 			.flags = info.stageFlags,
@@ -263,6 +280,7 @@ ref<Pipeline> Pipeline::CreateCompute(const Device& device, const ref<const Shad
 			.module = ***shader,
 			.pName = "main" },
 		.layout = ***layout });
+	device.PipelineCreated(pipeline->mCreationFeedback);
 	device.SetDebugName(***pipeline, shader->SourceFiles()[0].stem().string() + ":" + shader->EntryPointName());
 	return pipeline;
 }
@@ -273,6 +291,99 @@ ref<Pipeline> Pipeline::CreateCompute(const Device& device, const ref<const Shad
 }
 
 
+// Vulkan create info structs for a GraphicsPipelineInfo. Create infos returned by GetCreateInfo point into this struct.
+struct GraphicsPipelineState {
+	const GraphicsPipelineInfo& info;
+	std::vector<vk::PipelineShaderStageCreateInfo> stages = {};
+	std::vector<vk::PipelineShaderStageCreateInfo> preRasterizationStages = {};
+	std::vector<vk::PipelineShaderStageCreateInfo> fragmentStages = {};
+	vk::PipelineRenderingCreateInfo        dynamicRenderingState = {};
+	vk::PipelineVertexInputStateCreateInfo vertexInputState = {};
+	vk::PipelineViewportStateCreateInfo    viewportState = {};
+	vk::PipelineColorBlendStateCreateInfo  colorBlendState = {};
+	vk::PipelineDynamicStateCreateInfo     dynamicState = {};
+
+	inline GraphicsPipelineState(const GraphicsPipelineInfo& info_, const vk::ArrayProxy<const ref<const ShaderModule>>& shaders) : info(info_) {
+		for (const auto& shader : shaders) {
+			const vk::PipelineShaderStageCreateInfo stage {
+				.flags = info.stageFlags,
+				.stage = shader->Stage(),
+				.module = ***shader,
+				.pName = "main" };
+			stages.emplace_back(stage);
+			if (shader->Stage() == vk::ShaderStageFlagBits::eFragment)
+				fragmentStages.emplace_back(stage);
+			else
+				preRasterizationStages.emplace_back(stage);
+		}
+
+		if (info.dynamicRenderingState) {
+			dynamicRenderingState = vk::PipelineRenderingCreateInfo{
+				.viewMask = info.dynamicRenderingState->viewMask,
+				.depthAttachmentFormat = info.dynamicRenderingState->depthFormat,
+				.stencilAttachmentFormat = info.dynamicRenderingState->stencilFormat };
+			dynamicRenderingState.setColorAttachmentFormats(info.dynamicRenderingState->colorFormats);
+		}
+
+		if (info.vertexInputState) {
+			vertexInputState.setVertexBindingDescriptions(info.vertexInputState->bindings);
+			vertexInputState.setVertexAttributeDescriptions(info.vertexInputState->attributes);
+		}
+
+		viewportState.setViewports(info.viewports);
+		viewportState.setScissors(info.scissors);
+
+		if (info.colorBlendState) {
+			colorBlendState = vk::PipelineColorBlendStateCreateInfo{
+				.logicOpEnable   = info.colorBlendState->logicOpEnable,
+				.logicOp         = info.colorBlendState->logicOp,
+				.blendConstants  = info.colorBlendState->blendConstants };
+			colorBlendState.setAttachments(info.colorBlendState->attachments);
+		}
+
+		dynamicState.setDynamicStates(info.dynamicStates);
+	}
+
+	// Returns the create info for the parts of the pipeline in parts, or the whole pipeline if parts is empty.
+	// The dynamic rendering state is appended to pNext.
+	inline vk::GraphicsPipelineCreateInfo GetCreateInfo(const vk::GraphicsPipelineLibraryFlagsEXT parts, const vk::PipelineLayout layout, const void* pNext) {
+		const bool all = !parts;
+		const bool vertexInput      = all || (parts & vk::GraphicsPipelineLibraryFlagBitsEXT::eVertexInputInterface);
+		const bool preRasterization = all || (parts & vk::GraphicsPipelineLibraryFlagBitsEXT::ePreRasterizationShaders);
+		const bool fragmentShader   = all || (parts & vk::GraphicsPipelineLibraryFlagBitsEXT::eFragmentShader);
+		const bool fragmentOutput   = all || (parts & vk::GraphicsPipelineLibraryFlagBitsEXT::eFragmentOutputInterface);
+
+		const void* next = pNext;
+		if (info.dynamicRenderingState && (preRasterization || fragmentShader || fragmentOutput)) {
+			dynamicRenderingState.pNext = pNext;
+			next = &dynamicRenderingState;
+		}
+
+		vk::GraphicsPipelineCreateInfo createInfo = {
+			.pNext               = next,
+			.flags               = info.flags,
+			.pVertexInputState   = vertexInput      && info.vertexInputState.has_value()   ? &vertexInputState : nullptr,
+			.pInputAssemblyState = vertexInput      && info.inputAssemblyState.has_value() ? &info.inputAssemblyState.value() : nullptr,
+			.pTessellationState  = preRasterization && info.tessellationState.has_value()  ? &info.tessellationState.value()  : nullptr,
+			.pViewportState      = preRasterization ? &viewportState : nullptr,
+			.pRasterizationState = preRasterization && info.rasterizationState.has_value() ? &info.rasterizationState.value() : nullptr,
+			.pMultisampleState   = (fragmentShader || fragmentOutput) && info.multisampleState.has_value() ? &info.multisampleState.value() : nullptr,
+			.pDepthStencilState  = fragmentShader   && info.depthStencilState.has_value()  ? &info.depthStencilState.value()  : nullptr,
+			.pColorBlendState    = fragmentOutput   && info.colorBlendState.has_value()    ? &colorBlendState                 : nullptr,
+			.pDynamicState       = &dynamicState,
+			.layout              = (preRasterization || fragmentShader) ? layout : vk::PipelineLayout{},
+			.renderPass          = info.renderPass,
+			.subpass             = info.subpassIndex };
+		if (all)
+			createInfo.setStages(stages);
+		else if (preRasterization)
+			createInfo.setStages(preRasterizationStages);
+		else if (fragmentShader)
+			createInfo.setStages(fragmentStages);
+		return createInfo;
+	}
+};
+
 ref<Pipeline> Pipeline::CreateGraphics(const Device& device, const vk::ArrayProxy<const ref<const ShaderModule>>& shaders, const GraphicsPipelineInfo& info, const PipelineLayoutInfo& layoutInfo, const DescriptorSetLayouts& descriptorSetLayouts) {
 	// Pipeline constructor creates mLayout, mDescriptorSetLayouts, and mDescriptorMap
 
@@ -283,68 +394,194 @@ ref<Pipeline> Pipeline::CreateGraphics(const Device& device, const vk::ArrayProx
 	std::ranges::copy(shaders, pipeline->mShaders.begin());
 
 	std::string name;
-
-	std::vector<vk::PipelineShaderStageCreateInfo> stages;
-	for (const auto& shader : shaders) {
+	for (const auto& shader : shaders)
 		name += shader->SourceFiles()[0].stem().string() + ":" + shader->EntryPointName();
-		stages.emplace_back(vk::PipelineShaderStageCreateInfo{
-			.flags = info.stageFlags,
-			.stage = shader->Stage(),
-			.module = ***shader,
-			.pName = "main" });
-		}
 
-	vk::PipelineRenderingCreateInfo dynamicRenderingState = {};
-	if (info.dynamicRenderingState) {
-		dynamicRenderingState = vk::PipelineRenderingCreateInfo{
-			.viewMask = info.dynamicRenderingState->viewMask,
-			.depthAttachmentFormat = info.dynamicRenderingState->depthFormat,
-			.stencilAttachmentFormat = info.dynamicRenderingState->stencilFormat };
-		dynamicRenderingState.setColorAttachmentFormats(info.dynamicRenderingState->colorFormats);
+	// mesh shader pipelines have no vertex input interface to share, so they are created whole
+	const bool meshShading = std::ranges::any_of(shaders, [](const auto& s) { return s->Stage() == vk::ShaderStageFlagBits::eMeshEXT; });
+	if (device.EnabledExtensions().contains(VK_EXT_GRAPHICS_PIPELINE_LIBRARY_EXTENSION_NAME) && !info.renderPass && info.dynamicRenderingState && !meshShading) {
+		LinkGraphicsLibraries(device, *pipeline, info);
+		device.SetDebugName(***pipeline, name);
+		return pipeline;
 	}
 
-	vk::PipelineVertexInputStateCreateInfo vertexInputState = {};
-	if (info.vertexInputState) {
-		vertexInputState.setVertexBindingDescriptions(info.vertexInputState->bindings);
-		vertexInputState.setVertexAttributeDescriptions(info.vertexInputState->attributes);
+	GraphicsPipelineState state(info, shaders);
+
+	vk::PipelineCreationFeedbackCreateInfo feedbackInfo = {};
+	feedbackInfo.setPPipelineCreationFeedback(&pipeline->mCreationFeedback);
+
+	pipeline->mPipeline = device->createGraphicsPipeline(device.PipelineCache(), state.GetCreateInfo({}, ***pipeline->mLayout, &feedbackInfo));
+	device.PipelineCreated(pipeline->mCreationFeedback);
+	device.SetDebugName(***pipeline, name);
+
+	return pipeline;
+}
+
+void Pipeline::LinkGraphicsLibraries(const Device& device, Pipeline& pipeline, const GraphicsPipelineInfo& info) {
+	using Part = vk::GraphicsPipelineLibraryFlagBitsEXT;
+
+	GraphicsPipelineState state(info, pipeline.mShaders);
+
+	const size_t layoutHash = pipeline.mLayout->Hash();
+	const size_t dynamicStatesHash = HashRange(info.dynamicStates);
+	size_t preRasterizationShaders = 0;
+	size_t fragmentShaders = 0;
+	for (const auto& shader : pipeline.mShaders)
+		HashCombine(shader->Stage() == vk::ShaderStageFlagBits::eFragment ? fragmentShaders : preRasterizationShaders, shader->SpirvHash());
+
+	// each part is keyed by the state it uses, so e.g. the output interface is shared by all meshes and materials
+	const std::array<std::pair<Part, size_t>, 4> parts = {
+		std::pair{ Part::eVertexInputInterface, HashArgs(
+			(uint32_t)Part::eVertexInputInterface,
+			info.vertexInputState,
+			info.inputAssemblyState,
+			dynamicStatesHash) },
+		std::pair{ Part::ePreRasterizationShaders, HashArgs(
+			(uint32_t)Part::ePreRasterizationShaders,
+			preRasterizationShaders,
+			layoutHash,
+			info.stageFlags,
+			info.tessellationState,
+			info.rasterizationState,
+			HashRange(info.viewports),
+			HashRange(info.scissors),
+			info.dynamicRenderingState,
+			dynamicStatesHash) },
+		std::pair{ Part::eFragmentShader, HashArgs(
+			(uint32_t)Part::eFragmentShader,
+			fragmentShaders,
+			layoutHash,
+			info.stageFlags,
+			info.depthStencilState,
+			info.multisampleState,
+			info.dynamicRenderingState,
+			dynamicStatesHash) },
+		std::pair{ Part::eFragmentOutputInterface, HashArgs(
+			(uint32_t)Part::eFragmentOutputInterface,
+			info.colorBlendState,
+			info.multisampleState,
+			info.dynamicRenderingState,
+			dynamicStatesHash) },
+	};
+
+	std::vector<ref<vk::raii::Pipeline>> libraries;
+	for (const auto&[part, key] : parts) {
+		libraries.emplace_back(device.GetPipelineLibrary(key, [&]() {
+			vk::GraphicsPipelineLibraryCreateInfoEXT libraryInfo { .flags = part };
+			vk::GraphicsPipelineCreateInfo createInfo = state.GetCreateInfo(part, ***pipeline.mLayout, &libraryInfo);
+			createInfo.flags |= vk::PipelineCreateFlagBits::eLibraryKHR | vk::PipelineCreateFlagBits::eRetainLinkTimeOptimizationInfoEXT;
+			return device->createGraphicsPipeline(device.PipelineCache(), createInfo);
+		}));
 	}
 
-	vk::PipelineViewportStateCreateInfo viewportState = {};
-	viewportState.setViewports(info.viewports);
-	viewportState.setScissors(info.scissors);
-
-	vk::PipelineColorBlendStateCreateInfo colorBlendState = {};
-	if (info.colorBlendState) {
-		colorBlendState = vk::PipelineColorBlendStateCreateInfo{
-			.logicOpEnable   = info.colorBlendState->logicOpEnable,
-			.logicOp         = info.colorBlendState->logicOp,
-			.blendConstants  = info.colorBlendState->blendConstants };
-		colorBlendState.setAttachments(info.colorBlendState->attachments);
+	std::vector<vk::Pipeline> libraryHandles;
+	for (const auto& l : libraries)
+		libraryHandles.emplace_back(**l);
+
+	// fast link. the libraries already contain compiled shaders, so this doesn't invoke the shader compiler
+
+	vk::PipelineLibraryCreateInfoKHR linkInfo = {};
+	linkInfo.setLibraries(libraryHandles);
+	vk::PipelineCreationFeedbackCreateInfo feedbackInfo = { .pNext = &linkInfo };
+	feedbackInfo.setPPipelineCreationFeedback(&pipeline.mCreationFeedback);
+	pipeline.mPipeline = device->createGraphicsPipeline(device.PipelineCache(), vk::GraphicsPipelineCreateInfo{
+		.pNext  = &feedbackInfo,
+		.flags  = info.flags,
+		.layout = ***pipeline.mLayout });
+	device.PipelineCreated(pipeline.mCreationFeedback);
+
+	// compile the optimized pipeline in the background. libraries and layout are kept alive by the task.
+
+	device.BeginPipelineLink();
+	pipeline.mOptimizedPipeline = std::async(std::launch::async, [&device, libraries, layout = pipeline.mLayout, flags = info.flags]() {
+		std::vector<vk::Pipeline> handles;
+		for (const auto& l : libraries)
+			handles.emplace_back(**l);
+		vk::PipelineLibraryCreateInfoKHR linkInfo = {};
+		linkInfo.setLibraries(handles);
+		vk::PipelineCreationFeedback feedback = {};
+		vk::PipelineCreationFeedbackCreateInfo feedbackInfo = { .pNext = &linkInfo };
+		feedbackInfo.setPPipelineCreationFeedback(&feedback);
+		struct LinkEnd { const Device& device; ~LinkEnd() { device.EndPipelineLink(); } } linkEnd{ device };
+		vk::raii::Pipeline optimized = device->createGraphicsPipeline(device.PipelineCache(), vk::GraphicsPipelineCreateInfo{
+			.pNext  = &feedbackInfo,
+			.flags  = flags | vk::PipelineCreateFlagBits::eLinkTimeOptimizationEXT,
+			.layout = ***layout });
+		device.PipelineCreated(feedback);
+		return optimized;
+	});
+	pipeline.mLibraries = std::move(libraries);
+
+}
+
+ref<Pipeline> Pipeline::CreateShaderObjects(const Device& device, const vk::ArrayProxy<const ref<const ShaderModule>>& shaders, const GraphicsPipelineInfo& info, const PipelineLayoutInfo& layoutInfo, const DescriptorSetLayouts& descriptorSetLayouts) {
+	ref<Pipeline> pipeline = make_ref<Pipeline>();
+	pipeline->mLayout = PipelineLayout::Create(device, shaders, layoutInfo, descriptorSetLayouts);
+	pipeline->mShaders.resize(shaders.size());
+	std::ranges::copy(shaders, pipeline->mShaders.begin());
+	pipeline->mGraphicsState = info;
+
+	std::vector<vk::DescriptorSetLayout> setLayouts;
+	for (const auto& l : pipeline->mLayout->GetDescriptorSetLayouts())
+		setLayouts.emplace_back(**l);
+
+	// stages are linked, so each stage's next stage is the following shader
+	std::vector<vk::ShaderCreateInfoEXT> createInfos;
+	for (size_t i = 0; i < pipeline->mShaders.size(); i++) {
+		const ShaderModule& shader = *pipeline->mShaders[i];
+		vk::ShaderCreateInfoEXT& createInfo = createInfos.emplace_back(vk::ShaderCreateInfoEXT{
+			.flags     = pipeline->mShaders.size() > 1 ? vk::ShaderCreateFlagBitsEXT::eLinkStage : vk::ShaderCreateFlagsEXT{},
+			.stage     = shader.Stage(),
+			.nextStage = i + 1 < pipeline->mShaders.size() ? vk::ShaderStageFlags(pipeline->mShaders[i + 1]->Stage()) : vk::ShaderStageFlags{},
+			.codeType  = vk::ShaderCodeTypeEXT::eSpirv,
+			.codeSize  = shader.Spirv().size() * sizeof(uint32_t),
+			.pCode     = shader.Spirv().data(),
+			.pName     = "main" });
+		createInfo.setSetLayouts(setLayouts);
+		createInfo.setPushConstantRanges(pipeline->mLayout->PushConstantRanges());
 	}
+	pipeline->mShaderObjects = device->createShadersEXT(createInfos);
 
-	vk::PipelineDynamicStateCreateInfo dynamicState = {};
-	dynamicState.setDynamicStates(info.dynamicStates);
-
-	vk::GraphicsPipelineCreateInfo createInfo = {
-		.pNext               = info.dynamicRenderingState.has_value() ? &dynamicRenderingState : nullptr,
-		.flags               = info.flags,
-		.pVertexInputState   = info.vertexInputState.has_value()   ? &vertexInputState : nullptr,
-		.pInputAssemblyState = info.inputAssemblyState.has_value() ? &info.inputAssemblyState.value() : nullptr,
-		.pTessellationState  = info.tessellationState.has_value()  ? &info.tessellationState.value()  : nullptr,
-		.pViewportState      = &viewportState,
-		.pRasterizationState = info.rasterizationState.has_value() ? &info.rasterizationState.value() : nullptr,
-		.pMultisampleState   = info.multisampleState.has_value()   ? &info.multisampleState.value()   : nullptr,
-		.pDepthStencilState  = info.depthStencilState.has_value()  ? &info.depthStencilState.value()  : nullptr,
-		.pColorBlendState    = info.colorBlendState.has_value()    ? &colorBlendState                 : nullptr,
-		.pDynamicState       = &dynamicState,
-		.layout              = ***pipeline->mLayout,
-		.renderPass          = info.renderPass,
-		.subpass             = info.subpassIndex };
-	createInfo.setStages(stages);
-	pipeline->mPipeline = device->createGraphicsPipeline(device.PipelineCache(), createInfo);
-	device.SetDebugName(***pipeline, name);
+	// every stage the device supports must be bound, so unused ones are bound to null
+	std::vector<vk::ShaderStageFlagBits> stages = { vk::ShaderStageFlagBits::eVertex, vk::ShaderStageFlagBits::eGeometry, vk::ShaderStageFlagBits::eFragment };
+	if (device.EnabledExtensions().contains(VK_EXT_MESH_SHADER_EXTENSION_NAME)) {
+		stages.emplace_back(vk::ShaderStageFlagBits::eTaskEXT);
+		stages.emplace_back(vk::ShaderStageFlagBits::eMeshEXT);
+	}
+	for (const vk::ShaderStageFlagBits stage : stages) {
+		vk::ShaderEXT handle = {};
+		for (size_t i = 0; i < pipeline->mShaders.size(); i++)
+			if (pipeline->mShaders[i]->Stage() == stage)
+				handle = *pipeline->mShaderObjects[i];
+		pipeline->mShaderObjectStages.emplace_back(stage);
+		pipeline->mShaderObjectHandles.emplace_back(handle);
+	}
+	for (size_t i = 0; i < pipeline->mShaders.size(); i++) {
+		if (std::ranges::find(stages, pipeline->mShaders[i]->Stage()) == stages.end()) {
+			pipeline->mShaderObjectStages.emplace_back(pipeline->mShaders[i]->Stage());
+			pipeline->mShaderObjectHandles.emplace_back(*pipeline->mShaderObjects[i]);
+		}
+	}
 
 	return pipeline;
 }
 
+bool Pipeline::UpdateOptimized(Device& device) {
+	if (!mOptimizedPipeline.valid() || mOptimizedPipeline.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+		return false;
+
+	vk::raii::Pipeline optimized = nullptr;
+	try {
+		optimized = mOptimizedPipeline.get();
+	} catch (std::exception& e) {
+		std::cerr << "Warning: Failed to create optimized pipeline: " << e.what() << std::endl;
+		return false;
+	}
+
+	// command buffers in flight may still reference the fast-linked pipeline
+	device.DeferDestroy(std::move(mPipeline));
+	mPipeline = std::move(optimized);
+	return true;
+}
+
 }
\ No newline at end of file
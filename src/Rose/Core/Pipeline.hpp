@@ -1,6 +1,7 @@
 #pragma once
 
 #include <optional>
+#include <future>
 
 #include "ShaderModule.hpp"
 
@@ -23,6 +24,8 @@ private:
 	PipelineLayoutInfo       mInfo = {};
 	ShaderParameterBinding   mRootBinding = {};
 	DescriptorSetLayouts     mDescriptorSetLayouts = {};
+	size_t                   mHash = 0; // equal for identically defined layouts
+	std::vector<vk::PushConstantRange> mPushConstantRanges = {};
 
 public:
 	static ref<PipelineLayout> Create(const Device& device, const vk::ArrayProxy<const ref<const ShaderModule>>& shaders, const PipelineLayoutInfo& info = {}, const DescriptorSetLayouts& descriptorSetLayouts = {});
@@ -36,6 +39,8 @@ public:
 	inline const DescriptorSetLayouts&   GetDescriptorSetLayouts() const { return mDescriptorSetLayouts; }
 	inline       vk::ShaderStageFlags    ShaderStageMask() const { return mStageMask; }
 	inline       vk::PipelineStageFlags2 PipelineStageMask() const { return mPipelineStageMask; }
+	inline       size_t                  Hash() const { return mHash; }
+	inline const std::vector<vk::PushConstantRange>& PushConstantRanges() const { return mPushConstantRanges; }
 };
 
 
@@ -94,11 +99,29 @@ private:
 	vk::raii::Pipeline        mPipeline = nullptr;
 	ref<const PipelineLayout> mLayout = {};
 	std::vector<ref<const ShaderModule>> mShaders = {};
+	vk::PipelineCreationFeedback mCreationFeedback = {};
+
+	// link-time optimized pipeline being compiled in the background, if this pipeline was fast-linked from libraries
+	std::future<vk::raii::Pipeline> mOptimizedPipeline = {};
+	// the library parts this pipeline was linked from. holding them keeps them in the device's part cache,
+	// so other pipelines sharing a part can fast-link for as long as this one exists
+	std::vector<ref<vk::raii::Pipeline>> mLibraries = {};
+
+	// VK_EXT_shader_object "pipelines" have no VkPipeline. The graphics state is set dynamically when binding instead.
+	std::vector<vk::raii::ShaderEXT>     mShaderObjects = {};
+	std::vector<vk::ShaderStageFlagBits> mShaderObjectStages = {};  // includes stages which must be bound to null
+	std::vector<vk::ShaderEXT>           mShaderObjectHandles = {};
+	std::optional<GraphicsPipelineInfo>  mGraphicsState = std::nullopt;
+
+	static void LinkGraphicsLibraries(const Device& device, Pipeline& pipeline, const GraphicsPipelineInfo& info);
 
 public:
 	static ref<Pipeline> CreateCompute(const Device& device, const ref<const ShaderModule>& shader, const ComputePipelineInfo& info = {}, const PipelineLayoutInfo& layoutInfo = {}, const DescriptorSetLayouts& descriptorSetLayouts = {});
 	static ref<Pipeline> CreateCompute(const Device& device, const ref<const ShaderModule>& shader, const ref<PipelineLayout>& layout, const ComputePipelineInfo& info = {});
 	static ref<Pipeline> CreateGraphics(const Device& device, const vk::ArrayProxy<const ref<const ShaderModule>>& shaders, const GraphicsPipelineInfo& info = {}, const PipelineLayoutInfo& layoutInfo = {}, const DescriptorSetLayouts& descriptorSetLayouts = {});
+	// Creates linked shader objects instead of a pipeline. Requires VK_EXT_shader_object. The vertex input state in info is
+	// ignored, since it is expected to be set per draw with CommandContext::SetVertexInput.
+	static ref<Pipeline> CreateShaderObjects(const Device& device, const vk::ArrayProxy<const ref<const ShaderModule>>& shaders, const GraphicsPipelineInfo& info = {}, const PipelineLayoutInfo& layoutInfo = {}, const DescriptorSetLayouts& descriptorSetLayouts = {});
 
 	inline       vk::raii::Pipeline& operator*()        { return mPipeline; }
 	inline const vk::raii::Pipeline& operator*() const  { return mPipeline; }
@@ -107,6 +130,17 @@ public:
 
 	inline const ref<const PipelineLayout>& Layout() const { return mLayout; }
 	inline const auto& Shaders() const { return mShaders; }
+	// Creation time (in ns) and whether the pipeline was found in the device's pipeline cache
+	inline const vk::PipelineCreationFeedback& CreationFeedback() const { return mCreationFeedback; }
+
+	inline bool IsOptimizing() const { return mOptimizedPipeline.valid(); }
+	inline bool IsShaderObject() const { return !mShaderObjects.empty(); }
+	inline const auto& ShaderObjectStages() const { return mShaderObjectStages; }
+	inline const auto& ShaderObjectHandles() const { return mShaderObjectHandles; }
+	inline const std::optional<GraphicsPipelineInfo>& GraphicsState() const { return mGraphicsState; }
+	// Swaps in the link-time optimized pipeline once its background compile finishes. The fast-linked
+	// pipeline is released after the GPU is done with it. Returns true if the pipeline changed.
+	bool UpdateOptimized(Device& device);
 	inline const ref<const ShaderModule>& GetShader() const { return *mShaders.begin(); }
 	inline const ref<const ShaderModule>& GetShader(const vk::ShaderStageFlagBits stage) const {
 		return *std::ranges::find(mShaders, stage, &ShaderModule::Stage);
@@ -62,7 +62,7 @@ public:
 		ref<ShaderModule>& shader = cachedShaders[index][defines];
 
 		// shader hot reload
-		if (shader && ImGui::IsKeyPressed(ImGuiKey_F5, false) && shader->IsStale())
+		if (shader && ImGui::GetCurrentContext() && ImGui::IsKeyPressed(ImGuiKey_F5, false) && shader->IsStale())
 			shader = {};
 
 		if (!shader) shader = ShaderModule::Create(device, stages[index].path, stages[index].entry, "sm_6_7", defines);
@@ -77,7 +77,7 @@ public:
 		if (auto it = cachedPipelines.find(key); it != cachedPipelines.end()) {
 			// shader hot reload
 			bool stale = false;
-			if (ImGui::IsKeyPressed(ImGuiKey_F5, false)) {
+			if (ImGui::GetCurrentContext() && ImGui::IsKeyPressed(ImGuiKey_F5, false)) {
 				for (const auto& shader : it->second->Shaders()) {
 					if (shader->IsStale()) {
 						stale = true;
@@ -86,10 +86,12 @@ public:
 				}
 			}
 			if (stale) {
-				device.Wait();
+				device.DeferDestroy(std::move(it->second));
 				cachedPipelines.erase(it);
-			} else
+			} else {
+				it->second->UpdateOptimized(device);
 				return it->second; // pipeline in cache
+			}
 		}
 
 		// pipeline not in cache. create & cache pipeline.
@@ -385,6 +385,7 @@ ref<ShaderModule> ShaderModule::Create(
 		std::span spirv{(const uint32_t*)blob->getBufferPointer(), blob->getBufferSize()/sizeof(uint32_t)};
 
 		shader->mSpirvHash = HashRange(spirv);
+		shader->mSpirv.assign(spirv.begin(), spirv.end());
 		shader->mModule = device->createShaderModule(vk::ShaderModuleCreateInfo{}.setCode(spirv));
 		blob->Release();
 	}
@@ -62,6 +62,7 @@ class ShaderModule {
 private:
 	vk::raii::ShaderModule mModule = nullptr;
 	size_t mSpirvHash = 0;
+	std::vector<uint32_t> mSpirv = {}; // kept for creating shader objects
 
 	std::string mEntryPointName = {};
 
@@ -93,6 +94,8 @@ public:
 	inline const vk::raii::ShaderModule* operator->() const { return &mModule; }
 
 	inline vk::ShaderStageFlagBits       Stage() const { return mStage; }
+	inline size_t                        SpirvHash() const { return mSpirvHash; }
+	inline const std::vector<uint32_t>&  Spirv() const { return mSpirv; }
 	inline uint3                         WorkgroupSize() const { return mWorkgroupSize; }
 	inline const ShaderParameterBinding& RootBinding() const { return mRootBinding; }
 	inline const auto&                   EntryPointArguments() const { return mEntryPointArguments; }
@@ -59,7 +59,12 @@ bool Swapchain::Recreate(vk::SurfaceKHR surface, const std::vector<uint32_t>& qu
 	info.setQueueFamilyIndices(queueFamilies);
 	mSwapchain = std::move( vk::raii::SwapchainKHR(**mDevice, info) );
 
-	oldSwapchain = nullptr;
+	// frames in flight may still be using the old swapchain's images
+	if (*oldSwapchain)
+		mDevice->DeferDestroy(std::move(oldSwapchain));
+	if (!mImages.empty())
+		mDevice->DeferDestroy(std::move(mImages));
+	mImages.clear();
 
 	const auto images = mSwapchain.getImages();
 
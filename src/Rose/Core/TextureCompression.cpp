@@ -0,0 +1,761 @@
+#include "TextureCompression.hpp"
+#include "Device.hpp"
+#include "Hash.hpp"
+
+#include <stb_image.h>
+#include <glm/gtc/packing.hpp>
+
+#include <atomic>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include <thread>
+
+namespace RoseEngine {
+
+// bump when the encoders or the cache file layout change
+static constexpr uint32_t kCompressedImageVersion = 1;
+static constexpr uint32_t kCompressedImageMagic   = 0x54434252; // "RBCT"
+
+// Mip generation
+
+static const std::array<float, 256> kSrgbToLinear = []() {
+	std::array<float, 256> lut = {};
+	for (uint32_t i = 0; i < 256; i++) {
+		const float c = i / 255.f;
+		lut[i] = c <= 0.04045f ? c / 12.92f : std::pow((c + 0.055f) / 1.055f, 2.4f);
+	}
+	return lut;
+}();
+
+static uint8_t LinearToSrgb(const float c) {
+	const float s = c <= 0.0031308f ? c * 12.92f : 1.055f * std::pow(c, 1/2.4f) - 0.055f;
+	return (uint8_t)std::clamp(s * 255 + 0.5f, 0.f, 255.f);
+}
+
+static std::vector<uint8_t> Downsample(const std::span<const uint8_t> src, const uint2 srcExtent, const uint2 dstExtent, const uint32_t channels, const bool srgb) {
+	std::vector<uint8_t> dst(size_t(dstExtent.x) * dstExtent.y * channels);
+	for (uint32_t y = 0; y < dstExtent.y; y++) {
+		for (uint32_t x = 0; x < dstExtent.x; x++) {
+			const uint32_t x0 = std::min(2*x, srcExtent.x - 1), x1 = std::min(2*x + 1, srcExtent.x - 1);
+			const uint32_t y0 = std::min(2*y, srcExtent.y - 1), y1 = std::min(2*y + 1, srcExtent.y - 1);
+			const std::array<const uint8_t*, 4> texels = {
+				&src[(size_t(y0) * srcExtent.x + x0) * channels],
+				&src[(size_t(y0) * srcExtent.x + x1) * channels],
+				&src[(size_t(y1) * srcExtent.x + x0) * channels],
+				&src[(size_t(y1) * srcExtent.x + x1) * channels] };
+			uint8_t* out = &dst[(size_t(y) * dstExtent.x + x) * channels];
+			for (uint32_t c = 0; c < channels; c++) {
+				if (srgb && c < 3) {
+					float sum = 0;
+					for (const uint8_t* t : texels) sum += kSrgbToLinear[t[c]];
+					out[c] = LinearToSrgb(sum / 4);
+				} else {
+					uint32_t sum = 0;
+					for (const uint8_t* t : texels) sum += t[c];
+					out[c] = uint8_t((sum + 2) / 4);
+				}
+			}
+		}
+	}
+	return dst;
+}
+
+// BC4: two 8 bit endpoints and 3 bit indices into 8 interpolated values
+
+static uint64_t EncodeBC4Block(const std::array<uint8_t, 16>& values) {
+	const auto[minIt, maxIt] = std::ranges::minmax_element(values);
+	const uint32_t r0 = *maxIt, r1 = *minIt;
+	if (r0 == r1) return r0 | (r1 << 8);
+
+	std::array<uint32_t, 8> palette = { r0, r1 };
+	for (uint32_t k = 2; k < 8; k++)
+		palette[k] = ((8 - k) * r0 + (k - 1) * r1 + 3) / 7;
+
+	uint64_t block = r0 | (r1 << 8);
+	for (uint32_t i = 0; i < 16; i++) {
+		uint32_t best = 0;
+		uint32_t bestError = ~0u;
+		for (uint32_t k = 0; k < 8; k++) {
+			const uint32_t e = (uint32_t)std::abs((int)palette[k] - (int)values[i]);
+			if (e < bestError) { bestError = e; best = k; }
+		}
+		block |= uint64_t(best) << (16 + 3*i);
+	}
+	return block;
+}
+
+static std::array<uint8_t, 16> DecodeBC4Block(const uint64_t block) {
+	const uint32_t r0 = block & 0xFF, r1 = (block >> 8) & 0xFF;
+	std::array<uint32_t, 8> palette = { r0, r1 };
+	for (uint32_t k = 2; k < 8; k++)
+		palette[k] = r0 > r1 ? ((8 - k) * r0 + (k - 1) * r1 + 3) / 7 : (k < 6 ? ((6 - k) * r0 + (k - 1) * r1 + 2) / 5 : (k == 6 ? 0 : 255));
+	std::array<uint8_t, 16> values;
+	for (uint32_t i = 0; i < 16; i++)
+		values[i] = (uint8_t)palette[(block >> (16 + 3*i)) & 7];
+	return values;
+}
+
+// BC7 mode 6: one subset, RGBA endpoints with 7 bits per channel plus a shared low bit per endpoint, and 4 bit indices
+
+static constexpr std::array<uint32_t, 16> kBC7Weights = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+
+struct BC7Endpoints {
+	std::array<uint32_t, 4> q[2]; // 7 bit values
+	uint32_t p[2];                // shared low bits
+	inline uint32_t Value(const uint32_t e, const uint32_t c) const { return (q[e][c] << 1) | p[e]; }
+};
+
+// quantizes each endpoint with whichever low bit represents it best. opaque endpoints keep
+// the low bit set, since alpha is only exactly 255 with it.
+static BC7Endpoints QuantizeBC7(const float4& e0, const float4& e1) {
+	BC7Endpoints r;
+	for (uint32_t e = 0; e < 2; e++) {
+		const float4& v = e == 0 ? e0 : e1;
+		float bestError = std::numeric_limits<float>::max();
+		for (uint32_t p = v.w >= 254.5f ? 1 : 0; p < 2; p++) {
+			std::array<uint32_t, 4> q;
+			float error = 0;
+			for (uint32_t c = 0; c < 4; c++) {
+				q[c] = (uint32_t)std::clamp(std::round((v[c] - p) / 2), 0.f, 127.f);
+				const float d = float((q[c] << 1) | p) - v[c];
+				error += d*d;
+			}
+			if (error < bestError) { bestError = error; r.q[e] = q; r.p[e] = p; }
+		}
+	}
+	return r;
+}
+
+// finds the best index for each pixel, returns the total squared error
+static float SelectBC7Indices(const std::array<float4, 16>& pixels, const BC7Endpoints& endpoints, std::array<uint32_t, 16>& indices) {
+	std::array<float4, 16> palette;
+	for (uint32_t k = 0; k < 16; k++)
+		for (uint32_t c = 0; c < 4; c++)
+			palette[k][c] = float(((64 - kBC7Weights[k]) * endpoints.Value(0, c) + kBC7Weights[k] * endpoints.Value(1, c) + 32) >> 6);
+
+	float totalError = 0;
+	for (uint32_t i = 0; i < 16; i++) {
+		float bestError = std::numeric_limits<float>::max();
+		for (uint32_t k = 0; k < 16; k++) {
+			const float4 d = palette[k] - pixels[i];
+			const float e = dot(d, d);
+			if (e < bestError) { bestError = e; indices[i] = k; }
+		}
+		totalError += bestError;
+	}
+	return totalError;
+}
+
+static std::array<uint64_t, 2> EncodeBC7Block(const std::array<float4, 16>& pixels) {
+	// fit endpoints to the principal axis of the block
+	float4 mean = float4(0);
+	for (const float4& p : pixels) mean += p;
+	mean /= 16.f;
+
+	float4x4 covariance = float4x4(0);
+	for (const float4& p : pixels) {
+		const float4 d = p - mean;
+		covariance += glm::outerProduct(d, d);
+	}
+
+	float4 axis = float4(1, 1, 1, 1);
+	for (uint32_t i = 0; i < 8; i++) {
+		axis = covariance * axis;
+		const float len = glm::length(axis);
+		if (len < 1e-6f) { axis = float4(0); break; }
+		axis /= len;
+	}
+
+	float tmin = 0, tmax = 0;
+	for (const float4& p : pixels) {
+		const float t = dot(p - mean, axis);
+		tmin = std::min(tmin, t);
+		tmax = std::max(tmax, t);
+	}
+
+	BC7Endpoints endpoints = QuantizeBC7(clamp(mean + axis * tmin, float4(0), float4(255)), clamp(mean + axis * tmax, float4(0), float4(255)));
+	std::array<uint32_t, 16> indices;
+	float error = SelectBC7Indices(pixels, endpoints, indices);
+
+	// refine the endpoints with a least squares fit to the selected weights
+	if (error > 0) {
+		float aa = 0, ab = 0, bb = 0;
+		float4 ax = float4(0), bx = float4(0);
+		for (uint32_t i = 0; i < 16; i++) {
+			const float w = kBC7Weights[indices[i]] / 64.f;
+			aa += (1 - w) * (1 - w);
+			ab += (1 - w) * w;
+			bb += w * w;
+			ax += (1 - w) * pixels[i];
+			bx += w * pixels[i];
+		}
+		const float det = aa * bb - ab * ab;
+		if (std::abs(det) > 1e-6f) {
+			const float4 e0 = clamp((ax * bb - bx * ab) / det, float4(0), float4(255));
+			const float4 e1 = clamp((bx * aa - ax * ab) / det, float4(0), float4(255));
+			const BC7Endpoints refined = QuantizeBC7(e0, e1);
+			std::array<uint32_t, 16> refinedIndices;
+			const float refinedError = SelectBC7Indices(pixels, refined, refinedIndices);
+			if (refinedError < error) {
+				endpoints = refined;
+				indices = refinedIndices;
+			}
+		}
+	}
+
+	// the first index is stored without its high bit, so swap the endpoints if it is set
+	if (indices[0] >= 8) {
+		std::swap(endpoints.q[0], endpoints.q[1]);
+		std::swap(endpoints.p[0], endpoints.p[1]);
+		for (uint32_t& i : indices) i = 15 - i;
+	}
+
+	std::array<uint64_t, 2> block = {};
+	uint32_t pos = 0;
+	auto write = [&](const uint64_t v, const uint32_t bits) {
+		for (uint32_t i = 0; i < bits; i++, pos++)
+			block[pos >> 6] |= ((v >> i) & 1) << (pos & 63);
+	};
+	write(1 << 6, 7);
+	for (uint32_t c = 0; c < 4; c++) {
+		write(endpoints.q[0][c], 7);
+		write(endpoints.q[1][c], 7);
+	}
+	write(endpoints.p[0], 1);
+	write(endpoints.p[1], 1);
+	for (uint32_t i = 0; i < 16; i++)
+		write(indices[i], i == 0 ? 3 : 4);
+	return block;
+}
+
+static std::array<glm::u8vec4, 16> DecodeBC7Block(const std::array<uint64_t, 2>& block) {
+	uint32_t pos = 0;
+	auto read = [&](const uint32_t bits) {
+		uint32_t v = 0;
+		for (uint32_t i = 0; i < bits; i++, pos++)
+			v |= uint32_t((block[pos >> 6] >> (pos & 63)) & 1) << i;
+		return v;
+	};
+	if (read(7) != (1 << 6)) return {}; // only mode 6 is produced by EncodeBC7Block
+
+	BC7Endpoints endpoints;
+	for (uint32_t c = 0; c < 4; c++) {
+		endpoints.q[0][c] = read(7);
+		endpoints.q[1][c] = read(7);
+	}
+	endpoints.p[0] = read(1);
+	endpoints.p[1] = read(1);
+
+	std::array<glm::u8vec4, 16> pixels;
+	for (uint32_t i = 0; i < 16; i++) {
+		const uint32_t w = kBC7Weights[read(i == 0 ? 3 : 4)];
+		for (uint32_t c = 0; c < 4; c++)
+			pixels[i][c] = uint8_t(((64 - w) * endpoints.Value(0, c) + w * endpoints.Value(1, c) + 32) >> 6);
+	}
+	return pixels;
+}
+
+// BC6H mode 11 (unsigned): one region, RGB endpoints with 10 bits per channel and 4 bit indices.
+// Endpoints are interpolated on the bit patterns of the half floats, which are close to a log scale,
+// so endpoints are fit and errors are measured on the bit patterns rather than on the float values.
+
+static uint16_t FloatToHalfUF16(const float f) {
+	// BC6H_UF16 has no negative values, and values above the largest half would become infinity
+	return (uint16_t)glm::packHalf1x16(f > 0 ? std::min(f, 65504.f) : 0.f);
+}
+static float HalfToFloat(const uint16_t h) {
+	return glm::unpackHalf1x16(h);
+}
+
+static uint32_t UnquantizeBC6H(const uint32_t q) {
+	if (q == 0)    return 0;
+	if (q == 1023) return 0xFFFF;
+	return ((q << 16) + 0x8000) >> 10;
+}
+// interpolated values are scaled to half bit patterns
+static uint32_t FinishUnquantizeBC6H(const uint32_t v) {
+	return (v * 31) >> 6;
+}
+static uint32_t InterpolateBC6H(const uint32_t q0, const uint32_t q1, const uint32_t w) {
+	return FinishUnquantizeBC6H((UnquantizeBC6H(q0) * (64 - w) + UnquantizeBC6H(q1) * w + 32) >> 6);
+}
+static uint32_t QuantizeBC6H(const uint32_t h) {
+	const uint32_t q = std::min((h << 6) / 31 >> 6, 1023u);
+	uint32_t best = q;
+	for (uint32_t c = q > 0 ? q - 1 : q; c <= std::min(q + 1, 1023u); c++)
+		if (std::abs(int(FinishUnquantizeBC6H(UnquantizeBC6H(c))) - int(h)) < std::abs(int(FinishUnquantizeBC6H(UnquantizeBC6H(best))) - int(h)))
+			best = c;
+	return best;
+}
+
+static std::array<uint64_t, 2> EncodeBC6HBlock(const std::array<glm::u16vec3, 16>& pixels) {
+	// bounding box of the block. channels which decrease along the channel with the largest range use the other diagonal
+	glm::u16vec3 lo = pixels[0], hi = pixels[0];
+	float3 mean = float3(0);
+	for (const glm::u16vec3& p : pixels) {
+		lo = min(lo, p);
+		hi = max(hi, p);
+		mean += float3(p) / 16.f;
+	}
+	const glm::u16vec3 range = hi - lo;
+	const uint32_t k = range.x >= range.y && range.x >= range.z ? 0 : range.y >= range.z ? 1 : 2;
+
+	std::array<std::array<uint32_t, 3>, 2> q;
+	for (uint32_t c = 0; c < 3; c++) {
+		float covariance = 0;
+		for (const glm::u16vec3& p : pixels)
+			covariance += (p[c] - mean[c]) * (p[k] - mean[k]);
+		q[0][c] = QuantizeBC6H(covariance < 0 ? hi[c] : lo[c]);
+		q[1][c] = QuantizeBC6H(covariance < 0 ? lo[c] : hi[c]);
+	}
+
+	std::array<glm::u16vec3, 16> palette;
+	for (uint32_t i = 0; i < 16; i++)
+		for (uint32_t c = 0; c < 3; c++)
+			palette[i][c] = (uint16_t)InterpolateBC6H(q[0][c], q[1][c], kBC7Weights[i]);
+
+	std::array<uint32_t, 16> indices;
+	for (uint32_t i = 0; i < 16; i++) {
+		int64_t bestError = std::numeric_limits<int64_t>::max();
+		for (uint32_t j = 0; j < 16; j++) {
+			const int3 d = int3(palette[j]) - int3(pixels[i]);
+			const int64_t error = int64_t(d.x)*d.x + int64_t(d.y)*d.y + int64_t(d.z)*d.z;
+			if (error < bestError) { bestError = error; indices[i] = j; }
+		}
+	}
+
+	// the first index is stored without its high bit. the weights are symmetric, so swapping the endpoints flips the indices
+	if (indices[0] >= 8) {
+		std::swap(q[0], q[1]);
+		for (uint32_t& i : indices) i = 15 - i;
+	}
+
+	std::array<uint64_t, 2> block = {};
+	uint32_t pos = 0;
+	auto write = [&](const uint64_t value, const uint32_t bits) {
+		for (uint32_t i = 0; i < bits; i++, pos++)
+			block[pos >> 6] |= ((value >> i) & 1) << (pos & 63);
+	};
+	write(0x03, 5); // mode 11
+	for (uint32_t e = 0; e < 2; e++)
+		for (uint32_t c = 0; c < 3; c++)
+			write(q[e][c], 10);
+	for (uint32_t i = 0; i < 16; i++)
+		write(indices[i], i == 0 ? 3 : 4);
+	return block;
+}
+
+static std::array<glm::u16vec3, 16> DecodeBC6HBlock(const std::array<uint64_t, 2>& block) {
+	uint32_t pos = 0;
+	auto read = [&](const uint32_t bits) {
+		uint32_t v = 0;
+		for (uint32_t i = 0; i < bits; i++, pos++)
+			v |= uint32_t((block[pos >> 6] >> (pos & 63)) & 1) << i;
+		return v;
+	};
+	if (read(5) != 0x03) return {}; // only mode 11 is produced by EncodeBC6HBlock
+
+	std::array<std::array<uint32_t, 3>, 2> q;
+	for (uint32_t e = 0; e < 2; e++)
+		for (uint32_t c = 0; c < 3; c++)
+			q[e][c] = read(10);
+
+	std::array<glm::u16vec3, 16> pixels;
+	for (uint32_t i = 0; i < 16; i++) {
+		const uint32_t w = kBC7Weights[read(i == 0 ? 3 : 4)];
+		for (uint32_t c = 0; c < 3; c++)
+			pixels[i][c] = (uint16_t)InterpolateBC6H(q[0][c], q[1][c], w);
+	}
+	return pixels;
+}
+
+// Compresses one level of RGB half floats to BC6H on worker threads. Returns the squared error over the half bit patterns.
+static double CompressLevelBC6H(const std::span<const glm::u16vec3> pixels, const uint2 extent, std::byte* dst) {
+	const uint2 blocks = (extent + 3u) / 4u;
+
+	std::atomic_uint32_t nextRow = 0;
+	std::vector<double> rowErrors(blocks.y, 0.0);
+	auto compressRows = [&]() {
+		for (uint32_t by = nextRow++; by < blocks.y; by = nextRow++) {
+			for (uint32_t bx = 0; bx < blocks.x; bx++) {
+				// texels past the edge of the level repeat the last row/column
+				std::array<glm::u16vec3, 16> texels;
+				for (uint32_t i = 0; i < 16; i++) {
+					const uint32_t x = std::min(bx*4 + i % 4, extent.x - 1);
+					const uint32_t y = std::min(by*4 + i / 4, extent.y - 1);
+					texels[i] = pixels[size_t(y) * extent.x + x];
+				}
+
+				const std::array<uint64_t, 2> block = EncodeBC6HBlock(texels);
+				std::memcpy(dst + (size_t(by) * blocks.x + bx) * sizeof(block), block.data(), sizeof(block));
+
+				const std::array<glm::u16vec3, 16> decoded = DecodeBC6HBlock(block);
+				for (uint32_t i = 0; i < 16; i++) {
+					if (bx*4 + i % 4 >= extent.x || by*4 + i / 4 >= extent.y) continue;
+					const double3 d = double3(decoded[i]) - double3(texels[i]);
+					rowErrors[by] += dot(d, d);
+				}
+			}
+		}
+	};
+
+	{
+		std::vector<std::jthread> workers(std::min<size_t>(std::max(std::thread::hardware_concurrency(), 1u), blocks.y));
+		for (std::jthread& worker : workers)
+			worker = std::jthread(compressRows);
+	}
+
+	double error = 0;
+	for (const double e : rowErrors) error += e;
+	return error;
+}
+
+// Compresses one level. Writes the block data to dst and returns the squared error over the stored channels.
+static double CompressLevel(const std::span<const uint8_t> rgba, const uint2 extent, const vk::Format format, const uint2 sourceChannels, std::byte* dst) {
+	const bool bc7 = format == vk::Format::eBc7UnormBlock || format == vk::Format::eBc7SrgbBlock;
+	const uint32_t channels = bc7 ? 4 : format == vk::Format::eBc5UnormBlock ? 2 : 1;
+	const uint2 blocks = (extent + 3u) / 4u;
+
+	double error = 0;
+	for (uint32_t by = 0; by < blocks.y; by++) {
+		for (uint32_t bx = 0; bx < blocks.x; bx++) {
+			// texels past the edge of the level repeat the last row/column
+			std::array<glm::u8vec4, 16> texels;
+			for (uint32_t i = 0; i < 16; i++) {
+				const uint32_t x = std::min(bx*4 + i % 4, extent.x - 1);
+				const uint32_t y = std::min(by*4 + i / 4, extent.y - 1);
+				std::memcpy(&texels[i], &rgba[(size_t(y) * extent.x + x) * 4], 4);
+			}
+
+			std::array<glm::u8vec4, 16> decoded = texels;
+			if (bc7) {
+				std::array<float4, 16> pixels;
+				for (uint32_t i = 0; i < 16; i++) pixels[i] = float4(texels[i]);
+				const std::array<uint64_t, 2> block = EncodeBC7Block(pixels);
+				std::memcpy(dst, block.data(), sizeof(block));
+				dst += sizeof(block);
+				decoded = DecodeBC7Block(block);
+			} else {
+				for (uint32_t c = 0; c < channels; c++) {
+					std::array<uint8_t, 16> values;
+					for (uint32_t i = 0; i < 16; i++) values[i] = texels[i][sourceChannels[c]];
+					const uint64_t block = EncodeBC4Block(values);
+					std::memcpy(dst, &block, sizeof(block));
+					dst += sizeof(block);
+					values = DecodeBC4Block(block);
+					for (uint32_t i = 0; i < 16; i++) decoded[i][sourceChannels[c]] = values[i];
+				}
+			}
+
+			for (uint32_t i = 0; i < 16; i++) {
+				if (bx*4 + i % 4 >= extent.x || by*4 + i / 4 >= extent.y) continue;
+				for (uint32_t c = 0; c < channels; c++) {
+					const double d = double(decoded[i][sourceChannels[c]]) - double(texels[i][sourceChannels[c]]);
+					error += d*d;
+				}
+			}
+		}
+	}
+	return error;
+}
+
+HostPixelData CompressImage(const std::span<const uint8_t> rgba, const uint2 extent, const vk::Format format, const uint2 sourceChannels, float* psnr) {
+	if (!IsCpuCompressible(format))
+		throw std::invalid_argument("Unsupported compressed format: " + vk::to_string(format));
+
+	const bool bc7 = format == vk::Format::eBc7UnormBlock || format == vk::Format::eBc7SrgbBlock;
+	const uint32_t channels = bc7 ? 4 : format == vk::Format::eBc5UnormBlock ? 2 : 1;
+	const size_t blockSize = format == vk::Format::eBc4UnormBlock ? 8 : 16;
+	const uint32_t mipLevels = GetMaxMipLevels(uint3(extent, 1));
+
+	HostPixelData d;
+	d.pixels = PixelData{
+		.format = format,
+		.extent = uint3(extent, 1),
+		.mipLevels = mipLevels };
+
+	if (!bc7 && (sourceChannels.x != 0 || (channels == 2 && sourceChannels.y != 1))) {
+		// move the stored channels back to where they were sampled from
+		std::array<vk::ComponentSwizzle, 4> swizzle = { vk::ComponentSwizzle::eZero, vk::ComponentSwizzle::eZero, vk::ComponentSwizzle::eZero, vk::ComponentSwizzle::eOne };
+		for (uint32_t c = 0; c < channels; c++)
+			swizzle[sourceChannels[c]] = vk::ComponentSwizzle(uint32_t(vk::ComponentSwizzle::eR) + c);
+		d.pixels.components = vk::ComponentMapping{ swizzle[0], swizzle[1], swizzle[2], swizzle[3] };
+	}
+
+	size_t totalSize = 0;
+	for (uint32_t level = 0; level < mipLevels; level++) {
+		const uint2 e = max(extent >> level, uint2(1));
+		totalSize += size_t((e.x + 3) / 4) * ((e.y + 3) / 4) * blockSize;
+	}
+	d.bytes.resize(totalSize);
+
+	std::vector<uint8_t> levelPixels;
+	std::span<const uint8_t> src = rgba;
+	size_t offset = 0;
+	for (uint32_t level = 0; level < mipLevels; level++) {
+		const uint2 e = max(extent >> level, uint2(1));
+		if (level > 0) {
+			levelPixels = Downsample(src, max(extent >> (level - 1), uint2(1)), e, 4, format == vk::Format::eBc7SrgbBlock);
+			src = levelPixels;
+		}
+
+		const double error = CompressLevel(src, e, format, sourceChannels, d.bytes.data() + offset);
+		if (level == 0 && psnr) {
+			const double mse = error / (double(e.x) * e.y * channels);
+			*psnr = mse > 0 ? float(10 * std::log10(255.0 * 255.0 / mse)) : std::numeric_limits<float>::infinity();
+		}
+
+		d.pixels.regions.emplace_back(vk::BufferImageCopy{
+			.bufferOffset = offset,
+			.bufferRowLength = 0,
+			.bufferImageHeight = 0,
+			.imageSubresource = vk::ImageSubresourceLayers{
+				.aspectMask = vk::ImageAspectFlagBits::eColor,
+				.mipLevel = level,
+				.baseArrayLayer = 0,
+				.layerCount = 1 },
+			.imageOffset = { 0, 0, 0 },
+			.imageExtent = vk::Extent3D{ e.x, e.y, 1 } });
+		offset += size_t((e.x + 3) / 4) * ((e.y + 3) / 4) * blockSize;
+	}
+
+	return d;
+}
+
+HostPixelData CompressHdrImage(const std::span<const uint16_t> pixels, const uint2 extent, const uint32_t channels, float* psnr) {
+	const uint32_t mipLevels = GetMaxMipLevels(uint3(extent, 1));
+
+	HostPixelData d;
+	d.pixels = PixelData{
+		.format = vk::Format::eBc6HUfloatBlock,
+		.extent = uint3(extent, 1),
+		.mipLevels = mipLevels };
+
+	size_t totalSize = 0;
+	for (uint32_t level = 0; level < mipLevels; level++) {
+		const uint2 e = max(extent >> level, uint2(1));
+		totalSize += size_t((e.x + 3) / 4) * ((e.y + 3) / 4) * 16;
+	}
+	d.bytes.resize(totalSize);
+
+	// levels are box filtered on float values, then stored as half floats for the encoder
+	std::vector<float3> level(size_t(extent.x) * extent.y);
+	for (size_t i = 0; i < level.size(); i++)
+		for (uint32_t c = 0; c < 3; c++)
+			level[i][c] = HalfToFloat(pixels[i * channels + std::min(c, channels - 1)]);
+
+	std::vector<glm::u16vec3> halfs;
+	size_t offset = 0;
+	for (uint32_t l = 0; l < mipLevels; l++) {
+		const uint2 e = max(extent >> l, uint2(1));
+		if (l > 0) {
+			const uint2 srcExtent = max(extent >> (l - 1), uint2(1));
+			std::vector<float3> dst(size_t(e.x) * e.y);
+			for (uint32_t y = 0; y < e.y; y++) {
+				for (uint32_t x = 0; x < e.x; x++) {
+					const uint32_t x0 = std::min(2*x, srcExtent.x - 1), x1 = std::min(2*x + 1, srcExtent.x - 1);
+					const uint32_t y0 = std::min(2*y, srcExtent.y - 1), y1 = std::min(2*y + 1, srcExtent.y - 1);
+					dst[size_t(y) * e.x + x] = (
+						level[size_t(y0) * srcExtent.x + x0] + level[size_t(y0) * srcExtent.x + x1] +
+						level[size_t(y1) * srcExtent.x + x0] + level[size_t(y1) * srcExtent.x + x1]) / 4.f;
+				}
+			}
+			level = std::move(dst);
+		}
+
+		halfs.resize(level.size());
+		for (size_t i = 0; i < level.size(); i++)
+			halfs[i] = glm::u16vec3(FloatToHalfUF16(level[i].x), FloatToHalfUF16(level[i].y), FloatToHalfUF16(level[i].z));
+
+		const double error = CompressLevelBC6H(halfs, e, d.bytes.data() + offset);
+		if (l == 0 && psnr) {
+			const double mse = error / (double(e.x) * e.y * 3);
+			*psnr = mse > 0 ? float(10 * std::log10(double(0x7BFF) * 0x7BFF / mse)) : std::numeric_limits<float>::infinity();
+		}
+
+		d.pixels.regions.emplace_back(vk::BufferImageCopy{
+			.bufferOffset = offset,
+			.bufferRowLength = 0,
+			.bufferImageHeight = 0,
+			.imageSubresource = vk::ImageSubresourceLayers{
+				.aspectMask = vk::ImageAspectFlagBits::eColor,
+				.mipLevel = l,
+				.baseArrayLayer = 0,
+				.layerCount = 1 },
+			.imageOffset = { 0, 0, 0 },
+			.imageExtent = vk::Extent3D{ e.x, e.y, 1 } });
+		offset += size_t((e.x + 3) / 4) * ((e.y + 3) / 4) * 16;
+	}
+
+	return d;
+}
+
+bool GenerateMipLevels(HostPixelData& d) {
+	uint32_t channels = 0;
+	bool srgb = false;
+	switch (d.pixels.format) {
+		case vk::Format::eR8Unorm:       channels = 1; break;
+		case vk::Format::eR8Srgb:        channels = 1; srgb = true; break;
+		case vk::Format::eR8G8Unorm:     channels = 2; break;
+		case vk::Format::eR8G8Srgb:      channels = 2; srgb = true; break;
+		case vk::Format::eR8G8B8A8Unorm: channels = 4; break;
+		case vk::Format::eR8G8B8A8Srgb:  channels = 4; srgb = true; break;
+		default: return false;
+	}
+	if (d.pixels.mipLevels != 1 || d.pixels.arrayLayers != 1 || d.pixels.extent.z != 1 || !d.pixels.regions.empty())
+		return false;
+
+	const uint2 extent = uint2(d.pixels.extent);
+	const uint32_t mipLevels = GetMaxMipLevels(d.pixels.extent);
+
+	size_t totalSize = 0;
+	for (uint32_t level = 0; level < mipLevels; level++) {
+		const uint2 e = max(extent >> level, uint2(1));
+		totalSize += size_t(e.x) * e.y * channels;
+	}
+
+	std::vector<std::byte> bytes(totalSize);
+	std::memcpy(bytes.data(), d.bytes.data(), size_t(extent.x) * extent.y * channels);
+
+	size_t offset = 0;
+	for (uint32_t level = 0; level < mipLevels; level++) {
+		const uint2 e = max(extent >> level, uint2(1));
+		const size_t size = size_t(e.x) * e.y * channels;
+		if (level > 0) {
+			const uint2 srcExtent = max(extent >> (level - 1), uint2(1));
+			const std::span<const uint8_t> src = { reinterpret_cast<const uint8_t*>(bytes.data()) + offset - size_t(srcExtent.x) * srcExtent.y * channels, size_t(srcExtent.x) * srcExtent.y * channels };
+			const std::vector<uint8_t> dst = Downsample(src, srcExtent, e, channels, srgb);
+			std::memcpy(bytes.data() + offset, dst.data(), size);
+		}
+
+		d.pixels.regions.emplace_back(vk::BufferImageCopy{
+			.bufferOffset = offset,
+			.bufferRowLength = 0,
+			.bufferImageHeight = 0,
+			.imageSubresource = vk::ImageSubresourceLayers{
+				.aspectMask = vk::ImageAspectFlagBits::eColor,
+				.mipLevel = level,
+				.baseArrayLayer = 0,
+				.layerCount = 1 },
+			.imageOffset = { 0, 0, 0 },
+			.imageExtent = vk::Extent3D{ e.x, e.y, 1 } });
+		offset += size;
+	}
+
+	d.bytes = std::move(bytes);
+	d.pixels.mipLevels = mipLevels;
+	return true;
+}
+
+// Cache files: a header, the copy regions, then the block data
+
+struct CompressedImageHeader {
+	uint32_t magic;
+	uint32_t version;
+	vk::Format format;
+	uint3 extent;
+	uint32_t mipLevels;
+	vk::ComponentMapping components;
+	float psnr;
+	uint32_t regionCount;
+	uint64_t dataSize;
+};
+
+static std::filesystem::path CompressedImagePath(const std::filesystem::path& cacheDirectory, const uint64_t key) {
+	std::stringstream name;
+	name << std::hex << std::setfill('0') << std::setw(16) << key << ".bc";
+	return cacheDirectory / name.str();
+}
+
+std::optional<HostPixelData> LoadCompressedImage(const std::filesystem::path& cacheDirectory, const uint64_t key, float* psnr) {
+	std::ifstream file(CompressedImagePath(cacheDirectory, key), std::ios::binary);
+	if (!file) return std::nullopt;
+
+	CompressedImageHeader header;
+	if (!file.read(reinterpret_cast<char*>(&header), sizeof(header)) ||
+		header.magic != kCompressedImageMagic ||
+		header.version != kCompressedImageVersion ||
+		!IsCpuCompressible(header.format))
+		return std::nullopt;
+
+	HostPixelData d;
+	d.pixels = PixelData{
+		.format = header.format,
+		.extent = header.extent,
+		.mipLevels = header.mipLevels,
+		.components = header.components,
+		.regions = std::vector<vk::BufferImageCopy>(header.regionCount) };
+	d.bytes.resize(header.dataSize);
+	if (!file.read(reinterpret_cast<char*>(d.pixels.regions.data()), d.pixels.regions.size() * sizeof(vk::BufferImageCopy)) ||
+		!file.read(reinterpret_cast<char*>(d.bytes.data()), d.bytes.size()))
+		return std::nullopt;
+
+	if (psnr) *psnr = header.psnr;
+	return d;
+}
+
+void StoreCompressedImage(const std::filesystem::path& cacheDirectory, const uint64_t key, const HostPixelData& image, const float psnr) {
+	const CompressedImageHeader header {
+		.magic = kCompressedImageMagic,
+		.version = kCompressedImageVersion,
+		.format = image.pixels.format,
+		.extent = image.pixels.extent,
+		.mipLevels = image.pixels.mipLevels,
+		.components = image.pixels.components,
+		.psnr = psnr,
+		.regionCount = (uint32_t)image.pixels.regions.size(),
+		.dataSize = image.bytes.size() };
+
+	try {
+		std::filesystem::create_directories(cacheDirectory);
+		const std::filesystem::path path = CompressedImagePath(cacheDirectory, key);
+		// written to a temporary file first, since other threads or processes may be reading the same entry
+		std::filesystem::path tmp = path;
+		tmp += ".tmp" + std::to_string(std::hash<std::thread::id>{}(std::this_thread::get_id()));
+		{
+			std::ofstream file(tmp, std::ios::binary | std::ios::trunc);
+			file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+			file.write(reinterpret_cast<const char*>(image.pixels.regions.data()), image.pixels.regions.size() * sizeof(vk::BufferImageCopy));
+			file.write(reinterpret_cast<const char*>(image.bytes.data()), image.bytes.size());
+			if (!file) throw std::runtime_error("Failed to write " + tmp.string());
+		}
+		std::filesystem::rename(tmp, path);
+	} catch (std::exception& e) {
+		std::cerr << "Warning: Failed to write compressed image cache: " << e.what() << std::endl;
+	}
+}
+
+HostPixelData CompressImageFile(const std::span<const std::byte> file, const vk::Format format, const uint2 sourceChannels, const std::string& name) {
+	// persisted as the cache file name, so only HashBytes is used (HashArgs goes through std::hash)
+	const std::array<uint64_t, 4> keyFields = {
+		HashBytes(file.data(), file.size()),
+		uint64_t(format),
+		uint64_t(sourceChannels.x) | (uint64_t(sourceChannels.y) << 32),
+		uint64_t(kCompressedImageVersion) | (uint64_t(kHashBytesVersion) << 32) };
+	const uint64_t key = HashBytes(keyFields.data(), sizeof(keyFields));
+	std::filesystem::path cacheDirectory = Device::DefaultCacheDirectory();
+	if (!cacheDirectory.empty()) cacheDirectory /= "textures";
+
+	float psnr = 0;
+	if (!cacheDirectory.empty()) {
+		if (std::optional<HostPixelData> cached = LoadCompressedImage(cacheDirectory, key, &psnr)) {
+			std::cout << "Loaded cached " << name << " (" << vk::to_string(format) << ", PSNR " << psnr << " dB)" << std::endl;
+			return std::move(*cached);
+		}
+	}
+
+	int x, y, channels;
+	stbi_uc* pixels = stbi_load_from_memory(reinterpret_cast<const stbi_uc*>(file.data()), (int)file.size(), &x, &y, &channels, 4);
+	if (!pixels) throw std::runtime_error("Could not decode " + name + ": " + stbi_failure_reason());
+	HostPixelData d = CompressImage(std::span{ pixels, size_t(x)*size_t(y)*4 }, uint2(x, y), format, sourceChannels, &psnr);
+	stbi_image_free(pixels);
+
+	std::cout << "Compressed " << name << " (" << x << "x" << y << ", " << vk::to_string(format) << ", PSNR " << psnr << " dB)" << std::endl;
+
+	if (!cacheDirectory.empty())
+		StoreCompressedImage(cacheDirectory, key, d, psnr);
+	return d;
+}
+
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <optional>
+
+#include "Image.hpp"
+
+namespace RoseEngine {
+
+// CPU block compression for textures that aren't shipped compressed.
+// BC4 stores one channel, BC5 two channels and BC7 RGBA (mode 6 only, which is fast to encode and good on smooth content).
+inline constexpr bool IsCpuCompressible(const vk::Format format) {
+	switch (format) {
+		case vk::Format::eBc4UnormBlock:
+		case vk::Format::eBc5UnormBlock:
+		case vk::Format::eBc7UnormBlock:
+		case vk::Format::eBc7SrgbBlock:
+			return true;
+		default:
+			return false;
+	}
+}
+
+// Compresses 8 bit RGBA pixels to format with a full mip chain. Mips are box filtered, in linear space for sRGB formats.
+// BC4 stores sourceChannels.x and BC5 sourceChannels.x and .y; pixels.components swizzles them back into place.
+// psnr receives the PSNR of the first level over the stored channels, in dB.
+HostPixelData CompressImage(const std::span<const uint8_t> rgba, const uint2 extent, const vk::Format format, const uint2 sourceChannels = uint2(0, 1), float* psnr = nullptr);
+
+// Compresses RGB half floats (with channels values per pixel, of which the first 3 are used; 1 is replicated) to BC6H_UF16
+// with a full mip chain, using mode 11 only. Negative values are clamped to zero. Mips are box filtered on float values.
+// psnr receives the PSNR of the first level over the half floats' bit patterns, which are close to a log scale, in dB.
+HostPixelData CompressHdrImage(const std::span<const uint16_t> pixels, const uint2 extent, const uint32_t channels, float* psnr = nullptr);
+
+// Box filters every level of an 8 bit R, RG or RGBA image (in linear space for sRGB formats) and adds a copy region per level.
+// Returns false if d already has mip levels or isn't an 8 bit 2D image. Records no commands, so it can run on worker threads.
+bool GenerateMipLevels(HostPixelData& d);
+
+// Compressed images are cached in cacheDirectory by key, which should hash the source file and the compression settings
+std::optional<HostPixelData> LoadCompressedImage(const std::filesystem::path& cacheDirectory, const uint64_t key, float* psnr = nullptr);
+void StoreCompressedImage(const std::filesystem::path& cacheDirectory, const uint64_t key, const HostPixelData& image, const float psnr);
+
+// Decodes an 8 bit image file (png, jpg, ...) in memory and compresses it, or loads the result of a previous call from
+// Device::DefaultCacheDirectory(). Records no commands, so it can run on worker threads.
+HostPixelData CompressImageFile(const std::span<const std::byte> file, const vk::Format format, const uint2 sourceChannels, const std::string& name);
+
+}
@@ -2,7 +2,8 @@
 
 #include "Instance.hpp"
 #include "Window.hpp"
-#include "CommandContext.hpp"
+#include "FrameScheduler.hpp"
+#include "MemoryBudget.hpp"
 #include "Gui.hpp"
 
 #include <functional>
@@ -15,13 +16,18 @@ struct WindowedApp {
 	ref<Device>    device    = nullptr;
 	ref<Window>    window    = nullptr;
 	ref<Swapchain> swapchain = nullptr;
-	std::vector<ref<CommandContext>> contexts = {};
+	ref<FrameScheduler> frames = nullptr;
+	ref<MemoryBudget> memoryBudget = nullptr;
 
-	vk::raii::Semaphore commandSignalSemaphore = nullptr;
+	std::vector<vk::raii::Semaphore> presentSemaphores = {}; // one per swapchain image
 
 	uint32_t presentQueueFamily = 0;
 	bool alwaysSync = false;
 
+	// swapchain properties the gui was initialized with
+	vk::Format guiFormat = vk::Format::eUndefined;
+	uint32_t   guiImageCount = 0;
+
 	enum WidgetFlagBits {
 		eNone      = 0,
 		eNoBorders = 1,
@@ -41,9 +47,10 @@ struct WindowedApp {
 	double fps = 0;
 	std::chrono::high_resolution_clock::time_point lastFrame = {};
 
-	inline CommandContext& CurrentContext() { return *contexts[swapchain->ImageIndex()]; }
+	inline CommandContext& CurrentContext() { return frames->CurrentContext(); }
 
-	inline WindowedApp(const std::string& windowTitle, const vk::ArrayProxy<const std::string> &deviceExtensions = { VK_KHR_SWAPCHAIN_EXTENSION_NAME }) {
+	// optionalExtensions are enabled if the device supports them
+	inline WindowedApp(const std::string& windowTitle, const vk::ArrayProxy<const std::string> &deviceExtensions = { VK_KHR_SWAPCHAIN_EXTENSION_NAME }, const vk::ArrayProxy<const std::string>& optionalExtensions = {}) {
 		std::vector<std::string> instanceExtensions;
 		for (const auto& e : Window::RequiredInstanceExtensions())
 			instanceExtensions.emplace_back(e);
@@ -55,15 +62,21 @@ struct WindowedApp {
 
 		vk::raii::PhysicalDevice physicalDevice = nullptr;
 		std::tie(physicalDevice, presentQueueFamily) = Window::FindSupportedDevice(**instance);
-		device = Device::Create(*instance, physicalDevice, deviceExtensions);
+		device = Device::Create(*instance, physicalDevice, deviceExtensions, optionalExtensions);
 
 		window    = Window::Create(*instance, windowTitle.c_str(), uint2(1920, 1080));
 		swapchain = Swapchain::Create(device, *window->GetSurface());
 
-		contexts.emplace_back(CommandContext::Create(device, presentQueueFamily));
+		frames = FrameScheduler::Create(device, presentQueueFamily, 2);
 
-		commandSignalSemaphore = (*device)->createSemaphore(vk::SemaphoreCreateInfo{});
-		device->SetDebugName(*commandSignalSemaphore, "WindowedApp Command Signal");
+		memoryBudget = MemoryBudget::Create(device);
+		memoryBudget->AddEvictionCallback("Cached transient resources", 0.9f, [&](uint32_t heapIndex, vk::DeviceSize bytes) {
+			vk::DeviceSize released = 0;
+			for (const auto& c : frames->Contexts())
+				if (released < bytes)
+					released += c->ReleaseCachedResources(bytes - released);
+			return released;
+		});
 
 		AddWidget("Memory", [&]() {
 			const bool memoryBudgetExt = device->EnabledExtensions().contains(VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
@@ -107,6 +120,45 @@ struct WindowedApp {
 
 				ImGui::Unindent();
 			}
+
+			if (ImGui::CollapsingHeader("Budget"))
+				memoryBudget->InspectorGui();
+
+			if (ImGui::CollapsingHeader("Categories")) {
+				if (ImGui::BeginTable("Categories", 4, ImGuiTableFlags_RowBg)) {
+					ImGui::TableSetupColumn("Category");
+					ImGui::TableSetupColumn("Live");
+					ImGui::TableSetupColumn("Peak");
+					ImGui::TableSetupColumn("Allocations");
+					ImGui::TableHeadersRow();
+					for (uint32_t i = 0; i < (uint32_t)MemoryCategory::eCount; i++) {
+						const MemoryCategoryCounters& c = device->MemoryCounters((MemoryCategory)i);
+						const auto[live, liveUnit] = FormatBytes(c.liveBytes);
+						const auto[peak, peakUnit] = FormatBytes(c.peakBytes);
+						ImGui::TableNextRow();
+						ImGui::TableNextColumn(); ImGui::TextUnformatted(to_string((MemoryCategory)i));
+						ImGui::TableNextColumn(); ImGui::Text("%lu %s", live, liveUnit);
+						ImGui::TableNextColumn(); ImGui::Text("%lu %s", peak, peakUnit);
+						ImGui::TableNextColumn(); ImGui::Text("%u", c.allocationCount.load());
+					}
+					ImGui::EndTable();
+				}
+				if (ImGui::Button("Export JSON"))
+					WriteFile("memory.json", device->MemoryStatisticsJson());
+			}
+
+			// aliased transient images
+			{
+				vk::DeviceSize aliasedBytes = 0;
+				vk::DeviceSize requestedBytes = 0;
+				for (const auto& c : frames->Contexts()) {
+					aliasedBytes   += c->AliasedImageMemory();
+					requestedBytes += c->PeakAliasedImageRequestedMemory();
+				}
+				const auto[aliased, aliasedUnit]     = FormatBytes(aliasedBytes);
+				const auto[requested, requestedUnit] = FormatBytes(requestedBytes);
+				ImGui::Text("Transient images: %lu %s (%lu %s without aliasing)", aliased, aliasedUnit, requested, requestedUnit);
+			}
 		}, false);
 
 		AddWidget("Window", [&]() {
@@ -158,6 +210,11 @@ struct WindowedApp {
 			}
 		}, false);
 
+		AddWidget("Frames", [&]() {
+			frames->InspectorGui();
+			ImGui::Text("Pipeline cache: %u hits, %u misses", device->PipelineCacheHits(), device->PipelineCacheMisses());
+		}, false);
+
 		AddMenuItem("Edit", [&]() {
 			ImGui::PushStyleColor(ImGuiCol_FrameBg, ImVec4(0,0,0,0));
 			ImGui::PushStyleColor(ImGuiCol_FrameBgActive, ImVec4(0,0,0,0));
@@ -180,16 +237,24 @@ struct WindowedApp {
 	}
 
 	inline bool CreateSwapchain() {
-		device->Wait();
 		if (!swapchain->Recreate(*window->GetSurface(), { presentQueueFamily }))
 			return false; // Window unavailable (minimized?)
 
-		contexts.resize(swapchain->ImageCount());
-		for (auto& c : contexts)
-			if (!c)
-				c = CommandContext::Create(device, presentQueueFamily);
+		// the gui only needs to be recreated when the format or image count changes, which requires an idle device
+		if (swapchain->GetFormat().format != guiFormat || swapchain->ImageCount() != guiImageCount) {
+			device->Wait();
+			Gui::Initialize(frames->CurrentContext(), *window, *swapchain, presentQueueFamily);
+
+			presentSemaphores.clear();
+			for (uint32_t i = 0; i < swapchain->ImageCount(); i++) {
+				presentSemaphores.emplace_back((*device)->createSemaphore(vk::SemaphoreCreateInfo{}));
+				device->SetDebugName(*presentSemaphores.back(), "WindowedApp Present " + std::to_string(i));
+			}
 
-		Gui::Initialize(*contexts[0], *window, *swapchain, presentQueueFamily);
+			guiFormat     = swapchain->GetFormat().format;
+			guiImageCount = swapchain->ImageCount();
+		} else
+			Gui::ReleaseFramebuffers();
 
 		return true;
 	}
@@ -282,32 +347,35 @@ struct WindowedApp {
 
 		Gui::NewFrame();
 
-		const auto& context = contexts[swapchain->ImageIndex()];
+		// only blocks if the cpu is more than frames->FramesInFlight() frames ahead
+		CommandContext& context = frames->BeginFrame();
 
-		context->Begin();
-		context->ClearColor(swapchain->CurrentImage(), vk::ClearColorValue{std::array<float,4>{ .5f, .7f, 1.f, 1.f }});
+		memoryBudget->Update(context);
 
 		Update();
 
-		context->PushDebugLabel("Gui::Render");
-		Gui::Render(*context, swapchain->CurrentImage());
-		context->PopDebugLabel();
+		context.PushDebugLabel("Gui::Render");
+		// cleared by the gui's render pass, rather than with a separate transfer clear
+		Gui::Render(context, swapchain->CurrentImage(), vk::ClearColorValue{std::array<float,4>{ .5f, .7f, 1.f, 1.f }});
+		context.PopDebugLabel();
+
+		const vk::Semaphore presentSemaphore = *presentSemaphores[swapchain->ImageIndex()];
 
-		context->AddBarrier(swapchain->CurrentImage(), Image::ResourceState{
+		context.AddBarrier(swapchain->CurrentImage(), Image::ResourceState{
 			.layout = vk::ImageLayout::ePresentSrcKHR,
 			.stage  = vk::PipelineStageFlagBits2::eColorAttachmentOutput,
 			.access = vk::AccessFlagBits2::eNone,
 			.queueFamily = presentQueueFamily });
-		context->ExecuteBarriers();
-		uint64_t t = context->Submit(0,
-			*commandSignalSemaphore, (size_t)0,
+		context.ExecuteBarriers();
+		uint64_t t = context.Submit(0,
+			presentSemaphore, (size_t)0,
 			swapchain->ImageAvailableSemaphore(),
 			(vk::PipelineStageFlags)vk::PipelineStageFlagBits::eColorAttachmentOutput,
 			(size_t)0);
 
 		if (alwaysSync) device->Wait(t);
 
-		swapchain->Present(*(*device)->getQueue(presentQueueFamily, 0), *commandSignalSemaphore);
+		swapchain->Present(*(*device)->getQueue(presentQueueFamily, 0), presentSemaphore);
 	}
 
 	inline void Run() {
@@ -0,0 +1,15 @@
+#pragma once
+
+#define DOWNSAMPLE_GROUP_SIZE 256 // each workgroup reduces a 64x64 tile of the source level
+#define DOWNSAMPLE_MAX_MIPS 12
+
+namespace RoseEngine {
+
+struct DownsamplePushConstants {
+	uint2 extent;        // extent of the source level
+	uint  mipCount;      // number of levels written, at most DOWNSAMPLE_MAX_MIPS
+	uint  numWorkGroups; // workgroups per array layer
+	uint  convertSource; // whether DOWNSAMPLE_LOAD is applied to the source, which is only the case for the first dispatch
+};
+
+}
@@ -0,0 +1,129 @@
+#pragma once
+
+#include <Rose/Core/CommandContext.hpp>
+#include <Rose/Core/PipelineCache.hpp>
+
+#include "Downsample.h"
+
+namespace RoseEngine {
+
+// Generates mip levels in one compute dispatch per 12 levels (see Downsample.slang), instead of a blit and barrier per level.
+// Unlike blits, this works for integer formats and custom reductions, and is sRGB-correct for every supported format.
+class Downsampler {
+public:
+	enum class Reduction {
+		eAverage,
+		eMin,
+		eMax,
+		eMinMax, // min of the first channel in x and max in y, for depth pyramids
+	};
+
+private:
+	PipelineCache pipelines;
+
+public:
+	inline Downsampler() : pipelines(FindShaderPath("Downsample.cs.slang")) {}
+	// shaderFile defines Texel and Reduce4 and includes Downsample.slang. The Reduction passed to operator() is ignored.
+	inline Downsampler(const std::filesystem::path& shaderFile) : pipelines(shaderFile) {}
+
+	// sRGB images are written through UNORM views and encoded in the shader, since sRGB formats rarely support storage
+	static inline vk::Format GetStorageFormat(const vk::Format format) {
+		switch (format) {
+			case vk::Format::eR8Srgb:             return vk::Format::eR8Unorm;
+			case vk::Format::eR8G8Srgb:           return vk::Format::eR8G8Unorm;
+			case vk::Format::eR8G8B8A8Srgb:       return vk::Format::eR8G8B8A8Unorm;
+			case vk::Format::eB8G8R8A8Srgb:       return vk::Format::eB8G8R8A8Unorm;
+			case vk::Format::eA8B8G8R8SrgbPack32: return vk::Format::eA8B8G8R8UnormPack32;
+			default:                              return format;
+		}
+	}
+
+	// Adds the usage and flags images need to be downsampled
+	static inline void AddRequiredUsage(ImageInfo& info) {
+		info.usage |= vk::ImageUsageFlagBits::eSampled | vk::ImageUsageFlagBits::eStorage;
+		if (GetStorageFormat(info.format) != info.format)
+			info.createFlags |= vk::ImageCreateFlagBits::eMutableFormat | vk::ImageCreateFlagBits::eExtendedUsage;
+	}
+
+	// Whether images with info (after AddRequiredUsage) can be downsampled on device
+	static inline bool IsSupported(const Device& device, const ImageInfo& info) {
+		if (info.type != vk::ImageType::e2D || info.samples != vk::SampleCountFlagBits::e1 || IsBlockCompressed(info.format) || IsDepthStencil(info.format))
+			return false;
+		if (!device.Features().shaderStorageImageWriteWithoutFormat)
+			return false;
+		if (!(info.usage & vk::ImageUsageFlagBits::eStorage) || !(info.usage & vk::ImageUsageFlagBits::eSampled))
+			return false;
+		const vk::Format storageFormat = GetStorageFormat(info.format);
+		if (storageFormat != info.format && !(info.createFlags & vk::ImageCreateFlagBits::eMutableFormat))
+			return false;
+		const vk::FormatFeatureFlags sampledFeatures = device.PhysicalDevice().getFormatProperties(info.format).optimalTilingFeatures;
+		const vk::FormatFeatureFlags storageFeatures = device.PhysicalDevice().getFormatProperties(storageFormat).optimalTilingFeatures;
+		return (sampledFeatures & vk::FormatFeatureFlagBits::eSampledImage) && (storageFeatures & vk::FormatFeatureFlagBits::eStorageImage);
+	}
+
+	// Reduces level baseLevel of every layer of image into the levels below it
+	inline void operator()(CommandContext& context, const ref<Image>& image, const Reduction reduction = Reduction::eAverage, const uint32_t baseLevel = 0) {
+		const ImageInfo& info = image->Info();
+		const vk::Format storageFormat = GetStorageFormat(info.format);
+
+		const std::string formatName = vk::to_string(info.format);
+		const bool isUint = formatName.find("Uint") != std::string::npos;
+		const bool isSint = formatName.find("Sint") != std::string::npos;
+
+		ShaderDefines defines {
+			{ "REDUCTION", std::to_string((uint32_t)reduction) },
+			{ "TEXEL_TYPE", isUint ? "uint4" : isSint ? "int4" : "float4" } };
+		if (isUint || isSint)
+			defines["TEXEL_INTEGER"] = "1";
+		if (storageFormat != info.format)
+			defines["DOWNSAMPLE_SRGB"] = "1";
+		const ref<Pipeline> pipeline = pipelines.get(context.GetDevice(), defines);
+
+		for (uint32_t level = baseLevel; level + 1 < info.mipLevels; ) {
+			const uint2 extent = uint2(GetLevelExtent(info.extent, level));
+
+			// the last workgroup reduces at most 64x64 tiles, so larger levels are done 6 levels at a time
+			uint32_t mipCount = std::min<uint32_t>(info.mipLevels - 1 - level, DOWNSAMPLE_MAX_MIPS);
+			if (std::max(extent.x, extent.y) > 64*64)
+				mipCount = std::min(mipCount, 6u);
+
+			const uint2 groups = (extent + 63u) / 64u;
+
+			DownsamplePushConstants pushConstants;
+			pushConstants.extent = extent;
+			pushConstants.mipCount = mipCount;
+			pushConstants.numWorkGroups = groups.x * groups.y;
+			pushConstants.convertSource = level == baseLevel;
+
+			auto counters = context.GetTransientBuffer<uint32_t>(info.arrayLayers, vk::BufferUsageFlagBits::eStorageBuffer|vk::BufferUsageFlagBits::eTransferDst);
+			auto mip6     = context.GetTransientBuffer(sizeof(uint4) * 64*64 * info.arrayLayers, vk::BufferUsageFlagBits::eStorageBuffer);
+			context.Fill(counters, 0u);
+
+			ShaderParameter params = {};
+			params["source"] = ImageParameter{
+				.image = ImageView::Create(image, vk::ImageSubresourceRange{ vk::ImageAspectFlagBits::eColor, level, 1, 0, info.arrayLayers }, vk::ImageViewType::e2DArray),
+				.imageLayout = vk::ImageLayout::eShaderReadOnlyOptimal };
+			for (uint32_t i = 0; i < DOWNSAMPLE_MAX_MIPS; i++) {
+				const uint32_t mipLevel = level + 1 + std::min(i, mipCount - 1);
+				params["mips"][i] = ImageParameter{
+					.image = ImageView::Create(image, vk::ImageSubresourceRange{ vk::ImageAspectFlagBits::eColor, mipLevel, 1, 0, info.arrayLayers }, vk::ImageViewType::e2DArray, {}, storageFormat),
+					.imageLayout = vk::ImageLayout::eGeneral };
+			}
+			params["mip6"]     = (BufferParameter)mip6;
+			params["counters"] = (BufferParameter)counters;
+
+			auto descriptorSets = context.GetDescriptorSets(*pipeline->Layout());
+			context.UpdateDescriptorSets(*descriptorSets, params, *pipeline->Layout());
+			context.ExecuteBarriers();
+
+			context->bindPipeline(vk::PipelineBindPoint::eCompute, ***pipeline);
+			context.BindDescriptors(*pipeline->Layout(), *descriptorSets);
+			context->pushConstants<DownsamplePushConstants>(***pipeline->Layout(), vk::ShaderStageFlagBits::eCompute, 0, pushConstants);
+			context->dispatch(groups.x, groups.y, info.arrayLayers);
+
+			level += mipCount;
+		}
+	}
+};
+
+}
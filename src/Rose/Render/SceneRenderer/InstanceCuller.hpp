@@ -0,0 +1,536 @@
+#pragma once
+
+#include <functional>
+#include <numeric>
+
+#include <Rose/Scene/Scene.hpp>
+#include <Rose/Downsample/Downsample.hpp>
+
+#include "InstanceCulling.h"
+
+namespace RoseEngine {
+
+// Culls the instances of a scene's draw lists on the GPU (see InstanceCulling.cs.slang), and writes indexed indirect draws
+// with only the visible instances. Drawing is split in two phases: the first draws the instances that were visible in the
+// last frame, then a depth pyramid is built from its depth, and the second draws the instances which the pyramid shows to
+// be visible but the first phase didn't draw.
+//
+// Neighbouring draw batches with the same pipeline, index buffer and topology form a DrawGroup, which is drawn by a single
+// drawIndexedIndirectCount over the group's draws that have visible instances. Vertex shaders pull their vertices from the
+// scene's mesh buffers, and look up the scene instance of SV_InstanceID in DrawInstances().
+//
+// Groups whose pipeline draws meshlets instead get a task list: each visible instance appends a task for every
+// MESHLET_TASK_SIZE of its mesh's meshlets, and the group is drawn by a drawMeshTasksIndirect whose task shader culls the
+// meshlets. Without mesh shaders, MeshletEmulation.cs.slang culls them instead and appends the triangles of the visible ones,
+// which are drawn by a non-indexed drawIndirect.
+class InstanceCuller {
+public:
+	enum class GeometryPath {
+		eVertex,             // indexed draws of whole meshes
+		eMeshShader,         // task and mesh shaders over the meshlets of each mesh
+		eEmulatedMeshShader  // meshlets culled by a compute shader, and drawn by a vertex shader
+	};
+
+	struct DrawGroup {
+		const SceneRenderData::DrawBatch* batch = nullptr; // the first batch, for the pipeline, mesh layout and index buffer
+		uint32_t firstDraw = 0;
+		uint32_t drawCount = 0;
+		GeometryPath path = GeometryPath::eVertex;
+	};
+
+	struct Stats {
+		uint32_t instanceCount = 0;
+		uint32_t frustumCulled = 0;
+		uint32_t occlusionCulled = 0;
+		uint32_t firstPhaseDrawn = 0;
+		uint32_t secondPhaseDrawn = 0;
+		// meshlets of the drawn instances of meshlet groups, over both phases
+		uint32_t meshletFrustumCulled = 0;
+		uint32_t meshletConeCulled = 0;
+		uint32_t meshletOcclusionCulled = 0;
+		uint32_t meshletsDrawn = 0;
+		// GPU milliseconds of each pass
+		double   firstCullTime = 0;
+		double   firstDrawTime = 0;
+		double   depthPyramidTime = 0;
+		double   secondCullTime = 0;
+		double   secondDrawTime = 0;
+	};
+
+	enum Timestamp : uint32_t {
+		eBegin,
+		eFirstCull,
+		eFirstDraw,
+		eDepthPyramid,
+		eSecondCull,
+		eSecondDraw,
+		eTimestampCount
+	};
+
+	bool frustumCulling = true;
+	bool occlusionCulling = true;
+	bool coneCulling = true;
+	// Triangles the emulated meshlet path can draw per phase, shared by its groups in proportion to their instances' triangles.
+	// Triangles of visible meshlets past a group's share are dropped.
+	uint32_t maxEmulatedTriangles = 1 << 24;
+
+	// a task list is dispatched in rows of MESHLET_DISPATCH_WIDTH workgroups, and maxTaskWorkGroupTotalCount is at least 2^22
+	static constexpr uint32_t kMaxTasksPerGroup = MESHLET_DISPATCH_WIDTH * 64;
+
+private:
+	ref<Pipeline> cullPipeline, compactPipeline, depthPyramidPipeline, emulatePipeline;
+	Downsampler   downsampler;
+
+	uint64_t sceneRevision = ~0ull;
+	uint32_t instanceCount = 0;
+	uint32_t drawCount = 0;
+	std::vector<DrawGroup>       groups = {};
+	BufferRange<CullingDraw>     draws = {};
+	BufferRange<uint4>           drawGroups = {}; // group of each draw, the group's first draw, and tasks per instance
+	BufferRange<uint32_t>        instanceDraws = {};
+	BufferRange<uint32_t>        visibility = {};
+	BufferRange<DrawIndexedArgs> argsTemplate = {}; // args with no instances, copied to args every frame
+	BufferRange<DrawIndexedArgs> args = {};
+	BufferRange<DrawIndexedArgs> drawCommands = {};      // the draws of args with instances, compacted to the start of their group
+	BufferRange<uint32_t>        drawCommandCounts = {}; // per phase and group
+	BufferRange<uint32_t>        drawInstances = {};
+	BufferRange<uint32_t>        counters = {};
+
+	// meshlet groups. Tasks and emulated triangles are written again by the second phase, after the first phase drew them.
+	BufferRange<MeshletGroup>    meshletGroups = {};
+	BufferRange<uint2>           meshletTasks = {};      // instance and first meshlet of each task
+	BufferRange<uint2>           meshletCounts = {};     // tasks and emulated triangles appended to each group, per phase
+	BufferRange<uint4>           taskCommands = {};      // workgroup counts of each group's task list, per phase
+	BufferRange<DrawArgs>        emulatedDrawsTemplate = {};
+	BufferRange<DrawArgs>        emulatedDraws = {};     // per phase and group
+	BufferRange<uint2>           emulatedTriangles = {}; // instance and mesh triangle
+	bool                         hasMeshShaderGroups = false;
+	bool                         hasEmulatedGroups = false;
+
+	ref<Image> depthPyramid = {};
+	bool       occlusionActive = false; // occlusion culling is enabled and the pyramid can be built
+
+	struct Readback {
+		BufferRange<uint32_t> counters = {};
+		uint32_t              queryIndex = 0;
+		uint64_t              timelineValue = 0;
+		bool                  pending = false;
+	};
+	std::vector<Readback> readbacks = {};
+	vk::raii::QueryPool   queries = nullptr;
+	uint32_t              queryCapacity = 0; // readbacks the query pool has room for
+	Readback*             current = nullptr;
+
+	Stats stats = {};
+
+	inline uint32_t Flags() const {
+		return (frustumCulling ? INSTANCE_CULLING_FRUSTUM : 0) | (occlusionActive ? INSTANCE_CULLING_OCCLUSION : 0) | (coneCulling ? INSTANCE_CULLING_CONE : 0);
+	}
+
+	inline void ReadStats(Device& device) {
+		const uint64_t completedValue = device.CurrentTimelineValue();
+		const double period = device.Limits().timestampPeriod * 1e-6;
+		for (Readback& r : readbacks) {
+			if (!r.pending || r.timelineValue > completedValue) continue;
+			r.pending = false;
+			stats.frustumCulled    = r.counters[INSTANCE_CULLING_FRUSTUM_CULLED];
+			stats.occlusionCulled  = r.counters[INSTANCE_CULLING_OCCLUSION_CULLED];
+			stats.firstPhaseDrawn  = r.counters[INSTANCE_CULLING_FIRST_PHASE_DRAWN];
+			stats.secondPhaseDrawn = r.counters[INSTANCE_CULLING_SECOND_PHASE_DRAWN];
+			stats.meshletFrustumCulled   = r.counters[INSTANCE_CULLING_MESHLET_FRUSTUM_CULLED];
+			stats.meshletConeCulled      = r.counters[INSTANCE_CULLING_MESHLET_CONE_CULLED];
+			stats.meshletOcclusionCulled = r.counters[INSTANCE_CULLING_MESHLET_OCCLUSION_CULLED];
+			stats.meshletsDrawn          = r.counters[INSTANCE_CULLING_MESHLETS_DRAWN];
+			const auto[result, t] = queries.getResults<uint64_t>(r.queryIndex, eTimestampCount, eTimestampCount * sizeof(uint64_t), sizeof(uint64_t), vk::QueryResultFlagBits::e64);
+			if (result != vk::Result::eSuccess) continue;
+			stats.firstCullTime    = double(t[eFirstCull]    - t[eBegin])        * period;
+			stats.firstDrawTime    = double(t[eFirstDraw]    - t[eFirstCull])    * period;
+			stats.depthPyramidTime = double(t[eDepthPyramid] - t[eFirstDraw])    * period;
+			stats.secondCullTime   = double(t[eSecondCull]   - t[eDepthPyramid]) * period;
+			stats.secondDrawTime   = double(t[eSecondDraw]   - t[eSecondCull])   * period;
+		}
+	}
+
+public:
+	inline const Stats& GetStats() const { return stats; }
+	inline const BufferRange<uint32_t>& DrawInstances() const { return drawInstances; }
+	inline const std::vector<DrawGroup>& DrawGroups() const { return groups; }
+	inline bool OcclusionActive() const { return occlusionActive; }
+
+	// Parameters of the meshlet paths in Visibility.3d.slang, other than the push constants and the depth pyramid
+	inline void SetMeshletParameters(ShaderParameter& params) const {
+		params["meshletGroups"]     = (BufferParameter)meshletGroups;
+		params["meshletTasks"]      = (BufferParameter)meshletTasks;
+		params["meshletCounts"]     = (BufferParameter)meshletCounts;
+		params["emulatedTriangles"] = (BufferParameter)emulatedTriangles;
+		params["counters"]          = (BufferParameter)counters;
+		params["cullingFlags"]      = Flags();
+		params["groupCount"]        = (uint32_t)groups.size();
+		params["pyramidExtent"]     = depthPyramid ? uint2(depthPyramid->Extent()) : uint2(1);
+		params["pyramidLevels"]     = depthPyramid ? depthPyramid->Info().mipLevels : 1u;
+	}
+	inline ImageView DepthPyramid() const { return depthPyramid ? ImageView::Create(depthPyramid) : ImageView{}; }
+
+	// Records the draws of a group. The group's pipeline, index buffer (bound at offset 0) and dynamic state must be bound.
+	inline void DrawIndirect(CommandContext& context, const uint32_t phase, const uint32_t groupIndex) const {
+		const DrawGroup& g = groups[groupIndex];
+		const size_t commandIndex = phase * groups.size() + groupIndex;
+		switch (g.path) {
+		case GeometryPath::eVertex:
+			context->drawIndexedIndirectCount(
+				**drawCommands.mBuffer,      drawCommands.mOffset      + sizeof(DrawIndexedArgs) * (phase * drawCount + g.firstDraw),
+				**drawCommandCounts.mBuffer, drawCommandCounts.mOffset + sizeof(uint32_t) * commandIndex,
+				g.drawCount, sizeof(DrawIndexedArgs));
+			break;
+		case GeometryPath::eMeshShader: {
+			const PipelineLayout& layout = *g.batch->pipeline->Layout();
+			context->pushConstants<MeshletPushConstants>(**layout, layout.PushConstantRanges()[0].stageFlags, 0, MeshletPushConstants{ .group = groupIndex, .phase = phase });
+			context->drawMeshTasksIndirectEXT(**taskCommands.mBuffer, taskCommands.mOffset + sizeof(uint4) * commandIndex, 1, sizeof(uint4));
+			break;
+		}
+		case GeometryPath::eEmulatedMeshShader:
+			context->drawIndirect(**emulatedDraws.mBuffer, emulatedDraws.mOffset + sizeof(DrawArgs) * commandIndex, 1, sizeof(DrawArgs));
+			break;
+		}
+	}
+
+	// Creates the per instance buffers after the scene's draw lists were rebuilt, and the depth pyramid for depthExtent.
+	// geometryPath says how the batches of each pipeline are drawn. Call outside of rendering, before DrawInstances() is bound.
+	inline void Prepare(CommandContext& context, const SceneRenderData& renderData, const uint2 depthExtent, const std::function<GeometryPath(const Pipeline&)>& geometryPath) {
+		Device& device = context.GetDevice();
+		if (!cullPipeline) {
+			const auto shaderFile = FindShaderPath("InstanceCulling.cs.slang");
+			cullPipeline         = Pipeline::CreateCompute(device, ShaderModule::Create(device, shaderFile, "cull"));
+			compactPipeline      = Pipeline::CreateCompute(device, ShaderModule::Create(device, shaderFile, "compactDraws"));
+			depthPyramidPipeline = Pipeline::CreateCompute(device, ShaderModule::Create(device, shaderFile, "buildDepthPyramid"));
+			emulatePipeline      = Pipeline::CreateCompute(device, ShaderModule::Create(device, FindShaderPath("MeshletEmulation.cs.slang"), "emulateMeshlets"), {},
+				PipelineLayoutInfo{ .descriptorBindingFlags = {
+					{ "meshBuffers",  vk::DescriptorBindingFlagBits::ePartiallyBound },
+					{ "depthPyramid", vk::DescriptorBindingFlagBits::ePartiallyBound } } });
+		}
+
+		ReadStats(device);
+
+		if (renderData.revision != sceneRevision) {
+			sceneRevision = renderData.revision;
+			instanceCount = (uint32_t)renderData.instanceNodes.size();
+
+			std::vector<CullingDraw>     drawData;
+			std::vector<uint4>           drawGroupData;
+			std::vector<DrawIndexedArgs> argData;
+			std::vector<uint32_t>        instanceDrawData(instanceCount, 0);
+			std::vector<uint64_t>        groupTasks, groupTriangles; // capacity each meshlet group needs
+			groups.clear();
+			for (const auto& drawList : renderData.drawLists) {
+				const size_t listGroups = groups.size();
+				for (const SceneRenderData::DrawBatch& batch : drawList) {
+					const auto&[pipeline, mesh, meshLayout, batchDraws] = batch;
+					const GeometryPath path = mesh->meshletCount > 0 ? geometryPath(*pipeline) : GeometryPath::eVertex;
+					const bool merge = groups.size() > listGroups &&
+						groups.back().batch->pipeline == pipeline &&
+						groups.back().path == path &&
+						groups.back().batch->mesh->indexBuffer.mBuffer == mesh->indexBuffer.mBuffer &&
+						groups.back().batch->mesh->indexSize == mesh->indexSize &&
+						groups.back().batch->meshLayout.topology == meshLayout.topology;
+					if (!merge) {
+						groups.emplace_back(DrawGroup{ .batch = &batch, .firstDraw = (uint32_t)drawData.size(), .drawCount = 0, .path = path });
+						groupTasks.emplace_back(0);
+						groupTriangles.emplace_back(0);
+					}
+					const uint32_t tasksPerInstance = path == GeometryPath::eVertex ? 0 : (mesh->meshletCount + MESHLET_TASK_SIZE - 1) / MESHLET_TASK_SIZE;
+					for (const auto&[firstInstance, count] : batchDraws) {
+						drawGroupData.emplace_back(uint4(uint32_t(groups.size() - 1), groups.back().firstDraw, tasksPerInstance, 0));
+						groups.back().drawCount++;
+						groupTasks.back() += uint64_t(count) * tasksPerInstance;
+						if (path == GeometryPath::eEmulatedMeshShader)
+							groupTriangles.back() += uint64_t(count) * (mesh->indexBuffer.size_bytes() / mesh->indexSize / 3);
+						std::fill_n(instanceDrawData.begin() + firstInstance, count, (uint32_t)drawData.size());
+						drawData.emplace_back(CullingDraw{
+							.aabbMin = float3(mesh->aabb.minX, mesh->aabb.minY, mesh->aabb.minZ),
+							.firstInstance = firstInstance,
+							.aabbMax = float3(mesh->aabb.maxX, mesh->aabb.maxY, mesh->aabb.maxZ),
+							.instanceCount = count });
+						argData.emplace_back(DrawIndexedArgs{
+							.indexCount = uint32_t(mesh->indexBuffer.size_bytes() / mesh->indexSize),
+							.instanceCount = 0,
+							.firstIndex = uint32_t(mesh->indexBuffer.mOffset / mesh->indexSize),
+							.vertexOffset = 0,
+							.firstInstance = firstInstance });
+					}
+				}
+			}
+			drawCount = (uint32_t)drawData.size();
+
+			// regions of the task list and emulated triangles of each meshlet group
+			std::vector<MeshletGroup> meshletGroupData(groups.size(), MeshletGroup{});
+			std::vector<DrawArgs>     emulatedDrawData;
+			uint32_t taskCount = 0, triangleCount = 0;
+			{
+				const uint64_t totalTriangles = std::accumulate(groupTriangles.begin(), groupTriangles.end(), uint64_t(0));
+				for (size_t i = 0; i < groups.size(); i++) {
+					MeshletGroup& g = meshletGroupData[i];
+					g.taskOffset = taskCount;
+					g.taskCapacity = (uint32_t)std::min<uint64_t>(groupTasks[i], kMaxTasksPerGroup);
+					taskCount += g.taskCapacity;
+					g.triangleOffset = triangleCount;
+					g.triangleCapacity = totalTriangles > maxEmulatedTriangles ? uint32_t(groupTriangles[i] * maxEmulatedTriangles / totalTriangles) : (uint32_t)groupTriangles[i];
+					triangleCount += g.triangleCapacity;
+					emulatedDrawData.emplace_back(DrawArgs{ .vertexCount = 0, .instanceCount = 1, .firstVertex = 3 * g.triangleOffset, .firstInstance = 0 });
+				}
+			}
+			hasMeshShaderGroups = std::ranges::any_of(groups, [](const DrawGroup& g) { return g.path == GeometryPath::eMeshShader; });
+			hasEmulatedGroups   = std::ranges::any_of(groups, [](const DrawGroup& g) { return g.path == GeometryPath::eEmulatedMeshShader; });
+			// both phases use the same regions, and have their own commands
+			emulatedDrawData.reserve(2 * groups.size());
+			for (size_t i = 0; i < groups.size(); i++)
+				emulatedDrawData.emplace_back(emulatedDrawData[i]);
+
+			// the second phase writes its instances after the first phase's
+			argData.reserve(2 * drawCount);
+			for (uint32_t i = 0; i < drawCount; i++) {
+				argData.emplace_back(argData[i]);
+				argData.back().firstInstance += instanceCount;
+			}
+
+			if (draws) {
+				device.DeferDestroy(std::move(draws));
+				device.DeferDestroy(std::move(drawGroups));
+				device.DeferDestroy(std::move(drawCommands));
+				device.DeferDestroy(std::move(drawCommandCounts));
+				device.DeferDestroy(std::move(instanceDraws));
+				device.DeferDestroy(std::move(visibility));
+				device.DeferDestroy(std::move(argsTemplate));
+				device.DeferDestroy(std::move(args));
+				device.DeferDestroy(std::move(drawInstances));
+				device.DeferDestroy(std::move(meshletGroups));
+				device.DeferDestroy(std::move(meshletTasks));
+				device.DeferDestroy(std::move(meshletCounts));
+				device.DeferDestroy(std::move(taskCommands));
+				device.DeferDestroy(std::move(emulatedDrawsTemplate));
+				device.DeferDestroy(std::move(emulatedDraws));
+				device.DeferDestroy(std::move(emulatedTriangles));
+			}
+			auto createBuffer = [&](const auto& data, const vk::BufferUsageFlags usage) {
+				using T = std::ranges::range_value_t<decltype(data)>;
+				const BufferRange<T> buffer = Buffer::Create(device, sizeof(T) * std::max<size_t>(data.size(), 1), usage | vk::BufferUsageFlagBits::eTransferDst).template cast<T>();
+				if (!data.empty()) context.Copy(context.UploadData(data).template cast<T>().slice(0, data.size()), buffer);
+				return buffer;
+			};
+			draws         = createBuffer(drawData, vk::BufferUsageFlagBits::eStorageBuffer);
+			drawGroups    = createBuffer(drawGroupData, vk::BufferUsageFlagBits::eStorageBuffer);
+			instanceDraws = createBuffer(instanceDrawData, vk::BufferUsageFlagBits::eStorageBuffer);
+			argsTemplate  = createBuffer(argData, vk::BufferUsageFlagBits::eTransferSrc);
+			args          = Buffer::Create(device, argsTemplate.size_bytes(), vk::BufferUsageFlagBits::eStorageBuffer|vk::BufferUsageFlagBits::eTransferDst).cast<DrawIndexedArgs>();
+			drawCommands  = Buffer::Create(device, argsTemplate.size_bytes(), vk::BufferUsageFlagBits::eStorageBuffer|vk::BufferUsageFlagBits::eIndirectBuffer).cast<DrawIndexedArgs>();
+			drawCommandCounts = Buffer::Create(device, sizeof(uint32_t) * std::max<size_t>(2 * groups.size(), 1), vk::BufferUsageFlagBits::eStorageBuffer|vk::BufferUsageFlagBits::eIndirectBuffer|vk::BufferUsageFlagBits::eTransferDst).cast<uint32_t>();
+			visibility    = Buffer::Create(device, sizeof(uint32_t) * std::max(instanceCount, 1u), vk::BufferUsageFlagBits::eStorageBuffer|vk::BufferUsageFlagBits::eTransferDst).cast<uint32_t>();
+			drawInstances = Buffer::Create(device, sizeof(uint32_t) * std::max(2 * instanceCount, 1u), vk::BufferUsageFlagBits::eStorageBuffer).cast<uint32_t>();
+			meshletGroups         = createBuffer(meshletGroupData, vk::BufferUsageFlagBits::eStorageBuffer);
+			emulatedDrawsTemplate = createBuffer(emulatedDrawData, vk::BufferUsageFlagBits::eTransferSrc);
+			emulatedDraws     = Buffer::Create(device, emulatedDrawsTemplate.size_bytes(), vk::BufferUsageFlagBits::eStorageBuffer|vk::BufferUsageFlagBits::eIndirectBuffer|vk::BufferUsageFlagBits::eTransferDst).cast<DrawArgs>();
+			meshletTasks      = Buffer::Create(device, sizeof(uint2) * std::max(taskCount, 1u), vk::BufferUsageFlagBits::eStorageBuffer).cast<uint2>();
+			meshletCounts     = Buffer::Create(device, sizeof(uint2) * std::max<size_t>(2 * groups.size(), 1), vk::BufferUsageFlagBits::eStorageBuffer|vk::BufferUsageFlagBits::eTransferDst).cast<uint2>();
+			taskCommands      = Buffer::Create(device, sizeof(uint4) * std::max<size_t>(2 * groups.size(), 1), vk::BufferUsageFlagBits::eStorageBuffer|vk::BufferUsageFlagBits::eIndirectBuffer).cast<uint4>();
+			emulatedTriangles = Buffer::Create(device, sizeof(uint2) * std::max(triangleCount, 1u), vk::BufferUsageFlagBits::eStorageBuffer).cast<uint2>();
+			// nothing was visible before the first frame, so everything is tested by the second phase
+			context.Fill(visibility, 0u);
+		}
+
+		if (!counters)
+			counters = Buffer::Create(device, sizeof(uint32_t) * INSTANCE_CULLING_COUNTER_COUNT, vk::BufferUsageFlagBits::eStorageBuffer|vk::BufferUsageFlagBits::eTransferSrc|vk::BufferUsageFlagBits::eTransferDst).cast<uint32_t>();
+
+		// the pyramid's largest level is the largest power of two that fits in the depth buffer, so that every level halves exactly
+		const uint2 pyramidExtent = uint2(std::bit_floor(depthExtent.x), std::bit_floor(depthExtent.y));
+		// the pyramid is kept across frames rather than aliased: no other transient image lives outside [eDepthPyramid, eSecondDraw],
+		// so an aliased block would only hold the pyramid, once per frame in flight
+		if (occlusionCulling && (!depthPyramid || uint2(depthPyramid->Extent()) != pyramidExtent)) {
+			if (depthPyramid) device.DeferDestroy(std::move(depthPyramid));
+			ImageInfo info {
+				.format = vk::Format::eR32Sfloat,
+				.extent = uint3(pyramidExtent, 1),
+				.mipLevels = GetMaxMipLevels(uint3(pyramidExtent, 1)),
+				.queueFamilies = { context.QueueFamily() } };
+			Downsampler::AddRequiredUsage(info);
+			if (Downsampler::IsSupported(device, info))
+				depthPyramid = Image::Create(device, info);
+		}
+		occlusionActive = occlusionCulling && depthPyramid;
+	}
+
+	// Resets the draws and counters, and starts timing the passes
+	inline void BeginFrame(CommandContext& context) {
+		Device& device = context.GetDevice();
+		auto it = std::ranges::find_if(readbacks, [](const Readback& r) { return !r.pending; });
+		if (it == readbacks.end()) {
+			readbacks.emplace_back(Readback{
+				.counters = Buffer::Create(device, counters.size_bytes(), vk::BufferUsageFlagBits::eTransferDst,
+					vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent,
+					VMA_ALLOCATION_CREATE_MAPPED_BIT | VMA_ALLOCATION_CREATE_HOST_ACCESS_RANDOM_BIT,
+					MemoryCategory::eStaging).cast<uint32_t>(),
+				.queryIndex = uint32_t(readbacks.size()) * eTimestampCount });
+			it = readbacks.end() - 1;
+			if (readbacks.size() > queryCapacity) {
+				// pending readbacks lose their timings
+				for (Readback& r : readbacks) r.pending = false;
+				queryCapacity = std::max<uint32_t>(2 * queryCapacity, 4);
+				if (*queries) device.DeferDestroy(std::move(queries));
+				queries = device->createQueryPool(vk::QueryPoolCreateInfo{
+					.queryType  = vk::QueryType::eTimestamp,
+					.queryCount = queryCapacity * eTimestampCount });
+			}
+		}
+		current = &*it;
+		context->resetQueryPool(*queries, current->queryIndex, eTimestampCount);
+
+		context.Copy(argsTemplate, args);
+		context.Copy(emulatedDrawsTemplate, emulatedDraws);
+		context.Fill(drawCommandCounts, 0u);
+		context.Fill(meshletCounts.cast<uint32_t>(), 0u);
+		context.Fill(counters, 0u);
+		WriteTimestamp(context, eBegin);
+	}
+
+	inline void WriteTimestamp(CommandContext& context, const Timestamp t) {
+		context->writeTimestamp2(vk::PipelineStageFlagBits2::eAllCommands, *queries, current->queryIndex + t);
+	}
+
+	// Writes the draws of phase 0 or 1, and the emulated meshlet draws. The second phase needs BuildDepthPyramid first.
+	inline void Cull(CommandContext& context, const uint32_t phase, const SceneRenderData& renderData, const Transform& worldToClip, const float3& cameraPosition) {
+		ShaderParameter params = {};
+		params["instances"]     = renderData.sceneParameters.at("instances");
+		params["transforms"]    = renderData.sceneParameters.at("transforms");
+		params["draws"]         = (BufferParameter)draws;
+		params["instanceDraws"] = (BufferParameter)instanceDraws;
+		params["visibility"]    = (BufferParameter)visibility;
+		params["args"]          = (BufferParameter)args;
+		params["drawInstances"] = (BufferParameter)drawInstances;
+		params["counters"]      = (BufferParameter)counters;
+		params["drawGroups"]    = (BufferParameter)drawGroups;
+		params["meshletGroups"] = (BufferParameter)meshletGroups;
+		params["meshletTasks"]  = (BufferParameter)meshletTasks;
+		params["meshletCounts"] = (BufferParameter)meshletCounts;
+		if (phase == 1)
+			params["depthPyramid"] = ImageParameter{ .image = ImageView::Create(depthPyramid), .imageLayout = vk::ImageLayout::eShaderReadOnlyOptimal };
+		params["worldToClip"]   = worldToClip;
+		params["instanceCount"] = instanceCount;
+		params["drawCount"]     = drawCount;
+		params["phase"]         = phase;
+		params["flags"]         = Flags();
+		params["pyramidExtent"] = depthPyramid ? uint2(depthPyramid->Extent()) : uint2(1);
+		params["pyramidLevels"] = depthPyramid ? depthPyramid->Info().mipLevels : 1u;
+		params["groupCount"]    = (uint32_t)groups.size();
+		context.Dispatch(*cullPipeline, std::max(instanceCount, 1u), params);
+
+		ShaderParameter compactParams = {};
+		compactParams["args"]              = (BufferParameter)args;
+		compactParams["drawGroups"]        = (BufferParameter)drawGroups;
+		compactParams["drawCommands"]      = (BufferParameter)drawCommands;
+		compactParams["drawCommandCounts"] = (BufferParameter)drawCommandCounts;
+		compactParams["meshletGroups"]     = (BufferParameter)meshletGroups;
+		compactParams["meshletCounts"]     = (BufferParameter)meshletCounts;
+		compactParams["taskCommands"]      = (BufferParameter)taskCommands;
+		compactParams["drawCount"]  = drawCount;
+		compactParams["groupCount"] = (uint32_t)groups.size();
+		compactParams["phase"]      = phase;
+		context.Dispatch(*compactPipeline, std::max(drawCount, 1u), compactParams);
+
+		if (hasEmulatedGroups) {
+			// the task counts of every group were written above, so the slices each dispatch reads are transitioned with them
+			context.AddIndirectArgsBarrier(taskCommands);
+			ShaderParameter emulateParams = {};
+			emulateParams["instances"]         = renderData.sceneParameters.at("instances");
+			emulateParams["transforms"]        = renderData.sceneParameters.at("transforms");
+			emulateParams["inverseTransforms"] = renderData.sceneParameters.at("inverseTransforms");
+			emulateParams["meshes"]            = renderData.sceneParameters.at("meshes");
+			emulateParams["materials"]         = renderData.sceneParameters.at("materials");
+			emulateParams["meshBuffers"]       = renderData.sceneParameters.at("meshBuffers");
+			emulateParams["meshletGroups"]     = (BufferParameter)meshletGroups;
+			emulateParams["meshletTasks"]      = (BufferParameter)meshletTasks;
+			emulateParams["meshletCounts"]     = (BufferParameter)meshletCounts;
+			emulateParams["emulatedDraws"]     = (BufferParameter)emulatedDraws;
+			emulateParams["emulatedTriangles"] = (BufferParameter)emulatedTriangles;
+			emulateParams["counters"]          = (BufferParameter)counters;
+			if (phase == 1)
+				emulateParams["depthPyramid"] = ImageParameter{ .image = ImageView::Create(depthPyramid), .imageLayout = vk::ImageLayout::eShaderReadOnlyOptimal };
+			emulateParams["worldToClip"]    = worldToClip;
+			emulateParams["cameraPosition"] = cameraPosition;
+			emulateParams["flags"]          = Flags();
+			emulateParams["pyramidExtent"]  = depthPyramid ? uint2(depthPyramid->Extent()) : uint2(1);
+			emulateParams["pyramidLevels"]  = depthPyramid ? depthPyramid->Info().mipLevels : 1u;
+			emulateParams["groupCount"]     = (uint32_t)groups.size();
+			emulateParams["phase"]          = phase;
+			for (uint32_t i = 0; i < groups.size(); i++) {
+				if (groups[i].path != GeometryPath::eEmulatedMeshShader) continue;
+				emulateParams["group"] = i;
+				context.DispatchIndirect(*emulatePipeline, (BufferView)taskCommands.slice(phase * groups.size() + i, 1), emulateParams);
+			}
+		}
+		WriteTimestamp(context, phase == 0 ? eFirstCull : eSecondCull);
+	}
+
+	inline void BuildDepthPyramid(CommandContext& context, const ImageView& depthBuffer) {
+		const uint2 pyramidExtent = uint2(depthPyramid->Extent());
+		ShaderParameter params = {};
+		params["depthBuffer"]        = ImageParameter{ .image = depthBuffer, .imageLayout = vk::ImageLayout::eShaderReadOnlyOptimal };
+		params["depthPyramidLevel0"] = ImageParameter{ .image = ImageView::Create(depthPyramid, vk::ImageSubresourceRange{ vk::ImageAspectFlagBits::eColor, 0, 1, 0, 1 }), .imageLayout = vk::ImageLayout::eGeneral };
+		params["depthExtent"]   = uint2(depthBuffer.Extent());
+		params["pyramidExtent"] = pyramidExtent;
+		context.Dispatch(*depthPyramidPipeline, pyramidExtent, params);
+		downsampler(context, depthPyramid, Downsampler::Reduction::eMax);
+		WriteTimestamp(context, eDepthPyramid);
+	}
+
+	// Stands in for BuildDepthPyramid and the second phase when occlusion culling is off, so their timings read 0
+	inline void SkipSecondPhase(CommandContext& context) {
+		WriteTimestamp(context, eDepthPyramid);
+		WriteTimestamp(context, eSecondCull);
+		WriteTimestamp(context, eSecondDraw);
+	}
+
+	// Makes the draws and instance list available to indirect draws. Call before BeginRendering.
+	inline void PrepareDraws(CommandContext& context, const uint32_t phase) {
+		context.AddIndirectArgsBarrier(drawCommands);
+		context.AddIndirectArgsBarrier(drawCommandCounts);
+		context.AddBarrier(drawInstances, Buffer::ResourceState{
+			.stage  = vk::PipelineStageFlagBits2::eVertexShader,
+			.access = vk::AccessFlagBits2::eShaderRead,
+			.queueFamily = context.QueueFamily() });
+		if (hasEmulatedGroups) {
+			context.AddIndirectArgsBarrier(emulatedDraws);
+			context.AddBarrier(emulatedTriangles, Buffer::ResourceState{
+				.stage  = vk::PipelineStageFlagBits2::eVertexShader,
+				.access = vk::AccessFlagBits2::eShaderRead,
+				.queueFamily = context.QueueFamily() });
+		}
+		if (hasMeshShaderGroups) {
+			context.AddIndirectArgsBarrier(taskCommands);
+			for (const BufferView& b : { (BufferView)meshletTasks, (BufferView)meshletCounts, (BufferView)meshletGroups })
+				context.AddBarrier(b, Buffer::ResourceState{
+					.stage  = vk::PipelineStageFlagBits2::eTaskShaderEXT,
+					.access = vk::AccessFlagBits2::eShaderRead,
+					.queueFamily = context.QueueFamily() });
+			// task shaders add to the meshlet counters
+			context.AddBarrier(counters, Buffer::ResourceState{
+				.stage  = vk::PipelineStageFlagBits2::eTaskShaderEXT,
+				.access = vk::AccessFlagBits2::eShaderRead|vk::AccessFlagBits2::eShaderWrite,
+				.queueFamily = context.QueueFamily() });
+			if (phase == 1)
+				context.AddBarrier(ImageView::Create(depthPyramid), Image::ResourceState{
+					.layout = vk::ImageLayout::eShaderReadOnlyOptimal,
+					.stage  = vk::PipelineStageFlagBits2::eTaskShaderEXT,
+					.access = vk::AccessFlagBits2::eShaderRead,
+					.queueFamily = context.QueueFamily() });
+		}
+	}
+
+	// Copies the counters for Stats. Timings of passes which didn't run are left from the last frame they ran in.
+	inline void EndFrame(CommandContext& context) {
+		stats.instanceCount = instanceCount;
+		current->timelineValue = context.GetDevice().NextTimelineSignal();
+		current->pending = true;
+		context.Copy(counters, current->counters);
+		current = nullptr;
+	}
+};
+
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <Rose/Core/RoseEngine.h>
+
+#define INSTANCE_CULLING_GROUP_SIZE 64
+
+#define INSTANCE_CULLING_FRUSTUM   1
+#define INSTANCE_CULLING_OCCLUSION 2
+#define INSTANCE_CULLING_CONE      4 // backface culling of meshlets by their normal cones
+
+// indices of the counters the culling kernels write (see InstanceCuller::Stats)
+#define INSTANCE_CULLING_FRUSTUM_CULLED     0
+#define INSTANCE_CULLING_OCCLUSION_CULLED   1
+#define INSTANCE_CULLING_FIRST_PHASE_DRAWN  2
+#define INSTANCE_CULLING_SECOND_PHASE_DRAWN 3
+#define INSTANCE_CULLING_MESHLET_FRUSTUM_CULLED   4
+#define INSTANCE_CULLING_MESHLET_CONE_CULLED      5
+#define INSTANCE_CULLING_MESHLET_OCCLUSION_CULLED 6
+#define INSTANCE_CULLING_MESHLETS_DRAWN           7
+#define INSTANCE_CULLING_COUNTER_COUNT      8
+
+// Meshlet task lists are dispatched in rows of this many workgroups, since a dimension of a dispatch may be limited to 65535
+#define MESHLET_DISPATCH_WIDTH 65535
+
+namespace RoseEngine {
+
+// One draw of a SceneRenderData::DrawBatch, over instances [firstInstance, firstInstance + instanceCount)
+struct CullingDraw {
+	float3 aabbMin; // of the batch's mesh, in object space
+	uint   firstInstance;
+	float3 aabbMax;
+	uint   instanceCount;
+};
+
+// VkDrawIndexedIndirectCommand
+struct DrawIndexedArgs {
+	uint indexCount;
+	uint instanceCount;
+	uint firstIndex;
+	int  vertexOffset;
+	uint firstInstance;
+};
+
+// VkDrawIndirectCommand
+struct DrawArgs {
+	uint vertexCount;
+	uint instanceCount;
+	uint firstVertex;
+	uint firstInstance;
+};
+
+// Where a draw group which is drawn with meshlets keeps its task list and emulated triangles (see InstanceCuller)
+struct MeshletGroup {
+	uint taskOffset;       // in meshletTasks
+	uint taskCapacity;     // 0 if the group isn't drawn with meshlets
+	uint triangleOffset;   // in emulatedTriangles
+	uint triangleCapacity; // 0 if the group isn't drawn by MeshletEmulation.cs.slang
+};
+
+// Pushed before drawing a meshlet group with mesh shaders
+struct MeshletPushConstants {
+	uint group;
+	uint phase;
+};
+
+}
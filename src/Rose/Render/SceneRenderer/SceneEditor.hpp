@@ -6,7 +6,7 @@
 
 namespace RoseEngine {
 
-ref<SceneNode> LoadGLTF(CommandContext& context, const std::filesystem::path& filename);
+ref<SceneNode> LoadGLTF(CommandContext& context, const std::filesystem::path& filename, const bool compressTextures, TextureStreamer* textureStreamer);
 
 class SceneEditor {
 private:
@@ -90,33 +90,30 @@ public:
 	}
 
 	inline void InspectorWidget(CommandContext& context) {
-		bool changed = false;
-
-		changed |= ImGui::ColorEdit3("Background color", &scene->backgroundColor.x, ImGuiColorEditFlags_Float|ImGuiColorEditFlags_HDR);
+		if (ImGui::ColorEdit3("Background color", &scene->backgroundColor.x, ImGuiColorEditFlags_Float|ImGuiColorEditFlags_HDR))
+			scene->SetDirty();
 
 		auto n = selected.lock();
 		if (!n) return;
 
+		// transform and material edits are applied to the scene's tables in place, without rebuilding them
 		if (ImGui::CollapsingHeader("Selected node")) {
 			ImGui::Text("Transform: %s", n->transform ? "true" : "false");
 			if (n->transform.has_value()) {
 				if (InspectorGui(n->transform.value()))
-					changed = true;
+					scene->SetTransformDirty(n);
 			} else {
 				Transform t = Transform::Identity();
 				if (InspectorGui(t)) {
 					n->transform = t;
-					changed = true;
+					scene->SetTransformDirty(n);
 				}
 			}
 			if (n->material) {
 				if (InspectorGui(*n->material))
-					changed = true;
+					scene->SetMaterialDirty(n->material.get());
 			}
 		}
-
-		if (changed)
-			scene->SetDirty();
 	}
 
 	inline void PreRender(CommandContext& context, const Transform& worldToCamera, const Transform& projection) {
@@ -159,7 +156,7 @@ public:
 				NULL,
 				NULL)) {
 				n->transform = inverse(parentTransform) * t;
-				scene->SetDirty();
+				scene->SetTransformDirty(n);
 			}
 		}
 	}
@@ -179,7 +176,7 @@ public:
 				// outline selected object
 				{
 					if (!outlinePipeline || (ImGui::IsKeyDown(ImGuiKey_F5) && outlinePipeline->GetShader()->IsStale())) {
-						if (outlinePipeline) context.GetDevice().Wait();
+						if (outlinePipeline) context.GetDevice().DeferDestroy(std::move(outlinePipeline));
 						outlinePipeline = Pipeline::CreateCompute(context.GetDevice(), ShaderModule::Create(context.GetDevice(), FindShaderPath("Outline.cs.slang")));
 					}
 
@@ -3,10 +3,11 @@
 #include <stack>
 
 #include <Rose/Scene/Scene.hpp>
+#include "InstanceCuller.hpp"
 
 namespace RoseEngine {
 
-ref<SceneNode> LoadGLTF(CommandContext& context, const std::filesystem::path& filename);
+ref<SceneNode> LoadGLTF(CommandContext& context, const std::filesystem::path& filename, const bool compressTextures, TextureStreamer* textureStreamer);
 
 class SceneRenderer {
 public:
@@ -18,13 +19,22 @@ public:
 	};
 
 private:
-	TupleMap<ref<Pipeline>, MeshLayout, MaterialFlags, bool> cachedPipelines = {};
+	using GeometryPath = InstanceCuller::GeometryPath;
+
+	TupleMap<ref<Pipeline>, MeshLayout, MaterialFlags, bool, GeometryPath> cachedPipelines = {};
 	ref<vk::raii::Sampler> cachedSampler = nullptr;
-	ref<const ShaderModule> vertexShader, vertexShaderTextured, fragmentShader, fragmentShaderTextured, fragmentShaderTexturedAlphaCutoff;
+	// Visibility.3d.slang's entry points for a geometry path. The mesh shader path has a task shader, and mesh shaders in place of vertex shaders.
+	struct VisibilityShaders {
+		ref<const ShaderModule> task, vertex, vertexTextured, fragment, fragmentTextured, fragmentTexturedAlphaCutoff;
+	};
+	std::array<VisibilityShaders, 3> visibilityShaders = {};
+	std::unordered_map<const Pipeline*, GeometryPath> pipelinePaths = {};
+	GeometryPath meshletPath = GeometryPath::eVertex; // the path of meshes with meshlets
 	ref<Pipeline> pathTracer = nullptr;
 
 	std::vector<ImageView> attachments;
-	ref<DescriptorSets> descriptorSets = {};
+	// per geometry path, since the stages of their pipelines and so their descriptor set layouts differ
+	std::array<ref<DescriptorSets>, 3> descriptorSets = {};
 	struct ViewportParams {
 		Transform cameraToWorld;
 		Transform worldToCamera;
@@ -35,41 +45,36 @@ private:
 
 	ref<Scene> scene = nullptr;
 
-	inline const auto& GetPipeline(Device& device, const Mesh& mesh, const Material<ImageView>& material) {
-		if (!vertexShader || (ImGui::IsKeyPressed(ImGuiKey_F5, false) && vertexShader->IsStale())) {
-			if (vertexShader) device.Wait();
-			vertexShader                      = ShaderModule::Create(device, FindShaderPath("Visibility.3d.slang"), "vertexMain");
-			vertexShaderTextured              = ShaderModule::Create(device, FindShaderPath("Visibility.3d.slang"), "vertexMain", "sm_6_7", ShaderDefines{ { "HAS_TEXCOORD", "1" } });
-			fragmentShader                    = ShaderModule::Create(device, FindShaderPath("Visibility.3d.slang"), "fragmentMain");
-			fragmentShaderTextured            = ShaderModule::Create(device, FindShaderPath("Visibility.3d.slang"), "fragmentMain", "sm_6_7", ShaderDefines{ { "HAS_TEXCOORD", "1" } });
-			fragmentShaderTexturedAlphaCutoff = ShaderModule::Create(device, FindShaderPath("Visibility.3d.slang"), "fragmentMain", "sm_6_7", ShaderDefines{ { "HAS_TEXCOORD", "1" }, { "USE_ALPHA_CUTOFF", "1" } });
-		}
-
-		bool textured = mesh.vertexAttributes.contains(MeshVertexAttributeType::eTexcoord) && mesh.vertexAttributes.at(MeshVertexAttributeType::eTexcoord).size() > 0;
-		auto vs = textured ? vertexShaderTextured : vertexShader;
-		auto fs = textured ? (material.HasFlag(MaterialFlags::eAlphaCutoff) ? fragmentShaderTexturedAlphaCutoff : fragmentShaderTextured) : fragmentShader;
-		const bool alphaBlend = material.HasFlag(MaterialFlags::eAlphaBlend);
+	// shader objects are keyed only by material, since vertex input and topology are set per draw
+	TupleMap<ref<Pipeline>, MaterialFlags, bool, GeometryPath> cachedShaderObjects = {};
+	bool shaderObjectsActive = false;
 
-		auto key = std::tuple{ mesh.GetLayout(*vs), (MaterialFlags)material.GetFlags(), textured };
+	inline bool HasDraws() const {
+		return std::ranges::any_of(descriptorSets, [](const ref<DescriptorSets>& s) { return s != nullptr; });
+	}
 
-		if (auto it = cachedPipelines.find(key); it != cachedPipelines.end()) {
-			const auto& pipeline = it->second;
-			if (pipeline->GetShader(vk::ShaderStageFlagBits::eVertex) != vs || pipeline->GetShader(vk::ShaderStageFlagBits::eFragment) != fs)
-				cachedPipelines.erase(it);
-			else
-				return *it;
-		}
+	inline const VisibilityShaders& GetShaders(Device& device, const GeometryPath path) {
+		VisibilityShaders& s = visibilityShaders[(size_t)path];
+		if (s.vertex && !((ImGui::GetCurrentContext() && ImGui::IsKeyPressed(ImGuiKey_F5, false)) && s.vertex->IsStale()))
+			return s;
 
-		if (!cachedSampler) {
-			cachedSampler = make_ref<vk::raii::Sampler>(*device, vk::SamplerCreateInfo{
-				.magFilter  = vk::Filter::eLinear,
-				.minFilter  = vk::Filter::eLinear,
-				.mipmapMode = vk::SamplerMipmapMode::eLinear,
-				.minLod = 0,
-				.maxLod = 12 });
-		}
+		auto create = [&](const char* entryPoint, ShaderDefines defines) {
+			if (path == GeometryPath::eEmulatedMeshShader)
+				defines["MESHLET_EMULATION"] = "1";
+			return ShaderModule::Create(device, FindShaderPath("Visibility.3d.slang"), entryPoint, "sm_6_7", defines);
+		};
+		const char* vertexEntryPoint = path == GeometryPath::eMeshShader ? "meshMain" : "vertexMain";
+		s.task                        = path == GeometryPath::eMeshShader ? create("taskMain", {}) : nullptr;
+		s.vertex                      = create(vertexEntryPoint, {});
+		s.vertexTextured              = create(vertexEntryPoint, { { "HAS_TEXCOORD", "1" } });
+		s.fragment                    = create("fragmentMain", {});
+		s.fragmentTextured            = create("fragmentMain", { { "HAS_TEXCOORD", "1" } });
+		s.fragmentTexturedAlphaCutoff = create("fragmentMain", { { "HAS_TEXCOORD", "1" }, { "USE_ALPHA_CUTOFF", "1" } });
+		return s;
+	}
 
-		// get vertex buffer bindings from the mesh layout
+	inline GraphicsPipelineInfo GetPipelineInfo(const MeshLayout& meshLayout, const Material<ImageView>& material) const {
+		const bool alphaBlend = material.HasFlag(MaterialFlags::eAlphaBlend);
 
 		DynamicRenderingState renderState;
 		for (const auto&[name, format, clearValue] : kRenderAttachments) {
@@ -79,12 +84,12 @@ private:
 				renderState.colorFormats.emplace_back(format);
 		}
 
-		GraphicsPipelineInfo pipelineInfo {
+		return GraphicsPipelineInfo {
 			.vertexInputState = VertexInputDescription{
-				.bindings   = std::get<0>(key).bindings,
-				.attributes = std::get<0>(key).attributes },
+				.bindings   = meshLayout.bindings,
+				.attributes = meshLayout.attributes },
 			.inputAssemblyState = vk::PipelineInputAssemblyStateCreateInfo{
-				.topology = std::get<0>(key).topology },
+				.topology = meshLayout.topology },
 			.rasterizationState = vk::PipelineRasterizationStateCreateInfo{
 				.depthClampEnable = false,
 				.rasterizerDiscardEnable = false,
@@ -114,25 +119,134 @@ private:
 			.dynamicStates = { vk::DynamicState::eViewport, vk::DynamicState::eScissor },
 			.dynamicRenderingState = renderState
 		};
+	}
+
+	inline std::pair<MeshLayout, const Pipeline*> GetPipeline(Device& device, const Mesh& mesh, const Material<ImageView>& material) {
+		const GeometryPath path = mesh.meshletCount > 0 && mesh.topology == vk::PrimitiveTopology::eTriangleList ? meshletPath : GeometryPath::eVertex;
+		const VisibilityShaders& shaders = GetShaders(device, path);
+
+		bool textured = mesh.vertexAttributes.contains(MeshVertexAttributeType::eTexcoord) && mesh.vertexAttributes.at(MeshVertexAttributeType::eTexcoord).size() > 0;
+		auto vs = textured ? shaders.vertexTextured : shaders.vertex;
+		auto fs = textured ? (material.HasFlag(MaterialFlags::eAlphaCutoff) ? shaders.fragmentTexturedAlphaCutoff : shaders.fragmentTextured) : shaders.fragment;
+
+		const MeshLayout meshLayout = mesh.GetLayout(*vs);
+
+		auto findCached = [&](auto& cache, const auto& key) -> const Pipeline* {
+			auto it = cache.find(key);
+			if (it == cache.end())
+				return nullptr;
+			const auto& pipeline = it->second;
+			if (pipeline->GetShader(vs->Stage()) != vs || pipeline->GetShader(vk::ShaderStageFlagBits::eFragment) != fs) {
+				pipelinePaths.erase(pipeline.get());
+				device.DeferDestroy(std::move(it->second));
+				cache.erase(it);
+				return nullptr;
+			}
+			return pipeline.get();
+		};
+
+		const auto shaderObjectKey = std::tuple{ (MaterialFlags)material.GetFlags(), textured, path };
+		const auto pipelineKey     = std::tuple{ meshLayout, (MaterialFlags)material.GetFlags(), textured, path };
+		if (const Pipeline* p = shaderObjectsActive ? findCached(cachedShaderObjects, shaderObjectKey) : findCached(cachedPipelines, pipelineKey))
+			return { meshLayout, p };
+
+		if (!cachedSampler) {
+			cachedSampler = make_ref<vk::raii::Sampler>(*device, vk::SamplerCreateInfo{
+				.magFilter  = vk::Filter::eLinear,
+				.minFilter  = vk::Filter::eLinear,
+				.mipmapMode = vk::SamplerMipmapMode::eLinear,
+				.minLod = 0,
+				.maxLod = 12 });
+		}
+
 		PipelineLayoutInfo layoutInfo {
 			.descriptorBindingFlags = {
 				{ "scene.meshBuffers", vk::DescriptorBindingFlagBits::ePartiallyBound },
-				{ "scene.images",      vk::DescriptorBindingFlagBits::ePartiallyBound } },
+				{ "scene.images",      vk::DescriptorBindingFlagBits::ePartiallyBound },
+				{ "depthPyramid",      vk::DescriptorBindingFlagBits::ePartiallyBound } },
 			.immutableSamplers      = { { "scene.sampler", { cachedSampler } } } };
-		auto pipeline = Pipeline::CreateGraphics(device, { vs, fs }, pipelineInfo, layoutInfo);
-		return *cachedPipelines.emplace(key, pipeline).first;
+
+		const auto start = std::chrono::high_resolution_clock::now();
+
+		GraphicsPipelineInfo pipelineInfo = GetPipelineInfo(meshLayout, material);
+		std::vector<ref<const ShaderModule>> stages = { vs, fs };
+		if (path == GeometryPath::eMeshShader) {
+			stages.insert(stages.begin(), shaders.task);
+			pipelineInfo.vertexInputState.reset();
+			pipelineInfo.inputAssemblyState.reset();
+		}
+		ref<Pipeline> pipeline;
+		if (shaderObjectsActive) {
+			pipelineInfo.vertexInputState.reset();
+			pipeline = Pipeline::CreateShaderObjects(device, stages, pipelineInfo, layoutInfo);
+			cachedShaderObjects.emplace(shaderObjectKey, pipeline);
+		} else {
+			pipeline = Pipeline::CreateGraphics(device, stages, pipelineInfo, layoutInfo);
+			cachedPipelines.emplace(pipelineKey, pipeline);
+		}
+		pipelinePaths[pipeline.get()] = path;
+
+		stats.pipelineTime += std::chrono::duration_cast<std::chrono::duration<double, std::milli>>(std::chrono::high_resolution_clock::now() - start).count();
+		stats.pipelineCount++;
+
+		return { meshLayout, pipeline.get() };
 	}
 
 public:
+	// Draw with VK_EXT_shader_object when the device supports it, instead of one pipeline per mesh layout and material
+	bool useShaderObjects = true;
+	// How meshes with meshlets are drawn. eAuto draws them with task and mesh shaders when the device has VK_EXT_mesh_shader,
+	// and as whole meshes otherwise. eMeshShaders falls back to the compute emulation, which eEmulated always uses.
+	enum class MeshletMode { eOff, eAuto, eMeshShaders, eEmulated };
+	MeshletMode meshletMode = MeshletMode::eAuto;
+	// Set when PostRender runs after every Render. The path tracer writes every pixel of the render target, so the
+	// rasterizer's copy of it is neither cleared nor stored.
+	bool overwriteRenderTarget = false;
+
+	// For comparing the pipeline and shader object paths
+	struct RenderStats {
+		double   pipelineTime = 0;  // milliseconds spent creating pipelines or shader objects, since the last change of path
+		double   recordTime = 0;    // milliseconds spent recording the last Render
+		uint32_t pipelineCount = 0; // pipelines or shader objects created since the last change of path
+		uint32_t drawCount = 0;     // indirect draws in the last Render
+	};
+	RenderStats stats = {};
+
+	InstanceCuller culler = {};
+
 	inline void SetScene(const ref<Scene>& s) { scene = s; }
 
+	inline void InspectorWidget() {
+		ImGui::Checkbox("Shader objects", &useShaderObjects);
+		ImGui::Text("%u %s created in %.2f ms", stats.pipelineCount, shaderObjectsActive ? "shader objects" : "pipelines", stats.pipelineTime);
+		ImGui::Text("%u draws recorded in %.3f ms", stats.drawCount, stats.recordTime);
+
+		ImGui::Checkbox("Frustum culling", &culler.frustumCulling);
+		ImGui::Checkbox("Occlusion culling", &culler.occlusionCulling);
+		const InstanceCuller::Stats& c = culler.GetStats();
+		ImGui::Text("%u instances, %u outside the frustum, %u occluded", c.instanceCount, c.frustumCulled, c.occlusionCulled);
+		ImGui::Text("Phase 1: %u drawn, cull %.3f ms, draw %.3f ms", c.firstPhaseDrawn, c.firstCullTime, c.firstDrawTime);
+		if (culler.OcclusionActive()) {
+			ImGui::Text("Depth pyramid %.3f ms", c.depthPyramidTime);
+			ImGui::Text("Phase 2: %u drawn, cull %.3f ms, draw %.3f ms", c.secondPhaseDrawn, c.secondCullTime, c.secondDrawTime);
+		}
+
+		ImGui::Combo("Meshlets", (int*)&meshletMode, "Off\0Auto\0Mesh shaders\0Emulated\0");
+		ImGui::Checkbox("Meshlet cone culling", &culler.coneCulling);
+		if (meshletPath != GeometryPath::eVertex)
+			ImGui::Text("%u meshlets drawn, %u outside the frustum, %u backfacing, %u occluded",
+				c.meshletsDrawn, c.meshletFrustumCulled, c.meshletConeCulled, c.meshletOcclusionCulled);
+	}
+
 	inline const ImageView& GetAttachment(const uint32_t index) const {
 		return attachments[index];
 	}
 
 	inline void PreRender(CommandContext& context, const uint2 extent, const Transform& cameraToWorld, const Transform& projection) {
 		if (attachments.empty() || (uint2)attachments[0].Extent() != extent) {
-			context.GetDevice().Wait();
+			// the previous frame may still be rendering to the old attachments
+			if (!attachments.empty())
+				context.GetDevice().DeferDestroy(std::move(attachments));
 			attachments.clear();
 			// create attachments
 			for (const auto&[name, format, clearValue] : kRenderAttachments) {
@@ -142,7 +256,7 @@ public:
 						Image::Create(context.GetDevice(), ImageInfo{
 							.format = format,
 							.extent = uint3(extent, 1),
-							.usage = vk::ImageUsageFlagBits::eTransferDst | vk::ImageUsageFlagBits::eDepthStencilAttachment,
+							.usage = vk::ImageUsageFlagBits::eTransferDst | vk::ImageUsageFlagBits::eSampled | vk::ImageUsageFlagBits::eDepthStencilAttachment,
 							.queueFamilies = { context.QueueFamily() } }),
 						vk::ImageSubresourceRange{
 							.aspectMask = vk::ImageAspectFlagBits::eDepth,
@@ -162,60 +276,164 @@ public:
 			}
 		}
 
+		// swap in link-time optimized pipelines which finished compiling in the background
+		for (auto&[key, pipeline] : cachedPipelines)
+			pipeline->UpdateOptimized(context.GetDevice());
+
 		viewData.cameraToWorld = cameraToWorld;
 		viewData.worldToCamera = inverse(cameraToWorld);
 		viewData.projection = projection;
 
+		const bool shaderObjects = useShaderObjects && context.GetDevice().EnabledExtensions().contains(VK_EXT_SHADER_OBJECT_EXTENSION_NAME);
+		if (shaderObjects != shaderObjectsActive) {
+			shaderObjectsActive = shaderObjects;
+			stats.pipelineTime = 0;
+			stats.pipelineCount = 0;
+			if (scene) scene->SetDirty();
+		}
+
+		const bool meshShaders = context.GetDevice().EnabledExtensions().contains(VK_EXT_MESH_SHADER_EXTENSION_NAME);
+		GeometryPath path = GeometryPath::eVertex;
+		switch (meshletMode) {
+			case MeshletMode::eOff:         path = GeometryPath::eVertex; break;
+			case MeshletMode::eAuto:        path = meshShaders ? GeometryPath::eMeshShader : GeometryPath::eVertex; break;
+			case MeshletMode::eMeshShaders: path = meshShaders ? GeometryPath::eMeshShader : GeometryPath::eEmulatedMeshShader; break;
+			case MeshletMode::eEmulated:    path = GeometryPath::eEmulatedMeshShader; break;
+		}
+		if (path != meshletPath) {
+			meshletPath = path;
+			if (scene) scene->SetDirty();
+		}
+
+		descriptorSets = {};
 		if (scene && scene->sceneRoot) {
 			scene->PreRender(context, [&](Device& device, const Mesh& mesh, const Material<ImageView>& material) { return GetPipeline(device, mesh, material); });
 
-			ShaderParameter params = {};
-			params["scene"]         = scene->renderData.sceneParameters;
-			params["worldToCamera"] = viewData.worldToCamera;
-			params["projection"]    = viewData.projection;
+			if (std::ranges::any_of(scene->renderData.drawLists, [](const auto& drawList) { return !drawList.empty(); })) {
+				culler.Prepare(context, scene->renderData, extent, [&](const Pipeline& p) { return pipelinePaths.at(&p); });
+
+				ShaderParameter params = {};
+				params["scene"]          = scene->renderData.sceneParameters;
+				params["drawInstances"]  = (BufferParameter)culler.DrawInstances();
+				params["worldToCamera"]  = viewData.worldToCamera;
+				params["projection"]     = viewData.projection;
+				params["cameraPosition"] = viewData.cameraToWorld.TransformPoint(float3(0));
+				if (const ImageView pyramid = culler.DepthPyramid())
+					params["depthPyramid"] = ImageParameter{ .image = pyramid, .imageLayout = vk::ImageLayout::eShaderReadOnlyOptimal };
+				culler.SetMeshletParameters(params);
+
+				// all pipelines of a geometry path should have the same descriptor set layouts
+				for (const InstanceCuller::DrawGroup& g : culler.DrawGroups()) {
+					ref<DescriptorSets>& sets = descriptorSets[(size_t)g.path];
+					if (sets) continue;
+					const PipelineLayout& layout = *g.batch->pipeline->Layout();
+					sets = context.GetDescriptorSets(layout);
+					context.UpdateDescriptorSets(*sets, params, layout);
+				}
+			}
+		}
+	}
+
+	// Records one indirect draw per draw group. Vertices are pulled in the vertex shader, so only the index buffer is bound,
+	// and only for groups which aren't drawn from meshlets.
+	inline void DrawPhase(CommandContext& context, const uint32_t phase) {
+		const Pipeline* p = nullptr;
+		const Buffer* indexBuffer = nullptr;
+		uint32_t indexSize = 0;
+		const auto& groups = culler.DrawGroups();
+		for (uint32_t i = 0; i < groups.size(); i++) {
+			const auto&[pipeline, mesh, meshLayout, draws] = *groups[i].batch;
+			const GeometryPath path = groups[i].path;
+			if (p != pipeline) {
+				context.BindGraphicsPipeline(*pipeline);
+				context.BindDescriptors(*pipeline->Layout(), *descriptorSets[(size_t)path]);
+				if (pipeline->IsShaderObject() && path != GeometryPath::eMeshShader)
+					context.SetVertexInput(meshLayout.bindings, meshLayout.attributes);
+				p = pipeline;
+			}
 
-			// all pipelines should have the same descriptor set layouts
-			descriptorSets = context.GetDescriptorSets(*cachedPipelines.begin()->second->Layout());
-			context.UpdateDescriptorSets(*descriptorSets, params, *cachedPipelines.begin()->second->Layout());
-		} else {
-			descriptorSets = {};
+			if (pipeline->IsShaderObject() && path != GeometryPath::eMeshShader)
+				context->setPrimitiveTopology(meshLayout.topology);
+
+			if (path == GeometryPath::eVertex && (mesh->indexBuffer.mBuffer.get() != indexBuffer || mesh->indexSize != indexSize)) {
+				indexBuffer = mesh->indexBuffer.mBuffer.get();
+				indexSize   = mesh->indexSize;
+				context->bindIndexBuffer(**indexBuffer, 0, mesh->IndexType());
+			}
+
+			culler.DrawIndirect(context, phase, i);
+			stats.drawCount++;
 		}
 	}
 
 	inline void Render(CommandContext& context) {
-		context.BeginRendering({
-			{ attachments[0], std::get<vk::ClearValue>(kRenderAttachments[0]) },
-			{ attachments[1], std::get<vk::ClearValue>(kRenderAttachments[1]) },
-			{ attachments[2], std::get<vk::ClearValue>(kRenderAttachments[2]) },
-		});
-
-		if (descriptorSets) {
-			const Pipeline* p = nullptr;
-			for (const auto& drawList : scene->renderData.drawLists) {
-				for (const auto&[pipeline, mesh, meshLayout, draws] : drawList) {
-					if (p != pipeline) {
-						context->bindPipeline(vk::PipelineBindPoint::eGraphics, ***pipeline);
-						context.BindDescriptors(*pipeline->Layout(), *descriptorSets);
-						p = pipeline;
-					}
-
-					mesh->Bind(context, meshLayout);
-
-					const uint32_t indexCount = mesh->indexBuffer.size_bytes() / mesh->indexSize;
-					for (const auto&[firstInstance, instanceCount] : draws) {
-						context->drawIndexed(indexCount, instanceCount, 0, 0, firstInstance);
-					}
-				}
-			}
+		// the visibility buffer is read by PostRender and picking. the depth buffer is only kept for the depth pyramid.
+		const bool discardRenderTarget = overwriteRenderTarget && HasDraws();
+		const bool occlusionCulling = HasDraws() && culler.OcclusionActive();
+		auto beginRendering = [&](const bool clear) {
+			const vk::AttachmentLoadOp loadOp = clear ? vk::AttachmentLoadOp::eClear : vk::AttachmentLoadOp::eLoad;
+			context.BeginRendering({
+				RenderAttachment{
+					.image      = attachments[0],
+					.loadOp     = discardRenderTarget ? vk::AttachmentLoadOp::eDontCare  : loadOp,
+					.storeOp    = discardRenderTarget ? vk::AttachmentStoreOp::eDontCare : vk::AttachmentStoreOp::eStore,
+					.clearValue = std::get<vk::ClearValue>(kRenderAttachments[0]) },
+				RenderAttachment{
+					.image      = attachments[1],
+					.loadOp     = loadOp,
+					.storeOp    = vk::AttachmentStoreOp::eStore,
+					.clearValue = std::get<vk::ClearValue>(kRenderAttachments[1]) },
+				RenderAttachment{
+					.image      = attachments[2],
+					.loadOp     = loadOp,
+					.storeOp    = occlusionCulling && clear ? vk::AttachmentStoreOp::eStore : vk::AttachmentStoreOp::eDontCare,
+					.clearValue = std::get<vk::ClearValue>(kRenderAttachments[2]) },
+			});
+		};
+
+		const auto start = std::chrono::high_resolution_clock::now();
+		stats.drawCount = 0;
+
+		if (!HasDraws()) {
+			beginRendering(true);
+			context.EndRendering();
+			stats.recordTime = 0;
+			return;
 		}
 
+		const Transform worldToClip = viewData.projection * viewData.worldToCamera;
+		const float3 cameraPosition = viewData.cameraToWorld.TransformPoint(float3(0));
+
+		// first phase: what was visible last frame
+		culler.BeginFrame(context);
+		culler.Cull(context, 0, scene->renderData, worldToClip, cameraPosition);
+		culler.PrepareDraws(context, 0);
+		beginRendering(true);
+		DrawPhase(context, 0);
 		context.EndRendering();
+		culler.WriteTimestamp(context, InstanceCuller::eFirstDraw);
+
+		// second phase: what the first phase's depth shows to be visible, and wasn't drawn yet
+		if (occlusionCulling) {
+			culler.BuildDepthPyramid(context, attachments[2]);
+			culler.Cull(context, 1, scene->renderData, worldToClip, cameraPosition);
+			culler.PrepareDraws(context, 1);
+			beginRendering(false);
+			DrawPhase(context, 1);
+			context.EndRendering();
+			culler.WriteTimestamp(context, InstanceCuller::eSecondDraw);
+		} else
+			culler.SkipSecondPhase(context);
+
+		culler.EndFrame(context);
+
+		stats.recordTime = std::chrono::duration_cast<std::chrono::duration<double, std::milli>>(std::chrono::high_resolution_clock::now() - start).count();
 	}
 
 	inline void PostRender(CommandContext& context) {
 		if (!scene || !scene->sceneRoot || scene->renderData.drawLists.empty()) return;
-		if (!pathTracer || (ImGui::IsKeyPressed(ImGuiKey_F5, false) && pathTracer->GetShader()->IsStale())) {
-			if (pathTracer) context.GetDevice().Wait();
+		if (!pathTracer || ((ImGui::GetCurrentContext() && ImGui::IsKeyPressed(ImGuiKey_F5, false)) && pathTracer->GetShader()->IsStale())) {
+			if (pathTracer) context.GetDevice().DeferDestroy(std::move(pathTracer));
 			pathTracer = Pipeline::CreateCompute(context.GetDevice(), ShaderModule::Create(context.GetDevice(), FindShaderPath("PathTracer.cs.slang")), {},
 				PipelineLayoutInfo{
 					.descriptorBindingFlags = {
@@ -0,0 +1,22 @@
+#pragma once
+
+#include <Rose/Core/RoseEngine.h>
+
+#define ENVIRONMENT_SAMPLING_GROUP_SIZE 64
+#define ENVIRONMENT_SAMPLING_MAX_EXTENT 2048 // tables are built from the largest level of the image no wider than this
+
+namespace RoseEngine {
+
+// Tables over the texels of an equirectangular image have extent.y row entries, which pick a row by the row's total weight,
+// followed by extent.x entries per row which pick a texel within the row. The pdf of texel entries is relative to a uniform
+// pick over the whole image (the product of the row's and the texel's pdf), so it is the pdf in uv space.
+
+// One entry of an alias table. Sampling picks entry i uniformly, then keeps i with probability threshold and takes alias
+// otherwise. pdf is the entry's probability relative to a uniform pick, and is not modified when the table is built.
+struct EnvironmentAliasEntry {
+	float threshold;
+	uint  alias;
+	float pdf;
+};
+
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <Rose/Core/CommandContext.hpp>
+
+#include "EnvironmentSampling.h"
+
+namespace RoseEngine {
+
+// Builds alias tables for importance sampling equirectangular environment maps by luminance and solid angle
+// (see EnvironmentSampling.cs.slang), so that shaders can sample a direction and evaluate its pdf in constant time
+// (see Scene::SampleBackground and Scene::BackgroundPdf).
+class EnvironmentSampler {
+private:
+	ref<Pipeline> computeWeights, buildRows, buildMarginal, finalizePdf;
+
+public:
+	struct Table {
+		BufferRange<EnvironmentAliasEntry> entries = {};
+		uint2                              extent = uint2(0); // of the image level the table was built from
+		inline operator bool() const { return !entries.empty(); }
+	};
+
+	// Builds the table from the largest level of image no wider than ENVIRONMENT_SAMPLING_MAX_EXTENT.
+	// The table is written by the commands recorded here, so it can be used by any later command.
+	inline Table Build(CommandContext& context, const ImageView& image) {
+		Device& device = context.GetDevice();
+		if (!computeWeights) {
+			const auto shaderFile = FindShaderPath("EnvironmentSampling.cs.slang");
+			computeWeights = Pipeline::CreateCompute(device, ShaderModule::Create(device, shaderFile, "computeWeights"));
+			buildRows      = Pipeline::CreateCompute(device, ShaderModule::Create(device, shaderFile, "buildRows"));
+			buildMarginal  = Pipeline::CreateCompute(device, ShaderModule::Create(device, shaderFile, "buildMarginal"));
+			finalizePdf    = Pipeline::CreateCompute(device, ShaderModule::Create(device, shaderFile, "finalizePdf"));
+		}
+
+		// level is relative to the view
+		const uint32_t levelCount = image.mSubresource.levelCount == VK_REMAINING_MIP_LEVELS ? image.mImage->Info().mipLevels - image.mSubresource.baseMipLevel : image.mSubresource.levelCount;
+		uint32_t level = 0;
+		while (level + 1 < levelCount && std::max(image.Extent(level).x, image.Extent(level).y) > ENVIRONMENT_SAMPLING_MAX_EXTENT)
+			level++;
+
+		Table table;
+		table.extent = uint2(image.Extent(level));
+		table.entries = Buffer::Create(device,
+			sizeof(EnvironmentAliasEntry) * (table.extent.y + size_t(table.extent.x) * table.extent.y),
+			vk::BufferUsageFlagBits::eStorageBuffer).cast<EnvironmentAliasEntry>();
+
+		ShaderParameter params = {};
+		params["image"]  = ImageParameter{ .image = image, .imageLayout = vk::ImageLayout::eShaderReadOnlyOptimal };
+		params["table"]  = (BufferParameter)table.entries;
+		params["extent"] = table.extent;
+		params["level"]  = level;
+
+		context.Dispatch(*computeWeights, table.extent, params);
+		context.Dispatch(*buildRows, table.extent.y, params);
+		context.Dispatch(*buildMarginal, 1u, params);
+		context.Dispatch(*finalizePdf, table.extent, params);
+		return table;
+	}
+};
+
+}
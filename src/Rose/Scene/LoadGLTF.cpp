@@ -1,5 +1,11 @@
 #include <iostream>
+#include <atomic>
+#include <chrono>
+#include <future>
+#include <numeric>
+#include <thread>
 #include <Rose/Core/MathUtils.h>
+#include <Rose/Core/TextureCompression.hpp>
 
 #define TINYGLTF_USE_CPP14
 #define TINYGLTF_NO_STB_IMAGE_WRITE
@@ -7,14 +13,29 @@
 #include <tiny_gltf.h>
 
 #include "LoadGLTF.hpp"
+#include "Meshlets.hpp"
+#include "TextureStreamer.hpp"
 
 namespace RoseEngine {
 
-ref<SceneNode> LoadGLTF(CommandContext& context, const std::filesystem::path& filename) {
+static bool IsKtx2(const std::span<const unsigned char> bytes) {
+	static const std::array<unsigned char, 12> ktx2Identifier = { 0xAB, 'K', 'T', 'X', ' ', '2', '0', 0xBB, '\r', '\n', 0x1A, '\n' };
+	return bytes.size() >= ktx2Identifier.size() && std::equal(ktx2Identifier.begin(), ktx2Identifier.end(), bytes.begin());
+}
+
+// images are kept encoded (flagged as_is), and decoded by LoadGLTF's worker threads instead of serially by tinygltf
+static bool KeepEncodedImage(tinygltf::Image* image, const int imageIndex, std::string* err, std::string* warn, int reqWidth, int reqHeight, const unsigned char* bytes, int size, void* userData) {
+	image->image.assign(bytes, bytes + size);
+	image->as_is = true;
+	return true;
+}
+
+ref<SceneNode> LoadGLTF(CommandContext& context, const std::filesystem::path& filename, const bool compressTextures, TextureStreamer* textureStreamer) {
 	std::cout << "Loading " << filename << std::endl;
 
 	tinygltf::Model model;
 	tinygltf::TinyGLTF loader;
+	loader.SetImageLoader(&KeepEncodedImage, nullptr);
 	std::string err, warn;
 	if ((filename.extension() == ".glb" && !loader.LoadBinaryFromFile(&model, &err, &warn, filename.string())) ||
 		(filename.extension() == ".gltf" && !loader.LoadASCIIFromFile(&model, &err, &warn, filename.string())) )
@@ -23,98 +44,208 @@ ref<SceneNode> LoadGLTF(CommandContext& context, const std::filesystem::path& fi
 
 	Device& device = context.GetDevice();
 
-	std::vector<BufferView>               buffersCpu(model.buffers.size());
-	std::vector<BufferView>               buffers  (model.buffers.size());
 	std::vector<ImageView>                images   (model.images.size());
 	std::vector<std::vector<ref<Mesh>>>   meshes   (model.meshes.size());
 	std::vector<ref<Material<ImageView>>> materials(model.materials.size());
 
-	vk::BufferUsageFlags bufferUsage = vk::BufferUsageFlagBits::eVertexBuffer|vk::BufferUsageFlagBits::eIndexBuffer|vk::BufferUsageFlagBits::eStorageBuffer|vk::BufferUsageFlagBits::eTransferDst|vk::BufferUsageFlagBits::eTransferSrc;
+	// geometry is packed into one index pool and one vertex pool, which only hold the buffer views that meshes reference.
+	// bytes of embedded images aren't uploaded, and every mesh shares the same index and vertex buffers, so draws can be merged.
+	enum GeometryPool { eIndexPool, eVertexPool, ePoolCount };
+	std::array<BufferView, ePoolCount>          poolsCpu;
+	std::array<BufferView, ePoolCount>          pools;
+	std::array<std::vector<size_t>, ePoolCount> viewOffsets; // offset of each buffer view in each pool, ~0 if it isn't in the pool
+	std::array<size_t, ePoolCount>              poolSizes = {};
+	for (auto& o : viewOffsets) o.resize(model.bufferViews.size(), ~size_t(0));
+	{
+		auto AddView = [&](const GeometryPool pool, const int view) {
+			if (view < 0 || viewOffsets[pool][view] != ~size_t(0)) return;
+			viewOffsets[pool][view] = poolSizes[pool];
+			poolSizes[pool] = (poolSizes[pool] + model.bufferViews[view].byteLength + 15) / 16 * 16;
+		};
+		for (const tinygltf::Mesh& mesh : model.meshes) {
+			for (const tinygltf::Primitive& prim : mesh.primitives) {
+				AddView(eIndexPool, model.accessors[prim.indices].bufferView);
+				for (const auto&[attribName, attribIndex] : prim.attributes)
+					AddView(eVertexPool, model.accessors[attribIndex].bufferView);
+			}
+		}
+	}
+
+	vk::BufferUsageFlags bufferUsage = vk::BufferUsageFlagBits::eStorageBuffer|vk::BufferUsageFlagBits::eTransferDst|vk::BufferUsageFlagBits::eTransferSrc;
 	if (device.EnabledExtensions().contains(VK_KHR_ACCELERATION_STRUCTURE_EXTENSION_NAME)) {
 		bufferUsage |= vk::BufferUsageFlagBits::eShaderDeviceAddress;
 		bufferUsage |= vk::BufferUsageFlagBits::eAccelerationStructureBuildInputReadOnlyKHR;
 	}
 
+	auto GetImageIndex = [&](const uint32_t textureIndex) -> uint32_t {
+		if (textureIndex >= model.textures.size()) return ~0u;
+		const tinygltf::Texture& texture = model.textures[textureIndex];
+		uint32_t index = texture.source;
+		if (auto it = texture.extensions.find("KHR_texture_basisu"); it != texture.extensions.end() && it->second.Has("source")) {
+#ifdef ENABLE_KTX
+			index = it->second.Get("source").GetNumberAsInt();
+#else
+			if (index >= images.size()) std::cerr << filename.string() << ": KHR_texture_basisu textures require libktx" << std::endl;
+#endif
+		}
+		return index;
+	};
+
+	// how materials use each image. the combination of roles decides the color space and compressed format
+	enum ImageRole : uint32_t {
+		eColor             = 1 << 0,
+		eMetallicRoughness = 1 << 1, // roughness in g, metallic in b
+		eOcclusion         = 1 << 2, // r
+		eNormal            = 1 << 3, // z is reconstructed when sampling
+	};
+	struct ImageUsage {
+		bool       used = false;
+		bool       srgb = false;
+		vk::Format compressedFormat = vk::Format::eUndefined;
+		uint2      sourceChannels = uint2(0, 1); // channels stored by BC4/BC5
+	};
+	std::vector<ImageUsage> imageUsage(model.images.size());
+	{
+		std::vector<uint32_t> roles(model.images.size(), 0);
+		auto AddRole = [&](const uint32_t textureIndex, const ImageRole role) {
+			const uint32_t index = GetImageIndex(textureIndex);
+			if (index < roles.size()) roles[index] |= role;
+		};
+		for (const tinygltf::Material& material : model.materials) {
+			AddRole(material.emissiveTexture.index,                               eColor);
+			AddRole(material.pbrMetallicRoughness.baseColorTexture.index,         eColor);
+			AddRole(material.pbrMetallicRoughness.metallicRoughnessTexture.index, eMetallicRoughness);
+			AddRole(material.occlusionTexture.index,                              eOcclusion);
+			AddRole(material.normalTexture.index,                                 eNormal);
+		}
+
+		for (uint32_t i = 0; i < imageUsage.size(); i++) {
+			// materials don't sample occlusion, so images only used for it aren't loaded
+			if ((roles[i] & ~eOcclusion) == 0) continue;
+			ImageUsage& usage = imageUsage[i];
+			usage.used = true;
+			usage.srgb = (roles[i] & eColor) != 0;
+			if (!compressTextures) continue;
+			switch (roles[i]) {
+				case eMetallicRoughness:
+					usage.compressedFormat = vk::Format::eBc5UnormBlock;
+					usage.sourceChannels = uint2(1, 2);
+					break;
+				case eNormal:
+					usage.compressedFormat = vk::Format::eBc5UnormBlock;
+					break;
+				default:
+					// color, or channels shared between roles (e.g. occlusion in r of a metallic-roughness image), which BC5 would drop
+					usage.compressedFormat = usage.srgb ? vk::Format::eBc7SrgbBlock : vk::Format::eBc7UnormBlock;
+					break;
+			}
+		}
+	}
+
+	// decode, transcode or compress used images on worker threads while buffers and meshes are loaded.
+	// the largest files are started first, so that they don't end up last on a single thread
+	std::vector<std::promise<HostPixelData>> decodedImages(model.images.size());
+	std::vector<uint32_t> decodeOrder;
+	for (uint32_t i = 0; i < model.images.size(); i++)
+		if (imageUsage[i].used)
+			decodeOrder.emplace_back(i);
+	std::ranges::sort(decodeOrder, std::greater{}, [&](const uint32_t i) { return model.images[i].image.size(); });
+
+	const auto decodeStart = std::chrono::steady_clock::now();
+	std::atomic_uint32_t nextImage = 0;
+	std::vector<std::jthread> workers(std::min<size_t>(std::max(std::thread::hardware_concurrency(), 1u), decodeOrder.size()));
+	for (std::jthread& worker : workers) {
+		worker = std::jthread([&]() {
+			for (uint32_t i = nextImage++; i < decodeOrder.size(); i = nextImage++) {
+				const uint32_t index = decodeOrder[i];
+				const tinygltf::Image& image = model.images[index];
+				const ImageUsage& usage = imageUsage[index];
+				const std::span<const std::byte> bytes = std::as_bytes(std::span(image.image));
+				const std::string name = image.name.empty() ? (image.uri.empty() ? "image " + std::to_string(index) : image.uri) : image.name;
+				try {
+					if (IsKtx2(image.image))
+						decodedImages[index].set_value(DecodeKtx2(device, bytes));
+					else if (usage.compressedFormat != vk::Format::eUndefined)
+						decodedImages[index].set_value(CompressImageFile(bytes, usage.compressedFormat, usage.sourceChannels, name));
+					else {
+						HostPixelData d = DecodeImage(bytes, usage.srgb);
+						if (d.bytes.empty()) throw std::runtime_error("Could not decode " + name);
+						// streamed textures need every level in host memory
+						if (textureStreamer) GenerateMipLevels(d);
+						decodedImages[index].set_value(std::move(d));
+					}
+				} catch (...) {
+					decodedImages[index].set_exception(std::current_exception());
+				}
+			}
+		});
+	}
+
 	std::cout << "Loading buffers..." << std::endl;
-	for (size_t i = 0; i < buffers.size(); i++) {
-		buffersCpu[i] = Buffer::Create(
+	for (uint32_t pool = 0; pool < ePoolCount; pool++) {
+		const std::string poolName = pool == eIndexPool ? "indices" : "vertices";
+		poolsCpu[pool] = Buffer::Create(
 			context.GetDevice(),
-			model.buffers[i].data.size(),
+			std::max<size_t>(poolSizes[pool], 16),
 			vk::BufferUsageFlagBits::eTransferSrc,
 			vk::MemoryPropertyFlagBits::eHostVisible|vk::MemoryPropertyFlagBits::eHostCoherent,
-			VMA_ALLOCATION_CREATE_STRATEGY_MIN_MEMORY_BIT|VMA_ALLOCATION_CREATE_MAPPED_BIT|VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT);
-		context.GetDevice().SetDebugName(**buffersCpu[i].mBuffer, filename.stem().string() + "/hostbuffer" + std::to_string(i));
+			VMA_ALLOCATION_CREATE_STRATEGY_MIN_MEMORY_BIT|VMA_ALLOCATION_CREATE_MAPPED_BIT|VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT,
+			MemoryCategory::eStaging);
+		context.GetDevice().SetDebugName(**poolsCpu[pool].mBuffer, filename.stem().string() + "/host" + poolName);
 
-		buffers[i] = Buffer::Create(
+		pools[pool] = Buffer::Create(
 			context.GetDevice(),
-			model.buffers[i].data.size(),
-			bufferUsage,
+			std::max<size_t>(poolSizes[pool], 16),
+			bufferUsage | (pool == eIndexPool ? vk::BufferUsageFlagBits::eIndexBuffer : vk::BufferUsageFlagBits::eVertexBuffer),
 			vk::MemoryPropertyFlagBits::eDeviceLocal,
-			VMA_ALLOCATION_CREATE_STRATEGY_MIN_MEMORY_BIT);
-		context.GetDevice().SetDebugName(**buffers[i].mBuffer, filename.stem().string() + "/buffer" + std::to_string(i));
-
-		std::memcpy(buffersCpu[i].data(), model.buffers[i].data.data(), model.buffers[i].data.size());
-		context.Copy(buffersCpu[i], buffers[i]);
-	};
+			VMA_ALLOCATION_CREATE_STRATEGY_MIN_MEMORY_BIT,
+			MemoryCategory::eMesh);
+		context.GetDevice().SetDebugName(**pools[pool].mBuffer, filename.stem().string() + "/" + poolName);
+
+		for (size_t v = 0; v < model.bufferViews.size(); v++) {
+			if (viewOffsets[pool][v] == ~size_t(0)) continue;
+			const tinygltf::BufferView& view = model.bufferViews[v];
+			std::memcpy(poolsCpu[pool].data() + viewOffsets[pool][v], model.buffers[view.buffer].data.data() + view.byteOffset, view.byteLength);
+		}
+		context.Copy(poolsCpu[pool], pools[pool]);
+	}
+	{
+		size_t bufferBytes = 0;
+		for (const tinygltf::Buffer& b : model.buffers) bufferBytes += b.data.size();
+		std::cout << "Packed " << poolSizes[eIndexPool] / double(1024*1024) << " MiB of indices and " << poolSizes[eVertexPool] / double(1024*1024) << " MiB of vertices, from "
+			<< bufferBytes / double(1024*1024) << " MiB of buffers" << std::endl;
+	}
 
-	auto GetImage = [&](const uint32_t textureIndex, const bool srgb) -> ImageView {
-		if (textureIndex >= model.textures.size()) return {};
-		const uint32_t index = model.textures[textureIndex].source;
-		if (index >= images.size()) return {};
-		if (images[index]) return images[index];
-
-		const tinygltf::Image& image = model.images[index];
-
-		ImageInfo md = {};
-		md.extent = uint3(image.width, image.height, 1);
-		md.mipLevels = GetMaxMipLevels(md.extent);
-		if (srgb) {
-			static const std::array<vk::Format,4> formatMap { vk::Format::eR8Srgb, vk::Format::eR8G8Srgb, vk::Format::eR8G8B8Srgb, vk::Format::eR8G8B8A8Srgb };
-			md.format = formatMap.at(image.component - 1);
-		} else {
-			static const std::unordered_map<int, std::array<vk::Format,4>> formatMap {
-				{ TINYGLTF_COMPONENT_TYPE_UNSIGNED_BYTE,  { vk::Format::eR8Unorm,   vk::Format::eR8G8Unorm,    vk::Format::eR8G8B8Unorm,     vk::Format::eR8G8B8A8Unorm } },
-				{ TINYGLTF_COMPONENT_TYPE_BYTE,           { vk::Format::eR8Snorm,   vk::Format::eR8G8Snorm,    vk::Format::eR8G8B8Snorm,     vk::Format::eR8G8B8A8Snorm } },
-				{ TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT, { vk::Format::eR16Unorm,  vk::Format::eR16G16Unorm,  vk::Format::eR16G16B16Unorm,  vk::Format::eR16G16B16A16Unorm } },
-				{ TINYGLTF_COMPONENT_TYPE_SHORT,          { vk::Format::eR16Snorm,  vk::Format::eR16G16Snorm,  vk::Format::eR16G16B16Snorm,  vk::Format::eR16G16B16A16Snorm } },
-				{ TINYGLTF_COMPONENT_TYPE_UNSIGNED_INT,   { vk::Format::eR32Uint,   vk::Format::eR32G32Uint,   vk::Format::eR32G32B32Uint,   vk::Format::eR32G32B32A32Uint } },
-				{ TINYGLTF_COMPONENT_TYPE_INT,            { vk::Format::eR32Sint,   vk::Format::eR32G32Sint,   vk::Format::eR32G32B32Sint,   vk::Format::eR32G32B32A32Sint } },
-				{ TINYGLTF_COMPONENT_TYPE_FLOAT,          { vk::Format::eR32Sfloat, vk::Format::eR32G32Sfloat, vk::Format::eR32G32B32Sfloat, vk::Format::eR32G32B32A32Sfloat } },
-				{ TINYGLTF_COMPONENT_TYPE_DOUBLE,         { vk::Format::eR64Sfloat, vk::Format::eR64G64Sfloat, vk::Format::eR64G64B64Sfloat, vk::Format::eR64G64B64A64Sfloat } }
-			};
-			md.format = formatMap.at(image.pixel_type).at(image.component - 1);
+	// uploads decoded images on this thread, in the order materials use them
+	std::vector<bool> imageUploaded(model.images.size(), false);
+	auto GetImage = [&](const uint32_t textureIndex) -> ImageView {
+		const uint32_t index = GetImageIndex(textureIndex);
+		if (index >= images.size() || imageUploaded[index]) return index < images.size() ? images[index] : ImageView{};
+		imageUploaded[index] = true;
+
+		try {
+			HostPixelData d = decodedImages[index].get_future().get();
+			const std::string name = filename.stem().string() + "/" + model.images[index].name;
+			if (textureStreamer && TextureStreamer::IsStreamable(d))
+				images[index] = textureStreamer->Add(context, std::move(d), name);
+			else {
+				d.pixels.data = context.UploadData(d.bytes);
+				images[index] = UploadImage(context, d.pixels);
+				if (images[index]) device.SetDebugName(**images[index].mImage, name);
+			}
+		} catch (const std::exception& e) {
+			std::cerr << filename.string() << ": image " << index << ": " << e.what() << std::endl;
 		}
-		md.queueFamilies = { context.QueueFamily() };
-
-		ImageView img = ImageView::Create(Image::Create(device, md), vk::ImageSubresourceRange{
-			.aspectMask = vk::ImageAspectFlagBits::eColor,
-			.baseMipLevel = 0,
-			.levelCount = 1,
-			.baseArrayLayer = 0,
-			.layerCount = 1 });
-		device.SetDebugName(**img.mImage, filename.stem().string() + "/" + image.name);
-
-		context.Copy(context.UploadData(image.image), img);
-		context.GenerateMipMaps(img.mImage);
-
-		img = ImageView::Create(img.mImage, vk::ImageSubresourceRange{
-			.aspectMask = vk::ImageAspectFlagBits::eColor,
-			.baseMipLevel = 0,
-			.levelCount = md.mipLevels,
-			.baseArrayLayer = 0,
-			.layerCount = 1 });
-
-		images[index] = img;
-		return img;
+		return images[index];
 	};
 
 	std::cout << "Loading materials..." << std::endl;
 	std::ranges::transform(model.materials, materials.begin(), [&](const tinygltf::Material& material) {
 		Material<ImageView> m;
-		m.emissionImage     = GetImage(material.emissiveTexture.index, true);
-		m.baseColorImage    = GetImage(material.pbrMetallicRoughness.baseColorTexture.index, true);
-		m.metallicRoughness = GetImage(material.pbrMetallicRoughness.metallicRoughnessTexture.index, false);
-		m.bumpMap           = GetImage(material.normalTexture.index, false);
+		m.emissionImage     = GetImage(material.emissiveTexture.index);
+		m.baseColorImage    = GetImage(material.pbrMetallicRoughness.baseColorTexture.index);
+		m.metallicRoughness = GetImage(material.pbrMetallicRoughness.metallicRoughnessTexture.index);
+		m.bumpMap           = GetImage(material.normalTexture.index);
 		m.SetBaseColor((float3)double3(material.pbrMetallicRoughness.baseColorFactor[0], material.pbrMetallicRoughness.baseColorFactor[1], material.pbrMetallicRoughness.baseColorFactor[2]));
 		m.SetAlphaCutoff((float)material.alphaCutoff);
 		m.SetRoughness((float)material.pbrMetallicRoughness.roughnessFactor);
@@ -149,6 +280,8 @@ ref<SceneNode> LoadGLTF(CommandContext& context, const std::filesystem::path& fi
 
 		return make_ref<Material<ImageView>>(m);
 	});
+	if (!decodeOrder.empty())
+		std::cout << "Decoded " << decodeOrder.size() << " images on " << workers.size() << " threads in " << std::chrono::duration<float>(std::chrono::steady_clock::now() - decodeStart).count() << "s" << std::endl;
 
 	std::cout << "Loading meshes...";
 	for (uint32_t i = 0; i < model.meshes.size(); i++) {
@@ -157,12 +290,12 @@ ref<SceneNode> LoadGLTF(CommandContext& context, const std::filesystem::path& fi
 		for (uint32_t j = 0; j < model.meshes[i].primitives.size(); j++) {
 			const tinygltf::Primitive& prim = model.meshes[i].primitives[j];
 			const auto& indicesAccessor = model.accessors[prim.indices];
-			const auto& indexBufferView = model.bufferViews[indicesAccessor.bufferView];
 			const size_t indexStride = tinygltf::GetComponentSizeInBytes(indicesAccessor.componentType);
 
 			Mesh mesh = {};
-			mesh.indexBufferCpu = buffersCpu[indexBufferView.buffer].slice(indexBufferView.byteOffset + indicesAccessor.byteOffset, indicesAccessor.count * indexStride);
-			mesh.indexBuffer    = buffers   [indexBufferView.buffer].slice(indexBufferView.byteOffset + indicesAccessor.byteOffset, indicesAccessor.count * indexStride);
+			const size_t indexOffset = viewOffsets[eIndexPool][indicesAccessor.bufferView] + indicesAccessor.byteOffset;
+			mesh.indexBufferCpu = poolsCpu[eIndexPool].slice(indexOffset, indicesAccessor.count * indexStride);
+			mesh.indexBuffer    = pools   [eIndexPool].slice(indexOffset, indicesAccessor.count * indexStride);
 			mesh.indexSize = indexStride;
 			switch (prim.mode) {
 				case TINYGLTF_MODE_POINTS: 			mesh.topology = vk::PrimitiveTopology::ePointList; break;
@@ -272,7 +405,7 @@ ref<SceneNode> LoadGLTF(CommandContext& context, const std::filesystem::path& fi
 					const tinygltf::BufferView& b = model.bufferViews[accessor.bufferView];
 					const uint32_t stride = accessor.ByteStride(b);
 					attribs[typeIndex] = {
-						(i == 0 ? buffers[b.buffer] : buffersCpu[b.buffer]).slice(b.byteOffset + accessor.byteOffset, stride*accessor.count),
+						(i == 0 ? pools[eVertexPool] : poolsCpu[eVertexPool]).slice(viewOffsets[eVertexPool][accessor.bufferView] + accessor.byteOffset, stride*accessor.count),
 						MeshVertexAttributeLayout{
 							.stride = stride,
 							.format = attributeFormat,
@@ -286,6 +419,100 @@ ref<SceneNode> LoadGLTF(CommandContext& context, const std::filesystem::path& fi
 	}
 	std::cout << std::endl;
 
+	// meshlets of every triangle list, built in parallel from the host copies of the pools, and packed into one buffer.
+	// like the images, meshes are built by a bounded set of workers, largest first
+	{
+		const auto meshletStart = std::chrono::steady_clock::now();
+		std::vector<std::pair<ref<Mesh>, std::promise<MeshletData>>> meshletData;
+		for (const auto& primitives : meshes) {
+			for (const ref<Mesh>& mesh : primitives) {
+				if (mesh->topology != vk::PrimitiveTopology::eTriangleList) continue;
+				const auto& [positionsCpu, positionsLayout] = mesh->vertexAttributesCpu.at(MeshVertexAttributeType::ePosition)[0];
+				if (positionsLayout.format != vk::Format::eR32G32B32Sfloat) continue;
+				meshletData.emplace_back(mesh, std::promise<MeshletData>{});
+			}
+		}
+		std::vector<uint32_t> buildOrder(meshletData.size());
+		std::iota(buildOrder.begin(), buildOrder.end(), 0u);
+		std::ranges::sort(buildOrder, std::greater{}, [&](const uint32_t i) { return meshletData[i].first->indexBufferCpu.size_bytes() / meshletData[i].first->indexSize; });
+
+		std::atomic_uint32_t nextMesh = 0;
+		std::vector<std::jthread> meshletWorkers(std::min<size_t>(std::max(std::thread::hardware_concurrency(), 1u), buildOrder.size()));
+		for (std::jthread& worker : meshletWorkers) {
+			worker = std::jthread([&]() {
+				for (uint32_t i = nextMesh++; i < buildOrder.size(); i = nextMesh++) {
+					auto& [meshRef, promise] = meshletData[buildOrder[i]];
+					const Mesh& mesh = *meshRef;
+					const auto& [positionsCpu, positionsLayout] = mesh.vertexAttributesCpu.at(MeshVertexAttributeType::ePosition)[0];
+					try {
+						std::vector<float3> positions(positionsCpu.size_bytes() / positionsLayout.stride);
+						for (size_t v = 0; v < positions.size(); v++)
+							std::memcpy(&positions[v], positionsCpu.data() + v * positionsLayout.stride, sizeof(float3));
+						std::vector<uint32_t> indices(mesh.indexBufferCpu.size_bytes() / mesh.indexSize);
+						for (size_t v = 0; v < indices.size(); v++)
+							indices[v] = mesh.indexSize == sizeof(uint32_t) ? mesh.indexBufferCpu.cast<uint32_t>()[v] : mesh.indexBufferCpu.cast<uint16_t>()[v];
+						promise.set_value(BuildMeshlets(indices, positions));
+					} catch (...) {
+						promise.set_exception(std::current_exception());
+					}
+				}
+			});
+		}
+
+		std::vector<MeshletData> data;
+		std::vector<size_t> offsets;
+		size_t meshletBytes = 0, meshletCount = 0;
+		for (auto& [mesh, promise] : meshletData) {
+			MeshletData& d = data.emplace_back(promise.get_future().get());
+			offsets.emplace_back(meshletBytes);
+			// offsets in the buffer, for the mesh shaders
+			const size_t vertexOffset   = meshletBytes + d.meshlets.size() * sizeof(Meshlet);
+			const size_t triangleOffset = vertexOffset + d.vertices.size() * sizeof(uint32_t);
+			for (Meshlet& m : d.meshlets) {
+				m.vertexOffset   = uint32_t(vertexOffset   + m.vertexOffset   * sizeof(uint32_t));
+				m.triangleOffset = uint32_t(triangleOffset + m.triangleOffset * sizeof(uint32_t));
+			}
+			meshletBytes = (triangleOffset + d.triangles.size() * sizeof(uint32_t) + 15) / 16 * 16;
+			meshletCount += d.meshlets.size();
+		}
+
+		if (meshletBytes > 0 && meshletBytes <= std::numeric_limits<uint32_t>::max()) {
+			BufferView meshletsCpu = Buffer::Create(
+				context.GetDevice(),
+				meshletBytes,
+				vk::BufferUsageFlagBits::eTransferSrc,
+				vk::MemoryPropertyFlagBits::eHostVisible|vk::MemoryPropertyFlagBits::eHostCoherent,
+				VMA_ALLOCATION_CREATE_STRATEGY_MIN_MEMORY_BIT|VMA_ALLOCATION_CREATE_MAPPED_BIT|VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT,
+				MemoryCategory::eStaging);
+			BufferView meshlets = Buffer::Create(
+				context.GetDevice(),
+				meshletBytes,
+				vk::BufferUsageFlagBits::eStorageBuffer|vk::BufferUsageFlagBits::eTransferDst,
+				vk::MemoryPropertyFlagBits::eDeviceLocal,
+				VMA_ALLOCATION_CREATE_STRATEGY_MIN_MEMORY_BIT,
+				MemoryCategory::eMesh);
+			context.GetDevice().SetDebugName(**meshlets.mBuffer, filename.stem().string() + "/meshlets");
+
+			for (size_t i = 0; i < data.size(); i++) {
+				const MeshletData& d = data[i];
+				std::byte* dst = meshletsCpu.data() + offsets[i];
+				std::memcpy(dst, d.meshlets.data(), d.meshlets.size() * sizeof(Meshlet));
+				dst += d.meshlets.size() * sizeof(Meshlet);
+				std::memcpy(dst, d.vertices.data(), d.vertices.size() * sizeof(uint32_t));
+				dst += d.vertices.size() * sizeof(uint32_t);
+				std::memcpy(dst, d.triangles.data(), d.triangles.size() * sizeof(uint32_t));
+
+				Mesh& mesh = *meshletData[i].first;
+				mesh.meshlets     = meshlets.slice(offsets[i], d.meshlets.size() * sizeof(Meshlet));
+				mesh.meshletCount = (uint32_t)d.meshlets.size();
+			}
+			context.Copy(meshletsCpu, meshlets);
+
+			std::cout << "Built " << meshletCount << " meshlets (" << meshletBytes / double(1024*1024) << " MiB) in "
+				<< std::chrono::duration<float>(std::chrono::steady_clock::now() - meshletStart).count() << "s" << std::endl;
+		}
+	}
+
 	ref<Mesh> sphereMesh = {};
 
 	std::cout << "Loading scene nodes...";
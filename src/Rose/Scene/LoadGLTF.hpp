@@ -5,6 +5,10 @@
 
 namespace RoseEngine {
 
-ref<SceneNode> LoadGLTF(CommandContext& context, const std::filesystem::path& filename);
+class TextureStreamer;
+
+// compressTextures block compresses textures that aren't shipped compressed on the CPU (see CompressImageFile).
+// Textures are added to textureStreamer if it isn't null, so that only their smallest levels are uploaded up front.
+ref<SceneNode> LoadGLTF(CommandContext& context, const std::filesystem::path& filename, const bool compressTextures = false, TextureStreamer* textureStreamer = nullptr);
 
 }
\ No newline at end of file
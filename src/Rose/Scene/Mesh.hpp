@@ -2,6 +2,7 @@
 
 #include <Rose/Core/CommandContext.hpp>
 #include <Rose/Core/Hash.hpp>
+#include "Meshlets.h"
 
 namespace RoseEngine {
 
@@ -71,6 +72,8 @@ struct Mesh {
 	uint32_t              indexSize = sizeof(uint32_t);
 	vk::PrimitiveTopology topology = {};
 	vk::AabbPositionsKHR  aabb = {};
+	BufferView            meshlets = {}; // meshletCount Meshlets, followed by the vertices and triangles they reference
+	uint32_t              meshletCount = 0;
 	ref<AccelerationStructure> blas = {};
 	uint64_t              blasUpdateTime = 0;
 	uint64_t              lastUpdateTime = 0;
@@ -0,0 +1,106 @@
+#include "Meshlets.hpp"
+
+namespace RoseEngine {
+
+// Bounding sphere of the meshlet's vertices, and the cone containing its triangle normals
+static void ComputeBounds(Meshlet& meshlet, const MeshletData& data, const std::span<const uint32_t> indices, const std::span<const float3> positions) {
+	const uint32_t* vertices = data.vertices.data() + meshlet.vertexOffset;
+
+	float3 minPos = positions[vertices[0]];
+	float3 maxPos = minPos;
+	for (uint32_t i = 1; i < meshlet.GetVertexCount(); i++) {
+		minPos = min(minPos, positions[vertices[i]]);
+		maxPos = max(maxPos, positions[vertices[i]]);
+	}
+	meshlet.center = (minPos + maxPos) / 2.f;
+	meshlet.radius = 0;
+	for (uint32_t i = 0; i < meshlet.GetVertexCount(); i++)
+		meshlet.radius = std::max(meshlet.radius, length(positions[vertices[i]] - meshlet.center));
+
+	std::array<float3, MESHLET_MAX_TRIANGLES> normals;
+	uint32_t normalCount = 0;
+	float3 axis = float3(0);
+	for (uint32_t t = 0; t < meshlet.GetTriangleCount(); t++) {
+		const uint32_t* tri = indices.data() + 3 * size_t(meshlet.firstTriangle + t);
+		const float3 p0 = positions[tri[0]];
+		const float3 n = cross(positions[tri[1]] - p0, positions[tri[2]] - p0);
+		const float l = length(n);
+		if (!(l > 0)) continue; // degenerate triangles are never drawn, so they don't widen the cone
+		normals[normalCount++] = n / l;
+		axis += n / l;
+	}
+
+	// a cone wider than ~85 degrees culls too little to be worth testing, so it never culls
+	meshlet.coneAxis = float3(0, 0, 1);
+	meshlet.coneCutoff = 1;
+	const float axisLength = length(axis);
+	if (normalCount == 0 || !(axisLength > 0)) return;
+	axis /= axisLength;
+	float minDot = 1;
+	for (uint32_t i = 0; i < normalCount; i++)
+		minDot = std::min(minDot, dot(normals[i], axis));
+	if (minDot <= 0.1f) return;
+	meshlet.coneAxis = axis;
+	meshlet.coneCutoff = std::sqrt(1 - minDot * minDot);
+}
+
+MeshletData BuildMeshlets(const std::span<const uint32_t> indices, const std::span<const float3> positions) {
+	MeshletData data;
+	const uint32_t triangleCount = uint32_t(indices.size() / 3);
+	if (triangleCount == 0) return data;
+
+	// meshlet vertex of each mesh vertex, if owner is the current meshlet
+	std::vector<uint32_t> owner(positions.size(), ~0u);
+	std::vector<uint8_t>  local(positions.size(), 0);
+
+	Meshlet meshlet = {};
+	uint32_t vertexCount = 0, meshletTriangles = 0;
+	auto finish = [&]() {
+		meshlet.SetVertexCount(vertexCount);
+		meshlet.SetTriangleCount(meshletTriangles);
+		ComputeBounds(meshlet, data, indices, positions);
+		data.meshlets.emplace_back(meshlet);
+	};
+
+	for (uint32_t t = 0; t < triangleCount; t++) {
+		const uint32_t* tri = indices.data() + 3 * size_t(t);
+		const uint32_t current = (uint32_t)data.meshlets.size();
+
+		uint32_t newVertices = 0;
+		for (uint32_t k = 0; k < 3; k++)
+			if (owner[tri[k]] != current && (k == 0 || tri[k] != tri[0]) && (k < 2 || tri[k] != tri[1]))
+				newVertices++;
+
+		if (meshletTriangles > 0 && (vertexCount + newVertices > MESHLET_MAX_VERTICES || meshletTriangles == MESHLET_MAX_TRIANGLES)) {
+			finish();
+			meshletTriangles = 0;
+			vertexCount = 0;
+			t--; // retry the triangle in the new meshlet, where all its vertices are new
+			continue;
+		}
+
+		if (meshletTriangles == 0) {
+			meshlet = {};
+			meshlet.vertexOffset   = (uint32_t)data.vertices.size();
+			meshlet.triangleOffset = (uint32_t)data.triangles.size();
+			meshlet.firstTriangle  = t;
+		}
+
+		uint32_t packedTriangle = 0;
+		for (uint32_t k = 0; k < 3; k++) {
+			if (owner[tri[k]] != current) {
+				owner[tri[k]] = current;
+				local[tri[k]] = (uint8_t)vertexCount++;
+				data.vertices.emplace_back(tri[k]);
+			}
+			packedTriangle |= uint32_t(local[tri[k]]) << (8 * k);
+		}
+		data.triangles.emplace_back(packedTriangle);
+		meshletTriangles++;
+	}
+	finish();
+
+	return data;
+}
+
+}
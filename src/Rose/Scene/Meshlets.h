@@ -0,0 +1,30 @@
+#pragma once
+
+#include <Rose/Core/RoseEngine.h>
+
+#define MESHLET_MAX_VERTICES  64
+#define MESHLET_MAX_TRIANGLES 124
+#define MESHLET_TASK_SIZE     32 // meshlets culled by each task shader workgroup
+
+namespace RoseEngine {
+
+// A cluster of consecutive triangles of a mesh, with bounds for culling it (see BuildMeshlets)
+struct Meshlet {
+	float3 center;
+	float  radius;
+	// the meshlet faces away from a camera at c if dot(center - c, coneAxis) >= coneCutoff * length(center - c) + radius
+	float3 coneAxis;
+	float  coneCutoff;
+	uint   vertexOffset;   // byte offset in the meshlet buffer of the mesh vertex index of each meshlet vertex (uint)
+	uint   triangleOffset; // byte offset in the meshlet buffer of the meshlet vertices of each triangle (8 bits each, in a uint)
+	uint   firstTriangle;  // the meshlet's first triangle in the mesh's index buffer
+	uint   packed;
+
+	inline uint GetVertexCount() { return BF_GET(packed, 0, 8); }
+	SLANG_MUTATING inline void SetVertexCount(uint i) { BF_SET(packed, i, 0, 8); }
+
+	inline uint GetTriangleCount() { return BF_GET(packed, 8, 8); }
+	SLANG_MUTATING inline void SetTriangleCount(uint i) { BF_SET(packed, i, 8, 8); }
+};
+
+}
@@ -0,0 +1,21 @@
+#pragma once
+
+#include <span>
+#include <vector>
+
+#include "Meshlets.h"
+
+namespace RoseEngine {
+
+struct MeshletData {
+	std::vector<Meshlet>  meshlets;  // vertexOffset and triangleOffset index vertices and triangles until they are packed into a buffer
+	std::vector<uint32_t> vertices;  // mesh vertex index of each meshlet vertex
+	std::vector<uint32_t> triangles; // meshlet vertex indices of each triangle, 8 bits each
+};
+
+// Splits a triangle list into meshlets of consecutive triangles, with at most MESHLET_MAX_VERTICES vertices and
+// MESHLET_MAX_TRIANGLES triangles each. Keeping the mesh's triangle order lets meshlet triangles write the same primitive
+// index to the visibility buffer as the vertex path.
+MeshletData BuildMeshlets(const std::span<const uint32_t> indices, const std::span<const float3> positions);
+
+}
@@ -11,40 +11,80 @@ void Scene::LoadDialog(CommandContext& context) {
 	auto f = pfd::open_file("Open scene", "", {
 		//"All files (.*)", "*.*",
 		"glTF Scenes (.gltf .glb)", "*.gltf *.glb",
-		"Environment maps (.exr .hdr .dds .png .jpg)", "*.exr *.hdr *.dds *.png *.jpg",
+		"Environment maps (.exr .hdr .dds .ktx2 .png .jpg)", "*.exr *.hdr *.dds *.ktx2 *.png *.jpg",
 	});
 	for (const std::string& filepath : f.result()) {
 		std::filesystem::path p = filepath;
 		if (p.extension() == ".gltf" || p.extension() == ".glb") {
-			const ref<SceneNode> s = LoadGLTF(context, filepath);
+			if (streamTextures && !textureStreamer) textureStreamer = make_ref<TextureStreamer>();
+			const ref<SceneNode> s = LoadGLTF(context, filepath, compressTextures, streamTextures ? textureStreamer.get() : nullptr);
 			if (!s) continue;
+			if (sceneRoot) context.GetDevice().DeferDestroy(std::move(sceneRoot));
 			sceneRoot = s;
 			SetDirty();
 		} else {
-			const PixelData d = LoadImageFile(context, p);
+			const PixelData d = LoadImageFile(context, p, true, 0, compressTextures);
 			if (!d.data) continue;
-			const uint32_t maxMips = GetMaxMipLevels(d.extent);
-			const ImageView img = ImageView::Create(
-				Image::Create(context.GetDevice(), ImageInfo{
-					.format = d.format,
-					.extent = d.extent,
-					.mipLevels = maxMips,
-					.queueFamilies = { context.QueueFamily() } }),
-				vk::ImageSubresourceRange{
-					.aspectMask = vk::ImageAspectFlagBits::eColor,
-					.baseMipLevel = 0,
-					.levelCount = maxMips,
-					.baseArrayLayer = 0,
-					.layerCount = 1 });
+			if (d.cubemap || d.arrayLayers > 1 || d.extent.z > 1) {
+				std::cerr << "Environment maps must be 2D equirectangular images: " << p << std::endl;
+				continue;
+			}
+			const ImageView img = UploadImage(context, d);
 			if (!img) continue;
-			context.Copy(d.data, img);
-			context.GenerateMipMaps(img.mImage);
+			if (backgroundImage) context.GetDevice().DeferDestroy(std::move(backgroundImage));
+			if (backgroundSampling) context.GetDevice().DeferDestroy(std::move(backgroundSampling.entries));
 			backgroundImage = img;
+			backgroundSampling = environmentSampler.Build(context, img);
+			backgroundFlipY = d.flipY;
 			backgroundColor = float3(1);
 		}
 	}
 }
 
+// Creates a device buffer holding data. Tables are kept until the next rebuild, so they can't come from UploadData's transient buffers.
+template<typename T>
+static BufferRange<T> CreateTable(CommandContext& context, const std::vector<T>& data, const vk::BufferUsageFlags usage) {
+	const BufferRange<T> table = Buffer::Create(context.GetDevice(), sizeof(T) * std::max<size_t>(data.size(), 1), usage | vk::BufferUsageFlagBits::eTransferDst).cast<T>();
+	if (!data.empty())
+		context.Copy(context.UploadData(data).cast<T>().slice(0, data.size()), table);
+	return table;
+}
+
+// Copies data[i] for each i in indices (sorted and unique) into table, with one copy region per run of consecutive indices
+template<typename T>
+static void ScatterUpload(CommandContext& context, const std::vector<T>& data, const std::vector<uint32_t>& indices, const BufferRange<T>& table) {
+	if (indices.empty()) return;
+
+	std::vector<T> packed;
+	std::vector<vk::BufferCopy> regions;
+	packed.reserve(indices.size());
+	for (size_t j = 0; j < indices.size(); j++) {
+		if (j > 0 && indices[j] == indices[j - 1] + 1)
+			regions.back().size += sizeof(T);
+		else
+			regions.emplace_back(vk::BufferCopy{
+				.srcOffset = sizeof(T) * j,
+				.dstOffset = table.mOffset + sizeof(T) * indices[j],
+				.size      = sizeof(T) });
+		packed.emplace_back(data[indices[j]]);
+	}
+
+	const BufferView staging = context.UploadData(packed);
+	for (vk::BufferCopy& r : regions)
+		r.srcOffset += staging.mOffset;
+
+	context.AddBarrier(staging, Buffer::ResourceState{
+		.stage  = vk::PipelineStageFlagBits2::eTransfer,
+		.access = vk::AccessFlagBits2::eTransferRead,
+		.queueFamily = context.QueueFamily() });
+	context.AddBarrier(table, Buffer::ResourceState{
+		.stage  = vk::PipelineStageFlagBits2::eTransfer,
+		.access = vk::AccessFlagBits2::eTransferWrite,
+		.queueFamily = context.QueueFamily() });
+	context.ExecuteBarriers();
+	context->copyBuffer(**staging.mBuffer, **table.mBuffer, regions);
+}
+
 void Scene::PrepareRenderData(CommandContext& context, const Scene::RenderableSet& renderables) {
 	// create instances and draw calls from renderables
 	const bool useAccelerationStructure = context.GetDevice().EnabledExtensions().contains(VK_KHR_ACCELERATION_STRUCTURE_EXTENSION_NAME);
@@ -52,10 +92,12 @@ void Scene::PrepareRenderData(CommandContext& context, const Scene::RenderableSe
 	for (auto& d : renderData.drawLists) d.clear();
 	renderData.drawLists.resize(3);
 	renderData.instanceNodes.clear();
+	renderData.revision++;
 
 	instances.clear();
 	instanceHeaders.clear();
 	transforms.clear();
+	inverseTransforms.clear();
 
 	materials.clear();
 	materialMap.clear();
@@ -65,9 +107,9 @@ void Scene::PrepareRenderData(CommandContext& context, const Scene::RenderableSe
 	meshMap.clear();
 	meshBufferMap.clear();
 
-	for (const auto&[pipeline, meshes__] : renderables) {
-		const auto& [meshLayout, meshes_] = meshes__;
-		for (const auto&[mesh, materials_] : meshes_) {
+	for (const auto&[pipeline, meshes_] : renderables) {
+		for (const auto&[mesh, materials__] : meshes_) {
+			const auto& [meshLayout, materials_] = materials__;
 			size_t meshId = meshes.size();
 			if (auto it = meshMap.find(mesh); it != meshMap.end())
 				meshId = it->second;
@@ -93,7 +135,8 @@ void Scene::PrepareRenderData(CommandContext& context, const Scene::RenderableSe
 				}
 
 				size_t start = instanceHeaders.size();
-				for (const auto&[n,t] : nt_) {
+				for (const auto&[n, nodeIndex] : nt_) {
+					const Transform& t = transformHierarchy.World(nodeIndex);
 					size_t instanceId = instanceHeaders.size();
 					instanceHeaders.emplace_back(InstanceHeader{
 						.transformIndex = (uint32_t)transforms.size(),
@@ -101,7 +144,9 @@ void Scene::PrepareRenderData(CommandContext& context, const Scene::RenderableSe
 						.meshIndex = (uint32_t)meshId,
 						.triangleCount = uint32_t(mesh->indexBuffer.size_bytes()/mesh->indexSize)/3 });
 					transforms.emplace_back(t);
+					inverseTransforms.emplace_back(transformHierarchy.InverseWorld(nodeIndex));
 					renderData.instanceNodes.emplace_back(n->shared_from_this());
+					nodeRecords[n].instance = (uint32_t)instanceId;
 
 					if (useAccelerationStructure) {
 						vk::GeometryInstanceFlagsKHR flags = material->HasFlag(MaterialFlags::eDoubleSided) ? vk::GeometryInstanceFlagBitsKHR::eTriangleFacingCullDisable : vk::GeometryInstanceFlagBitsKHR{};
@@ -127,7 +172,27 @@ void Scene::PrepareRenderData(CommandContext& context, const Scene::RenderableSe
 		}
 	}
 
-	if (useAccelerationStructure) renderData.accelerationStructure = AccelerationStructure::Create(context, instances);
+	// neighbouring batches with the same pipeline, index buffer and topology are drawn with one indirect draw (see InstanceCuller)
+	for (auto& drawList : renderData.drawLists)
+		std::ranges::stable_sort(drawList, {}, [](const SceneRenderData::DrawBatch& b) {
+			return std::tuple{ b.pipeline, b.mesh->indexBuffer.mBuffer.get(), b.mesh->indexSize, b.meshLayout.topology }; });
+
+	Device& device = context.GetDevice();
+	if (instanceBuffer)         device.DeferDestroy(std::move(instanceBuffer));
+	if (transformBuffer)        device.DeferDestroy(std::move(transformBuffer));
+	if (inverseTransformBuffer) device.DeferDestroy(std::move(inverseTransformBuffer));
+	if (materialBuffer)         device.DeferDestroy(std::move(materialBuffer));
+	if (tlasInstanceBuffer)     device.DeferDestroy(std::move(tlasInstanceBuffer));
+	instanceBuffer         = CreateTable(context, instanceHeaders,   vk::BufferUsageFlagBits::eStorageBuffer|vk::BufferUsageFlagBits::eVertexBuffer);
+	transformBuffer        = CreateTable(context, transforms,        vk::BufferUsageFlagBits::eStorageBuffer);
+	inverseTransformBuffer = CreateTable(context, inverseTransforms, vk::BufferUsageFlagBits::eStorageBuffer);
+	materialBuffer         = CreateTable(context, materials,         vk::BufferUsageFlagBits::eStorageBuffer);
+
+	if (useAccelerationStructure) {
+		if (renderData.accelerationStructure) device.DeferDestroy(std::move(renderData.accelerationStructure));
+		tlasInstanceBuffer = CreateTable(context, instances, vk::BufferUsageFlagBits::eAccelerationStructureBuildInputReadOnlyKHR|vk::BufferUsageFlagBits::eShaderDeviceAddress);
+		renderData.accelerationStructure = AccelerationStructure::Create(context, tlasInstanceBuffer.slice(0, instances.size()), true);
+	}
 
 	renderData.sceneParameters["backgroundColor"] = backgroundColor;
 	uint32_t backgroundImageIndex = -1;
@@ -136,23 +201,133 @@ void Scene::PrepareRenderData(CommandContext& context, const Scene::RenderableSe
 		imageMap.emplace(backgroundImage, backgroundImageIndex);
 	}
 	renderData.sceneParameters["backgroundImage"] = backgroundImageIndex;
+	renderData.sceneParameters["backgroundFlipY"] = (uint32_t)backgroundFlipY;
+	if (!backgroundSampling) {
+		// bound even without a background image, since shaders which import the scene use it
+		backgroundSampling.entries = Buffer::Create(context.GetDevice(), sizeof(EnvironmentAliasEntry), vk::BufferUsageFlagBits::eStorageBuffer).cast<EnvironmentAliasEntry>();
+		backgroundSampling.extent = uint2(0);
+	}
+	renderData.sceneParameters["backgroundSampling"]       = (BufferView)backgroundSampling.entries;
+	renderData.sceneParameters["backgroundSamplingExtent"] = backgroundSampling.extent;
 
 	renderData.sceneParameters["instanceCount"]   = (uint32_t)instanceHeaders.size();
 	renderData.sceneParameters["meshBufferCount"] = (uint32_t)meshBufferMap.size();
 	renderData.sceneParameters["materialCount"]   = (uint32_t)materials.size();
 	renderData.sceneParameters["imageCount"]      = (uint32_t)imageMap.size();
 
-	std::vector<Transform> invTransforms(transforms.size());
-	std::ranges::transform(transforms, invTransforms.begin(), [](const Transform& t) { return inverse(t); });
-
-	renderData.sceneParameters["instances"]         = (BufferView)context.UploadData(instanceHeaders, vk::BufferUsageFlagBits::eStorageBuffer|vk::BufferUsageFlagBits::eVertexBuffer);
-	renderData.sceneParameters["transforms"]        = (BufferView)context.UploadData(transforms,      vk::BufferUsageFlagBits::eStorageBuffer);
-	renderData.sceneParameters["inverseTransforms"] = (BufferView)context.UploadData(invTransforms,   vk::BufferUsageFlagBits::eStorageBuffer);
-	renderData.sceneParameters["materials"]         = (BufferView)context.UploadData(materials,       vk::BufferUsageFlagBits::eStorageBuffer);
+	renderData.sceneParameters["instances"]         = (BufferView)instanceBuffer;
+	renderData.sceneParameters["transforms"]        = (BufferView)transformBuffer;
+	renderData.sceneParameters["inverseTransforms"] = (BufferView)inverseTransformBuffer;
+	renderData.sceneParameters["materials"]         = (BufferView)materialBuffer;
 	renderData.sceneParameters["meshes"]            = (BufferView)context.UploadData(meshes,          vk::BufferUsageFlagBits::eStorageBuffer);
 	if (useAccelerationStructure) renderData.sceneParameters["accelerationStructure"] = renderData.accelerationStructure;
 	for (const auto& [buf, idx] : meshBufferMap) renderData.sceneParameters["meshBuffers"][idx] = BufferView{buf, 0, buf->Size()};
-	for (const auto& [img, idx] : imageMap)      renderData.sceneParameters["images"][idx] = ImageParameter{ .image = img, .imageLayout = vk::ImageLayout::eShaderReadOnlyOptimal };
+	for (const auto& [img, idx] : imageMap)      renderData.sceneParameters["images"][idx] = ImageParameter{ .image = textureStreamer ? textureStreamer->GetView(img) : img, .imageLayout = vk::ImageLayout::eShaderReadOnlyOptimal };
+
+	if (!textureFeedback) {
+		textureFeedback = Buffer::Create(context.GetDevice(), sizeof(uint32_t) * kMaxImages, vk::BufferUsageFlagBits::eStorageBuffer|vk::BufferUsageFlagBits::eTransferSrc|vk::BufferUsageFlagBits::eTransferDst).cast<uint32_t>();
+		context.Fill(textureFeedback, 0u);
+	}
+	renderData.sceneParameters["textureFeedback"] = (BufferView)textureFeedback;
+}
+
+void Scene::UpdateRenderData(CommandContext& context) {
+	// the same node may be instanced through several paths, which a node record can't represent
+	if (hasSharedNodes) { SetDirty(); return; }
+
+	const bool useAccelerationStructure = renderData.accelerationStructure != nullptr;
+
+	// update world transforms below each dirty node. changes which add, remove or reparent instances need a rebuild,
+	// so nothing is uploaded until every change was found to be incremental.
+
+	std::unordered_set<const SceneNode*> dirtyNodes;
+	for (const weak_ref<SceneNode>& w : dirtyTransforms)
+		if (const ref<SceneNode> n = w.lock())
+			dirtyNodes.emplace(n.get());
+
+	constexpr uint32_t kNoParent = TransformHierarchy::kNoParent;
+
+	std::vector<uint32_t> updatedInstances;
+	for (const SceneNode* root : dirtyNodes) {
+		const auto rootIt = nodeRecords.find(root);
+		if (rootIt == nodeRecords.end()) { SetDirty(); return; }
+		const uint32_t rootIndex = rootIt->second.index;
+
+		// subtrees of dirty ancestors are updated anyway
+		bool hasDirtyAncestor = false;
+		for (uint32_t p = transformHierarchy.Parent(rootIndex); p != kNoParent && !hasDirtyAncestor; p = transformHierarchy.Parent(p))
+			hasDirtyAncestor = dirtyNodes.contains(transformHierarchy.Node(p));
+		if (hasDirtyAncestor) continue;
+
+		// the scene root's own transform is ignored, as in TransformHierarchy::Update
+		Transform rootTransform = Transform::Identity();
+		if (const uint32_t parent = transformHierarchy.Parent(rootIndex); parent != kNoParent) {
+			rootTransform = transformHierarchy.World(parent);
+			if (root->transform.has_value()) rootTransform = rootTransform * root->transform.value();
+		}
+
+		std::stack<std::tuple<const SceneNode*, uint32_t, Transform>> todo;
+		todo.push({root, transformHierarchy.Parent(rootIndex), rootTransform});
+		while (!todo.empty()) {
+			auto [n, parent, t] = todo.top();
+			todo.pop();
+
+			const auto it = nodeRecords.find(n);
+			if (it == nodeRecords.end() || transformHierarchy.Parent(it->second.index) != parent) { SetDirty(); return; }
+			const NodeRecord& record = it->second;
+			if ((n->mesh && n->material) != (record.instance != ~0u)) { SetDirty(); return; }
+
+			transformHierarchy.SetWorld(record.index, t);
+			if (record.instance != ~0u) {
+				transforms[record.instance] = t;
+				inverseTransforms[record.instance] = transformHierarchy.InverseWorld(record.index);
+				if (useAccelerationStructure)
+					instances[record.instance].transform = std::bit_cast<vk::TransformMatrixKHR>((float3x4)transpose(t.transform));
+				updatedInstances.emplace_back(record.instance);
+			}
+
+			for (const ref<SceneNode>& c : *n)
+				todo.push({c.get(), record.index, c->transform.has_value() ? t * c->transform.value() : t});
+		}
+	}
+
+	// repack dirty materials. new images, or flags (which pick the draw list and BLAS opacity) need a rebuild
+
+	std::vector<uint32_t> updatedMaterials;
+	for (const Material<ImageView>* material : dirtyMaterials) {
+		const auto it = materialMap.find(material);
+		if (it == materialMap.end()) continue; // not used by any instance
+		const size_t imageCount = imageMap.size();
+		const Material<uint32_t> packed = PackMaterial(*material, imageMap);
+		if (imageMap.size() != imageCount || packed.GetFlags() != materials[it->second].GetFlags()) { SetDirty(); return; }
+		materials[it->second] = packed;
+		updatedMaterials.emplace_back((uint32_t)it->second);
+	}
+
+	std::ranges::sort(updatedInstances);
+	updatedInstances.erase(std::ranges::unique(updatedInstances).begin(), updatedInstances.end());
+	std::ranges::sort(updatedMaterials);
+
+	ScatterUpload(context, transforms,        updatedInstances, transformBuffer);
+	ScatterUpload(context, inverseTransforms, updatedInstances, inverseTransformBuffer);
+	ScatterUpload(context, materials,         updatedMaterials, materialBuffer);
+	if (useAccelerationStructure && !updatedInstances.empty()) {
+		ScatterUpload(context, instances, updatedInstances, tlasInstanceBuffer);
+		renderData.accelerationStructure->Update(context, tlasInstanceBuffer);
+	}
+
+	stats.updatedInstances = (uint32_t)updatedInstances.size();
+	stats.updatedMaterials = (uint32_t)updatedMaterials.size();
+
+	dirtyTransforms.clear();
+	dirtyMaterials.clear();
+}
+
+void Scene::UpdateTextureStreaming(CommandContext& context) {
+	if (!textureFeedback) return;
+	if (!textureStreamer->Update(context, textureFeedback, imageMap)) return;
+	for (const auto& [img, idx] : imageMap)
+		renderData.sceneParameters["images"][idx] = ImageParameter{ .image = textureStreamer->GetView(img), .imageLayout = vk::ImageLayout::eShaderReadOnlyOptimal };
 }
 
 }
\ No newline at end of file
@@ -1,9 +1,14 @@
 #pragma once
 
+#include <chrono>
 #include <stack>
+#include <unordered_set>
 
 #include <Rose/Core/CommandContext.hpp>
 #include "SceneNode.hpp"
+#include "TextureStreamer.hpp"
+#include "TransformHierarchy.hpp"
+#include "EnvironmentSampling.hpp"
 
 namespace RoseEngine {
 
@@ -22,13 +27,18 @@ struct SceneRenderData {
 
 	std::vector<weak_ref<SceneNode>>    instanceNodes = {};
 	ShaderParameter                     sceneParameters = {};
+	uint64_t                            revision = 0; // incremented when drawLists and instanceNodes are rebuilt
 };
 
 class Scene {
+public:
+	static constexpr uint32_t kMaxImages = 1024; // Scene::kMaxImages in Scene.slang
+
 private:
 	std::vector<vk::AccelerationStructureInstanceKHR> instances;
 	std::vector<InstanceHeader>     instanceHeaders;
 	std::vector<Transform>          transforms;
+	std::vector<Transform>          inverseTransforms;
 
 	std::vector<Material<uint32_t>> materials;
 	std::unordered_map<const Material<ImageView>*, size_t> materialMap;
@@ -38,56 +48,127 @@ private:
 	std::unordered_map<const Mesh*, size_t> meshMap;
 	std::unordered_map<ref<Buffer>, uint32_t> meshBufferMap;
 
+	// device copies of the tables above. rebuilds create new ones, incremental updates copy changed records into them
+	BufferRange<InstanceHeader>                      instanceBuffer = {};
+	BufferRange<Transform>                           transformBuffer = {};
+	BufferRange<Transform>                           inverseTransformBuffer = {};
+	BufferRange<Material<uint32_t>>                  materialBuffer = {};
+	BufferRange<vk::AccelerationStructureInstanceKHR> tlasInstanceBuffer = {};
+
+	// world transforms of every node, from the last rebuild
+	TransformHierarchy transformHierarchy = {};
+
+	// nodes visited by the last rebuild, so that transform changes can be applied without rebuilding
+	struct NodeRecord {
+		uint32_t index = 0;      // in transformHierarchy
+		uint32_t instance = ~0u; // if the node has a mesh and material
+	};
+	std::unordered_map<const SceneNode*, NodeRecord> nodeRecords;
+	bool hasSharedNodes = false; // nodes with several parents have an instance per path, which updates can't tell apart
+
+	std::vector<weak_ref<SceneNode>> dirtyTransforms;
+	std::unordered_set<const Material<ImageView>*> dirtyMaterials;
+
+	BufferRange<uint32_t> textureFeedback = {}; // written by Scene::SampleImage, read by textureStreamer
+
+	EnvironmentSampler        environmentSampler = {};
+	EnvironmentSampler::Table backgroundSampling = {}; // alias table for importance sampling backgroundImage
+
 	bool dirty = false;
 
+	// the mesh layout is stored per mesh, since shader object pipelines are shared by meshes with different layouts
 	using RenderableSet =
 		std::unordered_map<const Pipeline*,
-			std::pair<
-				MeshLayout,
-				std::unordered_map<Mesh*,
+			std::unordered_map<Mesh*,
+				std::pair<
+					MeshLayout,
 					std::unordered_map<const Material<ImageView>*,
 						std::vector<
-							std::pair<SceneNode*, Transform> >>>>>;
+							std::pair<SceneNode*, uint32_t/*transformHierarchy index*/> >>>>>;
 
 	void PrepareRenderData(CommandContext& context, const RenderableSet& renderables);
+	// Applies dirtyTransforms and dirtyMaterials to the tables in place. Sets dirty instead if they changed the scene's structure.
+	void UpdateRenderData(CommandContext& context);
+	void UpdateTextureStreaming(CommandContext& context);
 
 public:
+	struct Stats {
+		double   updateTime = 0;       // ms spent in the last PreRender which changed anything
+		bool     rebuilt = false;      // whether that was a full rebuild
+		uint32_t updatedInstances = 0; // by the last incremental update
+		uint32_t updatedMaterials = 0;
+	};
+
 	ref<SceneNode>  sceneRoot = nullptr;
 	SceneRenderData renderData = {};
 	ImageView backgroundImage = {};
+	bool      backgroundFlipY = false; // see PixelData::flipY
 	float3    backgroundColor = float3(0);
+	bool      compressTextures = false; // used by LoadDialog
+	bool      streamTextures = false;   // used by LoadDialog, which creates textureStreamer
+	ref<TextureStreamer> textureStreamer = nullptr;
+	Stats     stats = {};
 
+	// Rebuilds all render data on the next PreRender. Needed when nodes, meshes or materials are added, removed or reassigned.
 	inline void SetDirty() { dirty = true; }
+	// Updates the instances below node on the next PreRender, without rebuilding
+	inline void SetTransformDirty(const ref<SceneNode>& node) { dirtyTransforms.emplace_back(node); }
+	// Repacks material on the next PreRender, without rebuilding unless its images or alpha mode changed
+	inline void SetMaterialDirty(const Material<ImageView>* material) { dirtyMaterials.emplace(material); }
 
 	void LoadDialog(CommandContext& context);
 
+	// getPipelineFn(device, mesh, material) returns a std::pair<MeshLayout, const Pipeline*>
 	inline void PreRender(CommandContext& context, auto getPipelineFn) {
-		if (!dirty || !sceneRoot) return;
+		if (!sceneRoot) return;
 
-		// collect renderables and their transforms from the scene graph
+		const auto start = std::chrono::high_resolution_clock::now();
+
+		if (!dirty && (!dirtyTransforms.empty() || !dirtyMaterials.empty())) {
+			UpdateRenderData(context);
+			if (!dirty) {
+				stats.updateTime = std::chrono::duration_cast<std::chrono::duration<double, std::milli>>(std::chrono::high_resolution_clock::now() - start).count();
+				stats.rebuilt = false;
+			}
+		}
+
+		if (!dirty) {
+			if (textureStreamer) UpdateTextureStreaming(context);
+			return;
+		}
+
+		// flatten the scene graph and compute world transforms, then collect renderables
+
+		transformHierarchy.Build(*sceneRoot);
+		transformHierarchy.Update();
 
 		RenderableSet renderables;
+		nodeRecords.clear();
+		hasSharedNodes = false;
+
+		for (uint32_t i = 0; i < transformHierarchy.size(); i++) {
+			SceneNode* n = transformHierarchy.Node(i);
 
-		std::stack<std::pair<SceneNode*, Transform>> todo;
-		todo.push({sceneRoot.get(), Transform::Identity()});
-		while (!todo.empty()) {
-			auto [n, t] = todo.top();
-			todo.pop();
+			if (!nodeRecords.emplace(n, NodeRecord{ .index = i }).second)
+				hasSharedNodes = true;
 
 			if (n->mesh && n->material) {
-				const auto& [key, cachedPipeline] = getPipelineFn(context.GetDevice(), *n->mesh, *n->material);
-				auto&[meshLayout_, meshes] = renderables[cachedPipeline.get()];
-				meshLayout_ = std::get<0>(key);
-				meshes[n->mesh.get()][n->material.get()].emplace_back(std::pair{n, t});
+				const auto [meshLayout, pipeline] = getPipelineFn(context.GetDevice(), *n->mesh, *n->material);
+				auto&[meshLayout_, materials] = renderables[pipeline][n->mesh.get()];
+				meshLayout_ = meshLayout;
+				materials[n->material.get()].emplace_back(std::pair{n, i});
 			}
-
-			for (const ref<SceneNode>& c : *n)
-				todo.push({c.get(), c->transform.has_value() ? t * c->transform.value() : t});
 		}
 
 		PrepareRenderData(context, renderables);
+		if (textureStreamer) UpdateTextureStreaming(context);
 
 		dirty = false;
+		dirtyTransforms.clear();
+		dirtyMaterials.clear();
+
+		stats.updateTime = std::chrono::duration_cast<std::chrono::duration<double, std::milli>>(std::chrono::high_resolution_clock::now() - start).count();
+		stats.rebuilt = true;
 	}
 };
 
@@ -35,6 +35,10 @@ struct MeshHeader {
 	VertexAttribute positions;
 	VertexAttribute normals;
 	VertexAttribute texcoords;
+	uint meshletBuffer; // index in meshBuffers of the mesh's Meshlets
+	uint meshletOffset;
+	uint meshletCount;  // 0 if the mesh has no meshlets
+	uint pad;
 };
 struct InstanceHeader {
     uint transformIndex;
@@ -206,6 +210,10 @@ inline MeshHeader PackMesh(const Mesh& mesh, std::unordered_map<ref<Buffer>, uin
 	m.texcoords.SetBufferIndex(find_or_emplace(texcoordsBuf));
 	m.texcoords.SetStride(texcoordsLayout.stride);
 
+	m.meshletBuffer = find_or_emplace(mesh.meshlets);
+	m.meshletOffset = mesh.meshlets.mOffset;
+	m.meshletCount  = mesh.meshlets ? mesh.meshletCount : 0;
+
 	return m;
 }
 #endif
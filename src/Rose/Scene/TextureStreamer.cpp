@@ -0,0 +1,295 @@
+#include "TextureStreamer.hpp"
+
+#include <imgui/imgui.h>
+
+namespace RoseEngine {
+
+static bool IsBC1OrBC4(const vk::Format format) {
+	return (format >= vk::Format::eBc1RgbUnormBlock && format <= vk::Format::eBc1RgbaSrgbBlock) || format == vk::Format::eBc4UnormBlock || format == vk::Format::eBc4SnormBlock;
+}
+
+static vk::DeviceSize GetLevelSize(const vk::Format format, const uint3 extent) {
+	if (IsBlockCompressed(format))
+		return vk::DeviceSize((extent.x + 3) / 4) * ((extent.y + 3) / 4) * (IsBC1OrBC4(format) ? 8 : 16);
+	return vk::DeviceSize(extent.x) * extent.y * GetTexelSize(format);
+}
+
+bool TextureStreamer::IsStreamable(const HostPixelData& d) {
+	const PixelData& p = d.pixels;
+	if (p.cubemap || p.arrayLayers != 1 || p.extent.z != 1 || p.mipLevels < 2 || p.regions.size() != p.mipLevels)
+		return false;
+	switch (p.format) {
+		case vk::Format::eR8Unorm:
+		case vk::Format::eR8Srgb:
+		case vk::Format::eR8G8Unorm:
+		case vk::Format::eR8G8Srgb:
+		case vk::Format::eR8G8B8A8Unorm:
+		case vk::Format::eR8G8B8A8Srgb:
+			return true;
+		default:
+			return IsBlockCompressed(p.format);
+	}
+}
+
+ImageView TextureStreamer::Add(CommandContext& context, HostPixelData&& d, const std::string& name) {
+	device = &context.GetDevice();
+
+	Texture t = {
+		.name = name,
+		.host = std::move(d) };
+	PixelData& p = t.host.pixels;
+	std::ranges::sort(p.regions, {}, [](const vk::BufferImageCopy& r) { return r.imageSubresource.mipLevel; });
+
+	Residency& r = t.residency;
+	r.mipLevels = p.mipLevels;
+	r.tailLevel = 0;
+	while (r.tailLevel + 1 < r.mipLevels && std::max(p.extent.x >> r.tailLevel, p.extent.y >> r.tailLevel) > minResidentExtent)
+		r.tailLevel++;
+
+	t.chainBytes.resize(r.mipLevels + 1);
+	for (uint32_t level = r.mipLevels; level-- > 0; )
+		t.chainBytes[level] = t.chainBytes[level + 1] + GetLevelSize(p.format, GetLevelExtent(p.extent, level));
+	r.fullBytes = t.chainBytes[0];
+
+	// upload the tail now. it stays resident until the texture is released
+	const ImageInfo info {
+		.format = p.format,
+		.extent = GetLevelExtent(p.extent, r.tailLevel),
+		.mipLevels = r.mipLevels - r.tailLevel,
+		.usage = vk::ImageUsageFlagBits::eTransferSrc | vk::ImageUsageFlagBits::eTransferDst | vk::ImageUsageFlagBits::eSampled,
+		.queueFamilies = { context.QueueFamily() } };
+	const ref<Image> image = Image::Create(*device, info, vk::MemoryPropertyFlagBits::eDeviceLocal, VMA_ALLOCATION_CREATE_STRATEGY_MIN_MEMORY_BIT, MemoryCategory::eTexture);
+	if (!image) return {};
+	device->SetDebugName(**image, name);
+
+	std::vector<vk::BufferImageCopy> regions(p.regions.begin() + r.tailLevel, p.regions.end());
+	const vk::DeviceSize tailOffset = regions.front().bufferOffset;
+	for (vk::BufferImageCopy& region : regions) {
+		region.bufferOffset -= tailOffset;
+		region.imageSubresource.mipLevel -= r.tailLevel;
+	}
+	const vk::DeviceSize tailSize = p.regions.back().bufferOffset + GetLevelSize(p.format, GetLevelExtent(p.extent, r.mipLevels - 1)) - tailOffset;
+	context.Copy(context.UploadData(std::span(t.host.bytes).subspan(tailOffset, tailSize)), image, regions);
+
+	t.handle = ImageView::Create(image, vk::ImageSubresourceRange{ vk::ImageAspectFlagBits::eColor, 0, info.mipLevels, 0, 1 }, vk::ImageViewType::e2D, p.components);
+	t.view = t.handle;
+	r.residentLevel = r.tailLevel;
+	r.requestedLevel = r.tailLevel;
+	r.residentBytes = t.chainBytes[r.tailLevel];
+
+	const ImageView handle = t.handle;
+	textures.emplace(handle.mImage.get(), std::move(t));
+	return handle;
+}
+
+void TextureStreamer::SetResidentLevel(CommandContext* context, Texture& t, const uint32_t level) {
+	Residency& r = t.residency;
+	if (level == r.residentLevel) return;
+
+	// the tail is always resident, so only levels above it need a new image
+	ImageView view = t.handle;
+	if (level < r.tailLevel) {
+		const PixelData& p = t.host.pixels;
+		const ImageInfo info {
+			.format = p.format,
+			.extent = GetLevelExtent(p.extent, level),
+			.mipLevels = r.mipLevels - level,
+			.usage = vk::ImageUsageFlagBits::eTransferSrc | vk::ImageUsageFlagBits::eTransferDst | vk::ImageUsageFlagBits::eSampled,
+			.queueFamilies = { context->QueueFamily() } };
+		const ref<Image> image = Image::Create(*device, info, vk::MemoryPropertyFlagBits::eDeviceLocal, VMA_ALLOCATION_CREATE_STRATEGY_MIN_MEMORY_BIT, MemoryCategory::eTexture);
+		if (!image) return;
+		device->SetDebugName(**image, t.name);
+
+		// copy the levels which are already resident
+		std::vector<vk::ImageCopy> copies;
+		for (uint32_t l = std::max(level, r.residentLevel); l < r.mipLevels; l++) {
+			const uint3 e = GetLevelExtent(p.extent, l);
+			copies.emplace_back(vk::ImageCopy{
+				.srcSubresource = { vk::ImageAspectFlagBits::eColor, l - r.residentLevel, 0, 1 },
+				.srcOffset = { 0, 0, 0 },
+				.dstSubresource = { vk::ImageAspectFlagBits::eColor, l - level, 0, 1 },
+				.dstOffset = { 0, 0, 0 },
+				.extent = { e.x, e.y, 1 } });
+		}
+		context->Copy(t.view.mImage, image, copies);
+
+		// upload the others
+		if (level < r.residentLevel) {
+			std::vector<std::byte> staging;
+			std::vector<vk::BufferImageCopy> regions;
+			for (uint32_t l = level; l < r.residentLevel; l++) {
+				vk::BufferImageCopy region = p.regions[l];
+				const vk::DeviceSize size = GetLevelSize(p.format, GetLevelExtent(p.extent, l));
+				const auto src = t.host.bytes.begin() + region.bufferOffset;
+				region.bufferOffset = staging.size();
+				region.imageSubresource.mipLevel = l - level;
+				staging.insert(staging.end(), src, src + size);
+				regions.emplace_back(region);
+			}
+			context->Copy(context->UploadData(staging), image, regions);
+		}
+
+		view = ImageView::Create(image, vk::ImageSubresourceRange{ vk::ImageAspectFlagBits::eColor, 0, info.mipLevels, 0, 1 }, vk::ImageViewType::e2D, p.components);
+	}
+
+	if (t.view != t.handle)
+		device->DeferDestroy(std::move(t.view));
+	t.view = view;
+	r.residentLevel = level;
+	r.residentBytes = t.chainBytes[r.tailLevel] + (level < r.tailLevel ? t.chainBytes[level] : 0);
+	viewsChanged = true;
+}
+
+bool TextureStreamer::Update(CommandContext& context, const BufferRange<uint32_t>& feedback, const std::unordered_map<ImageView, uint32_t>& imageIndices) {
+	frameIndex++;
+
+	// release textures which nothing else references
+	std::erase_if(textures, [&](auto& p) {
+		Texture& t = p.second;
+		if (t.handle.mImage.use_count() > (t.view == t.handle ? 2 : 1)) return false;
+		if (t.view != t.handle) device->DeferDestroy(std::move(t.view));
+		device->DeferDestroy(std::move(t.handle));
+		return true;
+	});
+
+	// feedback values are the log2 of the largest image extent that was needed, plus one (see Scene::SampleImage)
+	const uint64_t completedValue = context.GetDevice().CurrentTimelineValue();
+	for (Readback& readback : readbacks) {
+		if (!readback.pending || readback.timelineValue > completedValue) continue;
+		for (uint32_t i = 0; i < readback.images.size(); i++) {
+			const uint32_t value = readback.buffer[i];
+			if (value == 0) continue;
+			const ref<Image> handle = readback.images[i].lock();
+			if (!handle) continue;
+			auto it = textures.find(handle.get());
+			if (it == textures.end()) continue;
+			Residency& r = it->second.residency;
+			const uint32_t maxLevel = GetMaxMipLevels(it->second.host.pixels.extent) - 1;
+			r.requestedLevel = std::min((uint32_t)std::max(int(maxLevel) - int(value - 1), 0), r.tailLevel);
+			r.lastRequestFrame = std::max(r.lastRequestFrame, readback.frame);
+		}
+		readback.pending = false;
+	}
+
+	// copy this frame's feedback, then clear it for the next frame
+	auto readback = std::ranges::find_if(readbacks, [](const Readback& r) { return !r.pending; });
+	if (readback == readbacks.end()) {
+		readbacks.emplace_back(Readback{
+			.buffer = Buffer::Create(*device, feedback.size_bytes(), vk::BufferUsageFlagBits::eTransferDst,
+				vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent,
+				VMA_ALLOCATION_CREATE_MAPPED_BIT | VMA_ALLOCATION_CREATE_HOST_ACCESS_RANDOM_BIT,
+				MemoryCategory::eStaging).cast<uint32_t>() });
+		readback = readbacks.end() - 1;
+	}
+	readback->images.assign(feedback.size(), {});
+	for (const auto& [view, index] : imageIndices)
+		if (index < feedback.size() && textures.contains(view.mImage.get()))
+			readback->images[index] = view.mImage;
+	readback->timelineValue = context.GetDevice().NextTimelineSignal();
+	readback->frame = frameIndex;
+	readback->pending = true;
+	context.Copy(feedback, readback->buffer);
+	context.Fill(feedback, 0u);
+
+	// textures sampled recently keep the level they need, others only their tail.
+	// if that doesn't fit in the budget, every texture drops the same number of levels
+	auto TargetLevel = [&](const Texture& t, const uint32_t bias) {
+		const Residency& r = t.residency;
+		if (r.lastRequestFrame == 0 || frameIndex - r.lastRequestFrame > evictFrames)
+			return r.tailLevel;
+		return std::min(r.requestedLevel + bias, r.tailLevel);
+	};
+	uint32_t bias = 0;
+	for (; bias < 16; bias++) {
+		vk::DeviceSize total = 0;
+		for (const auto& [_, t] : textures) {
+			const uint32_t level = TargetLevel(t, bias);
+			total += t.chainBytes[t.residency.tailLevel] + (level < t.residency.tailLevel ? t.chainBytes[level] : 0);
+		}
+		if (total <= budget) break;
+	}
+
+	// evict first, so that uploads have room
+	std::vector<Texture*> missing;
+	for (auto& [_, t] : textures) {
+		const uint32_t level = TargetLevel(t, bias);
+		if (level > t.residency.residentLevel)
+			SetResidentLevel(&context, t, level);
+		else if (level < t.residency.residentLevel)
+			missing.emplace_back(&t);
+	}
+
+	// textures missing the most levels go first. each moves as many levels closer to its target as the upload limit allows,
+	// but at least one, so that large levels are still streamed in
+	std::ranges::sort(missing, std::greater{}, [&](const Texture* t) { return t->residency.residentLevel - TargetLevel(*t, bias); });
+	vk::DeviceSize uploadedBytes = 0;
+	for (Texture* t : missing) {
+		if (uploadedBytes >= maxUploadBytesPerFrame) break;
+		const Residency& r = t->residency;
+		const uint32_t target = TargetLevel(*t, bias);
+		uint32_t level = r.residentLevel - 1;
+		while (level > target && uploadedBytes + t->chainBytes[level - 1] - t->chainBytes[r.residentLevel] <= maxUploadBytesPerFrame)
+			level--;
+		uploadedBytes += t->chainBytes[level] - t->chainBytes[r.residentLevel];
+		SetResidentLevel(&context, *t, level);
+	}
+
+	stats = Stats{
+		.textureCount = (uint32_t)textures.size(),
+		.uploadedBytes = uploadedBytes,
+		.budgetBias = bias };
+	for (const auto& [_, t] : textures) {
+		stats.residentBytes += t.residency.residentBytes;
+		stats.fullBytes     += t.residency.fullBytes;
+		if (TargetLevel(t, bias) < t.residency.residentLevel)
+			stats.streamingCount++;
+	}
+
+	const bool changed = viewsChanged;
+	viewsChanged = false;
+	return changed;
+}
+
+vk::DeviceSize TextureStreamer::Evict(const vk::DeviceSize bytes) {
+	std::vector<Texture*> streamed;
+	for (auto& [_, t] : textures)
+		if (t.view != t.handle)
+			streamed.emplace_back(&t);
+	std::ranges::sort(streamed, {}, [](const Texture* t) { return t->residency.lastRequestFrame; });
+
+	vk::DeviceSize released = 0, releasedLevels = 0;
+	for (Texture* t : streamed) {
+		if (released >= bytes) break;
+		released += t->view.mImage->MemorySize();
+		releasedLevels += t->residency.residentBytes - t->chainBytes[t->residency.tailLevel];
+		SetResidentLevel(nullptr, *t, t->residency.tailLevel);
+	}
+	if (releasedLevels > 0)
+		budget = std::min(budget, stats.residentBytes - std::min(stats.residentBytes, releasedLevels));
+	return released;
+}
+
+void TextureStreamer::InspectorGui() {
+	const auto[resident, residentUnit] = FormatBytes(stats.residentBytes);
+	const auto[full, fullUnit]         = FormatBytes(stats.fullBytes);
+	const auto[saved, savedUnit]       = FormatBytes(stats.fullBytes - std::min(stats.fullBytes, stats.residentBytes));
+	ImGui::Text("%u textures: %lu %s resident of %lu %s (%lu %s saved)", stats.textureCount, resident, residentUnit, full, fullUnit, saved, savedUnit);
+	ImGui::Text("%u streaming, %u levels dropped to fit the budget", stats.streamingCount, stats.budgetBias);
+
+	uint64_t budgetMiB = budget / (1024*1024);
+	if (ImGui::InputScalar("Budget (MiB)", ImGuiDataType_U64, &budgetMiB))
+		budget = budgetMiB * 1024*1024;
+	uint64_t uploadMiB = maxUploadBytesPerFrame / (1024*1024);
+	if (ImGui::InputScalar("Uploads per frame (MiB)", ImGuiDataType_U64, &uploadMiB))
+		maxUploadBytesPerFrame = uploadMiB * 1024*1024;
+	ImGui::InputScalar("Evict after (frames)", ImGuiDataType_U32, &evictFrames);
+
+	if (ImGui::CollapsingHeader("Textures")) {
+		for (const auto& [_, t] : textures) {
+			const Residency& r = t.residency;
+			ImGui::Text("%s: level %u of %u resident, %u requested", t.name.c_str(), r.residentLevel, r.mipLevels, r.requestedLevel);
+		}
+	}
+}
+
+}
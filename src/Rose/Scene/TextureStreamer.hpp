@@ -0,0 +1,98 @@
+#pragma once
+
+#include <Rose/Core/CommandContext.hpp>
+
+namespace RoseEngine {
+
+// Streams mip levels of scene textures on demand. Textures start with only their smallest levels resident, and finer levels
+// are uploaded from host memory once the renderer samples them (see Scene::SampleImage, which records the finest level each
+// image needs in a feedback buffer). Levels of textures that haven't been sampled for a while are evicted.
+//
+// Residency changes reallocate the texture's image and copy the levels it keeps, instead of binding sparse memory,
+// so scene shaders see an ordinary image whose first level is the finest resident level.
+class TextureStreamer {
+public:
+	struct Residency {
+		uint32_t       mipLevels = 0;      // levels of the full texture
+		uint32_t       tailLevel = 0;      // first of the levels which are always resident
+		uint32_t       residentLevel = 0;  // finest resident level
+		uint32_t       requestedLevel = 0; // finest level the renderer sampled, from the last feedback that was read back
+		uint64_t       lastRequestFrame = 0; // 0 if never sampled
+		vk::DeviceSize residentBytes = 0;
+		vk::DeviceSize fullBytes = 0;      // bytes the texture takes with every level resident
+	};
+
+	struct Stats {
+		uint32_t       textureCount = 0;
+		uint32_t       streamingCount = 0; // textures with fewer levels resident than they should have
+		vk::DeviceSize residentBytes = 0;
+		vk::DeviceSize fullBytes = 0;
+		vk::DeviceSize uploadedBytes = 0; // by the last Update
+		uint32_t       budgetBias = 0;    // levels every texture dropped to fit in the budget
+	};
+
+	vk::DeviceSize budget = 1024ull*1024*1024;
+	vk::DeviceSize maxUploadBytesPerFrame = 64ull*1024*1024;
+	uint32_t       evictFrames = 120;      // frames a texture stays resident after it was last sampled
+	uint32_t       minResidentExtent = 128; // levels this size and smaller are uploaded immediately and never evicted
+
+private:
+	struct Texture {
+		std::string                 name;
+		HostPixelData               host; // every level, so that evicted levels can be streamed in again
+		std::vector<vk::DeviceSize> chainBytes; // chainBytes[level] is the size of level and every level below it
+		ImageView                   handle; // the tail, which identifies the texture
+		ImageView                   view;   // the resident levels. equal to handle if only the tail is resident
+		Residency                   residency;
+	};
+
+	struct Readback {
+		BufferRange<uint32_t>        buffer = {};
+		std::vector<weak_ref<Image>> images = {}; // handle of each image index when the feedback was copied
+		uint64_t                     timelineValue = 0;
+		uint64_t                     frame = 0;
+		bool                         pending = false;
+	};
+
+	Device*  device = nullptr;
+	std::unordered_map<const Image*, Texture> textures = {}; // by handle image
+	std::vector<Readback> readbacks = {};
+	uint64_t frameIndex = 0;
+	bool     viewsChanged = false;
+	Stats    stats = {};
+
+	void SetResidentLevel(CommandContext* context, Texture& texture, const uint32_t level);
+
+public:
+	// Whether d has every mip level of a single 2D image in a format the streamer can size (block compressed or 8 bit)
+	static bool IsStreamable(const HostPixelData& d);
+
+	// Uploads the smallest levels of d and keeps the rest in host memory. The returned view identifies the texture
+	// and is used like any other image by materials. GetView returns the levels that are actually resident.
+	ImageView Add(CommandContext& context, HostPixelData&& d, const std::string& name);
+
+	// The resident levels of the texture identified by handle, or handle if it isn't streamed
+	inline const ImageView& GetView(const ImageView& handle) const {
+		if (auto it = textures.find(handle.mImage.get()); it != textures.end())
+			return it->second.view;
+		return handle;
+	}
+	inline const Residency* GetResidency(const ImageView& handle) const {
+		if (auto it = textures.find(handle.mImage.get()); it != textures.end())
+			return &it->second.residency;
+		return nullptr;
+	}
+	inline const Stats& GetStats() const { return stats; }
+
+	// Reads back feedback from finished frames, copies the feedback written since the last call and clears it, then evicts and
+	// uploads levels. imageIndices maps handles to the indices the renderer samples them with. Returns true if any view changed.
+	bool Update(CommandContext& context, const BufferRange<uint32_t>& feedback, const std::unordered_map<ImageView, uint32_t>& imageIndices);
+
+	// Evicts every level above the tail of the least recently used textures, for MemoryBudget eviction callbacks.
+	// The budget is lowered so that the levels aren't streamed in again. Returns the number of bytes released.
+	vk::DeviceSize Evict(const vk::DeviceSize bytes);
+
+	void InspectorGui();
+};
+
+}
@@ -0,0 +1,80 @@
+#include "TransformHierarchy.hpp"
+
+#include <barrier>
+#include <thread>
+
+namespace RoseEngine {
+
+void TransformHierarchy::Build(SceneNode& root) {
+	nodes.clear();
+	parents.clear();
+	levelOffsets.clear();
+
+	nodes.emplace_back(&root);
+	parents.emplace_back(kNoParent);
+	for (size_t begin = 0; begin < nodes.size(); ) {
+		const size_t end = nodes.size();
+		levelOffsets.emplace_back((uint32_t)begin);
+		for (size_t i = begin; i < end; i++) {
+			for (const ref<SceneNode>& c : *nodes[i]) {
+				nodes.emplace_back(c.get());
+				parents.emplace_back((uint32_t)i);
+			}
+		}
+		begin = end;
+	}
+	levelOffsets.emplace_back((uint32_t)nodes.size());
+
+	world.resize(nodes.size());
+	inverseWorld.resize(nodes.size());
+}
+
+void TransformHierarchy::Update() {
+	if (nodes.empty()) return;
+
+	auto updateRange = [&](const size_t begin, const size_t end) {
+		for (size_t i = begin; i < end; i++) {
+			const uint32_t parent = parents[i];
+			if (parent == kNoParent) {
+				world[i] = Transform::Identity();
+			} else {
+				const std::optional<Transform>& local = nodes[i]->transform;
+				world[i] = local.has_value() ? world[parent] * local.value() : world[parent];
+			}
+			inverseWorld[i] = inverse(world[i]);
+		}
+	};
+
+	uint32_t largestLevel = 0;
+	for (uint32_t d = 0; d < LevelCount(); d++)
+		largestLevel = std::max(largestLevel, levelOffsets[d + 1] - levelOffsets[d]);
+
+	const uint32_t maxThreads = threadCount > 0 ? threadCount : std::max(std::thread::hardware_concurrency(), 1u);
+	const uint32_t workerCount = std::clamp(largestLevel / std::max(minNodesPerThread, 1u), 1u, maxThreads);
+
+	// parents precede their children, so a single thread can do every depth in one pass
+	if (workerCount == 1) {
+		updateRange(0, nodes.size());
+		return;
+	}
+
+	std::barrier levelDone(workerCount);
+	auto work = [&](const uint32_t worker) {
+		for (uint32_t d = 0; d < LevelCount(); d++) {
+			const size_t begin = levelOffsets[d];
+			const size_t count = levelOffsets[d + 1] - begin;
+			const uint32_t activeCount = std::clamp<uint32_t>(uint32_t(count / std::max(minNodesPerThread, 1u)), 1u, workerCount);
+			if (worker < activeCount)
+				updateRange(begin + count * worker / activeCount, begin + count * (worker + 1) / activeCount);
+			levelDone.arrive_and_wait();
+		}
+	};
+
+	std::vector<std::jthread> workers;
+	workers.reserve(workerCount - 1);
+	for (uint32_t i = 1; i < workerCount; i++)
+		workers.emplace_back(work, i);
+	work(0);
+}
+
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <span>
+
+#include "SceneNode.hpp"
+
+namespace RoseEngine {
+
+// Flattened copy of a SceneNode tree, for computing world transforms without walking the tree's pointers.
+// Nodes are stored breadth first in parallel arrays, so each depth is a contiguous range and parents precede their children.
+// Update computes world and inverse world transforms one depth at a time, with large depths split across worker threads.
+//
+// SceneNodes stay the interface for editing the scene: Build re-flattens the tree after nodes are added, removed or
+// reparented, and Update re-reads each node's local transform. A node reachable through several parents gets an entry per path.
+class TransformHierarchy {
+public:
+	static constexpr uint32_t kNoParent = ~0u;
+
+private:
+	std::vector<SceneNode*> nodes = {};
+	std::vector<uint32_t>   parents = {};      // index of each node's parent, kNoParent for the root
+	std::vector<uint32_t>   levelOffsets = {}; // depth d is [levelOffsets[d], levelOffsets[d+1])
+	std::vector<Transform>  world = {};
+	std::vector<Transform>  inverseWorld = {};
+
+public:
+	uint32_t threadCount = 0; // 0 for one per hardware thread
+	uint32_t minNodesPerThread = 4096; // depths with fewer nodes per thread use fewer threads
+
+	// Flattens the tree below root. The root's own transform is ignored, since the root is the scene's origin.
+	void Build(SceneNode& root);
+	// Recomputes every world and inverse world transform from the nodes' local transforms
+	void Update();
+
+	inline size_t   size() const { return nodes.size(); }
+	inline bool     empty() const { return nodes.empty(); }
+	inline uint32_t LevelCount() const { return levelOffsets.empty() ? 0 : uint32_t(levelOffsets.size() - 1); }
+
+	inline SceneNode*       Node(const uint32_t i)   const { return nodes[i]; }
+	inline uint32_t         Parent(const uint32_t i) const { return parents[i]; }
+	inline const Transform& World(const uint32_t i)  const { return world[i]; }
+	inline const Transform& InverseWorld(const uint32_t i) const { return inverseWorld[i]; }
+	inline std::span<const Transform> World()        const { return world; }
+	inline std::span<const Transform> InverseWorld() const { return inverseWorld; }
+
+	// Overrides a node's world transform, e.g. when updating a subtree without calling Update
+	inline void SetWorld(const uint32_t i, const Transform& t) {
+		world[i] = t;
+		inverseWorld[i] = inverse(t);
+	}
+};
+
+}
@@ -19,7 +19,10 @@ struct ComputeProgramNode {
 		WorkNodeAttribute{ "memoryFlags", WorkAttributeFlagBits::eInput },
 	};
 
-	std::vector<WorkNodeAttribute> attributes;
+	// if connected, the dispatch size is read from this buffer (a VkDispatchIndirectCommand) instead of threadCount
+	inline static const WorkNodeAttribute kIndirectArgsAttribute = { "indirectArgs", WorkAttributeFlagBits::eOptionalInput };
+
+	std::vector<WorkNodeAttribute> attributes = { kIndirectArgsAttribute };
 
 	std::string   shaderPath; // can be relative to src/
 	std::string   entryPoint = "main";
@@ -78,8 +81,12 @@ struct ComputeProgramNode {
 		if (auto s = GetShader(); s == nullptr || s->IsStale()) {
 			CreatePipeline(context.GetDevice());
 		}
+		if (!pipeline) return;
 
-		context.Dispatch(*pipeline, threadCount, rootParameter);
+		if (const auto args = GetResource<BufferParameter>(resources, {nodeId, kIndirectArgsAttribute.name}))
+			context.DispatchIndirect(*pipeline, args, rootParameter);
+		else
+			context.Dispatch(*pipeline, threadCount, rootParameter);
 	}
 };
 
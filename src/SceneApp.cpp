@@ -15,6 +15,11 @@ int main(int argc, const char** argv) {
 		VK_KHR_RAY_TRACING_PIPELINE_EXTENSION_NAME,
 		VK_KHR_RAY_QUERY_EXTENSION_NAME,
 		VK_KHR_FRAGMENT_SHADER_BARYCENTRIC_EXTENSION_NAME,
+	}, {
+		VK_KHR_PIPELINE_LIBRARY_EXTENSION_NAME,
+		VK_EXT_GRAPHICS_PIPELINE_LIBRARY_EXTENSION_NAME,
+		VK_EXT_SHADER_OBJECT_EXTENSION_NAME,
+		VK_EXT_MESH_SHADER_EXTENSION_NAME,
 	});
 
 	auto sceneRenderer = make_ref<SceneRenderer>();
@@ -22,6 +27,7 @@ int main(int argc, const char** argv) {
 
 	ref<Scene> scene = make_ref<Scene>();
 	sceneRenderer->SetScene(scene);
+	sceneRenderer->overwriteRenderTarget = true;
 	sceneEditor->SetScene(scene);
 
 	ViewportCamera camera = {};
@@ -30,8 +36,20 @@ int main(int argc, const char** argv) {
 		if (ImGui::MenuItem("Open scene") || (ImGui::IsKeyDown(ImGuiKey_ModCtrl) && ImGui::IsKeyPressed(ImGuiKey_O), false)) {
 			scene->LoadDialog(app.CurrentContext());
 		}
+		ImGui::MenuItem("Compress textures", nullptr, &scene->compressTextures);
+		ImGui::MenuItem("Stream textures", nullptr, &scene->streamTextures);
+	});
+	app.AddWidget("Renderers", [&]() {
+		sceneRenderer->InspectorWidget();
+		sceneEditor->InspectorWidget(app.CurrentContext());
+		if (scene->textureStreamer && ImGui::CollapsingHeader("Texture streaming"))
+			scene->textureStreamer->InspectorGui();
+	}, true);
+
+	// streamed texture levels are evicted before cached transient resources
+	app.memoryBudget->AddEvictionCallback("Streamed textures", 0.85f, [&](uint32_t heapIndex, vk::DeviceSize bytes) {
+		return scene->textureStreamer ? scene->textureStreamer->Evict(bytes) : 0;
 	});
-	app.AddWidget("Renderers", [&]() { sceneEditor->InspectorWidget(app.CurrentContext()); }, true);
 
 	app.AddWidget("Viewport", [&]() {
 		camera.Update(app.dt);
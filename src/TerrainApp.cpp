@@ -15,10 +15,10 @@ int main(int argc, const char** argv) {
 
 	auto terrain = make_ref<TerrainRenderer>();
 
-	ViewportWidget viewport(*app.contexts[0], terrain);
+	ViewportWidget viewport(app.CurrentContext(), terrain);
 
-	app.AddWidget("Renderers", [&]()     { viewport.InspectorWidget(*app.contexts[app.swapchain->ImageIndex()]); }, true);
-	app.AddWidget("Viewport", [&]()      { viewport.Render(*app.contexts[app.swapchain->ImageIndex()], app.dt); }, true);
+	app.AddWidget("Renderers", [&]()     { viewport.InspectorWidget(app.CurrentContext()); }, true);
+	app.AddWidget("Viewport", [&]()      { viewport.Render(app.CurrentContext(), app.dt); }, true);
 
 	app.Run();
 
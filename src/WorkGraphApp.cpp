@@ -152,10 +152,10 @@ public:
 int main(int argc, const char** argv) {
 	WindowedApp app("Work graph test", { VK_KHR_SWAPCHAIN_EXTENSION_NAME });
 
-	NodeWidget nodeEditor(*app.contexts[0]);
+	NodeWidget nodeEditor(app.CurrentContext());
 
-	app.AddWidget("Properties", [&]() { nodeEditor.RenderProperties(*app.contexts[app.swapchain->ImageIndex()]); }, true);
-	app.AddWidget("Nodes",      [&]() { nodeEditor.RenderNodes(     *app.contexts[app.swapchain->ImageIndex()]); }, true);
+	app.AddWidget("Properties", [&]() { nodeEditor.RenderProperties(app.CurrentContext()); }, true);
+	app.AddWidget("Nodes",      [&]() { nodeEditor.RenderNodes(     app.CurrentContext()); }, true);
 
 	app.Run();
 
@@ -0,0 +1,53 @@
+#include <Rose/Core/Instance.hpp>
+
+#include <iostream>
+
+using namespace RoseEngine;
+
+// Records whether it was released while the device's allocator still existed
+struct Tracker {
+	Device*     device = nullptr;
+	BufferView  buffer = {};
+	bool*       released = nullptr;
+	bool*       allocatorAlive = nullptr;
+
+	~Tracker() {
+		*released = true;
+		*allocatorAlive = device->MemoryAllocator() != nullptr;
+		// destructors of deferred objects may defer more objects
+		device->DeferDestroy(std::move(buffer));
+	}
+};
+
+int main(int argc, const char** argv) {
+	std::span args = { argv, (size_t)argc };
+
+	ref<Instance> instance = Instance::Create({}, { "VK_LAYER_KHRONOS_validation" });
+	ref<Device>   device   = Device::Create(*instance, (*instance)->enumeratePhysicalDevices()[0]);
+
+	bool released = false, allocatorAlive = false;
+
+	// nothing is submitted, so the default last use is never reached by the timeline
+	device->DeferDestroy(Buffer::Create(*device, 1024*1024));
+	ref<Tracker> tracker = make_ref<Tracker>();
+	tracker->device = device.get();
+	tracker->buffer = Buffer::Create(*device, 1024*1024);
+	tracker->released = &released;
+	tracker->allocatorAlive = &allocatorAlive;
+	device->DeferDestroy(std::move(tracker));
+	device->CollectGarbage();
+	const bool kept = device->DeferredDestructionCount() >= 2 && !released;
+
+	device.reset();
+
+	const bool passed = kept && released && allocatorAlive;
+	std::cout << "Release on device destruction: " << (passed ? "PASSED" : "FAILED") << std::endl;
+
+	if (passed) {
+		std::cout << "SUCCESS" << std::endl;
+		return EXIT_SUCCESS;
+	} else {
+		std::cout << "FAILURE" << std::endl;
+		return EXIT_FAILURE;
+	}
+}
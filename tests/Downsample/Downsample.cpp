@@ -0,0 +1,112 @@
+#include <Rose/Core/Instance.hpp>
+#include <Rose/Downsample/Downsample.hpp>
+
+#include <iostream>
+#include <random>
+
+using namespace RoseEngine;
+using Reduction = Downsampler::Reduction;
+
+// Reduces the 2^level x 2^level footprint of texel p, with coordinates clamped to the source's edges (see Downsample.slang)
+float4 ReduceFootprint(const std::vector<float4>& source, const uint2 extent, const uint32_t level, const uint2 p, const Reduction reduction) {
+	const uint32_t size = 1 << level;
+	float4 r = reduction == Reduction::eMin ? float4(FLT_MAX) : float4(-FLT_MAX);
+	double4 sum = double4(0);
+	for (uint32_t y = 0; y < size; y++) {
+		for (uint32_t x = 0; x < size; x++) {
+			const uint2 s = min(p * size + uint2(x, y), extent - 1u);
+			const float4 v = source[s.y * extent.x + s.x];
+			switch (reduction) {
+				case Reduction::eMin: r = min(r, v); break;
+				case Reduction::eMax: r = max(r, v); break;
+				default:              sum += double4(v); break;
+			}
+		}
+	}
+	if (reduction == Reduction::eAverage)
+		r = float4(sum / double(size * size));
+	return r;
+}
+
+bool TestDownsample(CommandContext& context, Downsampler& downsampler, const uint2 extent, const Reduction reduction) {
+	Device& device = context.GetDevice();
+
+	ImageInfo info {
+		.format = vk::Format::eR32G32B32A32Sfloat,
+		.extent = uint3(extent, 1),
+		.mipLevels = GetMaxMipLevels(uint3(extent, 1)),
+		.queueFamilies = { context.QueueFamily() } };
+	Downsampler::AddRequiredUsage(info);
+	if (!Downsampler::IsSupported(device, info)) {
+		std::cout << "Downsampling " << vk::to_string(info.format) << " is not supported" << std::endl;
+		return false;
+	}
+	const ref<Image> image = Image::Create(device, info);
+
+	std::vector<float4> pixels(extent.x * extent.y);
+	std::mt19937 rng(extent.x * 31 + extent.y);
+	std::uniform_real_distribution<float> dist(0, 1);
+	for (float4& p : pixels)
+		p = float4(dist(rng), dist(rng), dist(rng), dist(rng));
+
+	std::vector<BufferRange<float4>> readback(info.mipLevels);
+
+	context.Begin();
+	context.Copy(context.UploadData(pixels), ImageView::Create(image, vk::ImageSubresourceRange{ vk::ImageAspectFlagBits::eColor, 0, 1, 0, 1 }));
+	downsampler(context, image, reduction);
+	for (uint32_t level = 1; level < info.mipLevels; level++) {
+		const uint3 e = GetLevelExtent(info.extent, level);
+		readback[level] = Buffer::Create(device, sizeof(float4) * e.x * e.y, vk::BufferUsageFlagBits::eTransferDst, vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent, VMA_ALLOCATION_CREATE_HOST_ACCESS_RANDOM_BIT | VMA_ALLOCATION_CREATE_MAPPED_BIT).cast<float4>();
+		context.Copy(ImageView::Create(image, vk::ImageSubresourceRange{ vk::ImageAspectFlagBits::eColor, level, 1, 0, 1 }), readback[level]);
+	}
+	context.Submit();
+	device.Wait();
+
+	bool passed = true;
+	for (uint32_t level = 1; level < info.mipLevels && passed; level++) {
+		const uint2 e = uint2(GetLevelExtent(info.extent, level));
+		for (uint32_t y = 0; y < e.y && passed; y++) {
+			for (uint32_t x = 0; x < e.x && passed; x++) {
+				const float4 expected = ReduceFootprint(pixels, extent, level, uint2(x, y), reduction);
+				const float4 result = readback[level][y * e.x + x];
+				// min and max are exact, averages only differ by the order of the additions
+				const float tolerance = reduction == Reduction::eAverage ? 1e-4f : 0.f;
+				if (any(glm::greaterThan(abs(result - expected), float4(tolerance)))) {
+					std::cout << "Mismatch at level " << level << " (" << x << ", " << y << "): "
+						<< result.x << " != " << expected.x << std::endl;
+					passed = false;
+				}
+			}
+		}
+	}
+
+	std::cout << extent.x << "x" << extent.y << " " << (reduction == Reduction::eAverage ? "average" : reduction == Reduction::eMin ? "min" : "max")
+		<< ", " << info.mipLevels << " levels: " << (passed ? "PASSED" : "FAILED") << std::endl;
+	return passed;
+}
+
+int main(int argc, const char** argv) {
+	std::span args = { argv, (size_t)argc };
+
+	ref<Instance> instance = Instance::Create({}, { "VK_LAYER_KHRONOS_validation" });
+	ref<Device>   device   = Device::Create(*instance, (*instance)->enumeratePhysicalDevices()[0]);
+
+	ref<CommandContext> context = CommandContext::Create(device, vk::QueueFlagBits::eCompute | vk::QueueFlagBits::eTransfer);
+
+	Downsampler downsampler;
+
+	bool allPassed = true;
+	allPassed &= TestDownsample(*context, downsampler, uint2(256, 256),  Reduction::eAverage);
+	allPassed &= TestDownsample(*context, downsampler, uint2(2048, 2048), Reduction::eAverage); // levels 7-11 from the last workgroup
+	allPassed &= TestDownsample(*context, downsampler, uint2(300, 200),   Reduction::eMin);
+	allPassed &= TestDownsample(*context, downsampler, uint2(1000, 700),  Reduction::eMax);
+	allPassed &= TestDownsample(*context, downsampler, uint2(5000, 3),    Reduction::eMin); // wider than 4096, so two dispatches
+
+	if (allPassed) {
+		std::cout << "SUCCESS" << std::endl;
+		return EXIT_SUCCESS;
+	} else {
+		std::cout << "FAILURE" << std::endl;
+		return EXIT_FAILURE;
+	}
+}
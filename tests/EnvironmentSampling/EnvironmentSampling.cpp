@@ -0,0 +1,99 @@
+#include <Rose/Core/Instance.hpp>
+#include <Rose/Core/MathUtils.h>
+#include <Rose/Scene/EnvironmentSampling.hpp>
+
+#include <iostream>
+#include <random>
+
+using namespace RoseEngine;
+
+bool TestEnvironmentSampling(CommandContext& context, EnvironmentSampler& sampler, const uint2 extent, const bool withSun) {
+	Device& device = context.GetDevice();
+
+	const ref<Image> image = Image::Create(device, ImageInfo{
+		.format = vk::Format::eR32G32B32A32Sfloat,
+		.extent = uint3(extent, 1),
+		.usage = vk::ImageUsageFlagBits::eSampled | vk::ImageUsageFlagBits::eTransferDst,
+		.queueFamilies = { context.QueueFamily() } });
+
+	// dim noise, with a bright sun covering a few texels
+	std::vector<float4> pixels(size_t(extent.x) * extent.y);
+	std::mt19937 rng(extent.x * 31 + extent.y);
+	std::uniform_real_distribution<float> dist(0, 1);
+	for (float4& p : pixels)
+		p = float4(dist(rng), dist(rng), dist(rng), 1) * 0.1f;
+	if (withSun)
+		for (uint32_t y = extent.y / 4; y < extent.y / 4 + 2; y++)
+			for (uint32_t x = extent.x / 3; x < extent.x / 3 + 3; x++)
+				pixels[size_t(y) * extent.x + x] = float4(50000, 40000, 30000, 1);
+
+	context.Begin();
+	context.Copy(context.UploadData(pixels), ImageView::Create(image));
+	const EnvironmentSampler::Table table = sampler.Build(context, ImageView::Create(image));
+	const BufferRange<EnvironmentAliasEntry> readback = Buffer::Create(device, table.entries.size_bytes(), vk::BufferUsageFlagBits::eTransferDst, vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent, VMA_ALLOCATION_CREATE_HOST_ACCESS_RANDOM_BIT | VMA_ALLOCATION_CREATE_MAPPED_BIT).cast<EnvironmentAliasEntry>();
+	context.Copy(table.entries, readback);
+	context.Submit();
+	device.Wait();
+
+	// expected pdf of each texel relative to a uniform pick: luminance times solid angle
+	std::vector<double> weights(pixels.size());
+	double total = 0;
+	for (uint32_t y = 0; y < extent.y; y++) {
+		for (uint32_t x = 0; x < extent.x; x++) {
+			const size_t i = size_t(y) * extent.x + x;
+			weights[i] = luminance(float3(pixels[i])) * std::sin(M_PI * (y + 0.5) / extent.y);
+			total += weights[i];
+		}
+	}
+
+	// probability of each texel implied by the row and texel tables
+	std::vector<double> rowProbability(extent.y, 0.0);
+	for (uint32_t y = 0; y < extent.y; y++) {
+		rowProbability[y] += readback[y].threshold / extent.y;
+		rowProbability[readback[y].alias] += (1 - readback[y].threshold) / extent.y;
+	}
+	std::vector<double> probability(pixels.size(), 0.0);
+	for (uint32_t y = 0; y < extent.y; y++) {
+		for (uint32_t x = 0; x < extent.x; x++) {
+			const EnvironmentAliasEntry& e = readback[extent.y + size_t(y) * extent.x + x];
+			probability[size_t(y) * extent.x + x]       += rowProbability[y] * e.threshold / extent.x;
+			probability[size_t(y) * extent.x + e.alias] += rowProbability[y] * (1 - e.threshold) / extent.x;
+		}
+	}
+
+	bool passed = table.extent == extent;
+	for (size_t i = 0; i < pixels.size() && passed; i++) {
+		const double expected = weights[i] / total;
+		const double pdf = readback[extent.y + i].pdf / pixels.size();
+		// thresholds of heavy entries accumulate rounding errors over the row
+		if (std::abs(pdf - expected) > 1e-4 * expected + 1e-9 || std::abs(probability[i] - expected) > 1e-3 * expected + 1e-9) {
+			std::cout << "Mismatch at texel " << i << ": pdf " << pdf << ", sampled " << probability[i] << ", expected " << expected << std::endl;
+			passed = false;
+		}
+	}
+
+	std::cout << extent.x << "x" << extent.y << (withSun ? " with sun" : "") << ": " << (passed ? "PASSED" : "FAILED") << std::endl;
+	return passed;
+}
+
+int main(int argc, const char** argv) {
+	ref<Instance> instance = Instance::Create({}, { "VK_LAYER_KHRONOS_validation" });
+	ref<Device>   device   = Device::Create(*instance, (*instance)->enumeratePhysicalDevices()[0]);
+
+	ref<CommandContext> context = CommandContext::Create(device, vk::QueueFlagBits::eCompute | vk::QueueFlagBits::eTransfer);
+
+	EnvironmentSampler sampler;
+
+	bool allPassed = true;
+	allPassed &= TestEnvironmentSampling(*context, sampler, uint2(256, 128), false);
+	allPassed &= TestEnvironmentSampling(*context, sampler, uint2(512, 256), true);
+	allPassed &= TestEnvironmentSampling(*context, sampler, uint2(333, 97),  true);
+
+	if (allPassed) {
+		std::cout << "SUCCESS" << std::endl;
+		return EXIT_SUCCESS;
+	} else {
+		std::cout << "FAILURE" << std::endl;
+		return EXIT_FAILURE;
+	}
+}
@@ -0,0 +1,233 @@
+#include <Rose/Core/Hash.hpp>
+#include <Rose/Core/Image.hpp>
+#include <Rose/Core/PipelineCache.hpp>
+
+#include <chrono>
+#include <iostream>
+#include <numeric>
+#include <random>
+#include <unordered_set>
+
+using namespace RoseEngine;
+
+// the element-wise combine HashRange used before HashBytes, for comparison
+template<std::ranges::range R>
+size_t ElementwiseHashRange(const R& r) {
+	size_t seed = 0;
+	for (const auto& elem : r)
+		seed ^= (std::hash<std::ranges::range_value_t<R>>{}(elem) + 0x9e3779b9 + (seed << 6) + (seed >> 2));
+	return seed;
+}
+
+template<typename F>
+double Benchmark(const char* name, const size_t iterations, F&& fn) {
+	size_t sink = 0;
+	const auto start = std::chrono::high_resolution_clock::now();
+	for (size_t i = 0; i < iterations; i++)
+		sink += fn(i);
+	const double ns = std::chrono::duration_cast<std::chrono::duration<double, std::nano>>(std::chrono::high_resolution_clock::now() - start).count() / iterations;
+	std::cout << "  " << name << ": " << ns << " ns (" << (sink & 1) << ")" << std::endl;
+	return ns;
+}
+
+bool TestCollisions() {
+	bool passed = true;
+
+	// every input of up to 2 bytes, at every length up to 3
+	{
+		std::unordered_set<uint64_t> hashes;
+		size_t count = 0;
+		uint8_t bytes[3] = {};
+		hashes.emplace(HashBytes(bytes, 0)); count++;
+		for (uint32_t i = 0; i < 256; i++) {
+			bytes[0] = (uint8_t)i;
+			hashes.emplace(HashBytes(bytes, 1)); count++;
+		}
+		for (uint32_t i = 0; i < 65536; i++) {
+			bytes[0] = (uint8_t)i;
+			bytes[1] = (uint8_t)(i >> 8);
+			hashes.emplace(HashBytes(bytes, 2)); count++;
+			bytes[2] = 0;
+			hashes.emplace(HashBytes(bytes, 3)); count++;
+		}
+		if (hashes.size() != count) {
+			std::cout << "Short inputs: " << count - hashes.size() << " collisions" << std::endl;
+			passed = false;
+		}
+	}
+
+	// single bit flips at every length through all code paths
+	{
+		std::mt19937_64 rng(0);
+		std::vector<uint8_t> data(1024);
+		for (uint8_t& b : data) b = (uint8_t)rng();
+		std::unordered_set<uint64_t> hashes;
+		size_t count = 0;
+		double flippedBits = 0;
+		size_t flips = 0;
+		for (size_t len = 1; len <= data.size(); len = len < 300 ? len + 1 : len * 2) {
+			const uint64_t h = HashBytes(data.data(), len);
+			hashes.emplace(h); count++;
+			for (size_t bit = 0; bit < len * 8; bit += (len > 64 ? 7 : 1)) {
+				data[bit / 8] ^= uint8_t(1 << (bit % 8));
+				const uint64_t h1 = HashBytes(data.data(), len);
+				data[bit / 8] ^= uint8_t(1 << (bit % 8));
+				hashes.emplace(h1); count++;
+				flippedBits += std::popcount(h ^ h1);
+				flips++;
+			}
+		}
+		if (hashes.size() != count) {
+			std::cout << "Bit flips: " << count - hashes.size() << " collisions" << std::endl;
+			passed = false;
+		}
+		// a good hash changes half of the output bits on average
+		const double avalanche = flippedBits / flips;
+		if (avalanche < 30 || avalanche > 34) {
+			std::cout << "Bit flips: poor avalanche (" << avalanche << " bits changed on average)" << std::endl;
+			passed = false;
+		}
+	}
+
+	// seeds produce independent hashes
+	{
+		const std::array<uint32_t, 64> data = {};
+		std::unordered_set<uint64_t> hashes;
+		for (uint64_t seed = 0; seed < 1000; seed++) {
+			hashes.emplace(HashBytes(data.data(), 4, seed));
+			hashes.emplace(HashBytes(data.data(), 64, seed));
+			hashes.emplace(HashBytes(data.data(), data.size() * sizeof(uint32_t), seed));
+		}
+		if (hashes.size() != 3000) {
+			std::cout << "Seeds: " << 3000 - hashes.size() << " collisions" << std::endl;
+			passed = false;
+		}
+	}
+
+	// composite keys of small integers, which std::hash maps to themselves
+	{
+		std::unordered_set<size_t> hashes;
+		for (uint32_t i = 0; i < 1000; i++)
+			for (uint32_t j = 0; j < 1000; j++)
+				hashes.emplace(HashArgs(i, j));
+		if (hashes.size() != 1000 * 1000) {
+			std::cout << "HashArgs: " << 1000 * 1000 - hashes.size() << " collisions" << std::endl;
+			passed = false;
+		}
+		if (HashArgs(1u, 2u) == HashArgs(2u, 1u) || HashArgs(0u, 0u) == HashArgs(0u)) {
+			std::cout << "HashArgs: argument order or count is not hashed" << std::endl;
+			passed = false;
+		}
+
+		// the low bits pick unordered_map buckets, so they must be uniform
+		std::array<uint32_t, 1024> buckets = {};
+		for (uint32_t i = 0; i < 1024 * 64; i++)
+			buckets[HashArgs(i * 1024u, 7u) % buckets.size()]++;
+		const auto[minBucket, maxBucket] = std::ranges::minmax(buckets);
+		if (minBucket < 20 || maxBucket > 120) {
+			std::cout << "HashArgs: bucket sizes between " << minBucket << " and " << maxBucket << std::endl;
+			passed = false;
+		}
+	}
+
+	// byte and element-wise ranges agree with equality
+	{
+		const std::vector<uint32_t> a = { 1, 2, 3, 4 };
+		const std::vector<uint32_t> b = { 1, 2, 3, 4 };
+		const std::vector<uint32_t> c = { 1, 2, 4, 3 };
+		const std::vector<float>    f = { 0.5f, 1.f };
+		if (HashRange(a) != HashRange(b) || HashRange(a) == HashRange(c) || HashRange(f) != HashRange(std::vector<float>{ 0.5f, 1.f })) {
+			std::cout << "HashRange: inconsistent with equality" << std::endl;
+			passed = false;
+		}
+	}
+
+	std::cout << "Collisions: " << (passed ? "PASSED" : "FAILED") << std::endl;
+	return passed;
+}
+
+// HashBytes values are persisted (e.g. compressed texture cache names), so changing them requires bumping kHashBytesVersion
+bool TestStability() {
+	static_assert(kHashBytesVersion == 1, "update the expected values below");
+
+	std::vector<uint8_t> data(1000);
+	std::iota(data.begin(), data.end(), uint8_t(0));
+
+	const std::array<std::pair<size_t, uint64_t>, 6> expected = {
+		std::pair{ size_t(0),    0x3A1BE6E790D04765ull },
+		std::pair{ size_t(3),    0x393E58C50E65F858ull },
+		std::pair{ size_t(8),    0xBDB3B78A7D932216ull },
+		std::pair{ size_t(16),   0xC3C2B6467AC178F3ull },
+		std::pair{ size_t(100),  0x4777E464485D10E3ull },
+		std::pair{ size_t(1000), 0x8834A61B1C64AC62ull } };
+
+	bool passed = true;
+	for (const auto&[len, value] : expected) {
+		const uint64_t h = HashBytes(data.data(), len);
+		if (h != value) {
+			std::cout << "HashBytes of " << len << " bytes: " << std::hex << h << ", expected " << value << std::dec << std::endl;
+			passed = false;
+		}
+	}
+
+	std::cout << "Stability: " << (passed ? "PASSED" : "FAILED") << std::endl;
+	return passed;
+}
+
+void RunBenchmarks() {
+	std::cout << "Benchmarks (per hash or lookup):" << std::endl;
+
+	std::mt19937 rng(0);
+
+	// a typical SPIR-V blob
+	std::vector<uint32_t> spirv(64 * 1024 / sizeof(uint32_t));
+	for (uint32_t& w : spirv) w = rng();
+	Benchmark("64 KiB SPIR-V, HashRange",       1000, [&](size_t i) { spirv[0] = (uint32_t)i; return HashRange(spirv); });
+	Benchmark("64 KiB SPIR-V, element-wise",    1000, [&](size_t i) { spirv[0] = (uint32_t)i; return ElementwiseHashRange(spirv); });
+
+	// PipelineCache::CacheKey
+	std::vector<PipelineCache::CacheKey> cacheKeys;
+	for (uint32_t i = 0; i < 64; i++)
+		cacheKeys.emplace_back(PipelineCache::CacheKey{
+			.defines = ShaderDefines{ { "N_THREADS", std::to_string(32 << (i % 4)) }, { "VARIANT", std::to_string(i) } },
+			.pipelineInfo = ComputePipelineInfo{} });
+	Benchmark("PipelineCache::CacheKey", 1000000, [&](size_t i) { return PipelineCache::CacheKeyHasher{}(cacheKeys[i % cacheKeys.size()]); });
+
+	// CommandContext's transient image cache and aliased image lookups
+	std::vector<ImageInfo> imageInfos;
+	for (uint32_t i = 0; i < 64; i++)
+		imageInfos.emplace_back(ImageInfo{
+			.format = i % 2 ? vk::Format::eR8G8B8A8Unorm : vk::Format::eR32G32B32A32Sfloat,
+			.extent = uint3(256 << (i % 4), 256 << (i / 4 % 4), 1),
+			.usage  = vk::ImageUsageFlagBits::eStorage | vk::ImageUsageFlagBits::eSampled });
+	Benchmark("ImageInfo", 1000000, [&](size_t i) { return std::hash<ImageInfo>{}(imageInfos[i % imageInfos.size()]); });
+
+	std::unordered_map<ImageInfo, uint32_t> imageMap;
+	TupleMap<uint32_t, ImageInfo, uint32_t, vk::DeviceSize> aliasedMap;
+	for (uint32_t i = 0; i < imageInfos.size(); i++) {
+		imageMap.emplace(imageInfos[i], i);
+		aliasedMap.emplace(std::tuple{ imageInfos[i], i % 4, vk::DeviceSize(i) * 65536 }, i);
+	}
+	Benchmark("unordered_map<ImageInfo> lookup", 1000000, [&](size_t i) { return imageMap.find(imageInfos[i % imageInfos.size()])->second; });
+	Benchmark("TupleMap<ImageInfo, uint32_t, vk::DeviceSize> lookup", 1000000, [&](size_t i) {
+		const uint32_t j = uint32_t(i % imageInfos.size());
+		return aliasedMap.find(std::tuple{ imageInfos[j], j % 4, vk::DeviceSize(j) * 65536 })->second;
+	});
+}
+
+int main(int argc, const char** argv) {
+	std::span args = { argv, (size_t)argc };
+
+	bool allPassed = TestCollisions();
+	allPassed &= TestStability();
+
+	RunBenchmarks();
+
+	if (allPassed) {
+		std::cout << "SUCCESS" << std::endl;
+		return EXIT_SUCCESS;
+	} else {
+		std::cout << "FAILURE" << std::endl;
+		return EXIT_FAILURE;
+	}
+}
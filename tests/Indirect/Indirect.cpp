@@ -0,0 +1,46 @@
+#include <Rose/Core/Instance.hpp>
+#include <Rose/Core/CommandContext.hpp>
+
+#include <iostream>
+
+int main(int argc, const char** argv) {
+	std::span args = { argv, (size_t)argc };
+
+	using namespace RoseEngine;
+
+	ref<Instance> instance = Instance::Create({}, { "VK_LAYER_KHRONOS_validation" });
+	ref<Device>   device   = Device::Create(*instance, (*instance)->enumeratePhysicalDevices()[0]);
+
+	auto writeArgs = Pipeline::CreateCompute(*device, ShaderModule::Create(*device, FindShaderPath("Indirect.cs.slang"), "writeArgs"));
+	auto countMain = Pipeline::CreateCompute(*device, ShaderModule::Create(*device, FindShaderPath("Indirect.cs.slang"), "countMain"));
+
+	const uint32_t count = 1000;
+
+	// dispatch size is computed on the gpu and never read back before the indirect dispatch
+	auto argsBuffer    = Buffer::Create(*device, sizeof(vk::DispatchIndirectCommand), vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eIndirectBuffer);
+	auto counterBuffer = Buffer::Create(*device, sizeof(uint32_t), vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eTransferSrc);
+	auto counterCpu    = Buffer::Create(*device, std::vector<uint32_t>{ 0 }, vk::BufferUsageFlagBits::eTransferDst);
+
+	ShaderParameter params;
+	params["count"]   = count;
+	params["args"]    = argsBuffer;
+	params["counter"] = counterBuffer;
+
+	ref<CommandContext> context = CommandContext::Create(device, vk::QueueFlagBits::eCompute | vk::QueueFlagBits::eTransfer);
+	context->Begin();
+	context->Dispatch(*writeArgs, 1u, params);
+	context->DispatchIndirect(*countMain, argsBuffer, params);
+	context->Copy(counterBuffer, counterCpu);
+	context->Submit();
+	device->Wait();
+
+	const uint32_t expected = ((count + 31) / 32) * 32;
+	if (counterCpu[0] != expected) {
+		std::cout << "Got " << counterCpu[0] << " invocations, expected " << expected << std::endl;
+		std::cout << "FAILURE" << std::endl;
+		return EXIT_FAILURE;
+	}
+
+	std::cout << "SUCCESS" << std::endl;
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,106 @@
+#include <Rose/Core/Instance.hpp>
+#include <Rose/Core/MemoryBudget.hpp>
+
+#include <iostream>
+
+int main(int argc, const char** argv) {
+	std::span args = { argv, (size_t)argc };
+
+	using namespace RoseEngine;
+
+	ref<Instance> instance = Instance::Create({}, { "VK_LAYER_KHRONOS_validation" });
+	ref<Device>   device   = Device::Create(*instance, (*instance)->enumeratePhysicalDevices()[0]);
+
+	ref<CommandContext> context = CommandContext::Create(device, vk::QueueFlagBits::eCompute | vk::QueueFlagBits::eTransfer);
+	ref<MemoryBudget>   budget  = MemoryBudget::Create(device);
+	budget->autoDefragment = false;
+
+	bool allPassed = true;
+
+	const vk::DeviceSize kBufferSize = 1024*1024;
+	const uint32_t kBufferCount = 64;
+
+	std::vector<BufferRange<uint32_t>> buffers(kBufferCount);
+	context->Begin();
+	for (uint32_t i = 0; i < kBufferCount; i++) {
+		buffers[i] = Buffer::Create(*device, kBufferSize).cast<uint32_t>();
+		context->Fill(buffers[i], i);
+	}
+	context->Submit();
+	device->Wait();
+
+	// eviction with an artificially lowered budget
+	{
+		budget->Update(*context);
+
+		uint32_t heapIndex = 0;
+		for (uint32_t i = 0; i < budget->Heaps().size(); i++)
+			if (budget->Heaps()[i].deviceLocal && budget->Heaps()[i].usage > budget->Heaps()[heapIndex].usage)
+				heapIndex = i;
+
+		// leave room for half of the buffers at the 100% threshold
+		budget->SetBudgetLimit(heapIndex, budget->Heaps()[heapIndex].usage - kBufferSize * kBufferCount / 2);
+
+		std::vector<BufferRange<uint32_t>> evictable;
+		for (uint32_t i = 1; i < kBufferCount; i += 2)
+			evictable.emplace_back(std::exchange(buffers[i], {}));
+
+		uint32_t calls = 0;
+		budget->AddEvictionCallback("Test", 1.f, [&](uint32_t heap, vk::DeviceSize bytes) {
+			calls++;
+			vk::DeviceSize released = 0;
+			while (!evictable.empty() && released < bytes) {
+				released += evictable.back().size_bytes();
+				evictable.pop_back();
+			}
+			return released;
+		});
+
+		context->Begin();
+		budget->Update(*context);
+		context->Submit();
+		device->Wait();
+
+		const bool passed = calls == 1 && evictable.empty();
+		if (!passed) allPassed = false;
+		std::cout << "Eviction: " << (passed ? "PASSED" : "FAILED") << std::endl;
+
+		budget->RemoveEvictionCallback("Test");
+		budget->SetBudgetLimit(heapIndex, 0);
+	}
+
+	// defragmentation of the fragmented blocks left behind by eviction
+	{
+		budget->Defragment();
+		for (uint32_t i = 0; i < 1000 && budget->IsDefragmenting(); i++) {
+			context->Begin();
+			budget->Update(*context);
+			context->Submit();
+			device->Wait();
+		}
+
+		auto readback = Buffer::Create(*device, kBufferSize, vk::BufferUsageFlagBits::eTransferDst, vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent, VMA_ALLOCATION_CREATE_HOST_ACCESS_RANDOM_BIT | VMA_ALLOCATION_CREATE_MAPPED_BIT).cast<uint32_t>();
+
+		bool passed = !budget->IsDefragmenting();
+		for (uint32_t i = 0; i < kBufferCount && passed; i += 2) {
+			context->Begin();
+			context->Copy(buffers[i], readback);
+			context->Submit();
+			device->Wait();
+			if (std::ranges::any_of(readback, [&](uint32_t x) { return x != i; })) {
+				std::cout << "Mismatch in buffer " << i << std::endl;
+				passed = false;
+			}
+		}
+		if (!passed) allPassed = false;
+		std::cout << "Defragmentation (" << budget->GetDefragmentationStats().allocationsMoved << " moved): " << (passed ? "PASSED" : "FAILED") << std::endl;
+	}
+
+	if (allPassed) {
+		std::cout << "SUCCESS" << std::endl;
+		return EXIT_SUCCESS;
+	} else {
+		std::cout << "FAILURE" << std::endl;
+		return EXIT_FAILURE;
+	}
+}
@@ -0,0 +1,128 @@
+#include <Rose/Scene/Meshlets.hpp>
+
+#include <chrono>
+#include <iostream>
+#include <random>
+
+using namespace RoseEngine;
+
+double Milliseconds(const auto start) {
+	return std::chrono::duration_cast<std::chrono::duration<double, std::milli>>(std::chrono::high_resolution_clock::now() - start).count();
+}
+
+// A grid of quads on a bumpy surface, so meshlets have normal cones which aren't trivial
+void MakeGrid(const uint32_t size, std::vector<uint32_t>& indices, std::vector<float3>& positions) {
+	for (uint32_t y = 0; y <= size; y++)
+		for (uint32_t x = 0; x <= size; x++)
+			positions.emplace_back(float3(x, y, 0.25f * std::sin(x * 0.3f) * std::cos(y * 0.2f)) / float(size));
+	for (uint32_t y = 0; y < size; y++) {
+		for (uint32_t x = 0; x < size; x++) {
+			const uint32_t i = y * (size + 1) + x;
+			indices.insert(indices.end(), { i, i + 1, i + size + 2 });
+			indices.insert(indices.end(), { i, i + size + 2, i + size + 1 });
+		}
+	}
+}
+
+// Triangles with random vertices, so most triangles need three new meshlet vertices
+void MakeSoup(const uint32_t triangleCount, const uint32_t vertexCount, std::vector<uint32_t>& indices, std::vector<float3>& positions) {
+	std::mt19937 rng(0);
+	std::uniform_real_distribution<float> dist(-1, 1);
+	for (uint32_t i = 0; i < vertexCount; i++)
+		positions.emplace_back(dist(rng), dist(rng), dist(rng));
+	for (uint32_t i = 0; i < triangleCount * 3; i++)
+		indices.emplace_back(rng() % vertexCount);
+}
+
+bool TestMeshlets(const std::string& name, const std::vector<uint32_t>& indices, const std::vector<float3>& positions) {
+	const auto start = std::chrono::high_resolution_clock::now();
+	const MeshletData data = BuildMeshlets(indices, positions);
+	const double buildTime = Milliseconds(start);
+
+	bool passed = true;
+	auto fail = [&](const std::string& msg, const size_t i) {
+		if (passed) std::cout << msg << " in meshlet " << i << std::endl;
+		passed = false;
+	};
+
+	std::mt19937 rng(1);
+	std::uniform_real_distribution<float> dist(-4, 4);
+	std::vector<float3> cameras(64);
+	for (float3& c : cameras) c = float3(dist(rng), dist(rng), dist(rng));
+
+	uint32_t nextTriangle = 0;
+	size_t coneCulled = 0;
+	for (size_t i = 0; i < data.meshlets.size(); i++) {
+		Meshlet m = data.meshlets[i];
+		if (m.GetVertexCount() == 0 || m.GetVertexCount() > MESHLET_MAX_VERTICES || m.GetTriangleCount() == 0 || m.GetTriangleCount() > MESHLET_MAX_TRIANGLES)
+			fail("Invalid size", i);
+		if (m.firstTriangle != nextTriangle)
+			fail("Triangles out of order", i);
+		nextTriangle += m.GetTriangleCount();
+
+		// every triangle must reproduce the mesh's indices, and every vertex must be in the sphere
+		for (uint32_t t = 0; t < m.GetTriangleCount() && m.firstTriangle + t < indices.size() / 3; t++) {
+			const uint32_t packed = data.triangles[m.triangleOffset + t];
+			for (uint32_t k = 0; k < 3; k++) {
+				const uint32_t v = BF_GET(packed, 8 * k, 8);
+				if (v >= m.GetVertexCount() || data.vertices[m.vertexOffset + v] != indices[3 * size_t(m.firstTriangle + t) + k])
+					fail("Wrong triangle", i);
+				else if (length(positions[data.vertices[m.vertexOffset + v]] - m.center) > m.radius * 1.0001f + 1e-6f)
+					fail("Vertex outside sphere", i);
+			}
+		}
+
+		// a camera the cone culls from must see no triangle's front face
+		for (const float3& c : cameras) {
+			if (dot(m.center - c, m.coneAxis) < m.coneCutoff * length(m.center - c) + m.radius) continue;
+			coneCulled++;
+			for (uint32_t t = 0; t < m.GetTriangleCount(); t++) {
+				const uint32_t* tri = indices.data() + 3 * size_t(m.firstTriangle + t);
+				const float3 n = cross(positions[tri[1]] - positions[tri[0]], positions[tri[2]] - positions[tri[0]]);
+				if (dot(positions[tri[0]] - c, n) < -1e-6f * length(n))
+					fail("Cone culls a visible triangle", i);
+			}
+		}
+	}
+	if (nextTriangle != indices.size() / 3) {
+		std::cout << "Meshlets cover " << nextTriangle << " of " << indices.size() / 3 << " triangles" << std::endl;
+		passed = false;
+	}
+
+	std::cout << name << ": " << indices.size() / 3 << " triangles in " << data.meshlets.size() << " meshlets, "
+		<< data.vertices.size() << " meshlet vertices for " << positions.size() << " vertices. "
+		<< "Built in " << buildTime << " ms, " << coneCulled << " cone culls of " << data.meshlets.size() * cameras.size() << ": "
+		<< (passed ? "PASSED" : "FAILED") << std::endl;
+	return passed;
+}
+
+int main(int argc, const char** argv) {
+	bool allPassed = true;
+	{
+		std::vector<uint32_t> indices;
+		std::vector<float3> positions;
+		MakeGrid(512, indices, positions);
+		allPassed &= TestMeshlets("Grid", indices, positions);
+	}
+	{
+		std::vector<uint32_t> indices;
+		std::vector<float3> positions;
+		MakeSoup(100'000, 10'000, indices, positions);
+		allPassed &= TestMeshlets("Soup", indices, positions);
+	}
+	{
+		// degenerate triangles have no normal, and repeat vertices
+		std::vector<uint32_t> indices = { 0, 0, 0, 0, 1, 1, 0, 1, 2 };
+		std::vector<float3> positions = { float3(0), float3(1, 0, 0), float3(0, 1, 0) };
+		allPassed &= TestMeshlets("Degenerate", indices, positions);
+	}
+	allPassed &= TestMeshlets("Empty", {}, {});
+
+	if (allPassed) {
+		std::cout << "SUCCESS" << std::endl;
+		return EXIT_SUCCESS;
+	} else {
+		std::cout << "FAILURE" << std::endl;
+		return EXIT_FAILURE;
+	}
+}
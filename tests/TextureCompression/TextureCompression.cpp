@@ -0,0 +1,143 @@
+#include <Rose/Core/TextureCompression.hpp>
+
+#include <glm/gtc/packing.hpp>
+
+#include <chrono>
+#include <iostream>
+#include <random>
+
+using namespace RoseEngine;
+
+// smooth gradients with a little noise, similar to typical albedo and normal map content
+std::vector<uint8_t> MakeImage(const uint2 extent) {
+	std::mt19937 rng(0);
+	std::vector<uint8_t> pixels(size_t(extent.x) * extent.y * 4);
+	for (uint32_t y = 0; y < extent.y; y++) {
+		for (uint32_t x = 0; x < extent.x; x++) {
+			uint8_t* p = &pixels[(size_t(y) * extent.x + x) * 4];
+			const float u = x / float(extent.x), v = y / float(extent.y);
+			p[0] = (uint8_t)std::clamp(255 * u + int(rng() % 5) - 2, 0.f, 255.f);
+			p[1] = (uint8_t)std::clamp(255 * v + int(rng() % 5) - 2, 0.f, 255.f);
+			p[2] = (uint8_t)std::clamp(127.5f + 127.5f * std::sin(8 * u) * std::cos(8 * v), 0.f, 255.f);
+			p[3] = 255;
+		}
+	}
+	return pixels;
+}
+
+bool TestFormat(const std::vector<uint8_t>& pixels, const uint2 extent, const vk::Format format, const uint2 sourceChannels, const vk::ComponentMapping& components, const float minPsnr) {
+	float psnr = 0;
+	const auto start = std::chrono::high_resolution_clock::now();
+	const HostPixelData d = CompressImage(pixels, extent, format, sourceChannels, &psnr);
+	const double ms = std::chrono::duration_cast<std::chrono::duration<double, std::milli>>(std::chrono::high_resolution_clock::now() - start).count();
+
+	const size_t blockSize = format == vk::Format::eBc4UnormBlock ? 8 : 16;
+	const size_t expectedSize = size_t((extent.x + 3) / 4) * ((extent.y + 3) / 4) * blockSize;
+
+	bool passed = true;
+	if (psnr < minPsnr) {
+		std::cout << "  PSNR below " << minPsnr << " dB" << std::endl;
+		passed = false;
+	}
+	if (d.pixels.mipLevels != GetMaxMipLevels(uint3(extent, 1)) || d.pixels.regions.size() != d.pixels.mipLevels || d.bytes.size() < expectedSize) {
+		std::cout << "  Wrong mip chain" << std::endl;
+		passed = false;
+	}
+	if (d.pixels.components != components) {
+		std::cout << "  Wrong components" << std::endl;
+		passed = false;
+	}
+	for (const vk::BufferImageCopy& r : d.pixels.regions) {
+		if (r.bufferOffset % blockSize != 0 || r.bufferOffset >= d.bytes.size()) {
+			std::cout << "  Misaligned level " << r.imageSubresource.mipLevel << std::endl;
+			passed = false;
+		}
+	}
+
+	std::cout << vk::to_string(format) << ": " << psnr << " dB, " << ms << " ms, " << (passed ? "PASSED" : "FAILED") << std::endl;
+	return passed;
+}
+
+// sky-like radiance spanning several orders of magnitude, with a bright sun
+bool TestHdr(const uint2 extent, const float minPsnr) {
+	std::vector<uint16_t> pixels(size_t(extent.x) * extent.y * 3);
+	for (uint32_t y = 0; y < extent.y; y++) {
+		for (uint32_t x = 0; x < extent.x; x++) {
+			const float u = x / float(extent.x), v = y / float(extent.y);
+			const float sun = 20000 * std::exp(-2000 * ((u - 0.3f) * (u - 0.3f) + (v - 0.2f) * (v - 0.2f)));
+			const float3 c = float3(0.3f, 0.5f, 1.0f) * std::exp2(6 * (1 - v) - 4) + sun;
+			for (uint32_t i = 0; i < 3; i++)
+				pixels[(size_t(y) * extent.x + x) * 3 + i] = (uint16_t)glm::packHalf1x16(c[i]);
+		}
+	}
+
+	float psnr = 0;
+	const auto start = std::chrono::high_resolution_clock::now();
+	const HostPixelData d = CompressHdrImage(pixels, extent, 3, &psnr);
+	const double ms = std::chrono::duration_cast<std::chrono::duration<double, std::milli>>(std::chrono::high_resolution_clock::now() - start).count();
+
+	const size_t expectedSize = size_t((extent.x + 3) / 4) * ((extent.y + 3) / 4) * 16;
+
+	bool passed = true;
+	if (psnr < minPsnr) {
+		std::cout << "  PSNR below " << minPsnr << " dB" << std::endl;
+		passed = false;
+	}
+	if (d.pixels.format != vk::Format::eBc6HUfloatBlock || d.pixels.mipLevels != GetMaxMipLevels(uint3(extent, 1)) || d.pixels.regions.size() != d.pixels.mipLevels || d.bytes.size() < expectedSize) {
+		std::cout << "  Wrong mip chain" << std::endl;
+		passed = false;
+	}
+
+	std::cout << vk::to_string(d.pixels.format) << ": " << psnr << " dB, " << ms << " ms, " << (passed ? "PASSED" : "FAILED") << std::endl;
+	return passed;
+}
+
+bool TestCache(const std::vector<uint8_t>& pixels, const uint2 extent) {
+	const std::filesystem::path dir = std::filesystem::temp_directory_path() / "rose_test_texture_cache";
+	std::filesystem::remove_all(dir);
+
+	float psnr = 0;
+	const HostPixelData d = CompressImage(pixels, extent, vk::Format::eBc5UnormBlock, uint2(1, 2), &psnr);
+	StoreCompressedImage(dir, 1234, d, psnr);
+
+	float cachedPsnr = 0;
+	const std::optional<HostPixelData> cached = LoadCompressedImage(dir, 1234, &cachedPsnr);
+	const bool passed =
+		cached &&
+		!LoadCompressedImage(dir, 4321) &&
+		cached->bytes == d.bytes &&
+		cached->pixels.format == d.pixels.format &&
+		cached->pixels.extent == d.pixels.extent &&
+		cached->pixels.mipLevels == d.pixels.mipLevels &&
+		cached->pixels.regions == d.pixels.regions &&
+		cached->pixels.components == d.pixels.components &&
+		cachedPsnr == psnr;
+
+	std::filesystem::remove_all(dir);
+	std::cout << "Cache: " << (passed ? "PASSED" : "FAILED") << std::endl;
+	return passed;
+}
+
+int main(int argc, const char** argv) {
+	// not a multiple of 4, to cover partial blocks
+	const uint2 extent = uint2(513, 255);
+	const std::vector<uint8_t> pixels = MakeImage(extent);
+
+	bool allPassed = true;
+	using enum vk::ComponentSwizzle;
+	allPassed &= TestFormat(pixels, extent, vk::Format::eBc7SrgbBlock,  uint2(0, 1), {}, 38);
+	allPassed &= TestFormat(pixels, extent, vk::Format::eBc5UnormBlock, uint2(0, 1), {}, 38);
+	allPassed &= TestFormat(pixels, extent, vk::Format::eBc5UnormBlock, uint2(1, 2), { eZero, eR, eG, eOne }, 38); // metallic-roughness
+	allPassed &= TestFormat(pixels, extent, vk::Format::eBc5UnormBlock, uint2(0, 3), { eR, eZero, eZero, eG }, 38); // grey+alpha
+	allPassed &= TestFormat(pixels, extent, vk::Format::eBc4UnormBlock, uint2(2, 0), { eZero, eZero, eR, eOne }, 38);
+	allPassed &= TestHdr(extent, 40);
+	allPassed &= TestCache(pixels, extent);
+
+	if (allPassed) {
+		std::cout << "SUCCESS" << std::endl;
+		return EXIT_SUCCESS;
+	} else {
+		std::cout << "FAILURE" << std::endl;
+		return EXIT_FAILURE;
+	}
+}
@@ -0,0 +1,126 @@
+#include <Rose/Scene/TransformHierarchy.hpp>
+
+#include <chrono>
+#include <iostream>
+#include <random>
+#include <stack>
+#include <thread>
+
+using namespace RoseEngine;
+
+double Milliseconds(const auto start) {
+	return std::chrono::duration_cast<std::chrono::duration<double, std::milli>>(std::chrono::high_resolution_clock::now() - start).count();
+}
+
+Transform RandomTransform(std::mt19937& rng) {
+	std::uniform_real_distribution<float> dist(-1, 1);
+	return Transform::Translate(float3(dist(rng), dist(rng), dist(rng))) * Transform::Rotate(glm::angleAxis(dist(rng), normalize(float3(dist(rng), dist(rng), 1))));
+}
+
+// Gives each node branching children, breadth first, until there are nodeCount nodes
+ref<SceneNode> MakeWideTree(const size_t nodeCount, const uint32_t branching) {
+	std::mt19937 rng(0);
+	const ref<SceneNode> root = SceneNode::Create("root");
+	std::vector<ref<SceneNode>> level = { root };
+	size_t count = 1;
+	while (count < nodeCount) {
+		std::vector<ref<SceneNode>> next;
+		for (const ref<SceneNode>& p : level) {
+			for (uint32_t i = 0; i < branching && count < nodeCount; i++, count++) {
+				const ref<SceneNode> n = next.emplace_back(SceneNode::Create("node"));
+				if (rng() % 4) n->transform = RandomTransform(rng); // some nodes only group their children
+				n->SetParent(p);
+			}
+		}
+		level = std::move(next);
+	}
+	return root;
+}
+
+// chainCount chains of chainLength nodes below the root, so every depth is small
+ref<SceneNode> MakeDeepTree(const uint32_t chainCount, const uint32_t chainLength) {
+	std::mt19937 rng(1);
+	const ref<SceneNode> root = SceneNode::Create("root");
+	for (uint32_t c = 0; c < chainCount; c++) {
+		ref<SceneNode> p = root;
+		for (uint32_t i = 0; i < chainLength; i++) {
+			const ref<SceneNode> n = SceneNode::Create("node");
+			n->transform = RandomTransform(rng);
+			n->SetParent(p);
+			p = n;
+		}
+	}
+	return root;
+}
+
+// The pointer-chasing traversal the hierarchy replaces
+std::unordered_map<const SceneNode*, Transform> ReferenceTransforms(SceneNode& root) {
+	std::unordered_map<const SceneNode*, Transform> result;
+	std::stack<std::pair<SceneNode*, Transform>> todo;
+	todo.push({&root, Transform::Identity()});
+	while (!todo.empty()) {
+		auto [n, t] = todo.top();
+		todo.pop();
+		result.emplace(n, t);
+		for (const ref<SceneNode>& c : *n)
+			todo.push({c.get(), c->transform.has_value() ? t * c->transform.value() : t});
+	}
+	return result;
+}
+
+bool TestHierarchy(const std::string& name, const ref<SceneNode>& root) {
+	auto start = std::chrono::high_resolution_clock::now();
+	const auto reference = ReferenceTransforms(*root);
+	const double referenceTime = Milliseconds(start);
+
+	TransformHierarchy hierarchy;
+	start = std::chrono::high_resolution_clock::now();
+	hierarchy.Build(*root);
+	const double buildTime = Milliseconds(start);
+
+	hierarchy.threadCount = 1;
+	start = std::chrono::high_resolution_clock::now();
+	hierarchy.Update();
+	const double serialTime = Milliseconds(start);
+
+	hierarchy.threadCount = 0;
+	start = std::chrono::high_resolution_clock::now();
+	hierarchy.Update();
+	const double parallelTime = Milliseconds(start);
+
+	bool passed = hierarchy.size() == reference.size();
+	for (uint32_t i = 0; i < hierarchy.size() && passed; i++) {
+		// both multiply in the same order, so the results are identical
+		const Transform& expected = reference.at(hierarchy.Node(i));
+		if (hierarchy.World(i).transform != expected.transform || hierarchy.InverseWorld(i).transform != inverse(expected).transform) {
+			std::cout << "Mismatch at node " << i << std::endl;
+			passed = false;
+		}
+		if (const uint32_t p = hierarchy.Parent(i); p != TransformHierarchy::kNoParent && p >= i) {
+			std::cout << "Node " << i << " precedes its parent" << std::endl;
+			passed = false;
+		}
+	}
+
+	std::cout << name << ": " << hierarchy.size() << " nodes, " << hierarchy.LevelCount() << " levels. "
+		<< "Stack traversal " << referenceTime << " ms (world only), build " << buildTime << " ms, "
+		<< "update " << serialTime << " ms on one thread, " << parallelTime << " ms on up to " << std::thread::hardware_concurrency() << " threads: "
+		<< (passed ? "PASSED" : "FAILED") << std::endl;
+	return passed;
+}
+
+int main(int argc, const char** argv) {
+	bool allPassed = true;
+	allPassed &= TestHierarchy("Wide",  MakeWideTree(1'000'000, 8));
+	allPassed &= TestHierarchy("Flat",  MakeWideTree(1'000'000, 1'000'000)); // every node is a child of the root
+	allPassed &= TestHierarchy("Deep",  MakeDeepTree(1000, 1000)); // levels below minNodesPerThread, so done on one thread
+	allPassed &= TestHierarchy("Empty", SceneNode::Create("root"));
+
+	if (allPassed) {
+		std::cout << "SUCCESS" << std::endl;
+		return EXIT_SUCCESS;
+	} else {
+		std::cout << "FAILURE" << std::endl;
+		return EXIT_FAILURE;
+	}
+}
@@ -0,0 +1,152 @@
+#include <Rose/Core/Instance.hpp>
+#include <Rose/Downsample/Downsample.hpp>
+
+#include <iostream>
+
+using namespace RoseEngine;
+
+ImageInfo TestImageInfo(CommandContext& context, const vk::Format format) {
+	return ImageInfo {
+		.format = format,
+		.extent = uint3(2048, 2048, 1),
+		.usage = vk::ImageUsageFlagBits::eTransferSrc | vk::ImageUsageFlagBits::eTransferDst,
+		.queueFamilies = { context.QueueFamily() } };
+}
+
+template<typename T>
+bool CheckValue(const BufferRange<T>& data, const T expected, const char* name) {
+	for (size_t i = 0; i < data.size(); i++) {
+		if (data[i] != expected) {
+			std::cout << name << "[" << i << "] = " << data[i] << ", expected " << expected << std::endl;
+			return false;
+		}
+	}
+	return true;
+}
+
+// Three same-sized images with lifetimes A = [0,1], C = [1,2] and B = [2,3]. B may reuse A's memory, C may not share with either.
+bool TestAliasing(CommandContext& context) {
+	Device& device = context.GetDevice();
+
+	auto createReadback = [&]() {
+		return Buffer::Create(device, sizeof(float) * 2048 * 2048, vk::BufferUsageFlagBits::eTransferDst, vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent, VMA_ALLOCATION_CREATE_HOST_ACCESS_RANDOM_BIT | VMA_ALLOCATION_CREATE_MAPPED_BIT).cast<float>();
+	};
+	const BufferRange<float>    readbackA = createReadback();
+	const BufferRange<uint32_t> readbackB = createReadback().cast<uint32_t>();
+	const BufferRange<float>    readbackC = createReadback();
+
+	bool passed = true;
+
+	context.Begin();
+
+	const ref<Image> a = context.GetTransientImage(TestImageInfo(context, vk::Format::eR32Sfloat), 0, 1);
+	context.ClearColor(ImageView::Create(a), vk::ClearColorValue{ std::array<float, 4>{ 1.f, 1.f, 1.f, 1.f } });
+	context.Copy(ImageView::Create(a), readbackA);
+
+	const ref<Image> c = context.GetTransientImage(TestImageInfo(context, vk::Format::eR32Sfloat), 1, 2);
+	context.ClearColor(ImageView::Create(c), vk::ClearColorValue{ std::array<float, 4>{ 3.f, 3.f, 3.f, 3.f } });
+	context.Copy(ImageView::Create(c), readbackC);
+
+	const Image::ResourceState stateA = a->GetSubresourceState(0, 0);
+	const ref<Image> b = context.GetTransientImage(TestImageInfo(context, vk::Format::eR32Uint), 2, 3);
+
+	// b starts with undefined contents, after everything a did to the memory
+	const Image::ResourceState stateB = b->GetSubresourceState(0, 0);
+	if (stateB.layout != vk::ImageLayout::eUndefined || (stateB.stage & stateA.stage) != stateA.stage) {
+		std::cout << "Aliasing barrier: " << vk::to_string(stateB.layout) << ", " << vk::to_string(stateB.stage)
+			<< " does not wait for " << vk::to_string(stateA.stage) << std::endl;
+		passed = false;
+	}
+
+	context.ClearColor(ImageView::Create(b), vk::ClearColorValue{ std::array<uint32_t, 4>{ 2, 2, 2, 2 } });
+	context.Copy(ImageView::Create(b), readbackB);
+
+	context.Submit();
+	device.Wait();
+
+	// b reuses a's block, c needs a second one
+	const vk::DeviceSize memory    = context.AliasedImageMemory();
+	const vk::DeviceSize requested = context.PeakAliasedImageRequestedMemory();
+	if (memory * 3 != requested * 2) {
+		std::cout << "Aliased memory: " << memory << " bytes for " << requested << " requested" << std::endl;
+		passed = false;
+	}
+
+	passed &= CheckValue(readbackA, 1.f, "a");
+	passed &= CheckValue(readbackB, 2u,  "b");
+	passed &= CheckValue(readbackC, 3.f, "c");
+
+	// the same placements reuse the same images in later recordings, which start out undefined again
+	context.Begin();
+	const ref<Image> a2 = context.GetTransientImage(TestImageInfo(context, vk::Format::eR32Sfloat), 0, 1);
+	if (a2 != a || a2->GetSubresourceState(0, 0).layout != vk::ImageLayout::eUndefined) {
+		std::cout << "Placement was not reused" << std::endl;
+		passed = false;
+	}
+	context.Submit();
+	device.Wait();
+
+	std::cout << "Aliasing: " << (passed ? "PASSED" : "FAILED") << std::endl;
+	return passed;
+}
+
+// Reports the memory of InstanceCuller's 4K depth pyramid as a persistent image and as an aliased transient image,
+// then checks that evicting cached resources releases the aliased blocks
+bool Report4K(CommandContext& context) {
+	Device& device = context.GetDevice();
+
+	const uint2 depthExtent = uint2(3840, 2160);
+	const uint2 pyramidExtent = uint2(std::bit_floor(depthExtent.x), std::bit_floor(depthExtent.y));
+	ImageInfo info {
+		.format = vk::Format::eR32Sfloat,
+		.extent = uint3(pyramidExtent, 1),
+		.mipLevels = GetMaxMipLevels(uint3(pyramidExtent, 1)),
+		.queueFamilies = { context.QueueFamily() } };
+	Downsampler::AddRequiredUsage(info);
+	if (!Downsampler::IsSupported(device, info)) {
+		std::cout << "4K frame: depth pyramid is not supported, skipped" << std::endl;
+		return true;
+	}
+
+	const vk::DeviceSize persistent = Image::Create(device, info)->MemorySize();
+
+	context.Begin();
+	const ref<Image> pyramid = context.GetTransientImage(info, 3, 5);
+	context.Submit();
+	device.Wait();
+
+	const vk::DeviceSize aliased = context.AliasedImageMemory();
+
+	const double mib = 1024.0 * 1024.0;
+	std::cout << "4K depth pyramid: " << persistent / mib << " MiB persistent, "
+		<< aliased / mib << " MiB of aliased memory per frame in flight" << std::endl;
+
+	// the next recording has no placements yet, so every block may be released
+	context.Begin();
+	const vk::DeviceSize released = context.ReleaseCachedResources();
+	context.Submit();
+	device.Wait();
+
+	const bool passed = pyramid && released >= aliased && context.AliasedImageMemory() == 0;
+	std::cout << "Release aliased blocks: " << (passed ? "PASSED" : "FAILED") << std::endl;
+	return passed;
+}
+
+int main(int argc, const char** argv) {
+	std::span args = { argv, (size_t)argc };
+
+	ref<Instance> instance = Instance::Create({}, { "VK_LAYER_KHRONOS_validation" });
+	ref<Device>   device   = Device::Create(*instance, (*instance)->enumeratePhysicalDevices()[0]);
+
+	bool allPassed = true;
+	allPassed &= TestAliasing(*CommandContext::Create(device, vk::QueueFlagBits::eCompute | vk::QueueFlagBits::eTransfer));
+	allPassed &= Report4K(*CommandContext::Create(device, vk::QueueFlagBits::eCompute | vk::QueueFlagBits::eTransfer));
+
+	if (allPassed) {
+		std::cout << "SUCCESS" << std::endl;
+		return EXIT_SUCCESS;
+	} else {
+		std::cout << "FAILURE" << std::endl;
+		return EXIT_FAILURE;
+	}
+}